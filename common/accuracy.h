@@ -0,0 +1,279 @@
+/**
+ *
+ *  @file	accuracy.h
+ *
+ *
+ *  Sources :
+ *
+ *   Bruce Dawson
+ *    - Comparing Floating Point Numbers, 2012 Edition :
+ *          https://randomascii.wordpress.com/2012/02/25/comparing-floating-point-numbers-2012-edition/
+ *
+ *   George Marsaglia
+ *    - Xorshift RNGs, Journal of Statistical Software 8 (14), 2003
+ *
+ *
+ *  Differential accuracy checks : a fast routine (SIMD, float32, flush-to-zero, FFT) against a plain
+ *  reference on the same input. Header only (static inline), used by the check messages.
+ *
+ *  The signals are the ones fast paths get wrong : full-scale noise, DC, a sine, denormals, and noise
+ *  with NaN, infinities and huge values mixed in. They come from a seeded generator, a check gives the
+ *  same numbers on every run and every machine.
+ *
+ *  A t_accuracy sums up the outputs of one routine over all the signals :
+ *      maxulp      largest distance in units in the last place, of the routine's precision
+ *      maxrel      largest error relative to |reference|, absolute below floor (around 0 the relative error means nothing)
+ *      db          error to signal energy of the worst signal, in dB. By Parseval it is also the spectral error
+ *      special     outputs with a finite reference and a NaN or an infinity, or the other way around (see below)
+ *
+ *  The outputs follow the policy of denormal.h : an infinite reference accepts an infinite output or a 0 (the
+ *  scrub of the perform wrapper). A NaN reference is undefined and accepts anything : min, max and clip of a NaN
+ *  return either operand depending on the instruction set, only a NaN or an infinity out of a finite reference
+ *  is a mismatch. Flush-to-zero has to be applied to the inputs of the reference by the caller (accuracy_daz),
+ *  a denormal reference accepts 0 since the error is below floor.
+ *
+ */
+
+#ifndef _ACCURACY_H_
+#define _ACCURACY_H_
+
+#include "ext.h"
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <stdint.h>
+
+#define ACCURACY_PI     3.141592653589793238462643383279502884L
+
+// signal kinds, see accuracy_signal
+enum {
+    ACCURACY_NOISE = 0,     ///<    Uniform noise, full scale
+    ACCURACY_DC,            ///<    One value
+    ACCURACY_SINE,          ///<    A sine of random frequency and phase
+    ACCURACY_DENORMAL,      ///<    Denormals of doubles and of floats, zeros of both signs and a quarter of noise
+    ACCURACY_SPECIAL,       ///<    Noise, one sample in 8 is NaN, +-inf, +-DBL_MAX, +-1e300 or -0
+    ACCURACY_KINDS
+};
+
+typedef struct _accuracy
+{
+    double      floor;      ///<    Below it the error is absolute
+    long        single;     ///<    1 : the routine works in float, ULP and overflow are those of a float
+    long        count;      ///<    Samples compared
+    double      maxulp;
+    double      maxrel;
+    double      db;
+    long        special;
+} t_accuracy;
+
+
+
+
+
+//____________________________________________________________________
+//                          Signals
+//____________________________________________________________________
+
+// xorshift32, the seed must not be 0
+static inline uint32_t accuracy_rand(uint32_t *seed)
+{
+    uint32_t s = *seed;
+
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return *seed = s;
+}
+
+// uniform in [-1, 1)
+static inline double accuracy_uniform(uint32_t *seed)
+{
+    return accuracy_rand(seed) * (2. / 4294967296.) - 1.;
+}
+
+// n samples of one kind, scale is the full scale of the noise, DC and sine
+static inline void accuracy_signal(double *out, long n, long kind, double scale, uint32_t *seed)
+{
+    static const double special[8] = { NAN, INFINITY, -INFINITY, DBL_MAX, -DBL_MAX, 1e300, -1e300, -0. };
+    double  dc = scale * accuracy_uniform(seed);
+    double  w = ACCURACY_PI * (accuracy_rand(seed) & 0xffff) / 65536.;
+    double  phi = ACCURACY_PI * accuracy_uniform(seed);
+    long    i;
+
+    for (i = 0; i < n; i++) {
+        switch (kind) {
+            case ACCURACY_DC:
+                out[i] = dc;
+                break;
+            case ACCURACY_SINE:
+                out[i] = scale * sin(w * i + phi);
+                break;
+            case ACCURACY_DENORMAL:
+                switch (accuracy_rand(seed) & 3) {
+                    case 0:  out[i] = scale * accuracy_uniform(seed); break;
+                    case 1:  out[i] = accuracy_rand(seed) & 1 ? 0. : -0.; break;
+                    case 2:  out[i] = DBL_MIN * accuracy_uniform(seed); break;
+                    default: out[i] = FLT_MIN * accuracy_uniform(seed); break;      // normal in double
+                }
+                break;
+            case ACCURACY_SPECIAL:
+                out[i] = accuracy_rand(seed) & 7 ? scale * accuracy_uniform(seed) : special[accuracy_rand(seed) & 7];
+                break;
+            default:
+                out[i] = scale * accuracy_uniform(seed);
+                break;
+        }
+    }
+}
+
+// denormals-are-zero, the inputs of a reference for a routine running under denormal_enter
+static inline double accuracy_daz(double v, long single)
+{
+    return fabs(v) < (single ? FLT_MIN : DBL_MIN) ? 0. : v;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Comparison
+//____________________________________________________________________
+
+static inline void accuracy_reset(t_accuracy *a, double floor, long single)
+{
+    memset(a, 0, sizeof(t_accuracy));
+    a->floor = floor;
+    a->single = single;
+    a->db = -HUGE_VAL;
+}
+
+// distance in ULP of two finite values, the bit patterns are mapped to integers that count representable values
+static inline double accuracy_ulp(double r, double t, long single)
+{
+    int64_t     i, j;
+    int32_t     k, l;
+    float       f;
+
+    if (single) {
+        f = (float)r; memcpy(&k, &f, 4);
+        f = (float)t; memcpy(&l, &f, 4);
+        i = k < 0 ? (int64_t)INT32_MIN - k : k;
+        j = l < 0 ? (int64_t)INT32_MIN - l : l;
+        return fabs((double)(i - j));
+    }
+    memcpy(&i, &r, 8);
+    memcpy(&j, &t, 8);
+    i = i < 0 ? INT64_MIN - i : i;
+    j = j < 0 ? INT64_MIN - j : j;
+    return fabs((double)i - (double)j);
+}
+
+// compares n outputs with their reference, the energies are scaled by the largest reference (1e300 squared overflows)
+static inline void accuracy_add(t_accuracy *a, const double *ref, const double *out, long n)
+{
+    double  r, t, d, u, scale = a->floor;
+    double  err = 0., sig = 0.;
+    double  tiny = a->single ? FLT_MIN : DBL_MIN;
+    long    i;
+
+    for (i = 0; i < n; i++) {
+        r = a->single ? (double)(float)ref[i] : ref[i];
+        if (isfinite(r) && fabs(r) > scale)
+            scale = fabs(r);
+    }
+
+    for (i = 0; i < n; i++) {
+        r = a->single ? (double)(float)ref[i] : ref[i];     // overflows where the float routine does
+        t = out[i];
+        a->count++;
+
+        if (isnan(r))
+            continue;
+        if (isinf(r)) {
+            if (isfinite(t) && t != 0.)
+                a->special++;
+            continue;
+        }
+        if (!isfinite(t)) {
+            a->special++;
+            continue;
+        }
+
+        d = fabs(t - r);
+        if (d / (fabs(r) > a->floor ? fabs(r) : a->floor) > a->maxrel)
+            a->maxrel = d / (fabs(r) > a->floor ? fabs(r) : a->floor);
+        if (fabs(r) >= tiny && (u = accuracy_ulp(r, t, a->single)) > a->maxulp)
+            a->maxulp = u;
+
+        err += (d / scale) * (d / scale);
+        sig += (r / scale) * (r / scale);
+    }
+
+    if (sig > 0.) {
+        d = err > 0. ? 10. * log10(err / sig) : -HUGE_VAL;
+        if (d > a->db)
+            a->db = d;
+    }
+}
+
+// 1 if the routine is outside the bounds : relative error, error to signal energy (dB) or a special value mismatch
+static inline long accuracy_fails(const t_accuracy *a, double maxrel, double maxdb)
+{
+    return a->special || a->maxrel > maxrel || a->db > maxdb;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          References
+//____________________________________________________________________
+
+// DFT of n real samples, bins 0 to n / 2 as (re, im) pairs : the layout, sign and scale of FFTW's r2c (unnormalized, e^-i).
+// Sums in long double, the twiddles from one table of exact angles : k * j is reduced modulo n, not accumulated.
+// O(n) per bin, only about maxbins of them are computed (evenly spread), the others are NaN and left out of the
+// comparison. A NaN or an infinity in the input makes every bin NaN (undefined, see above) : the sums would only be
+// slower, by 100 times on x87. Returns non zero without memory
+static inline long accuracy_dft(const double *in, long n, double *out, long maxbins)
+{
+    long double *c;
+    long double *s;
+    long double re, im;
+    long        nbins = n / 2 + 1;
+    long        step = (nbins + maxbins - 1) / maxbins;
+    long        k, j, m;
+
+    for (k = 0; k < 2 * nbins; k++)
+        out[k] = NAN;
+    for (j = 0; j < n; j++)
+        if (!isfinite(in[j]))
+            return 0;
+
+    if (!(c = (long double *) sysmem_newptr(2 * n * sizeof(long double))))
+        return 1;
+    s = c + n;
+    for (j = 0; j < n; j++) {
+        c[j] = cosl(2. * ACCURACY_PI * j / n);
+        s[j] = sinl(2. * ACCURACY_PI * j / n);
+    }
+
+    for (k = 0; k < nbins; k += step) {
+        re = im = 0.;
+        for (j = 0, m = 0; j < n; j++) {
+            re += in[j] * c[m];
+            im -= in[j] * s[m];
+            if ((m += k) >= n)
+                m -= n;
+        }
+        out[2 * k]     = (double)re;
+        out[2 * k + 1] = (double)im;
+    }
+
+    sysmem_freeptr(c);
+    return 0;
+}
+
+#endif // _ACCURACY_H_
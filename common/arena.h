@@ -0,0 +1,171 @@
+/**
+ *
+ *  @file	arena.h
+ *
+ *
+ *  Sources :
+ *
+ *   Cylcing 74'
+ *    - Max 7.1 API, Memory Management & Threading (ext_systhread.h) :
+ *          https://cycling74.com/sdk/MaxSDK-6.0.4/html/index.html
+ *
+ *   Ulrich Drepper
+ *    - What Every Programmer Should Know About Memory :
+ *          https://people.freebsd.org/~lstewart/articles/cpumemory.pdf
+ *
+ *
+ *  A shared, reference counted arena for the DSP state of the templates.
+ *  Header only (static inline) so each external stays a single translation unit,
+ *  the arena is shared by all the instances of an external (one arena per class, created in ext_main).
+ *
+ *  Instead of one fftw_malloc per buffer, an instance asks for one block holding all its buffers
+ *  and carves it with arena_carve. Blocks are bump allocated in large chunks, a chunk is freed
+ *  when its last block is released. Every block and every carved buffer starts on a cache line,
+ *  which is also enough alignment for any SIMD extension (and for FFTW's SIMD code paths).
+ *
+ *  Read-only tables shared between instances are handled by tablecache.h, usually on top of the arena.
+ *
+ *  All these routines lock a mutex : call them from new, dsp64 and free, never from the perform routine.
+ *
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include "ext.h"
+#include "ext_systhread.h"
+
+#define ARENA_ALIGN         64                      ///<    Cache line, also covers 16/32/64 byte SIMD alignment
+#define ARENA_CHUNKSIZE     (1024 * 1024)           ///<    Default chunk size in bytes
+#define ARENA_PAD(bytes)    (((bytes) + ARENA_ALIGN - 1) & ~(long)(ARENA_ALIGN - 1))
+
+typedef struct _arena_chunk     ///<    A large allocation, blocks are bump allocated inside
+{
+    struct _arena_chunk *next;
+    char                *mem;       ///<    Pointer returned by sysmem_newptr
+    char                *data;      ///<    First aligned byte of mem
+    long                size;       ///<    Usable bytes from data
+    long                used;       ///<    Bytes handed out (never decreases, the chunk is freed as a whole)
+    long                blocks;     ///<    Live blocks, the chunk is freed when it reaches 0
+
+} t_arena_chunk;
+
+typedef struct _arena
+{
+    t_systhread_mutex   mutex;
+    t_arena_chunk       *chunks;    ///<    Chunks with live blocks, the first one is tried first
+    long                chunksize;  ///<    Size of a new chunk (a bigger block gets its own chunk)
+
+} t_arena;
+
+
+
+
+
+//____________________________________________________________________
+//                          Arena
+//____________________________________________________________________
+
+static inline t_arena *arena_new(void)
+{
+    t_arena *a = (t_arena *) sysmem_newptrclear(sizeof(t_arena));
+
+    if (a) {
+        systhread_mutex_new(&a->mutex, 0);
+        a->chunksize = ARENA_CHUNKSIZE;
+    }
+    return a;
+}
+
+// block allocation, the caller holds the mutex
+static inline void *arena_alloc_locked(t_arena *a, long bytes)
+{
+    t_arena_chunk   *c;
+    long            need = ARENA_ALIGN + ARENA_PAD(bytes);     // room for the header pointing back to the chunk
+    long            size;
+    char            *block;
+
+    for (c = a->chunks; c; c = c->next)
+        if (c->size - c->used >= need)
+            break;
+
+    if (!c) {
+        size = need > a->chunksize ? need : a->chunksize;
+        c = (t_arena_chunk *) sysmem_newptrclear(sizeof(t_arena_chunk));
+        if (!c)
+            return NULL;
+        c->mem = (char *) sysmem_newptr(size + ARENA_ALIGN);
+        if (!c->mem) {
+            sysmem_freeptr(c);
+            return NULL;
+        }
+        c->data = (char *)(((t_ptr_uint)c->mem + ARENA_ALIGN - 1) & ~(t_ptr_uint)(ARENA_ALIGN - 1));
+        c->size = size;
+        c->next = a->chunks;
+        a->chunks = c;
+    }
+
+    block = c->data + c->used;
+    *(t_arena_chunk **)block = c;
+    c->used += need;
+    c->blocks++;
+
+    memset(block + ARENA_ALIGN, 0, need - ARENA_ALIGN);
+    return block + ARENA_ALIGN;
+}
+
+static inline void arena_free_locked(t_arena *a, void *p)
+{
+    t_arena_chunk   *c = *(t_arena_chunk **)((char *)p - ARENA_ALIGN);
+    t_arena_chunk   **pc;
+
+    if (--c->blocks > 0)
+        return;
+
+    for (pc = &a->chunks; *pc; pc = &(*pc)->next) {
+        if (*pc == c) {
+            *pc = c->next;
+            break;
+        }
+    }
+    sysmem_freeptr(c->mem);
+    sysmem_freeptr(c);
+}
+
+// returns a zeroed, ARENA_ALIGN aligned block of at least bytes
+static inline void *arena_alloc(t_arena *a, long bytes)
+{
+    void *p;
+
+    systhread_mutex_lock(a->mutex);
+    p = arena_alloc_locked(a, bytes);
+    systhread_mutex_unlock(a->mutex);
+
+    return p;
+}
+
+static inline void arena_free(t_arena *a, void *p)
+{
+    if (!p)
+        return;
+
+    systhread_mutex_lock(a->mutex);
+    arena_free_locked(a, p);
+    systhread_mutex_unlock(a->mutex);
+}
+
+// hands out the next buffer of a block, each buffer starts on a cache line
+// pass a NULL cursor to only add up the size of the block
+static inline void *arena_carve(char **cursor, long *total, long bytes)
+{
+    char *p = cursor ? *cursor : NULL;
+
+    if (cursor)
+        *cursor += ARENA_PAD(bytes);
+    if (total)
+        *total += ARENA_PAD(bytes);
+
+    return p;
+}
+
+#endif // _ARENA_H_
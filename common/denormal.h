@@ -0,0 +1,164 @@
+/**
+ *
+ *  @file	denormal.h
+ *
+ *
+ *  Sources :
+ *
+ *   Intel 64 and IA-32 Architectures Software Developer's Manual, MXCSR Control/Status Register :
+ *          https://software.intel.com/en-us/articles/intel-sdm
+ *
+ *   ARM Architecture Reference Manual ARMv8, FPCR :
+ *          https://developer.arm.com/documentation/ddi0487/latest
+ *
+ *
+ *  Denormal and NaN policy for a whole DSP block instead of every sample.
+ *
+ *  FIX_DENORM_NAN_DOUBLE on each output sample costs a test and a branch in every inner loop.
+ *  Instead, a perform routine runs with flush-to-zero / denormals-are-zero set in the FPU
+ *  (MXCSR on Intel, FPCR on ARM) : denormals are neither produced nor read by the arithmetic,
+ *  so they can't slow the loops down. The previous FPU mode is restored on the way out.
+ *
+ *  NaN and infinities are still produced (0/0, pow of a negative...). A single pass over each
+ *  output finds them (x - x is 0 for a finite x, NaN otherwise), the output is only scrubbed
+ *  when the check fails, which is never in a healthy patch.
+ *
+ *  A perform routine opts in with DENORMAL_PERFORM, which generates the routine registered
+ *  in dsp64 around the one doing the work.
+ *
+ *  Values copied without arithmetic (a plain memcpy of an input) keep their denormals,
+ *  those come from the object upstream.
+ *
+ */
+
+#ifndef _DENORMAL_H_
+#define _DENORMAL_H_
+
+#include "simd.h"
+
+typedef unsigned long long t_denormal_state;    ///<    FPU mode before denormal_enter
+
+#define DENORMAL_MXCSR_FTZ  0x8000      ///<    Flush to zero (results)
+#define DENORMAL_MXCSR_DAZ  0x0040      ///<    Denormals are zero (operands)
+#define DENORMAL_FPCR_FZ    (1ULL << 24)///<    Flush to zero, results and operands on ARMv8
+
+
+
+
+
+//____________________________________________________________________
+//                          FPU Mode
+//____________________________________________________________________
+
+// sets flush-to-zero / denormals-are-zero, returns the previous mode for denormal_leave
+static inline t_denormal_state denormal_enter(void)
+{
+#if defined(SIMD_SSE2)
+    unsigned int csr = _mm_getcsr();
+
+    if ((csr & (DENORMAL_MXCSR_FTZ | DENORMAL_MXCSR_DAZ)) != (DENORMAL_MXCSR_FTZ | DENORMAL_MXCSR_DAZ))
+        _mm_setcsr(csr | DENORMAL_MXCSR_FTZ | DENORMAL_MXCSR_DAZ);
+    return csr;
+#elif defined(SIMD_NEON) && !defined(_MSC_VER)
+    unsigned long long fpcr;
+
+    __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (fpcr));
+    if (!(fpcr & DENORMAL_FPCR_FZ))
+        __asm__ __volatile__ ("msr fpcr, %0" : : "r" (fpcr | DENORMAL_FPCR_FZ));
+    return fpcr;
+#else
+    return 0;
+#endif
+}
+
+// restores the mode, writing the register is only done if we changed it (it stalls the pipeline)
+static inline void denormal_leave(t_denormal_state state)
+{
+#if defined(SIMD_SSE2)
+    if ((state & (DENORMAL_MXCSR_FTZ | DENORMAL_MXCSR_DAZ)) != (DENORMAL_MXCSR_FTZ | DENORMAL_MXCSR_DAZ))
+        _mm_setcsr((unsigned int)state);
+#elif defined(SIMD_NEON) && !defined(_MSC_VER)
+    if (!(state & DENORMAL_FPCR_FZ))
+        __asm__ __volatile__ ("msr fpcr, %0" : : "r" (state));
+#else
+    (void)state;
+#endif
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          NaN Check and Scrub
+//____________________________________________________________________
+
+// 1 if the block holds a NaN or an infinity
+static inline long denormal_isbad(const double *p, long n)
+{
+    t_vd    acc0 = vd_set1(0.);
+    t_vd    acc1 = vd_set1(0.);
+    t_vd    v;
+    double  tail = 0.;
+    long    i = 0;
+
+    // x - x is 0. for a finite x and NaN for NaN and inf, a NaN stays in the sum
+    for (; i + 2 * VD_SIZE <= n; i += 2 * VD_SIZE) {
+        v = vd_load(p + i);
+        acc0 = vd_add(acc0, vd_sub(v, v));
+        v = vd_load(p + i + VD_SIZE);
+        acc1 = vd_add(acc1, vd_sub(v, v));
+    }
+    for (; i < n; i++)
+        tail += p[i] - p[i];
+
+    return !(vd_hsum(vd_add(acc0, acc1)) + tail == 0.);
+}
+
+// FIX_DENORM_NAN_DOUBLE on the whole block
+static inline void denormal_scrub(double *p, long n)
+{
+    long i = 0;
+
+    for (; i + VD_SIZE <= n; i += VD_SIZE)
+        vd_store(p + i, vd_fixdenormnan(vd_load(p + i)));
+    for (; i < n; i++)
+        FIX_DENORM_NAN_DOUBLE(p[i]);
+}
+
+static inline void denormal_fix(double *p, long n)
+{
+    if (denormal_isbad(p, n))
+        denormal_scrub(p, n);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Perform Wrapper
+//____________________________________________________________________
+/*
+
+ DENORMAL_PERFORM(name, perform, type, first, count) generates the perform routine name, which calls
+ perform (same arguments) with flush-to-zero on, then checks outs[first] ... outs[first + count - 1].
+ first and count are expressions of the perform arguments, e.g. 0, numouts for every outlet,
+ or (t_ptr_int)userparam, 1 when each outlet has its own perform routine.
+
+ */
+
+#define DENORMAL_PERFORM(name, perform, type, first, count)                         \
+void name(type *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam) \
+{                                                                                   \
+    t_denormal_state    _state = denormal_enter();                                  \
+    long                _o;                                                         \
+                                                                                    \
+    perform(x, dsp64, ins, numins, outs, numouts, sampleframes, flags, userparam);  \
+    for (_o = (first); _o < (first) + (count); _o++)                                \
+        denormal_fix(outs[_o], sampleframes);                                       \
+                                                                                    \
+    denormal_leave(_state);                                                         \
+}
+
+#endif // _DENORMAL_H_
@@ -0,0 +1,244 @@
+/**
+ *
+ *  @file	lockfree.h
+ *
+ *
+ *  Sources :
+ *
+ *   Cylcing 74'
+ *    - Max 7.1 API, Threading (ext_atomic.h) :
+ *          https://cycling74.com/sdk/MaxSDK-6.0.4/html/index.html
+ *
+ *   Ross Bencina
+ *    - Real-time audio programming 101: time waits for nothing :
+ *          http://www.rossbencina.com/code/real-time-audio-programming-101-time-waits-for-nothing
+ *
+ *
+ *  Small lock-free helpers shared by the templates.
+ *  Everything is header only (static inline) so each external stays a single translation unit.
+ *
+ *  The perform routine runs in the audio thread, where we can't lock, allocate or post.
+ *  These helpers let the audio thread hand data to the main thread (and back) without ever blocking :
+ *  a triple buffer for the latest frame, and a ring for a stream of items.
+ *
+ */
+
+#ifndef _LOCKFREE_H_
+#define _LOCKFREE_H_
+
+#include "ext.h"
+#include "ext_atomic.h"     // ATOMIC_COMPARE_SWAP32 is a full barrier on both platforms
+
+
+
+
+
+//____________________________________________________________________
+//                          Atomic Helpers
+//____________________________________________________________________
+/*
+
+ ext_atomic.h only gives us increments and a compare-and-swap, both with a memory barrier.
+ Loads, stores and exchanges are built on top of the compare-and-swap so they get the same barrier.
+
+ */
+
+static inline int32_t lockfree_load(t_int32_atomic *p)
+{
+    int32_t v;
+
+    do {
+        v = *p;
+    } while (!ATOMIC_COMPARE_SWAP32(v, v, p));
+
+    return v;
+}
+
+static inline int32_t lockfree_exchange(t_int32_atomic *p, int32_t nv)
+{
+    int32_t v;
+
+    do {
+        v = *p;
+    } while (!ATOMIC_COMPARE_SWAP32(v, nv, p));
+
+    return v;
+}
+
+static inline void lockfree_store(t_int32_atomic *p, int32_t v)
+{
+    lockfree_exchange(p, v);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Triple Buffer
+//____________________________________________________________________
+/*
+
+ One writer (the audio thread) and one reader (the main thread) share three slots :
+    - back   : owned by the writer, being filled
+    - middle : the newest complete frame, owned by nobody
+    - front  : owned by the reader, being read
+
+ Publishing swaps back and middle, reading swaps middle and front. Both are a single exchange,
+ so the writer never waits for the reader and the reader always gets the newest complete frame.
+ The middle index and a "fresh" flag are packed in one atomic int.
+
+ */
+
+#define SNAPSHOT_FRESH  4   ///<    set in state when middle holds a frame the reader hasn't seen
+
+typedef struct _snapshot    ///<    Triple buffered, lock-free latest-frame snapshot
+{
+    char            *slot[3];   ///<    The three buffers, slot_size bytes each
+    long            slot_size;  ///<    Size of a slot in bytes
+    t_int32_atomic  state;      ///<    Middle index | SNAPSHOT_FRESH
+    int32_t         back;       ///<    Writer side index
+    int32_t         front;      ///<    Reader side index
+
+} t_snapshot;
+
+
+// allocates the three slots (main thread only), returns 0 on success
+static inline long snapshot_new(t_snapshot *s, long bytes)
+{
+    long i;
+
+    s->slot_size = bytes;
+    s->state = 1;
+    s->back  = 0;
+    s->front = 2;
+
+    for (i = 0; i < 3; i++) {
+        s->slot[i] = (char *) sysmem_newptrclear(bytes);
+        if (!s->slot[i])
+            return 1;
+    }
+
+    return 0;
+}
+
+static inline void snapshot_free(t_snapshot *s)
+{
+    long i;
+
+    for (i = 0; i < 3; i++) {
+        if (s->slot[i])
+            sysmem_freeptr(s->slot[i]);
+        s->slot[i] = NULL;
+    }
+}
+
+// writer : the buffer to fill with the next frame
+static inline void *snapshot_back(t_snapshot *s)
+{
+    return s->slot[s->back];
+}
+
+// writer : makes the back buffer the newest frame, never blocks
+static inline void snapshot_publish(t_snapshot *s)
+{
+    s->back = lockfree_exchange(&s->state, s->back | SNAPSHOT_FRESH) & 3;
+}
+
+// reader : newest complete frame, *fresh tells if it wasn't read before
+static inline void *snapshot_read(t_snapshot *s, long *fresh)
+{
+    long isfresh = (lockfree_load(&s->state) & SNAPSHOT_FRESH) != 0;
+
+    if (isfresh)
+        s->front = lockfree_exchange(&s->state, s->front) & 3;
+
+    if (fresh)
+        *fresh = isfresh;
+
+    return s->slot[s->front];
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          SPSC Ring
+//____________________________________________________________________
+/*
+
+ One producer (e.g. the main or scheduler thread) and one consumer (e.g. the audio thread) share
+ a ring of fixed size items. Each side only writes its own index : the producer head, the consumer tail.
+ The indices run freely and wrap with the mask, head - tail is the number of items in the ring.
+ Nothing blocks : push fails when the ring is full, peek returns NULL when it is empty.
+
+ */
+
+typedef struct _spsc        ///<    Single producer, single consumer ring of fixed size items
+{
+    char            *data;      ///<    size * item_size bytes
+    long            item_size;  ///<    Size of an item in bytes
+    int32_t         mask;       ///<    size - 1, size is a power of 2
+    t_int32_atomic  head;       ///<    Items pushed, written by the producer
+    t_int32_atomic  tail;       ///<    Items popped, written by the consumer
+
+} t_spsc;
+
+
+// allocates the ring (main thread only), size is rounded up to a power of 2. Returns 0 on success
+static inline long spsc_new(t_spsc *r, long size, long bytes)
+{
+    long n = 1;
+
+    while (n < size)
+        n <<= 1;
+
+    r->item_size = bytes;
+    r->mask = (int32_t)(n - 1);
+    r->head = 0;
+    r->tail = 0;
+    r->data = (char *) sysmem_newptrclear(n * bytes);
+
+    return r->data ? 0 : 1;
+}
+
+static inline void spsc_free(t_spsc *r)
+{
+    if (r->data)
+        sysmem_freeptr(r->data);
+    r->data = NULL;
+}
+
+// producer : copies item in the ring, returns 1 if the ring is full (the item is dropped)
+static inline long spsc_push(t_spsc *r, const void *item)
+{
+    int32_t head = r->head;     // only we write it
+
+    if ((uint32_t)(head - lockfree_load(&r->tail)) > (uint32_t)r->mask)
+        return 1;
+
+    memcpy(r->data + (head & r->mask) * r->item_size, item, r->item_size);
+    lockfree_store(&r->head, (int32_t)((uint32_t)head + 1));     // the barrier publishes the item before the index
+
+    return 0;
+}
+
+// consumer : oldest item, NULL if the ring is empty. It stays in the ring until spsc_pop
+static inline void *spsc_peek(t_spsc *r)
+{
+    int32_t tail = r->tail;     // only we write it
+
+    if (lockfree_load(&r->head) == tail)
+        return NULL;
+
+    return r->data + (tail & r->mask) * r->item_size;
+}
+
+// consumer : releases the item returned by spsc_peek
+static inline void spsc_pop(t_spsc *r)
+{
+    lockfree_store(&r->tail, (int32_t)((uint32_t)r->tail + 1));
+}
+
+#endif // _LOCKFREE_H_
@@ -0,0 +1,375 @@
+/**
+ *
+ *  @file	simd.h
+ *
+ *
+ *  Sources :
+ *
+ *   Intel Intrinsics Guide :
+ *          https://software.intel.com/sites/landingpage/IntrinsicsGuide/
+ *
+ *   ARM NEON Intrinsics Reference :
+ *          https://developer.arm.com/architectures/instruction-sets/intrinsics/
+ *
+ *
+ *  A tiny vector of 2 doubles (t_vd) for the perform routines of the templates,
+ *  and its float counterpart (t_vf, 4 floats in the same register) for the float32 processing modes.
+ *  SSE2 on Intel (every Mac and Windows x64 machine has it), NEON on 64 bit ARM, plain C elsewhere.
+ *  Header only (static inline), the compiler keeps everything in registers.
+ *
+ *  Loads and stores are unaligned : MSP signal vectors are aligned in practice, but nothing guarantees it.
+ *
+ */
+
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#include <float.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define SIMD_SSE2 1
+    #include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #define SIMD_NEON 1
+    #include <arm_neon.h>
+#endif
+
+#define VD_SIZE 2   ///<    doubles per vector
+#define VF_SIZE 4   ///<    floats per vector
+
+
+
+
+
+//____________________________________________________________________
+//                          Vector of 2 doubles
+//____________________________________________________________________
+
+#if defined(SIMD_SSE2)
+
+typedef __m128d t_vd;
+
+static inline t_vd vd_load(const double *p)             { return _mm_loadu_pd(p); }
+static inline void vd_store(double *p, t_vd a)          { _mm_storeu_pd(p, a); }
+static inline t_vd vd_set1(double v)                    { return _mm_set1_pd(v); }
+static inline t_vd vd_add(t_vd a, t_vd b)               { return _mm_add_pd(a, b); }
+static inline t_vd vd_sub(t_vd a, t_vd b)               { return _mm_sub_pd(a, b); }
+static inline t_vd vd_mul(t_vd a, t_vd b)               { return _mm_mul_pd(a, b); }
+static inline t_vd vd_div(t_vd a, t_vd b)               { return _mm_div_pd(a, b); }
+static inline t_vd vd_min(t_vd a, t_vd b)               { return _mm_min_pd(a, b); }
+static inline t_vd vd_max(t_vd a, t_vd b)               { return _mm_max_pd(a, b); }
+static inline t_vd vd_sqrt(t_vd a)                      { return _mm_sqrt_pd(a); }
+static inline t_vd vd_abs(t_vd a)                       { return _mm_andnot_pd(_mm_set1_pd(-0.), a); }
+static inline t_vd vd_neg(t_vd a)                       { return _mm_xor_pd(_mm_set1_pd(-0.), a); }
+static inline t_vd vd_madd(t_vd a, t_vd b, t_vd c)      { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+
+// a where mask is set, b elsewhere (mask from a comparison)
+static inline t_vd vd_select(t_vd mask, t_vd a, t_vd b) { return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b)); }
+static inline t_vd vd_cmpge(t_vd a, t_vd b)             { return _mm_cmpge_pd(a, b); }
+static inline t_vd vd_cmple(t_vd a, t_vd b)             { return _mm_cmple_pd(a, b); }
+static inline t_vd vd_cmpgt(t_vd a, t_vd b)             { return _mm_cmpgt_pd(a, b); }
+
+// horizontal sum and max of the two lanes
+static inline double vd_hsum(t_vd a)                    { return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a))); }
+static inline double vd_hmax(t_vd a)                    { return _mm_cvtsd_f64(_mm_max_sd(a, _mm_unpackhi_pd(a, a))); }
+
+// pairwise sum : (a0 + a1, b0 + b1), e.g. the squared magnitudes of two fftw_complex
+static inline t_vd vd_hadd2(t_vd a, t_vd b)             { return _mm_add_pd(_mm_unpacklo_pd(a, b), _mm_unpackhi_pd(a, b)); }
+
+// complex multiply-add, a t_vd holds one complex (re, im) as in fftw_complex : acc + a * b
+static inline t_vd vd_cmadd(t_vd a, t_vd b, t_vd acc)
+{
+    t_vd t = _mm_mul_pd(_mm_unpacklo_pd(a, a), b);                              // (ar br, ar bi)
+    t_vd u = _mm_mul_pd(_mm_unpackhi_pd(a, a), _mm_shuffle_pd(b, b, 1));        // (ai bi, ai br)
+
+    return _mm_add_pd(acc, _mm_add_pd(t, _mm_xor_pd(u, _mm_set_pd(0., -0.))));  // (ar br - ai bi, ar bi + ai br)
+}
+
+// 2^k for an integral k in [-1022, 1023] : k + 1023 sits in the low mantissa bits of k + 1023 + 2^52, shift it into the exponent
+static inline t_vd vd_exp2i(t_vd k)                     { return _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(_mm_add_pd(k, _mm_set1_pd(4503599627371519.))), 52)); }
+
+#elif defined(SIMD_NEON)
+
+typedef float64x2_t t_vd;
+
+static inline t_vd vd_load(const double *p)             { return vld1q_f64(p); }
+static inline void vd_store(double *p, t_vd a)          { vst1q_f64(p, a); }
+static inline t_vd vd_set1(double v)                    { return vdupq_n_f64(v); }
+static inline t_vd vd_add(t_vd a, t_vd b)               { return vaddq_f64(a, b); }
+static inline t_vd vd_sub(t_vd a, t_vd b)               { return vsubq_f64(a, b); }
+static inline t_vd vd_mul(t_vd a, t_vd b)               { return vmulq_f64(a, b); }
+static inline t_vd vd_div(t_vd a, t_vd b)               { return vdivq_f64(a, b); }
+static inline t_vd vd_min(t_vd a, t_vd b)               { return vminnmq_f64(a, b); }
+static inline t_vd vd_max(t_vd a, t_vd b)               { return vmaxnmq_f64(a, b); }
+static inline t_vd vd_sqrt(t_vd a)                      { return vsqrtq_f64(a); }
+static inline t_vd vd_abs(t_vd a)                       { return vabsq_f64(a); }
+static inline t_vd vd_neg(t_vd a)                       { return vnegq_f64(a); }
+static inline t_vd vd_madd(t_vd a, t_vd b, t_vd c)      { return vaddq_f64(vmulq_f64(a, b), c); }
+
+static inline t_vd vd_select(t_vd mask, t_vd a, t_vd b) { return vbslq_f64(vreinterpretq_u64_f64(mask), a, b); }
+static inline t_vd vd_cmpge(t_vd a, t_vd b)             { return vreinterpretq_f64_u64(vcgeq_f64(a, b)); }
+static inline t_vd vd_cmple(t_vd a, t_vd b)             { return vreinterpretq_f64_u64(vcleq_f64(a, b)); }
+static inline t_vd vd_cmpgt(t_vd a, t_vd b)             { return vreinterpretq_f64_u64(vcgtq_f64(a, b)); }
+
+static inline double vd_hsum(t_vd a)                    { return vaddvq_f64(a); }
+static inline double vd_hmax(t_vd a)                    { return vmaxvq_f64(a); }
+static inline t_vd vd_hadd2(t_vd a, t_vd b)             { return vpaddq_f64(a, b); }
+
+static inline t_vd vd_cmadd(t_vd a, t_vd b, t_vd acc)
+{
+    t_vd t = vmulq_f64(vdupq_laneq_f64(a, 0), b);
+    t_vd u = vmulq_f64(vdupq_laneq_f64(a, 1), vextq_f64(b, b, 1));
+    static const double sign[2] = { -1., 1. };
+
+    return vaddq_f64(acc, vfmaq_f64(t, u, vld1q_f64(sign)));
+}
+
+static inline t_vd vd_exp2i(t_vd k)                     { return vreinterpretq_f64_u64(vshlq_n_u64(vreinterpretq_u64_f64(vaddq_f64(k, vdupq_n_f64(4503599627371519.))), 52)); }
+
+#else
+
+typedef struct { double v[2]; } t_vd;
+
+static inline t_vd vd_make(double a, double b)          { t_vd r; r.v[0] = a; r.v[1] = b; return r; }
+static inline t_vd vd_load(const double *p)             { return vd_make(p[0], p[1]); }
+static inline void vd_store(double *p, t_vd a)          { p[0] = a.v[0]; p[1] = a.v[1]; }
+static inline t_vd vd_set1(double v)                    { return vd_make(v, v); }
+static inline t_vd vd_add(t_vd a, t_vd b)               { return vd_make(a.v[0] + b.v[0], a.v[1] + b.v[1]); }
+static inline t_vd vd_sub(t_vd a, t_vd b)               { return vd_make(a.v[0] - b.v[0], a.v[1] - b.v[1]); }
+static inline t_vd vd_mul(t_vd a, t_vd b)               { return vd_make(a.v[0] * b.v[0], a.v[1] * b.v[1]); }
+static inline t_vd vd_div(t_vd a, t_vd b)               { return vd_make(a.v[0] / b.v[0], a.v[1] / b.v[1]); }
+static inline t_vd vd_min(t_vd a, t_vd b)               { return vd_make(a.v[0] < b.v[0] ? a.v[0] : b.v[0], a.v[1] < b.v[1] ? a.v[1] : b.v[1]); }
+static inline t_vd vd_max(t_vd a, t_vd b)               { return vd_make(a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1]); }
+static inline t_vd vd_sqrt(t_vd a)                      { return vd_make(sqrt(a.v[0]), sqrt(a.v[1])); }
+static inline t_vd vd_abs(t_vd a)                       { return vd_make(fabs(a.v[0]), fabs(a.v[1])); }
+static inline t_vd vd_neg(t_vd a)                       { return vd_make(-a.v[0], -a.v[1]); }
+static inline t_vd vd_madd(t_vd a, t_vd b, t_vd c)      { return vd_make(a.v[0] * b.v[0] + c.v[0], a.v[1] * b.v[1] + c.v[1]); }
+
+// masks are 0. or 1. in plain C
+static inline t_vd vd_select(t_vd mask, t_vd a, t_vd b) { return vd_make(mask.v[0] != 0. ? a.v[0] : b.v[0], mask.v[1] != 0. ? a.v[1] : b.v[1]); }
+static inline t_vd vd_cmpge(t_vd a, t_vd b)             { return vd_make(a.v[0] >= b.v[0], a.v[1] >= b.v[1]); }
+static inline t_vd vd_cmple(t_vd a, t_vd b)             { return vd_make(a.v[0] <= b.v[0], a.v[1] <= b.v[1]); }
+static inline t_vd vd_cmpgt(t_vd a, t_vd b)             { return vd_make(a.v[0] > b.v[0], a.v[1] > b.v[1]); }
+
+static inline double vd_hsum(t_vd a)                    { return a.v[0] + a.v[1]; }
+static inline double vd_hmax(t_vd a)                    { return a.v[0] > a.v[1] ? a.v[0] : a.v[1]; }
+static inline t_vd vd_hadd2(t_vd a, t_vd b)             { return vd_make(a.v[0] + a.v[1], b.v[0] + b.v[1]); }
+static inline t_vd vd_cmadd(t_vd a, t_vd b, t_vd acc)   { return vd_make(acc.v[0] + a.v[0] * b.v[0] - a.v[1] * b.v[1], acc.v[1] + a.v[0] * b.v[1] + a.v[1] * b.v[0]); }
+static inline t_vd vd_exp2i(t_vd k)                     { return vd_make(ldexp(1., (int)k.v[0]), ldexp(1., (int)k.v[1])); }
+
+#endif
+
+// vector FIX_DENORM_NAN_DOUBLE : denormals, NaN and infinities become 0., without a branch
+// |a| inside [DBL_MIN, DBL_MAX] is kept, NaN fails both comparisons
+static inline t_vd vd_fixdenormnan(t_vd a)
+{
+    t_vd m = vd_abs(a);
+    t_vd keep = vd_select(vd_cmpge(m, vd_set1(DBL_MIN)), vd_cmple(m, vd_set1(DBL_MAX)), vd_set1(0.));
+
+    return vd_select(keep, a, vd_set1(0.));
+}
+
+// denormals become 0., for the library calls : they read their operands bit by bit and don't see denormals-are-zero
+static inline t_vd vd_daz(t_vd a)
+{
+    return vd_select(vd_cmpge(vd_abs(a), vd_set1(DBL_MIN)), a, vd_set1(0.));
+}
+
+// applies a scalar function to each lane, for operations without a vector instruction (pow...)
+static inline t_vd vd_map2(double (*f)(double, double), t_vd a, t_vd b)
+{
+    double  ta[VD_SIZE], tb[VD_SIZE];
+
+    vd_store(ta, a);
+    vd_store(tb, b);
+    ta[0] = f(ta[0], tb[0]);
+    ta[1] = f(ta[1], tb[1]);
+
+    return vd_load(ta);
+}
+
+// e^a without leaving the registers, relative error below 1e-15
+// a = k ln2 + r with |r| <= ln2 / 2, e^r from its Taylor series up to r^12, 2^k built in the exponent bits
+static inline t_vd vd_exp(t_vd a)
+{
+    static const double c[13] = { 1., 1., 1. / 2, 1. / 6, 1. / 24, 1. / 120, 1. / 720, 1. / 5040, 1. / 40320,
+                                  1. / 362880, 1. / 3628800, 1. / 39916800, 1. / 479001600 };
+    const t_vd round = vd_set1(6755399441055744.);      // 1.5 * 2^52 : adding and removing it rounds to the nearest integer
+    t_vd k, r, p;
+    int i;
+
+    a = vd_max(vd_min(a, vd_set1(708.)), vd_set1(-708.));
+    k = vd_sub(vd_add(vd_mul(a, vd_set1(1.4426950408889634)), round), round);
+    r = vd_sub(vd_sub(a, vd_mul(k, vd_set1(6.93147180369123816490e-01))), vd_mul(k, vd_set1(1.90821492927058770002e-10)));
+
+    p = vd_set1(c[12]);
+    for (i = 11; i >= 0; i--)
+        p = vd_madd(p, r, vd_set1(c[i]));
+
+    return vd_mul(p, vd_exp2i(k));
+}
+
+
+
+
+
+
+//____________________________________________________________________
+//                          Vector of 4 floats
+//____________________________________________________________________
+/*
+ 
+ Same register width as t_vd, twice the samples. MSP hands us doubles : convert once when entering
+ the float part of a routine (simd_tofloat) and once when leaving it (simd_todouble).
+ 
+ */
+
+#if defined(SIMD_SSE2)
+
+typedef __m128 t_vf;
+
+static inline t_vf vf_load(const float *p)              { return _mm_loadu_ps(p); }
+static inline void vf_store(float *p, t_vf a)           { _mm_storeu_ps(p, a); }
+static inline t_vf vf_set1(float v)                     { return _mm_set1_ps(v); }
+static inline t_vf vf_add(t_vf a, t_vf b)               { return _mm_add_ps(a, b); }
+static inline t_vf vf_sub(t_vf a, t_vf b)               { return _mm_sub_ps(a, b); }
+static inline t_vf vf_mul(t_vf a, t_vf b)               { return _mm_mul_ps(a, b); }
+static inline t_vf vf_div(t_vf a, t_vf b)               { return _mm_div_ps(a, b); }
+static inline t_vf vf_min(t_vf a, t_vf b)               { return _mm_min_ps(a, b); }
+static inline t_vf vf_max(t_vf a, t_vf b)               { return _mm_max_ps(a, b); }
+static inline t_vf vf_abs(t_vf a)                       { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+static inline t_vf vf_neg(t_vf a)                       { return _mm_xor_ps(_mm_set1_ps(-0.f), a); }
+static inline t_vf vf_madd(t_vf a, t_vf b, t_vf c)      { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+static inline t_vf vf_select(t_vf mask, t_vf a, t_vf b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline t_vf vf_cmpge(t_vf a, t_vf b)             { return _mm_cmpge_ps(a, b); }
+static inline t_vf vf_cmple(t_vf a, t_vf b)             { return _mm_cmple_ps(a, b); }
+static inline float vf_hsum(t_vf a)                     { a = _mm_add_ps(a, _mm_movehl_ps(a, a)); return _mm_cvtss_f32(_mm_add_ss(a, _mm_shuffle_ps(a, a, 1))); }
+
+// 2 t_vd to a t_vf and back
+static inline t_vf vf_fromvd(t_vd lo, t_vd hi)          { return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)); }
+static inline t_vd vf_tovdlo(t_vf a)                    { return _mm_cvtps_pd(a); }
+static inline t_vd vf_tovdhi(t_vf a)                    { return _mm_cvtps_pd(_mm_movehl_ps(a, a)); }
+
+#elif defined(SIMD_NEON)
+
+typedef float32x4_t t_vf;
+
+static inline t_vf vf_load(const float *p)              { return vld1q_f32(p); }
+static inline void vf_store(float *p, t_vf a)           { vst1q_f32(p, a); }
+static inline t_vf vf_set1(float v)                     { return vdupq_n_f32(v); }
+static inline t_vf vf_add(t_vf a, t_vf b)               { return vaddq_f32(a, b); }
+static inline t_vf vf_sub(t_vf a, t_vf b)               { return vsubq_f32(a, b); }
+static inline t_vf vf_mul(t_vf a, t_vf b)               { return vmulq_f32(a, b); }
+static inline t_vf vf_div(t_vf a, t_vf b)               { return vdivq_f32(a, b); }
+static inline t_vf vf_min(t_vf a, t_vf b)               { return vminnmq_f32(a, b); }
+static inline t_vf vf_max(t_vf a, t_vf b)               { return vmaxnmq_f32(a, b); }
+static inline t_vf vf_abs(t_vf a)                       { return vabsq_f32(a); }
+static inline t_vf vf_neg(t_vf a)                       { return vnegq_f32(a); }
+static inline t_vf vf_madd(t_vf a, t_vf b, t_vf c)      { return vaddq_f32(vmulq_f32(a, b), c); }
+static inline t_vf vf_select(t_vf mask, t_vf a, t_vf b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+static inline t_vf vf_cmpge(t_vf a, t_vf b)             { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+static inline t_vf vf_cmple(t_vf a, t_vf b)             { return vreinterpretq_f32_u32(vcleq_f32(a, b)); }
+static inline float vf_hsum(t_vf a)                     { return vaddvq_f32(a); }
+
+static inline t_vf vf_fromvd(t_vd lo, t_vd hi)          { return vcombine_f32(vcvt_f32_f64(lo), vcvt_f32_f64(hi)); }
+static inline t_vd vf_tovdlo(t_vf a)                    { return vcvt_f64_f32(vget_low_f32(a)); }
+static inline t_vd vf_tovdhi(t_vf a)                    { return vcvt_high_f64_f32(a); }
+
+#else
+
+typedef struct { float v[4]; } t_vf;
+
+static inline t_vf vf_make(float a, float b, float c, float d) { t_vf r; r.v[0] = a; r.v[1] = b; r.v[2] = c; r.v[3] = d; return r; }
+static inline t_vf vf_load(const float *p)              { return vf_make(p[0], p[1], p[2], p[3]); }
+static inline void vf_store(float *p, t_vf a)           { p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3]; }
+static inline t_vf vf_set1(float v)                     { return vf_make(v, v, v, v); }
+
+#define VF_LANES(expr) vf_make(expr(0), expr(1), expr(2), expr(3))
+#define VF_ADD(i)   (a.v[i] + b.v[i])
+#define VF_SUB(i)   (a.v[i] - b.v[i])
+#define VF_MUL(i)   (a.v[i] * b.v[i])
+#define VF_DIV(i)   (a.v[i] / b.v[i])
+#define VF_MIN(i)   (a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+#define VF_MAX(i)   (a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+#define VF_ABS(i)   fabsf(a.v[i])
+#define VF_NEG(i)   (-a.v[i])
+#define VF_MADD(i)  (a.v[i] * b.v[i] + c.v[i])
+#define VF_SEL(i)   (mask.v[i] != 0.f ? a.v[i] : b.v[i])
+#define VF_GE(i)    (float)(a.v[i] >= b.v[i])
+#define VF_LE(i)    (float)(a.v[i] <= b.v[i])
+
+static inline t_vf vf_add(t_vf a, t_vf b)               { return VF_LANES(VF_ADD); }
+static inline t_vf vf_sub(t_vf a, t_vf b)               { return VF_LANES(VF_SUB); }
+static inline t_vf vf_mul(t_vf a, t_vf b)               { return VF_LANES(VF_MUL); }
+static inline t_vf vf_div(t_vf a, t_vf b)               { return VF_LANES(VF_DIV); }
+static inline t_vf vf_min(t_vf a, t_vf b)               { return VF_LANES(VF_MIN); }
+static inline t_vf vf_max(t_vf a, t_vf b)               { return VF_LANES(VF_MAX); }
+static inline t_vf vf_abs(t_vf a)                       { return VF_LANES(VF_ABS); }
+static inline t_vf vf_neg(t_vf a)                       { return VF_LANES(VF_NEG); }
+static inline t_vf vf_madd(t_vf a, t_vf b, t_vf c)      { return VF_LANES(VF_MADD); }
+static inline t_vf vf_select(t_vf mask, t_vf a, t_vf b) { return VF_LANES(VF_SEL); }
+static inline t_vf vf_cmpge(t_vf a, t_vf b)             { return VF_LANES(VF_GE); }
+static inline t_vf vf_cmple(t_vf a, t_vf b)             { return VF_LANES(VF_LE); }
+static inline float vf_hsum(t_vf a)                     { return (a.v[0] + a.v[1]) + (a.v[2] + a.v[3]); }
+
+static inline t_vf vf_fromvd(t_vd lo, t_vd hi)          { return vf_make((float)lo.v[0], (float)lo.v[1], (float)hi.v[0], (float)hi.v[1]); }
+static inline t_vd vf_tovdlo(t_vf a)                    { return vd_make(a.v[0], a.v[1]); }
+static inline t_vd vf_tovdhi(t_vf a)                    { return vd_make(a.v[2], a.v[3]); }
+
+#endif
+
+// vector version of the float denormal/NaN fix, as vd_fixdenormnan
+static inline t_vf vf_fixdenormnan(t_vf a)
+{
+    t_vf m = vf_abs(a);
+    t_vf keep = vf_select(vf_cmpge(m, vf_set1(FLT_MIN)), vf_cmple(m, vf_set1(FLT_MAX)), vf_set1(0.f));
+
+    return vf_select(keep, a, vf_set1(0.f));
+}
+
+static inline float simd_fixf(float v)
+{
+    return (fabsf(v) >= FLT_MIN && fabsf(v) <= FLT_MAX) ? v : 0.f;
+}
+
+static inline t_vf vf_map2(float (*f)(float, float), t_vf a, t_vf b)
+{
+    float   ta[VF_SIZE], tb[VF_SIZE];
+    long    i;
+
+    vf_store(ta, a);
+    vf_store(tb, b);
+    for (i = 0; i < VF_SIZE; i++)
+        ta[i] = f(ta[i], tb[i]);
+
+    return vf_load(ta);
+}
+
+// double to float, when entering the float part of a routine
+static inline void simd_tofloat(const double *in, float *out, long n)
+{
+    long i = 0;
+
+    for (; i + VF_SIZE <= n; i += VF_SIZE)
+        vf_store(out + i, vf_fromvd(vd_load(in + i), vd_load(in + i + VD_SIZE)));
+    for (; i < n; i++)
+        out[i] = (float)in[i];
+}
+
+// float to double, when leaving it. A float denormal would become a normal double, they are flushed here
+static inline void simd_todouble(const float *in, double *out, long n)
+{
+    t_vf    v;
+    long    i = 0;
+
+    for (; i + VF_SIZE <= n; i += VF_SIZE) {
+        v = vf_fixdenormnan(vf_load(in + i));
+        vd_store(out + i,           vf_tovdlo(v));
+        vd_store(out + i + VD_SIZE, vf_tovdhi(v));
+    }
+    for (; i < n; i++)
+        out[i] = simd_fixf(in[i]);
+}
+
+#endif // _SIMD_H_
@@ -0,0 +1,161 @@
+/**
+ *
+ *  @file	tablecache.h
+ *
+ *
+ *  Sources :
+ *
+ *   Cylcing 74'
+ *    - Max 7.1 API, Threading (ext_systhread.h) :
+ *          https://cycling74.com/sdk/MaxSDK-6.0.4/html/index.html
+ *
+ *   FFTW3 documentation, New-array Execute Functions :
+ *          http://www.fftw.org/fftw3.pdf
+ *
+ *
+ *  A thread safe, reference counted cache of read-only tables shared by the instances of an external.
+ *  Header only (static inline), create one cache per class in ext_main.
+ *
+ *  An entry is keyed by (kind, size, variant), e.g. (window, 1024, hann) or (r2c plan, 1024, 0).
+ *  tablecache_acquire returns the entry built by a previous instance, or calls create to build it.
+ *  tablecache_release calls destroy when the last instance lets go of it.
+ *
+ *  FFTW plans are good candidates : a plan can be executed on other arrays than the ones it was made with
+ *  (fftw_execute_dft_r2c...) as long as they have the same alignment, so one plan serves every instance.
+ *  The create callback runs under the cache mutex, which also serializes the (non thread safe) FFTW planner.
+ *
+ *  Call these routines from new, dsp64 and free, never from the perform routine.
+ *
+ */
+
+#ifndef _TABLECACHE_H_
+#define _TABLECACHE_H_
+
+#include "ext.h"
+#include "ext_systhread.h"
+
+// builds a table (any pointer, an array or an fftw_plan...), returns NULL on failure
+typedef void *(*t_tablecache_create)(long kind, long size, long variant);
+
+// destroys a table built by the matching create
+typedef void (*t_tablecache_destroy)(void *table);
+
+typedef struct _tablecache_entry    ///<    A table and who uses it
+{
+    struct _tablecache_entry    *next;
+    long                        kind;       ///<    What the table holds, defined by the external
+    long                        size;       ///<    Transform/table size
+    long                        variant;    ///<    Window type...
+    long                        refcount;   ///<    Instances using the table
+    void                        *table;     ///<    What create returned
+    t_tablecache_destroy        destroy;    ///<    Called on the last release
+
+} t_tablecache_entry;
+
+typedef struct _tablecache
+{
+    t_systhread_mutex           mutex;
+    t_tablecache_entry          *entries;
+    long                        built;      ///<    Tables built since the cache exists, for statistics
+
+} t_tablecache;
+
+
+
+
+
+//____________________________________________________________________
+//                          Table Cache
+//____________________________________________________________________
+
+static inline t_tablecache *tablecache_new(void)
+{
+    t_tablecache *tc = (t_tablecache *) sysmem_newptrclear(sizeof(t_tablecache));
+
+    if (tc)
+        systhread_mutex_new(&tc->mutex, 0);
+    return tc;
+}
+
+static inline void *tablecache_acquire(t_tablecache *tc, long kind, long size, long variant,
+                                       t_tablecache_create create, t_tablecache_destroy destroy)
+{
+    t_tablecache_entry  *e;
+    void                *table = NULL;
+
+    systhread_mutex_lock(tc->mutex);
+
+    for (e = tc->entries; e; e = e->next) {
+        if (e->kind == kind && e->size == size && e->variant == variant) {
+            e->refcount++;
+            table = e->table;
+            break;
+        }
+    }
+
+    if (!e) {
+        e = (t_tablecache_entry *) sysmem_newptrclear(sizeof(t_tablecache_entry));
+        if (e)
+            e->table = create(kind, size, variant);
+        if (e && e->table) {
+            e->kind     = kind;
+            e->size     = size;
+            e->variant  = variant;
+            e->refcount = 1;
+            e->destroy  = destroy;
+            e->next     = tc->entries;
+            tc->entries = e;
+            tc->built++;
+            table = e->table;
+        }
+        else if (e) {
+            sysmem_freeptr(e);
+        }
+    }
+
+    systhread_mutex_unlock(tc->mutex);
+    return table;
+}
+
+static inline void tablecache_release(t_tablecache *tc, const void *table)
+{
+    t_tablecache_entry  **pe;
+    t_tablecache_entry  *e;
+
+    if (!table)
+        return;
+
+    systhread_mutex_lock(tc->mutex);
+
+    for (pe = &tc->entries; *pe; pe = &(*pe)->next) {
+        e = *pe;
+        if (e->table == table) {
+            if (--e->refcount == 0) {
+                *pe = e->next;
+                e->destroy(e->table);
+                sysmem_freeptr(e);
+            }
+            break;
+        }
+    }
+
+    systhread_mutex_unlock(tc->mutex);
+}
+
+// number of live entries, and tables built so far
+static inline long tablecache_count(t_tablecache *tc, long *built)
+{
+    t_tablecache_entry  *e;
+    long                n = 0;
+
+    systhread_mutex_lock(tc->mutex);
+    for (e = tc->entries; e; e = e->next)
+        n++;
+    if (built)
+        *built = tc->built;
+    systhread_mutex_unlock(tc->mutex);
+
+    return n;
+}
+
+#endif // _TABLECACHE_H_
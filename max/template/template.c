@@ -40,6 +40,15 @@
  *  The left outlet multiplies the inlets.
  *  The right outlet adds the inlets.
  *
+ *  Every inlet is a proxy and takes int, float, list and anything : the message is dispatched
+ *  to the inlet's handler with proxy_getinlet, a list is spread over the inlets from the one it came in.
+ *
+ *  The output attribute sets when the results are sent :
+ *      - hot   : the left inlet outputs, the right one only stores (standard Max behaviour)
+ *      - defer : the left inlet schedules a single output with a qelem, a burst of messages
+ *                (a slider dragged, a stream of OSC values) outputs once, with the last values
+ *  bang always outputs right away.
+ *
  *
  */
 
@@ -63,6 +72,14 @@
 #include "ext.h"            // should always be first, then ext_obex.h + other files.
 #include "ext_obex.h"		// required for "new" style objects
 
+#define TEMPLATE_INLETS     2       ///<    Number of inlets, all but the left one are proxies
+
+// values of the output attribute
+enum {
+    TEMPLATE_OUTPUT_HOT = 0,    ///<    Left inlet outputs at once
+    TEMPLATE_OUTPUT_DEFER       ///<    Left inlet outputs from a qelem, once per burst
+};
+
 
 
 
@@ -83,11 +100,13 @@ typedef struct _template	///<	A struct to hold data for our object
     t_atom      val;        ///<    Value to use for argument
     t_atom      val_0;      ///<	Value to use for inlet 0
     t_atom      val_1;      ///<	Value to use for inlet 1
-    void        *proxy;     ///<    A proxy is a small object that controls an inlet, but does not translate the message it receives. The advantage of proxies over regular inlets is that your object can respond to any message in all of its inlets.
+    void        *proxy[TEMPLATE_INLETS];    ///<    A proxy is a small object that controls an inlet, but does not translate the message it receives. The advantage of proxies over regular inlets is that your object can respond to any message in all of its inlets. proxy[0] is unused, the left inlet is the object's
     long        in_n;       ///<    Space for the inlet number used by all the proxies
     t_symbol    name;       ///<    Name of the Max object
     void        *out_0;     ///<    Output definition
     void        *out_1;     ///<    Output definition
+    long        output;     ///<    When the left inlet outputs (output attribute)
+    void        *outq;      ///<    Coalesces the outputs in defer mode
 
 } t_template;
 
@@ -113,14 +132,24 @@ void template_int(  t_template *x, long n);
 void template_bang( t_template *x);
 
 //// additional inlet behavious
-void template_in0( t_template *x, long n);      //1st inlet
-void template_in1( t_template *x, long n);      //2nd inlet
+void template_list(t_template *x, t_symbol *s, long ac, t_atom *av);
+void template_in0( t_template *x, t_atom *a);   //1st inlet
+void template_in1( t_template *x, t_atom *a);   //2nd inlet
 
 //// performance set
 void template_anything(t_template *x, t_symbol *s, long ac, t_atom *av);    ///< request that args be passed as an array, the routine will check the types itself.
 void template_identify(t_template *x);
 void template_dblclick(t_template *x);
 
+// an inlet handler gets one atom, a number or a symbol
+typedef void (*t_template_inlet)(t_template *x, t_atom *a);
+
+// handler of each inlet, indexed by proxy_getinlet
+static const t_template_inlet template_inlets[TEMPLATE_INLETS] = {
+    template_in0,
+    template_in1
+};
+
 
 
 
@@ -151,6 +180,7 @@ void ext_main(void *r)
     class_addmethod(c, (method)template_bang,       "bang",             0);
     class_addmethod(c, (method)template_int,        "int",      A_LONG, 0);
     class_addmethod(c, (method)template_float,		"float",	A_FLOAT,0);
+    class_addmethod(c, (method)template_list,       "list",     A_GIMME,0);
     
     class_addmethod(c, (method)template_assist,     "assist",	A_CANT, 0);
     class_addmethod(c, (method)template_anything,   "anything", A_GIMME, 0);
@@ -165,11 +195,14 @@ void ext_main(void *r)
     // A_SYM    symbols         A_DEFSYM    -----an empty symbol--------------symbol-------
     // A_GIMME  raw list of atoms, since mutliple A_FLOAT should be avoided (cf. MaxAPI), A_GIMME should be used for more than four arguments or with multiple floating-point arguments
     // A_CANT   used when we cannot type check the argument
-    class_addmethod(c, (method)template_in0,        "int",      A_LONG, 0);
-    class_addmethod(c, (method)template_in1,        "in1",      A_LONG, 0);
+    // int, float, list and anything above are received by all the inlets, they find out which one with proxy_getinlet
     
     CLASS_ATTR_SYM(c, "name", 0, t_template, name);
     
+    CLASS_ATTR_LONG(c, "output", 0, t_template, output);
+    CLASS_ATTR_ENUMINDEX(c, "output", 0, "hot defer");
+    CLASS_ATTR_LABEL(c, "output", 0, "Output Mode");
+    
     //  adds this class to the CLASS_BOX name space, meaning that it will be searched when a user tries to type it into a box.
     class_register(CLASS_BOX, c);
     
@@ -191,6 +224,7 @@ void *template_new(t_symbol *s, long argc, t_atom *argv)
 {
     //Setup the custom struct for our object
     t_template *x = (t_template *) object_alloc((t_class *) template_class);
+    long i;
     
     //Give our object two outlets
     // x->out0 = intout((t_object *)x);
@@ -199,21 +233,35 @@ void *template_new(t_symbol *s, long argc, t_atom *argv)
     x->out_0 = floatout((t_object *)x);
     x->out_1 = floatout((t_object *)x);
     
-    // add an inlet
-    intin(x, 1);
-
     // passing your object, a non-zero code value associated with the proxy, and a pointer to your object's inlet number location.
-    // additonally this creates the second inlet (i.e. inlet 1)
-    //x->proxy = proxy_new((t_object *) x, 1, &x->in_n);
-    // to make more inlets use     intin(x, 2);
+    // inlets are created from right to left, proxy i is inlet i
+    for (i = TEMPLATE_INLETS - 1; i > 0; i--)
+        x->proxy[i] = proxy_new((t_object *) x, i, &x->in_n);
+    
+    // the inlets start at 0 so a bang before any number outputs 0 0
+    atom_setlong(&x->val_0, 0);
+    atom_setlong(&x->val_1, 0);
+    
+    // a qelem is set any number of times before it runs, its function is called once
+    x->outq = qelem_new(x, (method)template_bang);
+    
+    // attributes typed in the box, e.g. [template @output defer]
+    attr_args_process(x, (short)argc, argv);
     
     return (x);
 }
 
-// NOT CALLED!, we use dsp_free for a generic free function
+// the proxies are objects of their own, Max doesn't free them with us : they are freed here
 void template_free(t_template *x)
 {
-    ;
+    long i;
+    
+    if (x->outq)
+        qelem_free(x->outq);
+    
+    for (i = 1; i < TEMPLATE_INLETS; i++)
+        if (x->proxy[i])
+            object_free(x->proxy[i]);
 }
 
 //Documentation shown when hovering over an inlet/outlet
@@ -244,18 +292,35 @@ void template_assist(t_template *x, void *b, long m, long a, char *s)
 //                          Inlet Handlers
 //____________________________________________________________________
 
-// posts messages upon reception
-void template_in0(t_template *x, long n)
+// called for each value through template_inlets, they run for every control message so nothing is posted or allocated
+// the left inlet is hot : it stores the value and outputs, or asks the qelem to output later
+void template_in0(t_template *x, t_atom *a)
 {
-    object_post((t_object *)x, "in 0 got : %ld", n);
-    atom_setlong(&x->val_0, n);
+    x->val_0 = *a;
+    
+    if (x->output == TEMPLATE_OUTPUT_DEFER)
+        qelem_set(x->outq);
+    else
+        template_bang(x);
 }
 
-void template_in1(t_template *x, long n)
+// the right inlet is cold : it only stores the value
+void template_in1(t_template *x, t_atom *a)
 {
-    object_post((t_object *)x, "in 1 got : %ld", n);
-    atom_setlong(&x->val_1, n);
+    x->val_1 = *a;
+}
 
+// a list sets the inlets from the one it was received in, right to left so the left (hot) inlet comes last
+void template_list(t_template *x, t_symbol *s, long ac, t_atom *av)
+{
+    long inlet = proxy_getinlet((t_object *)x);
+    long i;
+    
+    if (ac > TEMPLATE_INLETS - inlet)
+        ac = TEMPLATE_INLETS - inlet;
+    
+    for (i = ac - 1; i >= 0; i--)
+        template_inlets[inlet + i](x, av + i);
 }
 
 
@@ -272,16 +337,22 @@ void template_in1(t_template *x, long n)
  
  */
 
-//This simply copies the value of the argument to the internal storage within the instance. It stores it in one of the two values depending on which inlets the value was sent to. The bang function is then called, thus sending the values to the output
+//This simply copies the value of the argument to the internal storage within the instance. It stores it in one of the two values depending on which inlets the value was sent to, the left inlet then sends the values to the output
 void template_int(t_template *x, long n)
 {
-    template_bang(x);
+    t_atom a;
+    
+    atom_setlong(&a, n);
+    template_inlets[proxy_getinlet((t_object *)x)](x, &a);
 }
 
 // Identical to previous function, used upon reception of float values.
 void template_float(t_template *x, double f)
 {
-    template_bang(x);
+    t_atom a;
+    
+    atom_setfloat(&a, f);
+    template_inlets[proxy_getinlet((t_object *)x)](x, &a);
 }
 
 // Function called upon reception of a bang on an inlet. Outputs values.
@@ -310,10 +381,13 @@ void template_bang(t_template *x)
 //____________________________________________________________________
 //                          Perfomance Routines
 //____________________________________________________________________
+// any other message is stored as a symbol by the inlet it came in
 void template_anything(t_template *x, t_symbol *s, long ac, t_atom *av)
 {
-    atom_setsym(&x->val_0, s);
-    template_bang(x);
+    t_atom a;
+    
+    atom_setsym(&a, s);
+    template_inlets[proxy_getinlet((t_object *)x)](x, &a);
 }
 
 void template_identify(t_template *x)
@@ -28,6 +28,39 @@
  *      http://www.fftw.org/fftw3.pdf
  *
  *
+ *  This object has one signal inlet and two signal outlets, the signal is passed through the left one.
+ *  Meanwhile the input is analysed (STFT) and the newest magnitude spectrum can be polled with getspectrum.
+ *  With the onset attribute on, onsets are detected on each frame : the second outlet outputs a click (1.)
+ *  on the sample where the onset was detected, the third outlet outputs its strength.
+ *  The right outlet sends the polled spectrum as a list, or a jit_matrix message.
+ *
+ *  The frames are size samples long (a power of 2) and start every hop samples, whatever the signal vector size :
+ *  the perform routine cuts its vectors at the frame boundaries and runs as many frames as they complete.
+ *  A new size is applied when the DSP restarts, the plans are made there, never on the audio thread.
+ *
+ *  set <buffer~> loads the first channel of a buffer~ as an impulse response : the left outlet then
+ *  outputs the input convolved with it (uniformly partitioned, TEMPLATEFFTW_CONVP samples of latency).
+ *  The partitions are transformed on a worker thread and swapped in at a partition boundary, with a
+ *  crossfade over one partition when xfade is on. set without a buffer~ goes back to the passthrough.
+ *
+ *  writestate <file> saves the transformed partitions in a binary sidecar file,
+ *  readstate <file> or the state attribute (saved with the patcher) loads them back without any FFT,
+ *  the attribute waits for the first dsp64 (see State Snapshot below).
+ *
+ *  capture <slot> stores the next frame in one of the slots capture slots, freeze <slot> then resynthesizes it
+ *  on the left outlet, morph <a> <b> <t> interpolates between two slots (linear or log magnitudes, see morphmode),
+ *  unfreeze goes back to the passthrough / convolution. writestate saves the slots too.
+ *
+ *  learn [frames] averages the noise power over the next frames, the denoise attribute then resynthesizes the
+ *  input with spectral subtraction or Wiener gains on the left outlet (a freeze still wins over it). writestate
+ *  saves the profile, readstate restores it without learning again.
+ *
+ *  With the pitch attribute on (yin or mpm), each frame is also pitch tracked and "pitch <Hz> <confidence>"
+ *  goes out of the right outlet, from a clock (see Pitch Tracking below).
+ *
+ *  check compares the plans and the autocorrelation of the instance with plain references (a DFT summed in
+ *  long double, the direct autocorrelation) and posts their error (see Accuracy Check below).
+ *
  */
 
 //____________________________________________________________________
@@ -51,8 +84,131 @@
 #include "ext_obex.h"		// required for "new" style objects
 #include "z_dsp.h"			// required for MSP objects
 
+#include "jit.common.h"     // only used to write the spectrum in a jit.matrix
+#include "ext_buffer.h"     // impulse responses loaded by set
+#include "ext_systhread.h"  // the impulse responses are transformed on a worker thread
+#include "ext_path.h"       // state sidecar files
+
+#include <math.h>
+#ifndef M_PI
+#define M_PI 3.14159265358979323846     // not defined by every compiler (Visual Studio)
+#endif
+
 #include "fftw3.h"
 
+#include "../../common/lockfree.h"
+#include "../../common/arena.h"
+#include "../../common/tablecache.h"
+#include "../../common/denormal.h"
+#include "../../common/accuracy.h"  // check
+
+// STFT analysis settings, the frame size N is a power of 2 (size attribute), independent of the vector size
+#define TEMPLATEFFTW_SIZE       1024                    ///<    Default frame size
+#define TEMPLATEFFTW_MINSIZE    256                     ///<    Smallest frame size
+#define TEMPLATEFFTW_MAXSIZE    16384                   ///<    Largest frame size
+#define TEMPLATEFFTW_HOP        (TEMPLATEFFTW_SIZE / 4) ///<    Default samples between two frames
+#define TEMPLATEFFTW_MAXDISPLAY 4096                    ///<    Max bins output by getspectrum
+#define TEMPLATEFFTW_ONSETHIST  64                      ///<    Max frames used by the onset median threshold
+
+// partitioned convolution settings, the transforms are 2 * P samples long
+#define TEMPLATEFFTW_CONVP      256                     ///<    Partition size, also the latency of the convolution
+#define TEMPLATEFFTW_CONVBINS   (TEMPLATEFFTW_CONVP + 1)///<    Bins of a partition spectrum
+#define TEMPLATEFFTW_MAXPARTS   64                      ///<    Max partitions, i.e. 16384 samples of impulse response
+#define TEMPLATEFFTW_KSETS      3                       ///<    Kernel slots : live, fading out and being built
+
+#define TEMPLATEFFTW_STATEVERSION   1                   ///<    Version of the state file, in its first chunk
+
+// spectral freeze settings
+#define TEMPLATEFFTW_MAXSLOTS   16                      ///<    Max capture slots, slot + 1 fits the 5 bits of a morph request
+#define TEMPLATEFFTW_FLOOR      1e-20                   ///<    Smallest magnitude seen by the log interpolation
+
+#define TEMPLATEFFTW_LEARNFRAMES    64                  ///<    Frames averaged by learn without argument
+
+// pitch tracking settings, the lags go up to N / 2
+#define TEMPLATEFFTW_MPMK       0.9                     ///<    MPM picks the first key maximum above k times the highest
+#define TEMPLATEFFTW_MPMPEAKS   64                      ///<    Max key maxima kept by MPM
+
+// accuracy check bounds, relative to the largest bin or sample
+#define TEMPLATEFFTW_CHECKBINS  256                     ///<    Bins (or lags) compared with the O(n) references
+#define TEMPLATEFFTW_CHECKREL   1e-13                   ///<    ~log2(n) roundings of DBL_EPSILON, and a margin
+#define TEMPLATEFFTW_CHECKDB    -240.
+
+// kinds of the read-only tables shared through the table cache
+enum {
+    TABLE_WINDOW = 1,   ///<    Analysis window, variant = window type
+    TABLE_PLAN_R2C,     ///<    Real to complex forward plan, executed with fftw_execute_dft_r2c on each instance's arrays
+    TABLE_PLAN_C2R      ///<    Complex to real backward plan, executed with fftw_execute_dft_c2r
+};
+
+// window types, values of the window attribute
+enum {
+    WINDOW_HANN = 0,
+    WINDOW_HAMMING,
+    WINDOW_BLACKMAN
+};
+
+// onset detection functions, values of the onset attribute
+enum {
+    ONSET_OFF = 0,
+    ONSET_FLUX,         ///<    Spectral flux : half wave rectified magnitude increase
+    ONSET_HFC,          ///<    High frequency content : bin weighted energy
+    ONSET_COMPLEX       ///<    Complex domain : distance to the spectrum predicted from the two previous frames
+};
+
+// life of a kernel slot, each state has a single owner thread which hands the slot to the next one
+enum {
+    KERNEL_FREE = 0,    ///<    Empty, main thread
+    KERNEL_BUILDING,    ///<    Being transformed, worker thread
+    KERNEL_READY,       ///<    Published in x_kpending, audio thread picks it up at the next partition
+    KERNEL_LIVE,        ///<    Convolved by the audio thread
+    KERNEL_RETIRED      ///<    Replaced, freed on the main thread by templatefftw_kreclaim
+};
+
+// noise reduction gains, values of the denoise attribute
+enum {
+    DENOISE_OFF = 0,
+    DENOISE_SUBTRACT,   ///<    Magnitude subtraction : 1 - a sqrt(N / P)
+    DENOISE_WIENER      ///<    Wiener gain of the estimated SNR : x / (x + a), x = P / N - 1
+};
+
+// pitch trackers, values of the pitch attribute
+enum {
+    PITCH_OFF = 0,
+    PITCH_YIN,          ///<    First dip of the cumulative mean normalized difference below pitchthresh
+    PITCH_MPM           ///<    McLeod : first key maximum of the normalized square difference near the highest one
+};
+
+// arrays of a capture slot, x_freezebins doubles each
+enum {
+    FREEZE_MAG = 0,     ///<    Magnitudes
+    FREEZE_LOGMAG,      ///<    Natural log of the magnitudes (floored), for the log interpolation
+    FREEZE_ADVRE,       ///<    Phase advance over one hop, unit phasor
+    FREEZE_ADVIM,
+    FREEZE_PHRE,        ///<    Phase of the captured frame, unit phasor, starts the synthesis
+    FREEZE_PHIM,
+    FREEZE_ARRAYS
+};
+
+// array a of capture slot n
+#define FREEZE_ARRAY(x, n, a)   ((x)->x_slotdata + ((n) * FREEZE_ARRAYS + (a)) * (x)->x_freezebins)
+
+// owner of x_stdata, the spectral state read by readstate (see templatefftw_stateapply)
+enum {
+    STATE_OWNED = 0,    ///<    Main thread
+    STATE_PENDING,      ///<    Complete, the next frame (or dsp64) copies it
+    STATE_APPLYING      ///<    Being copied by the audio thread
+};
+
+// a transformed impulse response : npart spectra of TEMPLATEFFTW_CONVBINS bins
+typedef struct _templatefftw_kernel
+{
+    long            k_npart;    ///<    Number of partitions, 0 for the passthrough
+    fftw_complex    *k_parts;   ///<    Partition spectra, scaled by 1 / (2 * P) for the backward transform
+} t_templatefftw_kernel;
+
+// a set waiting for or given to the worker, defined after the object
+typedef struct _templatefftw_kjob t_templatefftw_kjob;
+
 
 //____________________________________________________________________
 //                        'Class' Definition
@@ -68,14 +224,160 @@ typedef struct _templatefftw	///<	A struct to hold data for our object
 {
     t_pxobject  x_obj;          ///<	The object itself (t_pxobject in MSP instead of t_object)
     t_float     x_val;          ///<	Value to use for the processing
-    t_bool      fftOn;          ///<    Turns on/off the FFT
+    t_int32_atomic fftOn;       ///<    FFT printout : 1 asked by dblclick, 2 frame copied to x_dump by the audio thread
+    double      *x_dump;        ///<    Input frame printed by templatefftw_basicfft, x_n samples
+    void        *x_fftclock;    ///<    Prints it from the scheduler
     void        *x_output;      ///<    Output definition
+    void        *x_spectrum;    ///<    Spectrum outlet (list or jit_matrix)
+    double      x_sr;           ///<    Sample rate, updated in dsp64
+
+    // STFT analysis, the audio thread fills x_fifo and computes a frame every x_curhop samples
+    long        x_size;         ///<    Frame size (size attribute), applied in dsp64
+    long        x_n;            ///<    Frame size of the buffers, the window and the plans
+    long        x_nbins;        ///<    Bins of the real to complex transform, x_n / 2 + 1
+    long        x_freezebins;   ///<    x_nbins rounded up to whole t_vd, length of the per bin arrays
+    long        x_maxlag;       ///<    Longest pitch period, x_n / 2
+    double      *x_fifo;        ///<    Circular input history, x_n samples
+    long        x_fifopos;      ///<    Write position in x_fifo, i.e. oldest sample
+    long        x_hop;          ///<    Samples between two frames (hop attribute)
+    long        x_curhop;       ///<    Hop of the period in progress, x_hop is only read when a frame is computed
+    long        x_hopcount;     ///<    Samples received since the last frame
+    long        x_wintype;      ///<    Window type (window attribute), applied in dsp64
+    long        x_winvariant;   ///<    Window type of x_window
+    const double *x_window;     ///<    Analysis window, shared with the other instances
+    double      x_winnorm;      ///<    Scales the magnitudes so a full scale sine reads 1.
+    double      *x_frame;       ///<    Windowed frame, input of x_plan
+    fftw_complex *x_bins;       ///<    Spectrum, output of x_plan
+    fftw_plan   x_plan;         ///<    Real to complex forward plan, shared with the other instances
+    char        *x_block;       ///<    Arena block holding x_fifo, x_frame, x_bins and the onset state
+    long        x_blocksize;    ///<    Size of x_block in bytes
+
+    // Magnitudes published by the audio thread, read by getspectrum
+    t_snapshot  x_snapshot;     ///<    Triple buffered magnitudes, x_nbins doubles per slot
+    t_atom      *x_display;     ///<    Atoms output by getspectrum
+    long        x_displaysize;  ///<    Number of atoms in x_display
+
+    // Onset detection, everything is allocated in new so the per frame path never allocates
+    long        x_onset;        ///<    Detection function (onset attribute), ONSET_OFF disables the detection
+    double      x_onsetthresh;  ///<    Constant part of the threshold (onsetthresh attribute)
+    double      x_onsetratio;   ///<    Median multiplier of the threshold (onsetratio attribute)
+    long        x_onsetwin;     ///<    Frames used by the median (onsetwin attribute)
+    double      x_onsetmin;     ///<    Min time between two onsets in ms (onsetmin attribute)
+    double      *x_prevmags;    ///<    Magnitudes of the previous frame
+    fftw_complex *x_prevphase;  ///<    Unit phasors of the two previous frames, interleaved [k][0..1] = n-1, [k][2..3] = n-2
+    double      x_onsethist[TEMPLATEFFTW_ONSETHIST];    ///<    Detection function history (circular)
+    long        x_onsethistpos; ///<    Next write position in x_onsethist
+    t_bool      x_onsetabove;   ///<    Detection function was above the threshold on the previous frame
+    long        x_onsetsince;   ///<    Samples since the last onset
+    double      x_onsetval;     ///<    Strength of the last onset, output by the clock
+    void        *x_onsetclock;  ///<    Outputs the onsets from the scheduler instead of the audio thread
+    void        *x_onsetout;    ///<    Onset outlet
+
+    // Partitioned convolution (overlap-save), the buffers are carved with the STFT ones
+    fftw_plan   x_convr2c;      ///<    2 * P forward plan, shared with the other instances
+    fftw_plan   x_convc2r;      ///<    2 * P backward plan, shared with the other instances
+    double      *x_cin;         ///<    Last two partitions of input, 2 * P samples
+    double      *x_cout;        ///<    Output of the last partition, P samples
+    double      *x_ctime[2];    ///<    Backward transforms of the live and the fading kernels, 2 * P samples each
+    fftw_complex *x_cacc;       ///<    Spectral accumulator, destroyed by the backward transform
+    fftw_complex *x_fdl;        ///<    Frequency domain delay line, TEMPLATEFFTW_MAXPARTS input spectra
+    long        x_fdlpos;       ///<    Newest spectrum in x_fdl
+    long        x_cpos;         ///<    Samples of the current partition received
+
+    // Kernel swap, see templatefftw_set
+    t_templatefftw_kernel *x_kset[TEMPLATEFFTW_KSETS];  ///<    Kernel slots, owned by the thread given by x_kstate
+    t_int32_atomic x_kstate[TEMPLATEFFTW_KSETS];        ///<    KERNEL_FREE ... KERNEL_RETIRED
+    t_int32_atomic x_kpending;  ///<    Slot + 1 of the newest READY kernel, 0 if none
+    long        x_klive;        ///<    Slot convolved by the audio thread, -1 for the passthrough
+    long        x_xfade;        ///<    Crossfades the kernels over one partition (xfade attribute)
+    t_systhread x_kthread;      ///<    Worker transforming a kernel, joined once it returned (or by free)
+    t_int32_atomic x_kbusy;     ///<    The worker is transforming, cleared by it when it returns
+    t_templatefftw_kjob *x_kjob;    ///<    Newest set waiting for the worker, main thread
+    void        *x_kclock;      ///<    Set from the audio thread and the worker when a slot retires or the worker returns
+    void        *x_kqelem;      ///<    Frees the retired slots and starts the waiting set on the main thread
+    
+    // State snapshot
+    t_symbol    *x_state;       ///<    State file restored with the patcher (state attribute)
+    long        x_stateload;    ///<    x_state is waiting for dsp64
+    double      *x_stdata;      ///<    Noise profile then capture slots read by readstate, waiting for the audio thread
+    long        x_stbins;       ///<    x_freezebins they were read for
+    long        x_stslots;      ///<    Slots in x_stdata, 0 if none
+    long        x_stlearned;    ///<    Frames the noise profile in x_stdata was learned from, 0 if none
+    t_int32_atomic x_stapply;   ///<    STATE_OWNED, STATE_PENDING or STATE_APPLYING
+    
+    // Spectral freeze, the slots and the synthesis buffers are carved with the STFT ones
+    long        x_slots;        ///<    Capture slots (slots attribute), applied in dsp64
+    long        x_slotcount;    ///<    Capture slots carved in x_block
+    long        x_morphlog;     ///<    Interpolates the log magnitudes instead of the magnitudes (morphmode attribute)
+    double      *x_slotdata;    ///<    FREEZE_ARRAYS arrays per slot
+    t_int32_atomic x_capture;   ///<    Slot + 1 to capture on the next frame, 0 if none
+    t_int32_atomic x_morph;     ///<    Packed morph request (templatefftw_morphpack), 0 for the live output
+    long        x_capslot;      ///<    Slot whose capture waits for its second frame, -1 if none
+    fftw_complex *x_capbins;    ///<    First frame of that capture
+    double      *x_phre;        ///<    Running synthesis phasors, real parts
+    double      *x_phim;        ///<    Running synthesis phasors, imaginary parts
+    fftw_complex *x_spec;       ///<    Synthesized spectrum, destroyed by the backward transform
+    double      *x_ola;         ///<    Overlap-add accumulator, x_n samples
+    double      *x_synth;       ///<    Samples output by the left outlet during this hop
+    t_bool      x_resynth;      ///<    x_synth replaces the left outlet
+    int32_t     x_morphslots;   ///<    Slot bits of the request being synthesized, the phases restart when they change
+    fftw_plan   x_iplan;        ///<    Backward plan of the frame size, shared with the other instances
+    double      x_winsq;        ///<    Sum of the squared window, normalizes the overlap-add
+    
+    // Noise reduction, the profile and the gains are carved with the STFT buffers
+    long        x_denoise;      ///<    Gain rule (denoise attribute), DENOISE_OFF keeps the left outlet as it is
+    double      x_denoiseamount;///<    Over-subtraction factor (denoiseamount attribute)
+    double      x_denoisefloor; ///<    Lowest gain (denoisefloor attribute)
+    double      x_denoisesmooth;///<    One pole coefficient of the gains over the frames (denoisesmooth attribute)
+    t_int32_atomic x_learn;     ///<    Frames to learn the profile from, 0 if no request
+    long        x_learnleft;    ///<    Frames left in the current learning
+    long        x_learntotal;   ///<    Frames of the current learning
+    double      *x_noise;       ///<    Average noise power per bin
+    double      *x_noiseacc;    ///<    Power summed while learning
+    double      *x_gains;       ///<    Smoothed gains of the previous frame
+    double      *x_graw;        ///<    Gains before the smoothing, with a guard on each side
+    void        *x_learnclock;  ///<    Posts the end of the learning from the scheduler
+    
+    // Pitch tracking, the autocorrelation goes through a 2 N transform pair (zero padded, no circular wrap)
+    long        x_pitch;        ///<    Tracker (pitch attribute), PITCH_OFF disables it
+    double      x_pitchthresh;  ///<    YIN threshold (pitchthresh attribute)
+    fftw_plan   x_acfr2c;       ///<    2 N forward plan, shared with the other instances
+    fftw_plan   x_acfc2r;       ///<    2 N backward plan, shared with the other instances
+    double      *x_acf;         ///<    Zero padded frame, then its autocorrelation, 2 N samples
+    fftw_complex *x_acfbins;    ///<    Its spectrum, then the power spectrum
+    double      *x_acfm;        ///<    Energy term m(lag) = sum of x[j]^2 + x[j + lag]^2, x_maxlag + 1
+    double      *x_acfd;        ///<    Normalized difference (YIN) or NSDF (MPM), x_maxlag + 1
+    t_snapshot  x_pitchout;     ///<    Frequency and confidence of the last frame, read by the clock
+    void        *x_pitchclock;  ///<    Outputs the pitch from the scheduler
 
 } t_templatefftw;
 
+// handed to the worker thread by templatefftw_kstart
+struct _templatefftw_kjob
+{
+    t_templatefftw  *j_x;       ///<    Owner
+    long            j_slot;     ///<    Kernel slot to fill, KERNEL_BUILDING
+    double          *j_ir;      ///<    Impulse response, j_n samples (NULL for the passthrough)
+    long            j_n;        ///<    Impulse response length
+};
+
+// header of a state file chunk, 16 bytes so the data that follows keeps the alignment of fftw_malloc
+typedef struct _templatefftw_chunk
+{
+    char            c_tag[4];   ///<    What the chunk holds, "TFWS" for the file header
+    int32_t         c_count;    ///<    Items in the chunk (partitions...), the version for the header
+    int64_t         c_size;     ///<    Bytes of data following the header, without the padding to 16
+} t_templatefftw_chunk;
+
 // global pointer to our class definition that is setup in main()
 static t_class *templatefftw_class = NULL;
 
+// arena shared by all the instances, holds their DSP buffers and the shared windows
+static t_arena *templatefftw_arena = NULL;
+
+// windows and plans shared by all the instances
+static t_tablecache *templatefftw_cache = NULL;
+
 
 
 
@@ -88,6 +390,12 @@ static t_class *templatefftw_class = NULL;
 void *templatefftw_new( t_symbol *s, long argc, t_atom *argv);
 void templatefftw_free( t_templatefftw *x);
 void templatefftw_assist(t_templatefftw *x, void *b, long m, long a, char *s);
+long templatefftw_alloc(t_templatefftw *x);
+long templatefftw_acquire(t_templatefftw *x);
+void *templatefftw_tablecreate(long kind, long size, long variant);
+void templatefftw_windowdestroy(void *table);
+void templatefftw_plandestroy(void *table);
+t_max_err templatefftw_size_set(t_templatefftw *x, void *attr, long argc, t_atom *argv);
 
 //// value specific
 void templatefftw_float(t_templatefftw *x, double f);
@@ -100,8 +408,76 @@ void templatefftw_in0( t_templatefftw *x, long n);      //1st inlet
 //// performance set
 void templatefftw_dsp64(t_templatefftw *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
 void templatefftw_perform64(t_templatefftw *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
-void templatefftw_basicfft(t_templatefftw *x, long N, double **ins);
+void templatefftw_basicfft(t_templatefftw *x, long N, const double *in);
 void templatefftw_dblclick(t_templatefftw *x);
+void templatefftw_ffttick(t_templatefftw *x);
+void templatefftw_tables(t_templatefftw *x);
+
+//// spectrum analysis
+long templatefftw_frame(t_templatefftw *x, long hop);
+void templatefftw_getspectrum(t_templatefftw *x, t_symbol *s, long argc, t_atom *argv);
+long templatefftw_decimate(t_templatefftw *x, double *mags, double *dest, long nbins);
+
+//// onset detection
+long templatefftw_onset(t_templatefftw *x, double *mags);
+double templatefftw_median(double *hist, long pos, long n);
+void templatefftw_onsettick(t_templatefftw *x);
+
+//// partitioned convolution
+void templatefftw_set(t_templatefftw *x, t_symbol *s, long argc, t_atom *argv);
+void *templatefftw_kbuild(t_templatefftw_kjob *job);
+long templatefftw_kstart(t_templatefftw *x);
+void templatefftw_kidle(t_templatefftw *x);
+void templatefftw_kjobfree(t_templatefftw_kjob *job);
+void templatefftw_kretire(t_templatefftw *x, long slot);
+void templatefftw_ktick(t_templatefftw *x);
+void templatefftw_kreclaim(t_templatefftw *x);
+void templatefftw_kfree(t_templatefftw_kernel *k);
+void templatefftw_convolve(t_templatefftw *x, double *in, double *out, long n);
+void templatefftw_partition(t_templatefftw *x);
+void templatefftw_kernelconv(t_templatefftw *x, t_templatefftw_kernel *k, double *time);
+long templatefftw_kslot(t_templatefftw *x);
+void templatefftw_kpublish(t_templatefftw *x, long slot, t_templatefftw_kernel *k);
+
+//// state snapshot
+t_max_err templatefftw_state_set(t_templatefftw *x, void *attr, long argc, t_atom *argv);
+void templatefftw_writestate(t_templatefftw *x, t_symbol *s);
+void templatefftw_readstate(t_templatefftw *x, t_symbol *s);
+long templatefftw_statesave(t_templatefftw *x, t_symbol *name);
+long templatefftw_stateload(t_templatefftw *x, t_symbol *name);
+long templatefftw_chunkwrite(t_filehandle fh, const char *tag, long count, long size, const void *data);
+void templatefftw_stateclaim(t_templatefftw *x);
+long templatefftw_stateapply(t_templatefftw *x);
+
+//// spectral freeze
+void templatefftw_capture(t_templatefftw *x, long slot);
+void templatefftw_freeze(t_templatefftw *x, long slot);
+void templatefftw_morph(t_templatefftw *x, t_symbol *s, long argc, t_atom *argv);
+void templatefftw_unfreeze(t_templatefftw *x);
+int32_t templatefftw_morphpack(long a, long b, double t);
+long templatefftw_freezeframe(t_templatefftw *x, long hop);
+void templatefftw_capturestore(t_templatefftw *x, long slot);
+void templatefftw_synthesize(t_templatefftw *x, long a, long b, double t, long hop);
+void templatefftw_overlapadd(t_templatefftw *x, long hop);
+
+//// noise reduction
+void templatefftw_learn(t_templatefftw *x, long frames);
+void templatefftw_learnframe(t_templatefftw *x);
+long templatefftw_denoise(t_templatefftw *x, long hop);
+t_vd templatefftw_power(const double *bins);
+void templatefftw_learntick(t_templatefftw *x);
+
+//// pitch tracking
+void templatefftw_pitchframe(t_templatefftw *x);
+double templatefftw_yin(t_templatefftw *x, double *conf);
+double templatefftw_mpm(t_templatefftw *x, double *conf);
+double templatefftw_parabola(double *y, long i, double *peak);
+void templatefftw_pitchtick(t_templatefftw *x);
+
+//// accuracy check
+void templatefftw_check(t_templatefftw *x);
+long templatefftw_checkplans(t_templatefftw *x, fftw_plan r2c, fftw_plan c2r, long n, const char *name);
+long templatefftw_checkacf(t_templatefftw *x);
 
 
 
@@ -125,12 +501,12 @@ void ext_main(void *r)
 {
     // object initialization, note the use of dsp_free for the freemethod, which is required
     // unless you need to free allocated memory, in which case you should call dsp_free from
-    // your custom free function.
+    // your custom free function. We allocate the STFT buffers, so templatefftw_free calls dsp_free.
     
-    // creates a class with the new instance routine (see below), a free function (in this case there isn't one, so we pass NULL), the size of the structure, a no-longer used argument, and then a description of the arguments you type when creating an instance (in this case, there are no arguments, so we pass 0).
+    // creates a class with the new instance routine (see below), a free function, the size of the structure, a no-longer used argument, and then a description of the arguments you type when creating an instance (in this case, there are no arguments, so we pass 0).
     t_class *c;
     
-    c = class_new("templatefftw~", (method)templatefftw_new, (method)dsp_free, (long)sizeof(t_templatefftw), 0L, A_GIMME, 0);
+    c = class_new("templatefftw~", (method)templatefftw_new, (method)templatefftw_free, (long)sizeof(t_templatefftw), 0L, A_GIMME, 0);
     
     //binds a C function to a text symbol.
     class_addmethod(c, (method)templatefftw_bang,       "bang",             0);
@@ -147,6 +523,70 @@ void ext_main(void *r)
     // A_CANT   used when we cannot type check the argument
     class_addmethod(c, (method)templatefftw_in0,        "int",      A_LONG, 0);
     class_addmethod(c, (method)templatefftw_dblclick,   "dblclick", A_CANT, 0);
+    class_addmethod(c, (method)templatefftw_getspectrum,"getspectrum", A_GIMME, 0);
+    class_addmethod(c, (method)templatefftw_tables,     "tables",           0);
+    class_addmethod(c, (method)templatefftw_set,        "set",      A_GIMME, 0);
+    class_addmethod(c, (method)templatefftw_writestate, "writestate", A_DEFSYM, 0);
+    class_addmethod(c, (method)templatefftw_readstate,  "readstate",  A_DEFSYM, 0);
+    class_addmethod(c, (method)templatefftw_capture,    "capture",  A_LONG, 0);
+    class_addmethod(c, (method)templatefftw_freeze,     "freeze",   A_LONG, 0);
+    class_addmethod(c, (method)templatefftw_morph,      "morph",    A_GIMME, 0);
+    class_addmethod(c, (method)templatefftw_unfreeze,   "unfreeze",         0);
+    class_addmethod(c, (method)templatefftw_learn,      "learn",    A_DEFLONG, 0);
+    class_addmethod(c, (method)templatefftw_check,      "check",            0);
+    
+    CLASS_ATTR_LONG(c, "window", 0, t_templatefftw, x_wintype);
+    CLASS_ATTR_ENUMINDEX(c, "window", 0, "hann hamming blackman");
+    CLASS_ATTR_LABEL(c, "window", 0, "Analysis Window (applied when DSP restarts)");
+    
+    CLASS_ATTR_LONG(c, "size", 0, t_templatefftw, x_size);
+    CLASS_ATTR_ACCESSORS(c, "size", NULL, templatefftw_size_set);
+    CLASS_ATTR_LABEL(c, "size", 0, "Frame Size (applied when DSP restarts)");
+    
+    CLASS_ATTR_LONG(c, "hop", 0, t_templatefftw, x_hop);
+    CLASS_ATTR_FILTER_CLIP(c, "hop", 16, TEMPLATEFFTW_MAXSIZE);
+    CLASS_ATTR_LABEL(c, "hop", 0, "Samples Between Frames (at most the frame size)");
+    
+    CLASS_ATTR_LONG(c, "onset", 0, t_templatefftw, x_onset);
+    CLASS_ATTR_ENUMINDEX(c, "onset", 0, "off flux hfc complex");
+    CLASS_ATTR_DOUBLE(c, "onsetthresh", 0, t_templatefftw, x_onsetthresh);
+    CLASS_ATTR_FILTER_MIN(c, "onsetthresh", 0.);
+    CLASS_ATTR_DOUBLE(c, "onsetratio", 0, t_templatefftw, x_onsetratio);
+    CLASS_ATTR_FILTER_MIN(c, "onsetratio", 0.);
+    CLASS_ATTR_LONG(c, "onsetwin", 0, t_templatefftw, x_onsetwin);
+    CLASS_ATTR_FILTER_CLIP(c, "onsetwin", 1, TEMPLATEFFTW_ONSETHIST);
+    CLASS_ATTR_DOUBLE(c, "onsetmin", 0, t_templatefftw, x_onsetmin);
+    CLASS_ATTR_FILTER_MIN(c, "onsetmin", 0.);
+    
+    CLASS_ATTR_LONG(c, "xfade", 0, t_templatefftw, x_xfade);
+    CLASS_ATTR_STYLE_LABEL(c, "xfade", 0, "onoff", "Crossfade Kernel Changes");
+    
+    CLASS_ATTR_SYM(c, "state", 0, t_templatefftw, x_state);
+    CLASS_ATTR_ACCESSORS(c, "state", NULL, templatefftw_state_set);
+    CLASS_ATTR_SAVE(c, "state", 0);
+    CLASS_ATTR_LABEL(c, "state", 0, "State File (restored when DSP starts)");
+    
+    CLASS_ATTR_LONG(c, "slots", 0, t_templatefftw, x_slots);
+    CLASS_ATTR_FILTER_CLIP(c, "slots", 1, TEMPLATEFFTW_MAXSLOTS);
+    CLASS_ATTR_LABEL(c, "slots", 0, "Capture Slots (applied when DSP restarts)");
+    
+    CLASS_ATTR_LONG(c, "morphmode", 0, t_templatefftw, x_morphlog);
+    CLASS_ATTR_ENUMINDEX(c, "morphmode", 0, "linear log");
+    CLASS_ATTR_LABEL(c, "morphmode", 0, "Magnitude Interpolation");
+    
+    CLASS_ATTR_LONG(c, "denoise", 0, t_templatefftw, x_denoise);
+    CLASS_ATTR_ENUMINDEX(c, "denoise", 0, "off subtract wiener");
+    CLASS_ATTR_DOUBLE(c, "denoiseamount", 0, t_templatefftw, x_denoiseamount);
+    CLASS_ATTR_FILTER_MIN(c, "denoiseamount", 0.);
+    CLASS_ATTR_DOUBLE(c, "denoisefloor", 0, t_templatefftw, x_denoisefloor);
+    CLASS_ATTR_FILTER_CLIP(c, "denoisefloor", 0., 1.);
+    CLASS_ATTR_DOUBLE(c, "denoisesmooth", 0, t_templatefftw, x_denoisesmooth);
+    CLASS_ATTR_FILTER_CLIP(c, "denoisesmooth", 0., 0.99);
+    
+    CLASS_ATTR_LONG(c, "pitch", 0, t_templatefftw, x_pitch);
+    CLASS_ATTR_ENUMINDEX(c, "pitch", 0, "off yin mpm");
+    CLASS_ATTR_DOUBLE(c, "pitchthresh", 0, t_templatefftw, x_pitchthresh);
+    CLASS_ATTR_FILTER_CLIP(c, "pitchthresh", 0., 1.);
     
     // if the filename on disk is different from the object name in Max, ex. w/ times
 //  class_setname("*~","times~");
@@ -160,6 +600,10 @@ void ext_main(void *r)
     //assign the class we've created to a global variable so we can use it when creating new instances.
     templatefftw_class = c;
     
+    // live as long as the class, chunks and tables are freed with their last user
+    templatefftw_arena  = arena_new();
+    templatefftw_cache  = tablecache_new();
+    
 }
 
 
@@ -179,19 +623,336 @@ void *templatefftw_new(t_symbol *s, long argc, t_atom *argv)
     //Setup 1 inlet for our object
     dsp_setup((t_pxobject *)x, 1);
     
-    //Give our object a signal outlet
+    // outlets are created from right to left, the spectrum outlet is the rightmost one
+    x->x_spectrum = outlet_new((t_object *)x, NULL);    //NULL indicates the outlet will be used to send various messages
+    x->x_onsetout = floatout((t_object *)x);
+    
+    //Give our object two signal outlets, the signal and the onset clicks
+    outlet_new((t_pxobject *)x, "signal");
     outlet_new((t_pxobject *)x, "signal");
     
+    // the click outlet is cleared before the input is read, so inputs and outputs can't share memory
+    x->x_obj.z_misc |= Z_NO_INPLACE;
+    
     // splatted in _dsp method if optimizations are on
     x->x_val = argc;
+    x->x_sr  = sys_getsr();
+    x->x_size = TEMPLATEFFTW_SIZE;
+    x->x_hop = TEMPLATEFFTW_HOP;
+    x->x_fftclock = clock_new(x, (method)templatefftw_ffttick);
+    
+    x->x_onset       = ONSET_OFF;
+    x->x_onsetthresh = 0.05;
+    x->x_onsetratio  = 1.5;
+    x->x_onsetwin    = 16;
+    x->x_onsetmin    = 50.;
+    x->x_onsetclock  = clock_new(x, (method)templatefftw_onsettick);
+    
+    x->x_klive   = -1;
+    x->x_xfade   = 1;
+    x->x_kclock  = clock_new(x, (method)templatefftw_ktick);
+    x->x_kqelem  = qelem_new(x, (method)templatefftw_kidle);
+    
+    x->x_slots   = 8;
+    x->x_capslot = -1;
+    
+    x->x_denoiseamount = 1.;
+    x->x_denoisefloor  = 0.1;
+    x->x_denoisesmooth = 0.5;
+    x->x_learnclock    = clock_new(x, (method)templatefftw_learntick);
+    
+    x->x_pitchthresh = 0.15;
+    x->x_pitchclock  = clock_new(x, (method)templatefftw_pitchtick);
+    
+    // attributes typed in the box, e.g. [templatefftw~ @onset flux @hop 128]
+    attr_args_process(x, (short)argc, argv);
+    
+    // the window and the plan are shared by the instances of the same size, the DSP buffers are carved from the arena in dsp64
+    if (templatefftw_acquire(x) || snapshot_new(&x->x_pitchout, 2 * sizeof(double))) {
+        object_error((t_object *)x, "out of memory");
+        object_free(x);     // calls templatefftw_free
+        return NULL;
+    }
     
     return (x);
 }
 
-// NOT CALLED!, we use dsp_free for a generic free function
+// called when the object is deleted, dsp_free must be called first to remove the object from the DSP chain
 void templatefftw_free(t_templatefftw *x)
 {
-    ;
+    long i;
+    
+    dsp_free((t_pxobject *)x);
+    
+    if (x->x_fftclock)
+        object_free(x->x_fftclock);
+    if (x->x_onsetclock)
+        object_free(x->x_onsetclock);
+    if (x->x_learnclock)
+        object_free(x->x_learnclock);
+    if (x->x_pitchclock)
+        object_free(x->x_pitchclock);
+    
+    // out of the DSP chain and the worker done, every kernel slot is ours
+    if (x->x_kthread)
+        systhread_join(x->x_kthread, NULL);
+    templatefftw_kjobfree(x->x_kjob);
+    if (x->x_kclock)
+        object_free(x->x_kclock);
+    if (x->x_kqelem)
+        qelem_free(x->x_kqelem);
+    for (i = 0; i < TEMPLATEFFTW_KSETS; i++)
+        templatefftw_kfree(x->x_kset[i]);
+    if (x->x_stdata)
+        sysmem_freeptr(x->x_stdata);
+    
+    arena_free(templatefftw_arena, x->x_block);
+    tablecache_release(templatefftw_cache, x->x_window);
+    tablecache_release(templatefftw_cache, x->x_plan);
+    tablecache_release(templatefftw_cache, x->x_convr2c);
+    tablecache_release(templatefftw_cache, x->x_convc2r);
+    tablecache_release(templatefftw_cache, x->x_iplan);
+    tablecache_release(templatefftw_cache, x->x_acfr2c);
+    tablecache_release(templatefftw_cache, x->x_acfc2r);
+    
+    snapshot_free(&x->x_snapshot);
+    snapshot_free(&x->x_pitchout);
+    
+    if (x->x_display)
+        sysmem_freeptr(x->x_display);
+}
+
+// (re)carves the DSP buffers from the arena, called by dsp64 so the sizes can follow the DSP settings
+// the block is kept when its size doesn't change. Returns 0 on success
+long templatefftw_alloc(t_templatefftw *x)
+{
+    char    *cursor;
+    long    size = 0;
+    long    i, n;
+    
+    // first pass adds up the size, the second one hands out the buffers
+    arena_carve(NULL, &size, sizeof(double) * x->x_n);                  // x_fifo
+    arena_carve(NULL, &size, sizeof(double) * x->x_n);                  // x_frame
+    arena_carve(NULL, &size, sizeof(fftw_complex) * x->x_freezebins);   // x_bins, the padding bin stays 0
+    arena_carve(NULL, &size, sizeof(double) * x->x_nbins);              // x_prevmags
+    arena_carve(NULL, &size, sizeof(fftw_complex) * 2 * x->x_nbins);    // x_prevphase
+    arena_carve(NULL, &size, sizeof(double) * 2 * TEMPLATEFFTW_CONVP);          // x_cin
+    arena_carve(NULL, &size, sizeof(double) * TEMPLATEFFTW_CONVP);              // x_cout
+    arena_carve(NULL, &size, sizeof(double) * 4 * TEMPLATEFFTW_CONVP);          // x_ctime
+    arena_carve(NULL, &size, sizeof(fftw_complex) * TEMPLATEFFTW_CONVBINS);     // x_cacc
+    arena_carve(NULL, &size, sizeof(fftw_complex) * TEMPLATEFFTW_MAXPARTS * TEMPLATEFFTW_CONVBINS);  // x_fdl
+    arena_carve(NULL, &size, sizeof(double) * x->x_slots * FREEZE_ARRAYS * x->x_freezebins); // x_slotdata
+    arena_carve(NULL, &size, sizeof(fftw_complex) * x->x_nbins);        // x_capbins
+    arena_carve(NULL, &size, sizeof(double) * 2 * x->x_freezebins);     // x_phre, x_phim
+    arena_carve(NULL, &size, sizeof(fftw_complex) * x->x_freezebins);   // x_spec
+    arena_carve(NULL, &size, sizeof(double) * 2 * x->x_n);              // x_ola, x_synth
+    arena_carve(NULL, &size, sizeof(double) * 3 * x->x_freezebins);     // x_noise, x_noiseacc, x_gains
+    arena_carve(NULL, &size, sizeof(double) * (x->x_freezebins + 2));   // x_graw
+    arena_carve(NULL, &size, sizeof(double) * 2 * x->x_n);              // x_acf
+    arena_carve(NULL, &size, sizeof(fftw_complex) * (x->x_n + 2));      // x_acfbins, N + 1 rounded up to whole t_vd
+    arena_carve(NULL, &size, sizeof(double) * 2 * (x->x_maxlag + 1));   // x_acfm, x_acfd
+    arena_carve(NULL, &size, sizeof(double) * x->x_n);                  // x_dump
+    
+    if (x->x_block && x->x_blocksize == size)
+        return 0;
+    
+    arena_free(templatefftw_arena, x->x_block);
+    
+    x->x_block = (char *) arena_alloc(templatefftw_arena, size);
+    x->x_blocksize = x->x_block ? size : 0;
+    if (!x->x_block)
+        return 1;
+    
+    cursor = x->x_block;
+    x->x_fifo      = (double *)       arena_carve(&cursor, NULL, sizeof(double) * x->x_n);
+    x->x_frame     = (double *)       arena_carve(&cursor, NULL, sizeof(double) * x->x_n);
+    x->x_bins      = (fftw_complex *) arena_carve(&cursor, NULL, sizeof(fftw_complex) * x->x_freezebins);
+    x->x_prevmags  = (double *)       arena_carve(&cursor, NULL, sizeof(double) * x->x_nbins);
+    x->x_prevphase = (fftw_complex *) arena_carve(&cursor, NULL, sizeof(fftw_complex) * 2 * x->x_nbins);
+    x->x_cin       = (double *)       arena_carve(&cursor, NULL, sizeof(double) * 2 * TEMPLATEFFTW_CONVP);
+    x->x_cout      = (double *)       arena_carve(&cursor, NULL, sizeof(double) * TEMPLATEFFTW_CONVP);
+    x->x_ctime[0]  = (double *)       arena_carve(&cursor, NULL, sizeof(double) * 4 * TEMPLATEFFTW_CONVP);
+    x->x_ctime[1]  = x->x_ctime[0] + 2 * TEMPLATEFFTW_CONVP;
+    x->x_cacc      = (fftw_complex *) arena_carve(&cursor, NULL, sizeof(fftw_complex) * TEMPLATEFFTW_CONVBINS);
+    x->x_fdl       = (fftw_complex *) arena_carve(&cursor, NULL, sizeof(fftw_complex) * TEMPLATEFFTW_MAXPARTS * TEMPLATEFFTW_CONVBINS);
+    x->x_slotdata  = (double *)       arena_carve(&cursor, NULL, sizeof(double) * x->x_slots * FREEZE_ARRAYS * x->x_freezebins);
+    x->x_capbins   = (fftw_complex *) arena_carve(&cursor, NULL, sizeof(fftw_complex) * x->x_nbins);
+    x->x_phre      = (double *)       arena_carve(&cursor, NULL, sizeof(double) * 2 * x->x_freezebins);
+    x->x_phim      = x->x_phre + x->x_freezebins;
+    x->x_spec      = (fftw_complex *) arena_carve(&cursor, NULL, sizeof(fftw_complex) * x->x_freezebins);
+    x->x_ola       = (double *)       arena_carve(&cursor, NULL, sizeof(double) * 2 * x->x_n);
+    x->x_synth     = x->x_ola + x->x_n;
+    x->x_noise     = (double *)       arena_carve(&cursor, NULL, sizeof(double) * 3 * x->x_freezebins);
+    x->x_noiseacc  = x->x_noise + x->x_freezebins;
+    x->x_gains     = x->x_noiseacc + x->x_freezebins;
+    x->x_graw      = (double *)       arena_carve(&cursor, NULL, sizeof(double) * (x->x_freezebins + 2));
+    x->x_acf       = (double *)       arena_carve(&cursor, NULL, sizeof(double) * 2 * x->x_n);
+    x->x_acfbins   = (fftw_complex *) arena_carve(&cursor, NULL, sizeof(fftw_complex) * (x->x_n + 2));
+    x->x_acfm      = (double *)       arena_carve(&cursor, NULL, sizeof(double) * 2 * (x->x_maxlag + 1));
+    x->x_acfd      = x->x_acfm + x->x_maxlag + 1;
+    x->x_dump      = (double *)       arena_carve(&cursor, NULL, sizeof(double) * x->x_n);
+    x->x_slotcount = x->x_slots;
+    
+    // the block comes zeroed, only the phasors need a value (empty slots resynthesize silence)
+    for (i = 0; i < 2 * x->x_nbins; i++)
+        x->x_prevphase[i][0] = 1.;
+    for (n = 0; n < x->x_slotcount; n++)
+        for (i = 0; i < x->x_freezebins; i++) {
+            FREEZE_ARRAY(x, n, FREEZE_LOGMAG)[i] = log(TEMPLATEFFTW_FLOOR);
+            FREEZE_ARRAY(x, n, FREEZE_ADVRE)[i] = 1.;
+            FREEZE_ARRAY(x, n, FREEZE_PHRE)[i] = 1.;
+        }
+    for (i = 0; i < x->x_freezebins; i++) {
+        x->x_phre[i] = 1.;
+        x->x_gains[i] = 1.;
+    }
+    x->x_learnleft = 0;
+    x->x_fifopos = 0;
+    x->x_fdlpos = 0;
+    x->x_cpos = 0;
+    
+    return 0;
+}
+
+// gets the window and the plan from the table cache, called by new and dsp64 (the window or the size attribute may
+// have changed) : the audio thread never plans. Returns 0 on success
+long templatefftw_acquire(t_templatefftw *x)
+{
+    const double    *w;
+    long            i;
+    
+    // a new frame size drops the tables of the old one, the buffers follow in templatefftw_alloc
+    if (x->x_n != x->x_size) {
+        tablecache_release(templatefftw_cache, x->x_window);
+        tablecache_release(templatefftw_cache, x->x_plan);
+        tablecache_release(templatefftw_cache, x->x_iplan);
+        tablecache_release(templatefftw_cache, x->x_acfr2c);
+        tablecache_release(templatefftw_cache, x->x_acfc2r);
+        x->x_window = NULL;
+        x->x_plan = x->x_iplan = x->x_acfr2c = x->x_acfc2r = NULL;
+        
+        x->x_n = x->x_size;
+        x->x_nbins = x->x_n / 2 + 1;
+        x->x_freezebins = x->x_nbins + 1;
+        x->x_maxlag = x->x_n / 2;
+        
+        // getspectrum reads the magnitudes from the main thread, like us
+        snapshot_free(&x->x_snapshot);
+        if (snapshot_new(&x->x_snapshot, x->x_nbins * sizeof(double)))
+            return 1;
+    }
+    
+    if (!x->x_window || x->x_winvariant != x->x_wintype) {
+        w = (const double *) tablecache_acquire(templatefftw_cache, TABLE_WINDOW, x->x_n, x->x_wintype,
+                                                templatefftw_tablecreate, templatefftw_windowdestroy);
+        if (!w)
+            return 1;
+        
+        tablecache_release(templatefftw_cache, x->x_window);
+        x->x_window = w;
+        x->x_winvariant = x->x_wintype;
+        
+        // the sum of the window normalizes the magnitudes, the sum of its square the overlap-add
+        x->x_winnorm = 0.;
+        x->x_winsq = 0.;
+        for (i = 0; i < x->x_n; i++) {
+            x->x_winnorm += w[i];
+            x->x_winsq += w[i] * w[i];
+        }
+        x->x_winnorm = 2. / x->x_winnorm;
+    }
+    
+    if (!x->x_plan)
+        x->x_plan = (fftw_plan) tablecache_acquire(templatefftw_cache, TABLE_PLAN_R2C, x->x_n, 0,
+                                                   templatefftw_tablecreate, templatefftw_plandestroy);
+    if (!x->x_convr2c)
+        x->x_convr2c = (fftw_plan) tablecache_acquire(templatefftw_cache, TABLE_PLAN_R2C, 2 * TEMPLATEFFTW_CONVP, 0,
+                                                      templatefftw_tablecreate, templatefftw_plandestroy);
+    if (!x->x_convc2r)
+        x->x_convc2r = (fftw_plan) tablecache_acquire(templatefftw_cache, TABLE_PLAN_C2R, 2 * TEMPLATEFFTW_CONVP, 0,
+                                                      templatefftw_tablecreate, templatefftw_plandestroy);
+    if (!x->x_iplan)
+        x->x_iplan = (fftw_plan) tablecache_acquire(templatefftw_cache, TABLE_PLAN_C2R, x->x_n, 0,
+                                                    templatefftw_tablecreate, templatefftw_plandestroy);
+    if (!x->x_acfr2c)
+        x->x_acfr2c = (fftw_plan) tablecache_acquire(templatefftw_cache, TABLE_PLAN_R2C, 2 * x->x_n, 0,
+                                                     templatefftw_tablecreate, templatefftw_plandestroy);
+    if (!x->x_acfc2r)
+        x->x_acfc2r = (fftw_plan) tablecache_acquire(templatefftw_cache, TABLE_PLAN_C2R, 2 * x->x_n, 0,
+                                                     templatefftw_tablecreate, templatefftw_plandestroy);
+    
+    return x->x_plan && x->x_convr2c && x->x_convc2r && x->x_iplan && x->x_acfr2c && x->x_acfc2r ? 0 : 1;
+}
+
+// builds the tables shared through the cache, called once per kind/size/variant (under the cache mutex)
+void *templatefftw_tablecreate(long kind, long size, long variant)
+{
+    double      *w;
+    double      *in;
+    fftw_complex *out;
+    fftw_plan   p;
+    double      a;
+    long        i;
+    
+    switch (kind) {
+        case TABLE_WINDOW:
+            // periodic windows, the ends don't both go to 0 so overlapping frames sum to a constant
+            w = (double *) arena_alloc(templatefftw_arena, sizeof(double) * size);
+            if (!w)
+                return NULL;
+            for (i = 0; i < size; i++) {
+                a = 2. * M_PI * i / size;
+                switch (variant) {
+                    case WINDOW_HAMMING:    w[i] = 0.54 - 0.46 * cos(a); break;
+                    case WINDOW_BLACKMAN:   w[i] = 0.42 - 0.5 * cos(a) + 0.08 * cos(2. * a); break;
+                    default:                w[i] = 0.5 - 0.5 * cos(a); break;
+                }
+            }
+            return w;
+            
+        case TABLE_PLAN_R2C:
+            // FFTW_ESTIMATE doesn't touch the arrays, they only give the plan its alignment (fftw_malloc's, the arena's is stricter)
+            in  = (double *) fftw_malloc(sizeof(double) * size);
+            out = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * (size / 2 + 1));
+            p = (in && out) ? fftw_plan_dft_r2c_1d((int)size, in, out, FFTW_ESTIMATE) : NULL;
+            fftw_free(in);
+            fftw_free(out);
+            return p;
+            
+        case TABLE_PLAN_C2R:
+            in  = (double *) fftw_malloc(sizeof(double) * size);
+            out = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * (size / 2 + 1));
+            p = (in && out) ? fftw_plan_dft_c2r_1d((int)size, out, in, FFTW_ESTIMATE) : NULL;
+            fftw_free(in);
+            fftw_free(out);
+            return p;
+            
+        default:
+            return NULL;
+    }
+}
+
+void templatefftw_windowdestroy(void *table)
+{
+    arena_free(templatefftw_arena, table);
+}
+
+void templatefftw_plandestroy(void *table)
+{
+    fftw_destroy_plan((fftw_plan)table);
+}
+
+// the frame size is a power of 2 between TEMPLATEFFTW_MINSIZE and TEMPLATEFFTW_MAXSIZE
+t_max_err templatefftw_size_set(t_templatefftw *x, void *attr, long argc, t_atom *argv)
+{
+    long want = argc ? (long)atom_getlong(argv) : TEMPLATEFFTW_SIZE;
+    long n = TEMPLATEFFTW_MINSIZE;
+    
+    while (n < want && n < TEMPLATEFFTW_MAXSIZE)
+        n <<= 1;
+    x->x_size = n;
+    
+    return MAX_ERR_NONE;
 }
 
 //Documentation shown when hovering over an inlet/outlet
@@ -201,13 +962,16 @@ void templatefftw_assist(t_templatefftw *x, void *b, long m, long a, char *s)
     if (m == ASSIST_INLET) {
         //inlet
         switch (a){
-            case 0: sprintf(s, "(Signal) Input; gets signal"); break;
+            case 0: sprintf(s, "(Signal) Input; gets signal, set [buffer~] loads an impulse response"); break;
         }
     }
     else if (m == ASSIST_OUTLET) {
         // outlet
         switch (a){
-            case 0: sprintf(s, "(Signal) Output; passes signal"); break;
+            case 0: sprintf(s, "(Signal) Output; passes, convolves or resynthesizes signal"); break;
+            case 1: sprintf(s, "(Signal) Onset clicks"); break;
+            case 2: sprintf(s, "(Float) Onset strength"); break;
+            case 3: sprintf(s, "(List) Spectrum; output by getspectrum, pitch <Hz> <confidence>"); break;
         }
     }
 }
@@ -255,10 +1019,23 @@ void templatefftw_bang(t_templatefftw *x)
     object_post((t_object *)x, "value is %ld",x->x_val);
 }
 
+// the next frame's input is copied by the audio thread, the clock prints its transform (see templatefftw_basicfft)
 void templatefftw_dblclick(t_templatefftw *x)
 {
+    if (lockfree_load(&x->fftOn))
+        return;
+    
     object_post((t_object *)x, "about to fft");
-    x-> fftOn = true;
+    lockfree_store(&x->fftOn, 1);
+}
+
+// posts how many tables the instances share, and how many were built since the class was loaded
+void templatefftw_tables(t_templatefftw *x)
+{
+    long built;
+    long live = tablecache_count(templatefftw_cache, &built);
+    
+    object_post((t_object *)x, "%ld shared tables, %ld built", live, built);
 }
 
 // Note object_post will print text to the Max window, it is linked to an instance of your object
@@ -279,6 +1056,32 @@ void templatefftw_dsp64(t_templatefftw *x, t_object *dsp64, short *count, double
 {
     object_post((t_object *)x, "my sample rate is: %f", samplerate);
     
+    x->x_sr = samplerate;
+    x->x_hopcount = 0;
+    lockfree_store(&x->fftOn, 0);
+    x->x_onsetsince = 0;
+    x->x_onsetabove = false;
+    x->x_resynth = false;
+    x->x_morphslots = 0;
+    x->x_capslot = -1;
+    
+    // the size attribute is applied here, on the main thread : new plans and buffers, whatever the vector size
+    if (templatefftw_acquire(x) || templatefftw_alloc(x)) {
+        object_error((t_object *)x, "out of memory, not added to the DSP chain");
+        return;
+    }
+    x->x_curhop = x->x_hop < x->x_n ? x->x_hop : x->x_n;
+    
+    // the state file named in the patcher is only read once the DSP needs it
+    if (x->x_stateload) {
+        x->x_stateload = 0;
+        templatefftw_stateload(x, x->x_state);
+    }
+    
+    // the audio thread is stopped, a state read earlier goes in the new buffers now
+    if (templatefftw_stateapply(x) < 0)
+        object_warn((t_object *)x, "the captures and noise profile read by readstate are for another frame size, dropped");
+    
     /* 
         instead of calling dsp_add(), we send the "dsp_add64" message to the object representing the dsp chain
      the arguments passed are:
@@ -298,27 +1101,51 @@ void templatefftw_dsp64(t_templatefftw *x, t_object *dsp64, short *count, double
 /*
  The perform routine is not a "method" in the traditional sense. It will be called within the callback of an audio driver, which, unless the user is employing the Non-Real Time audio driver, will typically be in a high-priority thread. Thread protection inside the perform routine is minimal. You can use a clock, but you cannot use qelems or outlets.
  */
-void templatefftw_perform64(t_templatefftw *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+static void templatefftw_process64(t_templatefftw *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
 {
     t_double *in = ins[0];     // we get audio for each inlet of the object from the **ins argument
     t_double *out = outs[0];    // we get audio for each outlet of the object from the **outs argument
-    t_double ftmp;
+    t_double *click = outs[1];
+    long hop = x->x_curhop;     // x_synth holds the output of this many samples
+    long n, i;
 
-    if (x->fftOn) {
-        templatefftw_basicfft(x, 256, ins);
-        object_post((t_object *)x, "i just ffted");
-        x->fftOn = false;
-    }
+    memset(click, 0, sampleframes * sizeof(double));
+    
+    // the input is convolved with the live kernel, or copied without one, the wrapper below checks it for NaN
+    templatefftw_convolve(x, in, out, sampleframes);
     
-    // this perform method simply copies the input to the output, offsetting the value
-    while (sampleframes--) {
-        //  mult two signals
-        ftmp = *in++;
-        FIX_DENORM_NAN_DOUBLE(ftmp);
-        *out++ = ftmp;
+    // feed the STFT history, a frame is computed each time a hop is complete
+    // the vector is cut in chunks that never cross the end of the fifo or a frame boundary : any vector size
+    // runs 0 to k frames of the same cost, and the hop and the frame size don't depend on it
+    // a frozen spectrum replaces the output with the hop synthesized by the last frame
+    for (i = 0; i < sampleframes; i += n) {
+        n = sampleframes - i;
+        if (n > hop - x->x_hopcount)
+            n = hop - x->x_hopcount;
+        if (n > x->x_n - x->x_fifopos)
+            n = x->x_n - x->x_fifopos;
+        
+        memcpy(x->x_fifo + x->x_fifopos, in + i, n * sizeof(double));
+        if (x->x_resynth)
+            memcpy(out + i, x->x_synth + x->x_hopcount, n * sizeof(double));
+        x->x_fifopos  = (x->x_fifopos + n) & (x->x_n - 1);
+        x->x_hopcount += n;
+        
+        // the click goes on the last sample of the frame, i.e. the first sample where the onset can be known
+        // the hop attribute is read here only : the frame synthesizes exactly the next period
+        if (x->x_hopcount == hop) {
+            x->x_hopcount = 0;
+            hop = x->x_hop < x->x_n ? x->x_hop : x->x_n;
+            if (templatefftw_frame(x, hop))
+                click[i + n - 1] = 1.;
+            x->x_curhop = hop;
+        }
     }
 }
 
+// the FFTs and the onset detection run with flush-to-zero on, only the signal outlet needs the NaN check (clicks are 0 or 1)
+DENORMAL_PERFORM(templatefftw_perform64, templatefftw_process64, t_templatefftw, 0, 1)
+
 
 
 
@@ -327,16 +1154,70 @@ void templatefftw_perform64(t_templatefftw *x, t_object *dsp64, double **ins, lo
 //                          FFT Routines
 //____________________________________________________________________
 
-void templatefftw_basicfft(t_templatefftw *x, long N, double **ins)
+// called by the perform routine (audio thread) once per hop : no allocation, no posting
+// hop is the period until the next frame. Returns 1 if an onset was detected on this frame
+long templatefftw_frame(t_templatefftw *x, long hop)
+{
+    double  *mags = (double *) snapshot_back(&x->x_snapshot);
+    long    old = x->x_n - x->x_fifopos;   // samples between the oldest sample and the end of the fifo
+    long    onset = 0;
+    long    i;
+    
+    // unwrap the circular history, oldest sample first, while applying the window
+    for (i = 0; i < old; i++)
+        x->x_frame[i] = x->x_fifo[x->x_fifopos + i] * x->x_window[i];
+    for (; i < x->x_n; i++)
+        x->x_frame[i] = x->x_fifo[i - old] * x->x_window[i];
+    
+    // dblclick : the same samples without the window, printed by the clock
+    if (lockfree_load(&x->fftOn) == 1) {
+        memcpy(x->x_dump, x->x_fifo + x->x_fifopos, old * sizeof(double));
+        memcpy(x->x_dump + old, x->x_fifo, x->x_fifopos * sizeof(double));
+        lockfree_store(&x->fftOn, 2);
+        clock_delay(x->x_fftclock, 0);
+    }
+    
+    // the plan is shared, the new-array execute function runs it on our buffers
+    fftw_execute_dft_r2c(x->x_plan, x->x_frame, x->x_bins);
+    
+    for (i = 0; i < x->x_nbins; i++)
+        mags[i] = x->x_winnorm * sqrt(x->x_bins[i][0] * x->x_bins[i][0] + x->x_bins[i][1] * x->x_bins[i][1]);
+    
+    if (x->x_onset != ONSET_OFF)
+        onset = templatefftw_onset(x, mags);
+    if (x->x_pitch != PITCH_OFF)
+        templatefftw_pitchframe(x);
+    
+    // captures and learns, then synthesizes the next hop from the slots when frozen, from the denoised input
+    // otherwise (x_frame is free again). A state read by readstate goes first
+    templatefftw_stateapply(x);
+    templatefftw_learnframe(x);
+    x->x_resynth = templatefftw_freezeframe(x, hop) || templatefftw_denoise(x, hop);
+    
+    // the main thread now sees this frame, we'll write the next one in another slot
+    snapshot_publish(&x->x_snapshot);
+    
+    return onset;
+}
+
+// scheduler, prints the frame copied by the audio thread after a dblclick
+void templatefftw_ffttick(t_templatefftw *x)
 {
-    t_double *inL = ins[0];
+    if (lockfree_load(&x->fftOn) != 2)
+        return;
     
-    fftw_complex    *data;      // audio samples/data
+    templatefftw_basicfft(x, x->x_n, x->x_dump);
+    object_post((t_object *)x, "i just ffted");
+    lockfree_store(&x->fftOn, 0);
+}
+
+// main thread only (it allocates and posts) : N samples of input, the frame size of the shared plans
+void templatefftw_basicfft(t_templatefftw *x, long N, const double *in)
+{
+    double          *data;      // audio samples/data
     fftw_complex    *fft_out;   // result of the forward plan, i.e. the FFT
-    fftw_complex    *ifft_out;  // result of the backward plan, i.e. the iFFT
-    fftw_plan       p_forw;     // forward plan
-    fftw_plan       p_back;     // backward plan
-    int             i;          // global incrementer
+    double          *ifft_out;  // result of the backward plan, i.e. the iFFT
+    long            i;          // global incrementer
     
     // Allocate mem (i/o arrays)
     /* 
@@ -345,37 +1226,36 @@ void templatefftw_basicfft(t_templatefftw *x, long N, double **ins)
      Wrapper routines : 
         fftw_alloc_real(N)    == (double*)fftw_malloc(sizeof(double) * N)
         fftw_alloc_complex(N) == (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * N),
+     A real input only needs N / 2 + 1 complex bins, the others are their conjugates.
      */
-    data        = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
-    fft_out     = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
-    ifft_out    = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
+    data        = (double*) fftw_malloc(sizeof(double) * N);
+    fft_out     = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (N / 2 + 1));
+    ifft_out    = (double*) fftw_malloc(sizeof(double) * N);
+    if (!data || !fft_out || !ifft_out) {
+        object_error((t_object *)x, "out of memory");
+        fftw_free(data);
+        fftw_free(fft_out); fftw_free(ifft_out);
+        return;
+    }
     
-    // Make a plan
+    // The plans
     /*
      Object that contains all th data that FFTW needs to compute the FFT.
-      
-      4th arg : FFTW_FORWARD : -/+ 1  sign of the exponent in the transform.
-      5th arg : FFTW_ESTIMATE : does not run any computation and just builds a reasonable plan that is probably sub-optimal. does not touch arrays, but make a plan to be sure
-                     or
-                FFTW_MEASURE : measure the execution time of several FFTs in order to find the best way to compute the transform of size n. Overwrites the i/o arrays
-                a lot of other flags are included, check def of FFTW_ESTIMATE to check them out.
-     Note : 
-      - Once the plan has been created you can use it as many as times as you like to transform the specified i/o arrays (w/fftw_execute(fftw_plan p)).
-      - If you want to transform a different array of the ame size, you can create a new plan w/fftw_plan_dft_1d and FFTW automatically reuses the info from previous plan when possible.
-     - FFTW also provides two routines for creating plans for 2d and 3d transforms, and one routine for creating plans of arbitrary dimensionality.
+     They come from the table cache (templatefftw_acquire), built once per size with FFTW_ESTIMATE : does not run any
+     computation and just builds a reasonable plan that is probably sub-optimal, it does not touch the arrays.
+     FFTW_MEASURE would measure the execution time of several FFTs in order to find the best way to compute the
+     transform of size n, and overwrite the i/o arrays.
+     Note :
+      - Once a plan has been created you can use it as many as times as you like, fftw_execute(fftw_plan p) transforms
+        the arrays given to the planner, the new-array functions (fftw_execute_dft_r2c...) any other arrays of the
+        same size and alignment : one plan per size serves every instance.
+      - Creating a plan is slow and not thread safe, it is never done in the perform routine.
      */
-    p_forw = fftw_plan_dft_1d(N, data,      fft_out,    FFTW_FORWARD,   FFTW_ESTIMATE);
-    p_back = fftw_plan_dft_1d(N, fft_out,   ifft_out,   FFTW_BACKWARD,  FFTW_ESTIMATE);
+    for( i = 0 ; i < N ; i++ )
+        data[i] = in[i];
     
     for( i = 0 ; i < N ; i++ ) {
-        data[i][0] = *inL;
-        data[i][1] = 0.0; // use this if your data is complex valued
-    }
-    
-    
-    for( i = 0 ; i < N ; i++ ) {
-        object_post((t_object *)x, "data[%d] = { %2.2f, %2.2f }\n",
-                i, data[i][0], data[i][1] );
+        object_post((t_object *)x, "data[%ld] = %2.2f\n", i, data[i]);
     }
     
     object_post((t_object *)x, "________________________________________________________");
@@ -383,59 +1263,1619 @@ void templatefftw_basicfft(t_templatefftw *x, long N, double **ins)
     // Compute transform
     /*
      DFT results are stored in-order in the output array (i.e. out). out[0] == DC component.
-     If in != out => transform is out-of-place => in is not modified. Otherwise input array is overwritten with the transform.
+     If in != out => transform is out-of-place. A c2r transform destroys its input array, r2c doesn't.
      Computes an unormalized DFT, so couputing FORWARD then BACKWARD transform results in the original array scaled by n.
      
      */
-    fftw_execute(p_forw);
+    fftw_execute_dft_r2c(x->x_plan, data, fft_out);
     
-    for( i = 0 ; i < N ; i++ ) {
-        object_post((t_object *)x, "fft_result[%d] = { %2.2f, %2.2f }\n",
+    for( i = 0 ; i <= N / 2 ; i++ ) {
+        object_post((t_object *)x, "fft_result[%ld] = { %2.2f, %2.2f }\n",
                 i, fft_out[i][0], fft_out[i][1] );
     }
     
     object_post((t_object *)x, "________________________________________________________");
     
-    fftw_execute(p_back);
+    fftw_execute_dft_c2r(x->x_iplan, fft_out, ifft_out);
     
     for( i = 0 ; i < N ; i++ ) {
-        object_post((t_object *)x, "ifft_result[%d] = { %2.2f, %2.2f }\n",
-                i, ifft_out[i][0] / N, ifft_out[i][1] / N );
+        object_post((t_object *)x, "ifft_result[%ld] = %2.2f\n", i, ifft_out[i] / N);
     }
-
-    
-    fftw_destroy_plan(p_forw);
-    fftw_destroy_plan(p_back);
     
     fftw_free(data);
     fftw_free(fft_out); fftw_free(ifft_out);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Spectrum Snapshot
+//____________________________________________________________________
+
+/*
+ 
+ getspectrum [bins] [matrix name]
+ 
+ Reads the newest complete frame and outputs it as [bins] log-frequency spaced bins (64 by default).
+ If a jit.matrix name is given, the bins are written in the matrix (1 plane, float32 or float64, dim >= bins)
+ and "jit_matrix <name>" is output instead of the list.
+ Called from the main thread, the audio thread never waits for us.
+ 
+ */
+void templatefftw_getspectrum(t_templatefftw *x, t_symbol *s, long argc, t_atom *argv)
+{
+    t_atom_long         nbins = 64;
+    t_symbol            *name = NULL;
+    double              *mags;
+    double              *disp;
+    void                *matrix;
+    void                *lock;
+    char                *data = NULL;
+    t_jit_matrix_info   info;
+    t_atom              a;
+    long                i;
+    
+    atom_arg_getlong(&nbins, 0, argc, argv);
+    atom_arg_getsym(&name, 1, argc, argv);
+    
+    if (nbins < 1 || nbins > TEMPLATEFFTW_MAXDISPLAY) {
+        object_error((t_object *)x, "getspectrum: bins must be between 1 and %d", TEMPLATEFFTW_MAXDISPLAY);
+        return;
+    }
+    
+    // the decimated values are computed in doubles at the end of the atom array (same size as a t_atom at worst)
+    if (x->x_displaysize < nbins) {
+        if (x->x_display)
+            sysmem_freeptr(x->x_display);
+        x->x_display = (t_atom *) sysmem_newptr(nbins * (sizeof(t_atom) + sizeof(double)));
+        x->x_displaysize = x->x_display ? nbins : 0;
+        if (!x->x_display)
+            return;
+    }
+    disp = (double *)(x->x_display + x->x_displaysize);
+    
+    mags = (double *) snapshot_read(&x->x_snapshot, NULL);
+    templatefftw_decimate(x, mags, disp, nbins);
+    
+    if (name && name != gensym("")) {
+        matrix = jit_object_findregistered(name);
+        if (!matrix) {
+            object_error((t_object *)x, "getspectrum: no jit.matrix named %s", name->s_name);
+            return;
+        }
+        
+        lock = jit_object_method(matrix, _jit_sym_lock, 1);
+        jit_object_method(matrix, _jit_sym_getinfo, &info);
+        jit_object_method(matrix, _jit_sym_getdata, &data);
+        
+        if (data && info.planecount == 1 && info.dim[0] >= nbins && info.type == _jit_sym_float32) {
+            for (i = 0; i < nbins; i++)
+                *(float *)(data + i * info.dimstride[0]) = (float)disp[i];
+        }
+        else if (data && info.planecount == 1 && info.dim[0] >= nbins && info.type == _jit_sym_float64) {
+            for (i = 0; i < nbins; i++)
+                *(double *)(data + i * info.dimstride[0]) = disp[i];
+        }
+        else {
+            data = NULL;
+            object_error((t_object *)x, "getspectrum: %s must be a 1 plane float32/float64 matrix of at least %ld cells", name->s_name, (long)nbins);
+        }
+        
+        jit_object_method(matrix, _jit_sym_lock, lock);
+        
+        if (data) {
+            atom_setsym(&a, name);
+            outlet_anything(x->x_spectrum, gensym("jit_matrix"), 1, &a);
+        }
+        return;
+    }
+    
+    for (i = 0; i < nbins; i++)
+        atom_setfloat(x->x_display + i, disp[i]);
+    
+    outlet_list(x->x_spectrum, NULL, (short)nbins, x->x_display);
+}
+
+// decimates the magnitudes to nbins log spaced bins between ~20 Hz (or the first bin) and Nyquist
+// a display bin covering several fft bins takes their peak, a narrower one interpolates between its neighbours
+long templatefftw_decimate(t_templatefftw *x, double *mags, double *dest, long nbins)
+{
+    double  binhz = x->x_sr / x->x_n;
+    double  fmin  = binhz > 20. ? binhz : 20.;
+    double  ratio = (x->x_sr * 0.5) / fmin;
+    double  lo, hi, c, frac;
+    long    i, j, jlo, jhi;
     
+    for (i = 0; i < nbins; i++) {
+        lo = fmin * pow(ratio, (double)i / nbins) / binhz;
+        hi = fmin * pow(ratio, (double)(i + 1) / nbins) / binhz;
+        
+        jlo = (long)ceil(lo);
+        jhi = (long)floor(hi);
+        if (jhi > x->x_nbins - 1)
+            jhi = x->x_nbins - 1;
+        
+        if (jhi > jlo) {
+            dest[i] = mags[jlo];
+            for (j = jlo + 1; j <= jhi; j++)
+                if (mags[j] > dest[i])
+                    dest[i] = mags[j];
+        }
+        else {
+            c = sqrt(lo * hi);
+            j = (long)c;
+            if (j >= x->x_nbins - 1) {
+                dest[i] = mags[x->x_nbins - 1];
+                continue;
+            }
+            frac = c - j;
+            dest[i] = mags[j] + frac * (mags[j + 1] - mags[j]);
+        }
+    }
     
+    return nbins;
 }
 
 
 
 
 
+//____________________________________________________________________
+//                          Onset Detection
+//____________________________________________________________________
 
+/*
+ 
+ Each frame reduces the spectrum to one value, the detection function, with one of :
+    - flux    : sum of the magnitude increases since the previous frame
+    - hfc     : sum of k * |X[k]|^2, favours the broadband energy of percussive attacks
+    - complex : sum of |X[k] - X'[k]| where X' continues the magnitude and the phase advance of the two previous frames,
+                catches soft (pitched) onsets too. The prediction uses unit phasors so no atan2/cos/sin are needed.
+ 
+ An onset is reported when the detection function rises above onsetthresh + onsetratio * median(last onsetwin values),
+ and at least onsetmin ms after the previous one.
+ Called from the audio thread : a few loops over the bins, no allocation.
+ 
+ */
+long templatefftw_onset(t_templatefftw *x, double *mags)
+{
+    double          *prev = x->x_prevmags;
+    fftw_complex    *ph = x->x_prevphase;
+    fftw_complex    *bins = x->x_bins;
+    double          norm = x->x_winnorm;
+    double          df = 0.;
+    double          d, re, im, ure, uim, pre, pim, mag, thresh;
+    long            win, onset;
+    long            k;
+    
+    switch (x->x_onset) {
+        case ONSET_FLUX:
+            // half wave rectification without a branch : (d + |d|) / 2
+            for (k = 0; k < x->x_nbins; k++) {
+                d = mags[k] - prev[k];
+                df += d + fabs(d);
+            }
+            df *= 0.5;
+            break;
+            
+        case ONSET_HFC:
+            for (k = 0; k < x->x_nbins; k++)
+                df += k * mags[k] * mags[k];
+            df /= x->x_nbins;
+            break;
+            
+        case ONSET_COMPLEX:
+            for (k = 0; k < x->x_nbins; k++) {
+                // predicted phasor : u1 * (u1 * conj(u2)), i.e. phase(n-1) + (phase(n-1) - phase(n-2))
+                re  = ph[2 * k][0] * ph[2 * k + 1][0] + ph[2 * k][1] * ph[2 * k + 1][1];
+                im  = ph[2 * k][1] * ph[2 * k + 1][0] - ph[2 * k][0] * ph[2 * k + 1][1];
+                pre = prev[k] * (ph[2 * k][0] * re - ph[2 * k][1] * im);
+                pim = prev[k] * (ph[2 * k][0] * im + ph[2 * k][1] * re);
+                
+                re = norm * bins[k][0];
+                im = norm * bins[k][1];
+                df += sqrt((re - pre) * (re - pre) + (im - pim) * (im - pim));
+                
+                // shift the phasors, a silent bin keeps its previous phase
+                mag = mags[k];
+                ure = mag > 1e-12 ? re / mag : ph[2 * k][0];
+                uim = mag > 1e-12 ? im / mag : ph[2 * k][1];
+                ph[2 * k + 1][0] = ph[2 * k][0];
+                ph[2 * k + 1][1] = ph[2 * k][1];
+                ph[2 * k][0] = ure;
+                ph[2 * k][1] = uim;
+            }
+            break;
+            
+        default: break;
+    }
+    
+    memcpy(prev, mags, x->x_nbins * sizeof(double));
+    
+    // adaptive threshold on the history before this frame
+    win = x->x_onsetwin;
+    thresh = x->x_onsetthresh + x->x_onsetratio * templatefftw_median(x->x_onsethist, x->x_onsethistpos, win);
+    
+    x->x_onsethist[x->x_onsethistpos] = df;
+    x->x_onsethistpos = (x->x_onsethistpos + 1) % TEMPLATEFFTW_ONSETHIST;
+    
+    x->x_onsetsince += x->x_curhop;
+    onset = df > thresh && !x->x_onsetabove && x->x_onsetsince >= x->x_onsetmin * 0.001 * x->x_sr;
+    x->x_onsetabove = df > thresh;
+    
+    if (onset) {
+        x->x_onsetsince = 0;
+        x->x_onsetval = df;
+        clock_delay(x->x_onsetclock, 0);    // the outlet is called from the scheduler, not from here
+    }
+    
+    return onset;
+}
 
+// median of the n values written before pos in the circular history, insertion sorted in a copy on the stack
+double templatefftw_median(double *hist, long pos, long n)
+{
+    double  sorted[TEMPLATEFFTW_ONSETHIST];
+    double  v;
+    long    i, j;
+    
+    for (i = 0; i < n; i++) {
+        v = hist[(pos - 1 - i + TEMPLATEFFTW_ONSETHIST) % TEMPLATEFFTW_ONSETHIST];
+        for (j = i; j > 0 && sorted[j - 1] > v; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = v;
+    }
+    
+    return (n & 1) ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+}
 
+// scheduler thread, outputs the strength of the last onset
+void templatefftw_onsettick(t_templatefftw *x)
+{
+    outlet_float(x->x_onsetout, x->x_onsetval);
+}
 
 
 
 
 
 
+//____________________________________________________________________
+//                          Partitioned Convolution
+//____________________________________________________________________
 
+/*
+ 
+ Uniformly partitioned overlap-save : the impulse response is cut in P sample partitions, each one zero padded
+ to 2 P and transformed once. Every P input samples, the spectrum of the last 2 P samples enters a delay line
+ and the output spectrum is the sum of partition k times the input spectrum k partitions old. The last P samples
+ of its backward transform are the next P output samples.
+ 
+ Kernel swap, without locking or transforming on the audio thread :
+    - main thread   : set copies the buffer~ into a job, which waits in x_kjob while the worker is busy (a newer
+                      set replaces it). templatefftw_kstart gives it a KERNEL_FREE slot and starts templatefftw_kbuild
+    - worker        : transforms the partitions into the slot, marks it READY and publishes slot + 1 in x_kpending
+                      (a READY kernel that was never picked up is retired, the newest wins)
+    - audio thread  : takes x_kpending on a partition boundary and flips x_klive, the only index it convolves.
+                      With xfade on, the old and the new kernel are both convolved on this partition and crossfaded,
+                      then the old slot is retired
+    - main thread   : retired slots are freed by templatefftw_kreclaim, from a qelem set by the clock the audio
+                      thread and the worker set (neither may free, nor set a qelem from the perform routine).
+                      The worker sets it when it returns too, the qelem then starts the job waiting in x_kjob
+ 
+ The main thread never waits for the worker : a long impulse response doesn't hold up set, the UI or the scheduler.
+ 
+ The swap is a slot index rather than a pointer, ext_atomic only has a 32 bit compare-and-swap.
+ 
+ */
+void templatefftw_set(t_templatefftw *x, t_symbol *s, long argc, t_atom *argv)
+{
+    t_templatefftw_kjob *job;
+    t_buffer_ref        *ref;
+    t_buffer_obj        *b;
+    t_symbol            *name;
+    float               *samples;
+    long                frames, chans, i;
+    
+    job = (t_templatefftw_kjob *) sysmem_newptrclear(sizeof(t_templatefftw_kjob));
+    if (!job)
+        return;
+    job->j_x = x;
+    job->j_slot = -1;
+    
+    // the samples are copied here, the buffer~ may change while the worker runs
+    if (argc && atom_gettype(argv) == A_SYM) {
+        name = atom_getsym(argv);
+        ref = buffer_ref_new((t_object *)x, name);
+        b = buffer_ref_getobject(ref);
+        samples = b ? buffer_locksamples(b) : NULL;
+        if (!samples) {
+            object_error((t_object *)x, "set: no buffer~ named %s", name->s_name);
+            object_free(ref);
+            sysmem_freeptr(job);
+            return;
+        }
+        
+        frames = buffer_getframecount(b);
+        chans  = buffer_getchannelcount(b);
+        if (frames > TEMPLATEFFTW_MAXPARTS * TEMPLATEFFTW_CONVP) {
+            object_warn((t_object *)x, "set: %s truncated to %d samples", name->s_name, TEMPLATEFFTW_MAXPARTS * TEMPLATEFFTW_CONVP);
+            frames = TEMPLATEFFTW_MAXPARTS * TEMPLATEFFTW_CONVP;
+        }
+        
+        job->j_ir = frames > 0 ? (double *) sysmem_newptr(sizeof(double) * frames) : NULL;
+        if (job->j_ir) {
+            for (i = 0; i < frames; i++)
+                job->j_ir[i] = samples[i * chans];
+            job->j_n = frames;
+        }
+        
+        buffer_unlocksamples(b);
+        object_free(ref);
+    }
+    
+    // one worker at a time : while it transforms, the newest set waits and the one it replaces is dropped
+    templatefftw_kjobfree(x->x_kjob);
+    x->x_kjob = job;
+    templatefftw_kreclaim(x);
+    if (templatefftw_kstart(x)) {
+        object_error((t_object *)x, "set: no free kernel slot, try again");
+        templatefftw_kjobfree(x->x_kjob);
+        x->x_kjob = NULL;
+    }
+}
 
+// main thread, starts the worker on x_kjob unless it is busy. Returns 1 if no slot is free
+long templatefftw_kstart(t_templatefftw *x)
+{
+    t_templatefftw_kjob *job = x->x_kjob;
+    long                slot;
+    
+    if (!job || lockfree_load(&x->x_kbusy))
+        return 0;
+    
+    // it cleared x_kbusy on its way out, the join doesn't wait
+    if (x->x_kthread) {
+        systhread_join(x->x_kthread, NULL);
+        x->x_kthread = NULL;
+    }
+    
+    slot = templatefftw_kslot(x);
+    if (slot < 0)
+        return 1;
+    
+    x->x_kjob = NULL;
+    job->j_slot = slot;
+    lockfree_store(&x->x_kstate[slot], KERNEL_BUILDING);
+    lockfree_store(&x->x_kbusy, 1);
+    if (systhread_create((method)templatefftw_kbuild, job, 0, 0, 0, &x->x_kthread)) {
+        object_error((t_object *)x, "set: can't start the kernel thread");
+        x->x_kthread = NULL;
+        lockfree_store(&x->x_kbusy, 0);
+        lockfree_store(&x->x_kstate[slot], KERNEL_FREE);
+        templatefftw_kjobfree(job);
+    }
+    return 0;
+}
 
+// main thread (qelem), after a slot retired or the worker returned. A job without a slot waits for the next retire
+void templatefftw_kidle(t_templatefftw *x)
+{
+    templatefftw_kreclaim(x);
+    templatefftw_kstart(x);
+}
 
+void templatefftw_kjobfree(t_templatefftw_kjob *job)
+{
+    if (!job)
+        return;
+    if (job->j_ir)
+        sysmem_freeptr(job->j_ir);
+    sysmem_freeptr(job);
+}
 
+// worker thread, transforms the partitions of job->j_ir into a new kernel and publishes it
+void *templatefftw_kbuild(t_templatefftw_kjob *job)
+{
+    t_templatefftw          *x = job->j_x;
+    t_templatefftw_kernel   *k;
+    double                  *pad;
+    long                    npart = (job->j_n + TEMPLATEFFTW_CONVP - 1) / TEMPLATEFFTW_CONVP;
+    long                    i, j, n;
+    
+    k   = (t_templatefftw_kernel *) sysmem_newptrclear(sizeof(t_templatefftw_kernel));
+    pad = (double *) fftw_malloc(sizeof(double) * 2 * TEMPLATEFFTW_CONVP);
+    if (k && npart)
+        k->k_parts = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * npart * TEMPLATEFFTW_CONVBINS);
+    
+    if (!k || !pad || (npart && !k->k_parts)) {
+        object_error((t_object *)x, "set: out of memory");
+        templatefftw_kfree(k);
+        lockfree_store(&x->x_kstate[job->j_slot], KERNEL_FREE);
+    }
+    else {
+        // the 1 / (2 P) of the backward transform is applied to the kernel once, not to every output
+        for (i = 0; i < npart; i++) {
+            n = job->j_n - i * TEMPLATEFFTW_CONVP;
+            if (n > TEMPLATEFFTW_CONVP)
+                n = TEMPLATEFFTW_CONVP;
+            for (j = 0; j < n; j++)
+                pad[j] = job->j_ir[i * TEMPLATEFFTW_CONVP + j] * (0.5 / TEMPLATEFFTW_CONVP);
+            memset(pad + n, 0, sizeof(double) * (2 * TEMPLATEFFTW_CONVP - n));
+            fftw_execute_dft_r2c(x->x_convr2c, pad, k->k_parts + i * TEMPLATEFFTW_CONVBINS);
+        }
+        k->k_npart = npart;
+        templatefftw_kpublish(x, job->j_slot, k);
+    }
+    
+    if (pad)
+        fftw_free(pad);
+    templatefftw_kjobfree(job);
+    
+    // the main thread starts the next set, if one came in meanwhile
+    lockfree_store(&x->x_kbusy, 0);
+    clock_delay(x->x_kclock, 0);
+    
+    systhread_exit(0);
+    return NULL;
+}
 
+// main thread, a KERNEL_FREE slot or -1. Live, fading and READY are the most we hold when the worker is idle
+long templatefftw_kslot(t_templatefftw *x)
+{
+    long slot;
+    
+    for (slot = 0; slot < TEMPLATEFFTW_KSETS; slot++)
+        if (lockfree_load(&x->x_kstate[slot]) == KERNEL_FREE)
+            return slot;
+    
+    return -1;
+}
 
+// worker or main thread, hands a complete kernel to the audio thread for the next partition boundary
+void templatefftw_kpublish(t_templatefftw *x, long slot, t_templatefftw_kernel *k)
+{
+    int32_t old;
+    
+    // the exchange is a full barrier, the audio thread sees the whole kernel once it sees the slot
+    x->x_kset[slot] = k;
+    lockfree_store(&x->x_kstate[slot], KERNEL_READY);
+    old = lockfree_exchange(&x->x_kpending, (int32_t)slot + 1);
+    if (old)
+        templatefftw_kretire(x, old - 1);   // never picked up, the newest wins
+}
 
+// audio or worker thread, hands a slot over to the main thread
+void templatefftw_kretire(t_templatefftw *x, long slot)
+{
+    lockfree_store(&x->x_kstate[slot], KERNEL_RETIRED);
+    clock_delay(x->x_kclock, 0);
+}
 
+// scheduler thread, the free happens in the main thread
+void templatefftw_ktick(t_templatefftw *x)
+{
+    qelem_set(x->x_kqelem);
+}
 
+// main thread, frees the retired kernels
+void templatefftw_kreclaim(t_templatefftw *x)
+{
+    long slot;
+    
+    for (slot = 0; slot < TEMPLATEFFTW_KSETS; slot++) {
+        if (lockfree_load(&x->x_kstate[slot]) != KERNEL_RETIRED)
+            continue;
+        templatefftw_kfree(x->x_kset[slot]);
+        x->x_kset[slot] = NULL;
+        lockfree_store(&x->x_kstate[slot], KERNEL_FREE);
+    }
+}
 
+void templatefftw_kfree(t_templatefftw_kernel *k)
+{
+    if (!k)
+        return;
+    if (k->k_parts)
+        fftw_free(k->k_parts);
+    sysmem_freeptr(k);
+}
 
+// perform routine, collects the input by partitions and outputs the previous partition's result (P samples of latency)
+// the input side always runs, so a new kernel starts with the full input history
+void templatefftw_convolve(t_templatefftw *x, double *in, double *out, long n)
+{
+    long i, m;
+    
+    for (i = 0; i < n; i += m) {
+        m = TEMPLATEFFTW_CONVP - x->x_cpos;
+        if (m > n - i)
+            m = n - i;
+        
+        memcpy(x->x_cin + TEMPLATEFFTW_CONVP + x->x_cpos, in + i, m * sizeof(double));
+        if (x->x_klive >= 0)
+            memcpy(out + i, x->x_cout + x->x_cpos, m * sizeof(double));
+        else
+            memcpy(out + i, in + i, m * sizeof(double));
+        
+        x->x_cpos += m;
+        if (x->x_cpos == TEMPLATEFFTW_CONVP) {
+            x->x_cpos = 0;
+            templatefftw_partition(x);
+        }
+    }
+}
 
+// audio thread, once per partition : delay line, kernel swap and the next P output samples
+void templatefftw_partition(t_templatefftw *x)
+{
+    double  *cur = x->x_ctime[0] + TEMPLATEFFTW_CONVP;
+    double  *old = x->x_ctime[1] + TEMPLATEFFTW_CONVP;
+    double  w;
+    int32_t pending;
+    long    prev = -1;
+    long    i;
+    
+    // spectrum of the last 2 P samples at the head of the delay line, then the input slides by P
+    x->x_fdlpos = (x->x_fdlpos + 1) % TEMPLATEFFTW_MAXPARTS;
+    fftw_execute_dft_r2c(x->x_convr2c, x->x_cin, x->x_fdl + x->x_fdlpos * TEMPLATEFFTW_CONVBINS);
+    memmove(x->x_cin, x->x_cin + TEMPLATEFFTW_CONVP, TEMPLATEFFTW_CONVP * sizeof(double));
+    
+    // a kernel published since the last partition goes live on this boundary
+    pending = lockfree_exchange(&x->x_kpending, 0);
+    if (pending) {
+        prev = x->x_klive;
+        x->x_klive = pending - 1;
+        lockfree_store(&x->x_kstate[x->x_klive], KERNEL_LIVE);
+        
+        // an empty kernel is the passthrough, it has no latency so it can't be crossfaded with the convolution
+        if (!x->x_kset[x->x_klive]->k_npart) {
+            templatefftw_kretire(x, x->x_klive);
+            x->x_klive = -1;
+        }
+        if (prev >= 0 && (!x->x_xfade || x->x_klive < 0)) {
+            templatefftw_kretire(x, prev);
+            prev = -1;
+        }
+    }
+    
+    if (x->x_klive < 0)
+        return;
+    
+    templatefftw_kernelconv(x, x->x_kset[x->x_klive], x->x_ctime[0]);
+    
+    if (prev < 0) {
+        memcpy(x->x_cout, cur, TEMPLATEFFTW_CONVP * sizeof(double));
+        return;
+    }
+    
+    // both kernels see the same input history, a linear fade over the partition is enough to hide the change
+    templatefftw_kernelconv(x, x->x_kset[prev], x->x_ctime[1]);
+    for (i = 0; i < TEMPLATEFFTW_CONVP; i++) {
+        w = (i + 0.5) / TEMPLATEFFTW_CONVP;
+        x->x_cout[i] = old[i] + w * (cur[i] - old[i]);
+    }
+    templatefftw_kretire(x, prev);
+}
+
+// spectral multiply-accumulate of a kernel with the delay line, and the backward transform into time (2 P samples)
+void templatefftw_kernelconv(t_templatefftw *x, t_templatefftw_kernel *k, double *time)
+{
+    double          *acc = (double *) x->x_cacc;
+    const double    *h, *in;
+    long            p, b;
+    
+    memset(acc, 0, sizeof(fftw_complex) * TEMPLATEFFTW_CONVBINS);
+    
+    for (p = 0; p < k->k_npart; p++) {
+        h  = (const double *)(k->k_parts + p * TEMPLATEFFTW_CONVBINS);
+        in = (const double *)(x->x_fdl + ((x->x_fdlpos - p + TEMPLATEFFTW_MAXPARTS) % TEMPLATEFFTW_MAXPARTS) * TEMPLATEFFTW_CONVBINS);
+        for (b = 0; b < 2 * TEMPLATEFFTW_CONVBINS; b += VD_SIZE)
+            vd_store(acc + b, vd_cmadd(vd_load(h + b), vd_load(in + b), vd_load(acc + b)));
+    }
+    
+    // c2r overwrites its input, x_cacc is only scratch
+    fftw_execute_dft_c2r(x->x_convc2r, x->x_cacc, time);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          State Snapshot
+//____________________________________________________________________
+
+/*
+ 
+ The transformed partitions are saved as they are in memory, so loading them back is a file read
+ into the kernel's own buffer, no FFT. A state file is a list of chunks :
+    - header (t_templatefftw_chunk, 16 bytes) : tag, count, size
+    - size bytes of data, padded to a multiple of 16
+ The first chunk is "TFWS" with count = TEMPLATEFFTW_STATEVERSION and no data. Then :
+    - "KERN" : count partitions of TEMPLATEFFTW_CONVBINS fftw_complex, the live kernel
+    - "CAPT" : count capture slots, FREEZE_ARRAYS arrays of x_freezebins doubles each
+    - "NOIS" : the noise profile, x_freezebins doubles, learned over count frames
+ Unknown chunks are skipped, a chunk whose size doesn't match (another partition size, frame size...) too.
+ There is no FFTW wisdom : the plans are FFTW_ESTIMATE and already made when the file is read.
+ A size that is negative or runs past the end of the file makes the file damaged : nothing after it is read.
+ The file is in the byte order of the machine that wrote it.
+ 
+ Main thread only : the kernel goes through templatefftw_kpublish like the ones built by set. The captures and
+ the noise profile are read into x_stdata and handed to the audio thread (x_stapply), which copies them into its
+ buffers at the next frame, or dsp64 does while the audio is stopped. They are saved from the audio thread's
+ buffers : a capture or a learning completing during writestate may be saved half old, half new.
+ 
+ */
+
+// the state attribute only names the file, it is read by the first dsp64 (or right away if the DSP already ran)
+t_max_err templatefftw_state_set(t_templatefftw *x, void *attr, long argc, t_atom *argv)
+{
+    x->x_state = (argc && atom_gettype(argv) == A_SYM) ? atom_getsym(argv) : NULL;
+    x->x_stateload = x->x_state && x->x_state != gensym("");
+    
+    if (x->x_stateload && x->x_block) {
+        x->x_stateload = 0;
+        templatefftw_stateload(x, x->x_state);
+    }
+    
+    return MAX_ERR_NONE;
+}
+
+// writestate [file], defaults to the state attribute
+void templatefftw_writestate(t_templatefftw *x, t_symbol *s)
+{
+    if (s == gensym(""))
+        s = x->x_state;
+    if (!s || s == gensym("")) {
+        object_error((t_object *)x, "writestate: no file name");
+        return;
+    }
+    
+    if (!templatefftw_statesave(x, s))
+        object_post((t_object *)x, "state written to %s", s->s_name);
+}
+
+// readstate [file], defaults to the state attribute
+void templatefftw_readstate(t_templatefftw *x, t_symbol *s)
+{
+    if (s == gensym(""))
+        s = x->x_state;
+    if (!s || s == gensym("")) {
+        object_error((t_object *)x, "readstate: no file name");
+        return;
+    }
+    
+    x->x_stateload = 0;
+    templatefftw_stateload(x, s);
+}
+
+// writes the state in the default path, returns 0 on success
+long templatefftw_statesave(t_templatefftw *x, t_symbol *name)
+{
+    t_filehandle            fh;
+    t_templatefftw_kernel   *k = NULL;
+    long                    live = x->x_klive;
+    long                    err;
+    
+    if (path_createsysfile(name->s_name, path_getdefault(), FOUR_CHAR_CODE('T', 'F', 'W', 'S'), &fh)) {
+        object_error((t_object *)x, "writestate: can't create %s", name->s_name);
+        return 1;
+    }
+    
+    // a LIVE slot is only freed on this thread, after it retires
+    if (live >= 0 && lockfree_load(&x->x_kstate[live]) == KERNEL_LIVE)
+        k = x->x_kset[live];
+    
+    err = templatefftw_chunkwrite(fh, "TFWS", TEMPLATEFFTW_STATEVERSION, 0, NULL);
+    if (!err && k && k->k_npart)
+        err = templatefftw_chunkwrite(fh, "KERN", k->k_npart, sizeof(fftw_complex) * k->k_npart * TEMPLATEFFTW_CONVBINS, k->k_parts);
+    if (!err && x->x_block && x->x_slotcount)
+        err = templatefftw_chunkwrite(fh, "CAPT", x->x_slotcount, sizeof(double) * x->x_slotcount * FREEZE_ARRAYS * x->x_freezebins, x->x_slotdata);
+    if (!err && x->x_block && x->x_learntotal > 0)
+        err = templatefftw_chunkwrite(fh, "NOIS", x->x_learntotal, sizeof(double) * x->x_freezebins, x->x_noise);
+    
+    sysfile_close(fh);
+    
+    if (err)
+        object_error((t_object *)x, "writestate: error writing %s", name->s_name);
+    return err;
+}
+
+long templatefftw_chunkwrite(t_filehandle fh, const char *tag, long count, long size, const void *data)
+{
+    static const char       zeros[16] = { 0 };
+    t_templatefftw_chunk    c;
+    t_ptr_size              n = sizeof(c);
+    
+    memcpy(c.c_tag, tag, 4);
+    c.c_count = (int32_t)count;
+    c.c_size  = size;
+    if (sysfile_write(fh, &n, &c) || n != sizeof(c))
+        return 1;
+    
+    n = size;
+    if (size && (sysfile_write(fh, &n, data) || n != size))
+        return 1;
+    
+    n = (16 - size % 16) % 16;
+    if (n && sysfile_write(fh, &n, zeros))
+        return 1;
+    
+    return 0;
+}
+
+// reads a state file found in the search path, returns 0 on success
+long templatefftw_stateload(t_templatefftw *x, t_symbol *name)
+{
+    char                    filename[MAX_FILENAME_CHARS];
+    t_filehandle            fh;
+    t_templatefftw_chunk    c;
+    t_templatefftw_kernel   *k;
+    t_ptr_size              n, pos, eof;
+    short                   path;
+    t_fourcc                type;
+    long                    slot, slots;
+    long                    slotsize = sizeof(double) * FREEZE_ARRAYS * x->x_freezebins;
+    long                    err = 0;
+    
+    strncpy_zero(filename, name->s_name, MAX_FILENAME_CHARS);
+    if (locatefile_extended(filename, &path, &type, NULL, 0) || path_opensysfile(filename, path, &fh, READ_PERM)) {
+        object_error((t_object *)x, "readstate: can't find %s", name->s_name);
+        return 1;
+    }
+    
+    n = sizeof(c);
+    if (sysfile_read(fh, &n, &c) || n != sizeof(c) || memcmp(c.c_tag, "TFWS", 4) || c.c_count != TEMPLATEFFTW_STATEVERSION) {
+        object_error((t_object *)x, "readstate: %s is not a templatefftw~ state file", name->s_name);
+        sysfile_close(fh);
+        return 1;
+    }
+    
+    if (sysfile_geteof(fh, &eof)) {
+        sysfile_close(fh);
+        object_error((t_object *)x, "readstate: can't read %s", name->s_name);
+        return 1;
+    }
+    
+    // the captures and the profile are read for the frame size and the slots of now, the previous ones if they still wait are replaced
+    templatefftw_stateclaim(x);
+    x->x_stslots = 0;
+    x->x_stlearned = 0;
+    x->x_stbins = x->x_freezebins;
+    if (x->x_stdata)
+        sysmem_freeptr(x->x_stdata);
+    x->x_stdata = (double *) sysmem_newptr(slotsize * x->x_slots + sizeof(double) * x->x_freezebins);
+    if (!x->x_stdata) {
+        sysfile_close(fh);
+        object_error((t_object *)x, "readstate: out of memory");
+        return 1;
+    }
+    
+    for (;;) {
+        n = sizeof(c);
+        if (sysfile_read(fh, &n, &c) || n != sizeof(c))
+            break;      // end of file
+        
+        // every chunk moves forward, a size read from the file is checked before it is used to seek or allocate
+        if (c.c_size < 0 || sysfile_getpos(fh, &pos) || (uint64_t)c.c_size > (uint64_t)(eof - pos)) {
+            err = 1;
+            break;
+        }
+        
+        if (!memcmp(c.c_tag, "KERN", 4) && c.c_count > 0 && c.c_count <= TEMPLATEFFTW_MAXPARTS
+            && c.c_size == (int64_t)sizeof(fftw_complex) * c.c_count * TEMPLATEFFTW_CONVBINS) {
+            
+            // read straight into the kernel, it is published as if set had built it
+            k = (t_templatefftw_kernel *) sysmem_newptrclear(sizeof(t_templatefftw_kernel));
+            if (k)
+                k->k_parts = (fftw_complex *) fftw_malloc((size_t)c.c_size);
+            n = (t_ptr_size)c.c_size;
+            slot = templatefftw_kslot(x);
+            if (!k || !k->k_parts || slot < 0 || sysfile_read(fh, &n, k->k_parts) || n != c.c_size) {
+                templatefftw_kfree(k);
+                err = 1;
+                break;
+            }
+            k->k_npart = c.c_count;
+            templatefftw_kpublish(x, slot, k);
+        }
+        else if (!memcmp(c.c_tag, "CAPT", 4) && c.c_count > 0 && c.c_count <= TEMPLATEFFTW_MAXSLOTS
+                 && c.c_size == (int64_t)slotsize * c.c_count) {
+            
+            // the slots beyond the slots attribute are left in the file
+            slots = c.c_count < x->x_slots ? c.c_count : x->x_slots;
+            n = (t_ptr_size)slotsize * slots;
+            if (sysfile_read(fh, &n, x->x_stdata + x->x_freezebins) || n != (t_ptr_size)slotsize * slots
+                || sysfile_setpos(fh, SYSFILE_FROMMARK, (t_ptr_int)slotsize * (c.c_count - slots))) {
+                err = 1;
+                break;
+            }
+            x->x_stslots = slots;
+        }
+        else if (!memcmp(c.c_tag, "NOIS", 4) && c.c_count > 0 && c.c_size == (int64_t)sizeof(double) * x->x_freezebins) {
+            
+            n = (t_ptr_size)c.c_size;
+            if (sysfile_read(fh, &n, x->x_stdata) || n != c.c_size) {
+                err = 1;
+                break;
+            }
+            x->x_stlearned = c.c_count;
+        }
+        else {
+            if (!memcmp(c.c_tag, "CAPT", 4))
+                object_warn((t_object *)x, "readstate: the captures of %s are for another frame size, skipped", name->s_name);
+            else if (!memcmp(c.c_tag, "NOIS", 4))
+                object_warn((t_object *)x, "readstate: the noise profile of %s is for another frame size, skipped", name->s_name);
+            if (sysfile_setpos(fh, SYSFILE_FROMMARK, (t_ptr_int)c.c_size)) {
+                err = 1;
+                break;
+            }
+        }
+        
+        // chunks are padded to 16 bytes
+        if (c.c_size % 16 && sysfile_setpos(fh, SYSFILE_FROMMARK, (t_ptr_int)(16 - c.c_size % 16))) {
+            err = 1;
+            break;
+        }
+    }
+    
+    sysfile_close(fh);
+    
+    // what was read before an error is still good
+    if (x->x_stslots || x->x_stlearned)
+        lockfree_store(&x->x_stapply, STATE_PENDING);
+    
+    if (err)
+        object_error((t_object *)x, "readstate: %s is damaged or couldn't be loaded", name->s_name);
+    return err;
+}
+
+// main thread, takes x_stdata back before it is written : from a STATE_PENDING the audio thread didn't take,
+// or once the audio thread is done copying it (a few microseconds)
+void templatefftw_stateclaim(t_templatefftw *x)
+{
+    while (!ATOMIC_COMPARE_SWAP32(STATE_PENDING, STATE_OWNED, &x->x_stapply) && lockfree_load(&x->x_stapply) == STATE_APPLYING)
+        systhread_sleep(1);
+}
+
+// audio thread once per frame, or dsp64 : copies a pending x_stdata into the slots and the noise profile
+// returns 1 if it did, 0 if nothing was pending, -1 if it was read for another frame size (dropped)
+long templatefftw_stateapply(t_templatefftw *x)
+{
+    long slots;
+    long applied = -1;
+    
+    if (lockfree_load(&x->x_stapply) != STATE_PENDING || !ATOMIC_COMPARE_SWAP32(STATE_PENDING, STATE_APPLYING, &x->x_stapply))
+        return 0;
+    
+    if (x->x_stbins == x->x_freezebins) {
+        slots = x->x_stslots < x->x_slotcount ? x->x_stslots : x->x_slotcount;
+        memcpy(x->x_slotdata, x->x_stdata + x->x_freezebins, sizeof(double) * slots * FREEZE_ARRAYS * x->x_freezebins);
+        x->x_morphslots = 0;    // a frozen output restarts from the phases of its slot
+        
+        // the profile replaces a learning in progress, like a new learn request
+        if (x->x_stlearned) {
+            memcpy(x->x_noise, x->x_stdata, sizeof(double) * x->x_freezebins);
+            x->x_learntotal = x->x_stlearned;
+            x->x_learnleft = 0;
+        }
+        applied = 1;
+    }
+    
+    lockfree_store(&x->x_stapply, STATE_OWNED);
+    return applied;
+}
+
+
+
+
+
+
+//____________________________________________________________________
+//                          Spectral Freeze
+//____________________________________________________________________
+
+/*
+ 
+ capture <slot> keeps two consecutive frames : the magnitudes and the phases of the second one, and the phase
+ advance between them, the unit phasor of X(n) conj(X(n - 1)). freeze and morph resynthesize from the slots :
+ on each frame the running phasor of every bin turns by the advance, the magnitudes are interpolated (their
+ logs with morphmode log, i.e. a geometric interpolation), then the backward transform is windowed again and
+ overlap-added. Between two slots the advances are interpolated too and brought back on the unit circle.
+ 
+ The requests are 32 bit words the audio thread reads on each frame, and the slots are carved from the arena
+ block in dsp64 : neither the capture nor the synthesis allocates or locks. The bin loops run on t_vd,
+ x_freezebins is rounded up so they have no scalar tail.
+ A slot replays the phase advance of the hop used when it was captured.
+ 
+ */
+
+// capture <slot>, the next two frames are stored in slot
+void templatefftw_capture(t_templatefftw *x, long slot)
+{
+    if (slot < 0 || slot >= x->x_slots) {
+        object_error((t_object *)x, "capture: no slot %ld (0 to %ld)", slot, x->x_slots - 1);
+        return;
+    }
+    
+    lockfree_store(&x->x_capture, (int32_t)slot + 1);
+}
+
+// freeze <slot>, resynthesizes a single slot
+void templatefftw_freeze(t_templatefftw *x, long slot)
+{
+    if (slot < 0 || slot >= x->x_slots) {
+        object_error((t_object *)x, "freeze: no slot %ld (0 to %ld)", slot, x->x_slots - 1);
+        return;
+    }
+    
+    lockfree_store(&x->x_morph, templatefftw_morphpack(slot, slot, 0.));
+}
+
+// morph <a> <b> <t>, t from 0. (slot a) to 1. (slot b)
+void templatefftw_morph(t_templatefftw *x, t_symbol *s, long argc, t_atom *argv)
+{
+    long a, b;
+    
+    if (argc < 3) {
+        object_error((t_object *)x, "morph: expects <slot> <slot> <position>");
+        return;
+    }
+    
+    a = (long)atom_getlong(argv);
+    b = (long)atom_getlong(argv + 1);
+    if (a < 0 || a >= x->x_slots || b < 0 || b >= x->x_slots) {
+        object_error((t_object *)x, "morph: slots go from 0 to %ld", x->x_slots - 1);
+        return;
+    }
+    
+    lockfree_store(&x->x_morph, templatefftw_morphpack(a, b, atom_getfloat(argv + 2)));
+}
+
+// back to the passthrough or the convolution
+void templatefftw_unfreeze(t_templatefftw *x)
+{
+    lockfree_store(&x->x_morph, 0);
+}
+
+// a morph request in a single word : a + 1 in bits 0 - 4, b + 1 in bits 5 - 9, t in 1 / 65535 in bits 10 - 25
+int32_t templatefftw_morphpack(long a, long b, double t)
+{
+    t = t < 0. ? 0. : (t > 1. ? 1. : t);
+    
+    return (int32_t)((a + 1) | ((b + 1) << 5) | ((long)(t * 65535. + 0.5) << 10));
+}
+
+// audio thread, once per frame after the analysis : capture, then the synthesis of the next hop
+// returns 1 if x_synth holds the next hop
+long templatefftw_freezeframe(t_templatefftw *x, long hop)
+{
+    int32_t req;
+    long    a, b;
+    
+    // the frame after the request completes the capture, a new request waits for it
+    if (x->x_capslot >= 0) {
+        templatefftw_capturestore(x, x->x_capslot);
+        x->x_capslot = -1;
+    }
+    else if ((req = lockfree_exchange(&x->x_capture, 0)) > 0 && req <= x->x_slotcount) {
+        memcpy(x->x_capbins, x->x_bins, sizeof(fftw_complex) * x->x_nbins);
+        x->x_capslot = req - 1;
+    }
+    
+    // slots beyond x_slotcount were requested before dsp64 shrank them, the live output stays
+    req = lockfree_load(&x->x_morph);
+    a = (req & 31) - 1;
+    b = ((req >> 5) & 31) - 1;
+    if (a < 0 || b < 0 || a >= x->x_slotcount || b >= x->x_slotcount) {
+        x->x_morphslots = 0;
+        return 0;
+    }
+    
+    // the phases start from the first slot when the slots change (FREEZE_PHIM follows FREEZE_PHRE),
+    // a new t keeps the running phases
+    if ((req & 1023) != x->x_morphslots) {
+        memcpy(x->x_phre, FREEZE_ARRAY(x, a, FREEZE_PHRE), sizeof(double) * 2 * x->x_freezebins);
+        x->x_morphslots = req & 1023;
+    }
+    
+    templatefftw_synthesize(x, a, b, ((req >> 10) & 65535) / 65535., hop);
+    return 1;
+}
+
+// audio thread, stores x_bins in slot, x_capbins being the frame before
+void templatefftw_capturestore(t_templatefftw *x, long slot)
+{
+    double  *mag    = FREEZE_ARRAY(x, slot, FREEZE_MAG);
+    double  *logmag = FREEZE_ARRAY(x, slot, FREEZE_LOGMAG);
+    double  *advre  = FREEZE_ARRAY(x, slot, FREEZE_ADVRE);
+    double  *advim  = FREEZE_ARRAY(x, slot, FREEZE_ADVIM);
+    double  *phre   = FREEZE_ARRAY(x, slot, FREEZE_PHRE);
+    double  *phim   = FREEZE_ARRAY(x, slot, FREEZE_PHIM);
+    double  re, im, m, ar, ai, n;
+    long    i;
+    
+    for (i = 0; i < x->x_nbins; i++) {
+        re = x->x_bins[i][0];
+        im = x->x_bins[i][1];
+        m  = sqrt(re * re + im * im);
+        
+        // X(n) conj(X(n - 1))
+        ar = re * x->x_capbins[i][0] + im * x->x_capbins[i][1];
+        ai = im * x->x_capbins[i][0] - re * x->x_capbins[i][1];
+        n  = sqrt(ar * ar + ai * ai);
+        
+        mag[i]    = m;
+        logmag[i] = log(m > TEMPLATEFFTW_FLOOR ? m : TEMPLATEFFTW_FLOOR);
+        advre[i]  = n > 0. ? ar / n : 1.;
+        advim[i]  = n > 0. ? ai / n : 0.;
+        phre[i]   = m > 0. ? re / m : 1.;
+        phim[i]   = m > 0. ? im / m : 0.;
+    }
+}
+
+// audio thread : turns the phasors, interpolates slots a and b at t and overlap-adds the frame
+void templatefftw_synthesize(t_templatefftw *x, long a, long b, double t, long hop)
+{
+    long            array = x->x_morphlog ? FREEZE_LOGMAG : FREEZE_MAG;
+    const double    *ma  = FREEZE_ARRAY(x, a, array);
+    const double    *mb  = FREEZE_ARRAY(x, b, array);
+    const double    *ara = FREEZE_ARRAY(x, a, FREEZE_ADVRE);
+    const double    *aia = FREEZE_ARRAY(x, a, FREEZE_ADVIM);
+    const double    *arb = FREEZE_ARRAY(x, b, FREEZE_ADVRE);
+    const double    *aib = FREEZE_ARRAY(x, b, FREEZE_ADVIM);
+    double          *phre = x->x_phre;
+    double          *phim = x->x_phim;
+    double          yr[VD_SIZE], yi[VD_SIZE];
+    t_vd            vt = vd_set1(t);
+    t_vd            m, ar, ai, pr, pi, nr, ni, len, keep;
+    long            i, j;
+    
+    for (i = 0; i < x->x_freezebins; i += VD_SIZE) {
+        m = vd_madd(vt, vd_sub(vd_load(mb + i), vd_load(ma + i)), vd_load(ma + i));
+        if (array == FREEZE_LOGMAG)
+            m = vd_exp(m);
+        
+        ar = vd_madd(vt, vd_sub(vd_load(arb + i), vd_load(ara + i)), vd_load(ara + i));
+        ai = vd_madd(vt, vd_sub(vd_load(aib + i), vd_load(aia + i)), vd_load(aia + i));
+        
+        // phasor times advance, normalized ; a null advance (opposite slots halfway) keeps the phase
+        pr  = vd_load(phre + i);
+        pi  = vd_load(phim + i);
+        nr  = vd_sub(vd_mul(pr, ar), vd_mul(pi, ai));
+        ni  = vd_madd(pr, ai, vd_mul(pi, ar));
+        len = vd_sqrt(vd_madd(nr, nr, vd_mul(ni, ni)));
+        keep = vd_cmpgt(len, vd_set1(1e-12));
+        len = vd_select(keep, len, vd_set1(1.));
+        pr  = vd_select(keep, vd_div(nr, len), pr);
+        pi  = vd_select(keep, vd_div(ni, len), pi);
+        vd_store(phre + i, pr);
+        vd_store(phim + i, pi);
+        
+        vd_store(yr, vd_mul(m, pr));
+        vd_store(yi, vd_mul(m, pi));
+        for (j = 0; j < VD_SIZE; j++) {
+            x->x_spec[i + j][0] = yr[j];
+            x->x_spec[i + j][1] = yi[j];
+        }
+    }
+    
+    templatefftw_overlapadd(x, hop);
+}
+
+// audio thread : backward transform of x_spec, windowed and overlap-added, x_synth gets the next hop
+// the accumulator starts empty when the left outlet wasn't resynthesized on the previous frame
+void templatefftw_overlapadd(t_templatefftw *x, long hop)
+{
+    // 1 / N for the backward transform, hop / sum(w^2) for the overlap of the squared window
+    t_vd    scale = vd_set1((double)hop / (x->x_n * x->x_winsq));
+    long    i;
+    
+    if (!x->x_resynth)
+        memset(x->x_ola, 0, sizeof(double) * x->x_n);
+    
+    // the analysis frame is done with, it receives the backward transform
+    fftw_execute_dft_c2r(x->x_iplan, x->x_spec, x->x_frame);
+    
+    for (i = 0; i < x->x_n; i += VD_SIZE)
+        vd_store(x->x_ola + i, vd_madd(vd_mul(vd_load(x->x_frame + i), vd_load(x->x_window + i)), scale, vd_load(x->x_ola + i)));
+    
+    // the first hop is complete, the accumulator slides by a hop
+    memcpy(x->x_synth, x->x_ola, hop * sizeof(double));
+    memmove(x->x_ola, x->x_ola + hop, (x->x_n - hop) * sizeof(double));
+    memset(x->x_ola + x->x_n - hop, 0, hop * sizeof(double));
+}
+
+
+
+
+
+
+//____________________________________________________________________
+//                          Noise Reduction
+//____________________________________________________________________
+
+/*
+ 
+ learn [frames] sums the power of the next frames, their average becomes the noise profile N. With denoise on,
+ each bin of the input is scaled by a gain of r = N / P (P the power of the bin, r clipped to 1) :
+    - subtract  : 1 - a sqrt(r), magnitude subtraction
+    - wiener    : (1 - r) / (1 + (a - 1) r), i.e. SNR / (SNR + a) with the SNR estimated as P / N - 1
+ a is denoiseamount, the gain is clipped to [denoisefloor, 1]. Then it is smoothed over the bins (1/4 1/2 1/4)
+ and over the frames (one pole, denoisesmooth), which keeps the residual noise from "singing", and the
+ scaled spectrum is resynthesized by overlap-add like a freeze.
+ 
+ The bin loops have no data dependent branch (min/max and selects), and run on t_vd over the interleaved bins.
+ The profile is carved from the arena block with the STFT buffers, learning only adds into it.
+ Without a profile N is 0, every gain is 1. The state file keeps the profile ("NOIS", see State Snapshot).
+ 
+ */
+
+// learn [frames], the profile is the average power of the next frames
+void templatefftw_learn(t_templatefftw *x, long frames)
+{
+    lockfree_store(&x->x_learn, (int32_t)(frames > 0 ? frames : TEMPLATEFFTW_LEARNFRAMES));
+}
+
+// audio thread, once per frame : adds the power of the bins while learning
+void templatefftw_learnframe(t_templatefftw *x)
+{
+    double  *acc = x->x_noiseacc;
+    double  *bins = (double *)x->x_bins;    // re, im interleaved, 2 bins per load pair
+    t_vd    k;
+    int32_t req;
+    long    i;
+    
+    // a new request restarts the sum
+    if ((req = lockfree_exchange(&x->x_learn, 0)) > 0) {
+        memset(acc, 0, sizeof(double) * x->x_freezebins);
+        x->x_learnleft = x->x_learntotal = req;
+    }
+    if (x->x_learnleft <= 0)
+        return;
+    
+    for (i = 0; i < x->x_freezebins; i += VD_SIZE)
+        vd_store(acc + i, vd_add(vd_load(acc + i), templatefftw_power(bins + 2 * i)));
+    
+    // the profile changes in one frame, once the sum is complete
+    if (--x->x_learnleft == 0) {
+        k = vd_set1(1. / x->x_learntotal);
+        for (i = 0; i < x->x_freezebins; i += VD_SIZE)
+            vd_store(x->x_noise + i, vd_mul(vd_load(acc + i), k));
+        clock_delay(x->x_learnclock, 0);
+    }
+}
+
+// audio thread : computes the gains and resynthesizes the scaled input, returns 1 if x_synth holds the next hop
+long templatefftw_denoise(t_templatefftw *x, long hop)
+{
+    double  *bins = (double *)x->x_bins;
+    double  *noise = x->x_noise;
+    double  *gains = x->x_gains;
+    double  *graw = x->x_graw + 1;          // graw[-1] and graw[x_freezebins] are the guards
+    double  g[VD_SIZE];
+    long    wiener = x->x_denoise == DENOISE_WIENER;
+    t_vd    one = vd_set1(1.);
+    t_vd    a = vd_set1(x->x_denoiseamount);
+    t_vd    gmin = vd_set1(x->x_denoisefloor);
+    t_vd    smooth = vd_set1(x->x_denoisesmooth);
+    t_vd    r, gv;
+    long    i, j;
+    
+    if (x->x_denoise == DENOISE_OFF)
+        return 0;
+    
+    // the gain rule is the same for the whole frame, the bins only go through min/max
+    for (i = 0; i < x->x_freezebins; i += VD_SIZE) {
+        r = vd_min(vd_div(vd_load(noise + i), vd_max(templatefftw_power(bins + 2 * i), vd_set1(DBL_MIN))), one);
+        if (wiener)
+            gv = vd_div(vd_sub(one, r), vd_max(vd_madd(vd_sub(a, one), r, one), vd_set1(DBL_MIN)));
+        else
+            gv = vd_sub(one, vd_mul(a, vd_sqrt(r)));
+        vd_store(graw + i, vd_min(vd_max(gv, gmin), one));
+    }
+    
+    // the guards repeat the edge bins (the padding bin repeats the last one)
+    graw[-1] = graw[0];
+    graw[x->x_nbins] = graw[x->x_freezebins] = graw[x->x_nbins - 1];
+    
+    for (i = 0; i < x->x_freezebins; i += VD_SIZE) {
+        gv = vd_mul(vd_set1(0.25), vd_add(vd_load(graw + i - 1), vd_load(graw + i + 1)));
+        gv = vd_madd(vd_set1(0.5), vd_load(graw + i), gv);
+        gv = vd_madd(smooth, vd_sub(vd_load(gains + i), gv), gv);
+        vd_store(gains + i, gv);
+        
+        vd_store(g, gv);
+        for (j = 0; j < VD_SIZE; j++)
+            vd_store(x->x_spec[i + j], vd_mul(vd_load(x->x_bins[i + j]), vd_set1(g[j])));
+    }
+    
+    templatefftw_overlapadd(x, hop);
+    return 1;
+}
+
+// power of two interleaved bins (re, im, re, im)
+t_vd templatefftw_power(const double *bins)
+{
+    t_vd a = vd_load(bins);
+    t_vd b = vd_load(bins + VD_SIZE);
+    
+    return vd_hadd2(vd_mul(a, a), vd_mul(b, b));
+}
+
+// scheduler, the learning finished on the audio thread
+void templatefftw_learntick(t_templatefftw *x)
+{
+    object_post((t_object *)x, "noise profile learned over %ld frames", x->x_learntotal);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Pitch Tracking
+//____________________________________________________________________
+
+/*
+ 
+ Both trackers work on the difference of the frame with itself shifted by a lag, over the overlapping part :
+    d(lag) = sum (x[j] - x[j + lag])^2 = m(lag) - 2 r(lag)     j from 0 to N - 1 - lag
+ r is the autocorrelation and m the energy term, sum x[j]^2 + x[j + lag]^2. Computed lag by lag it would be
+ O(N^2) per frame : r comes instead from the backward transform of the power spectrum of the frame zero padded
+ to 2 N (so the correlation doesn't wrap around), and m from m(0) = 2 r(0), minus two squares per lag.
+    - yin : d'(lag) = d(lag) lag / sum of d(1 .. lag), the first dip below pitchthresh (followed down to
+            its bottom) is the period, the confidence is 1 - d'
+    - mpm : n(lag) = 2 r(lag) / m(lag), the first key maximum above TEMPLATEFFTW_MPMK times the highest one
+            is the period, the confidence is its height
+ The lag is refined by a parabola through its neighbours. The frame is the STFT history without window,
+ the lowest pitch is sr / x_maxlag. A silent frame, or one without a period, reads 0 Hz, 0 confidence.
+ 
+ The audio thread writes both values in a snapshot and sets a clock, pitch <Hz> <confidence> goes out
+ from the scheduler on every frame. The 2 N plans are shared by the instances like the others.
+ 
+ */
+
+// audio thread, once per frame : autocorrelation and energy terms, then the tracker
+void templatefftw_pitchframe(t_templatefftw *x)
+{
+    double  *a = x->x_acf;
+    double  *m = x->x_acfm;
+    double  *bins = (double *)x->x_acfbins;
+    double  *out;
+    double  p[VD_SIZE];
+    double  hz = 0., conf = 0.;
+    long    old = x->x_n - x->x_fifopos;
+    long    i, j;
+    
+    // oldest sample first, no window, the second half is the zero padding (the last backward transform wrote there)
+    memcpy(a, x->x_fifo + x->x_fifopos, old * sizeof(double));
+    memcpy(a + old, x->x_fifo, x->x_fifopos * sizeof(double));
+    memset(a + x->x_n, 0, x->x_n * sizeof(double));
+    
+    // m(0) = 2 r(0), each lag drops a sample at each end
+    m[0] = 0.;
+    for (i = 0; i < x->x_n; i++)
+        m[0] += a[i] * a[i];
+    m[0] *= 2.;
+    for (i = 1; i <= x->x_maxlag; i++)
+        m[i] = m[i - 1] - a[i - 1] * a[i - 1] - a[x->x_n - i] * a[x->x_n - i];
+    
+    // the autocorrelation is the backward transform of the power spectrum : a[lag] = 2 N r(lag) afterwards
+    fftw_execute_dft_r2c(x->x_acfr2c, a, x->x_acfbins);
+    for (i = 0; i < x->x_n + 2; i += VD_SIZE) {
+        vd_store(p, templatefftw_power(bins + 2 * i));
+        for (j = 0; j < VD_SIZE; j++) {
+            x->x_acfbins[i + j][0] = p[j];
+            x->x_acfbins[i + j][1] = 0.;
+        }
+    }
+    fftw_execute_dft_c2r(x->x_acfc2r, x->x_acfbins, a);
+    
+    // below -100 dBFS there is nothing to track
+    if (m[0] > 2e-10 * x->x_n)
+        hz = x->x_pitch == PITCH_YIN ? templatefftw_yin(x, &conf) : templatefftw_mpm(x, &conf);
+    
+    out = (double *) snapshot_back(&x->x_pitchout);
+    out[0] = hz;
+    out[1] = conf;
+    snapshot_publish(&x->x_pitchout);
+    clock_delay(x->x_pitchclock, 0);    // the outlet is called from the scheduler, not from here
+}
+
+// cumulative mean normalized difference, returns the frequency
+double templatefftw_yin(t_templatefftw *x, double *conf)
+{
+    double  *d = x->x_acfd;
+    double  *m = x->x_acfm;
+    double  *a = x->x_acf;
+    double  k = 1. / x->x_n;   // a[lag] / N = 2 r(lag)
+    double  sum = 0., y;
+    long    i, best;
+    
+    d[0] = 1.;
+    for (i = 1; i <= x->x_maxlag; i++) {
+        y = m[i] - a[i] * k;
+        sum += y;
+        d[i] = sum > 0. ? y * i / sum : 1.;
+    }
+    
+    // first dip below the threshold, down to its bottom, or the lowest point if nothing dips
+    for (best = 2; best < x->x_maxlag; best++)
+        if (d[best] < x->x_pitchthresh)
+            break;
+    if (best < x->x_maxlag) {
+        while (best + 1 < x->x_maxlag && d[best + 1] < d[best])
+            best++;
+    }
+    else {
+        for (best = i = 2; i < x->x_maxlag; i++)
+            if (d[i] < d[best])
+                best = i;
+    }
+    
+    y = templatefftw_parabola(d, best, &sum);
+    *conf = sum < 0. ? 1. : (sum > 1. ? 0. : 1. - sum);
+    
+    return x->x_sr / y;
+}
+
+// normalized square difference function, returns the frequency (0. if none)
+double templatefftw_mpm(t_templatefftw *x, double *conf)
+{
+    double  *n = x->x_acfd;
+    double  *m = x->x_acfm;
+    double  *a = x->x_acf;
+    double  k = 1. / x->x_n;
+    double  highest = 0., peak, lag;
+    long    peaks[TEMPLATEFFTW_MPMPEAKS];
+    long    count = 0;
+    long    i, best;
+    
+    for (i = 0; i <= x->x_maxlag; i++)
+        n[i] = m[i] > 0. ? a[i] * k / m[i] : 0.;
+    
+    // key maxima : the highest point of each positive lobe, the lobe around lag 0 excluded
+    for (i = 1; i < x->x_maxlag && n[i] > 0.; i++)
+        ;
+    while (count < TEMPLATEFFTW_MPMPEAKS) {
+        while (i < x->x_maxlag && n[i] <= 0.)
+            i++;
+        if (i >= x->x_maxlag)
+            break;
+        for (best = i; i < x->x_maxlag && n[i] > 0.; i++)
+            if (n[i] > n[best])
+                best = i;
+        peaks[count++] = best;
+        if (n[best] > highest)
+            highest = n[best];
+    }
+    
+    *conf = 0.;
+    if (!count)
+        return 0.;
+    
+    for (i = 0; i < count - 1; i++)
+        if (n[peaks[i]] >= TEMPLATEFFTW_MPMK * highest)
+            break;
+    
+    lag = templatefftw_parabola(n, peaks[i], &peak);
+    *conf = peak < 0. ? 0. : (peak > 1. ? 1. : peak);
+    
+    return x->x_sr / lag;
+}
+
+// vertex of the parabola through y[i - 1], y[i], y[i + 1] : returns its position, its value in *peak
+double templatefftw_parabola(double *y, long i, double *peak)
+{
+    double  den = y[i - 1] - 2. * y[i] + y[i + 1];
+    double  delta = den != 0. ? 0.5 * (y[i - 1] - y[i + 1]) / den : 0.;
+    
+    // a flat neighbourhood can push the vertex away, it stays between the neighbours
+    delta = delta < -1. ? -1. : (delta > 1. ? 1. : delta);
+    *peak = y[i] - 0.25 * (y[i - 1] - y[i + 1]) * delta;
+    
+    return i + delta;
+}
+
+// scheduler, outputs the newest frame's pitch
+void templatefftw_pitchtick(t_templatefftw *x)
+{
+    double  *v;
+    long    fresh;
+    t_atom  a[2];
+    
+    v = (double *) snapshot_read(&x->x_pitchout, &fresh);
+    if (!fresh)
+        return;
+    
+    atom_setfloat(a, v[0]);
+    atom_setfloat(a + 1, v[1]);
+    outlet_anything(x->x_spectrum, gensym("pitch"), 2, a);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Accuracy Check
+//____________________________________________________________________
+/*
+ 
+ check runs the transforms of this instance on the signals of accuracy.h (noise, DC, sine, denormals, NaN and
+ infinities) and compares them with plain references :
+    r2c     each forward plan (frame, convolution, autocorrelation) against accuracy_dft, summed in long double
+    c2r     each backward plan on the spectrum of the forward one, against the input times n (round trip)
+    acf     the autocorrelation of the pitch tracker (power spectrum of the zero padded frame, backward transform)
+            against the direct sum over the lags, N * N / 2 products
+ An FFT spreads its rounding over all the bins : the error is relative to the largest bin (or sample) of the signal,
+ a bin 100 dB below it is only as exact as it. A reference bin or lag costs n products, about TEMPLATEFFTW_CHECKBINS
+ of them (evenly spread) are compared, the transforms see all of them.
+ 
+ Main thread, it allocates and takes a fraction of a second. Executing a plan is thread safe, the audio thread
+ keeps using them meanwhile.
+ 
+ */
+
+void templatefftw_check(t_templatefftw *x)
+{
+    long fails = 0;
+    
+    fails += templatefftw_checkplans(x, x->x_plan, x->x_iplan, x->x_n, "frame");
+    fails += templatefftw_checkplans(x, x->x_convr2c, x->x_convc2r, 2 * TEMPLATEFFTW_CONVP, "convolution");
+    fails += templatefftw_checkplans(x, x->x_acfr2c, x->x_acfc2r, 2 * x->x_n, "autocorrelation");
+    fails += templatefftw_checkacf(x);
+    
+    if (fails)
+        object_error((t_object *)x, "check: %ld transform(s) above bounds", fails);
+    else
+        object_post((t_object *)x, "check : transforms within bounds");
+}
+
+// the largest finite |value|, the floor of the relative error
+static double templatefftw_checkfloor(const double *v, long n)
+{
+    double  m = 0.;
+    long    i;
+    
+    for (i = 0; i < n; i++)
+        if (isfinite(v[i]) && fabs(v[i]) > m)
+            m = fabs(v[i]);
+    return m > 0. ? m : 1.;
+}
+
+// one forward and one backward plan of size n, returns the number of them above bounds
+long templatefftw_checkplans(t_templatefftw *x, fftw_plan r2c, fftw_plan c2r, long n, const char *name)
+{
+    t_accuracy      fwd, bwd;
+    double          *in, *back, *ref, *spec;
+    fftw_complex    *out;
+    uint32_t        seed = 0x9E3779B9;
+    long            nbins = n / 2 + 1;
+    long            kind, i, bad, fails = 0;
+    
+    if (!r2c || !c2r)
+        return 0;
+    // the plans want fftw_malloc's alignment, the references don't
+    in   = (double *) fftw_malloc(sizeof(double) * n);
+    back = (double *) fftw_malloc(sizeof(double) * n);
+    out  = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * nbins);
+    ref  = (double *) sysmem_newptr(sizeof(double) * (n + 2 * nbins));
+    if (!in || !back || !out || !ref) {
+        object_error((t_object *)x, "check: out of memory");
+        fails = 1;
+        goto done;
+    }
+    spec = ref + n;
+    
+    accuracy_reset(&fwd, 1., 0);
+    accuracy_reset(&bwd, 1., 0);
+    
+    for (kind = 0; kind < ACCURACY_KINDS; kind++) {
+        accuracy_signal(in, n, kind, 1., &seed);
+        if (accuracy_dft(in, n, spec, TEMPLATEFFTW_CHECKBINS)) {
+            object_error((t_object *)x, "check: out of memory");
+            fails = 1;
+            goto done;
+        }
+        
+        // a fftw_complex array is the (re, im) pairs of accuracy_dft
+        fftw_execute_dft_r2c(r2c, in, out);
+        fwd.floor = templatefftw_checkfloor(spec, 2 * nbins);
+        accuracy_add(&fwd, spec, (double *)out, 2 * nbins);
+        
+        // round trip, the c2r overwrites its input
+        fftw_execute_dft_r2c(r2c, in, out);
+        fftw_execute_dft_c2r(c2r, out, back);
+        for (i = 0, bad = 0; i < n; i++)
+            bad |= !isfinite(in[i]);
+        for (i = 0; i < n; i++)
+            ref[i] = bad ? NAN : in[i] * n;
+        bwd.floor = templatefftw_checkfloor(ref, n);
+        accuracy_add(&bwd, ref, back, n);
+    }
+    
+    fails += accuracy_fails(&fwd, TEMPLATEFFTW_CHECKREL, TEMPLATEFFTW_CHECKDB);
+    fails += accuracy_fails(&bwd, TEMPLATEFFTW_CHECKREL, TEMPLATEFFTW_CHECKDB);
+    object_post((t_object *)x, "check %-15s %6ld : r2c error %-12g %7.1f dB%s, c2r error %-12g %7.1f dB%s", name, n,
+                fwd.maxrel, fwd.db, accuracy_fails(&fwd, TEMPLATEFFTW_CHECKREL, TEMPLATEFFTW_CHECKDB) ? " (above bound)" : "",
+                bwd.maxrel, bwd.db, accuracy_fails(&bwd, TEMPLATEFFTW_CHECKREL, TEMPLATEFFTW_CHECKDB) ? " (above bound)" : "");
+    
+done:
+    fftw_free(in);
+    fftw_free(back);
+    fftw_free(out);
+    if (ref)
+        sysmem_freeptr(ref);
+    return fails;
+}
+
+// the steps of templatefftw_pitchframe on a frame of each signal, against the direct autocorrelation
+long templatefftw_checkacf(t_templatefftw *x)
+{
+    t_accuracy      acc;
+    double          *a, *frame, *ref;
+    fftw_complex    *bins;
+    double          p[VD_SIZE];
+    long double     r;
+    uint32_t        seed = 0x9E3779B9;
+    long            n = x->x_n;
+    long            maxlag = n / 2;
+    long            step = (maxlag + TEMPLATEFFTW_CHECKBINS) / TEMPLATEFFTW_CHECKBINS;
+    long            kind, i, j, bad, fails = 0;
+    
+    if (!x->x_acfr2c || !x->x_acfc2r)
+        return 0;
+    
+    a     = (double *) fftw_malloc(sizeof(double) * 2 * n);
+    bins  = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * (n + 2));
+    frame = (double *) sysmem_newptr(sizeof(double) * (n + maxlag + 1));
+    if (!a || !bins || !frame) {
+        object_error((t_object *)x, "check: out of memory");
+        fails = 1;
+        goto done;
+    }
+    ref = frame + n;
+    accuracy_reset(&acc, 1., 0);
+    
+    for (kind = 0; kind < ACCURACY_KINDS; kind++) {
+        accuracy_signal(frame, n, kind, 1., &seed);
+        
+        memcpy(a, frame, n * sizeof(double));
+        memset(a + n, 0, n * sizeof(double));
+        fftw_execute_dft_r2c(x->x_acfr2c, a, bins);
+        for (i = 0; i < n + 2; i += VD_SIZE) {
+            vd_store(p, templatefftw_power((double *)bins + 2 * i));
+            for (j = 0; j < VD_SIZE; j++) {
+                bins[i + j][0] = p[j];
+                bins[i + j][1] = 0.;
+            }
+        }
+        fftw_execute_dft_c2r(x->x_acfc2r, bins, a);
+        
+        // a[lag] = 2 N r(lag) every step lags, undefined with a NaN or an infinity in the frame (as accuracy_dft)
+        for (i = 0, bad = 0; i < n; i++)
+            bad |= !isfinite(frame[i]);
+        for (i = 0; i <= maxlag; i++) {
+            for (j = 0, r = 0.; j < n - i && !bad && !(i % step); j++)
+                r += (long double)frame[j] * frame[j + i];
+            ref[i] = bad || i % step ? NAN : (double)(2 * n * r);
+        }
+        acc.floor = templatefftw_checkfloor(ref, maxlag + 1);
+        accuracy_add(&acc, ref, a, maxlag + 1);
+    }
+    
+    fails = accuracy_fails(&acc, TEMPLATEFFTW_CHECKREL, TEMPLATEFFTW_CHECKDB);
+    object_post((t_object *)x, "check %-15s %6ld : error %-12g %7.1f dB%s", "acf", n, acc.maxrel, acc.db, fails ? " (above bound)" : "");
+    
+done:
+    fftw_free(a);
+    fftw_free(bins);
+    if (frame)
+        sysmem_freeptr(frame);
+    return fails;
+}
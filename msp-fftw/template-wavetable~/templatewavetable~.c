@@ -0,0 +1,716 @@
+/**
+ *
+ *  @file	templatewavetable~.c
+ *
+ *
+ *  Sources :
+ *
+ *   Cylcing 74'
+ *    - Max 7.1 API :
+ *          https://cycling74.com/sdk/MaxSDK-6.0.4/html/index.html
+ *
+ *    - Max/MSP 7.1 SDK examples :
+ *          https://cycling74.com/downloads/sdk/#.Vzn0OpPbugw
+ *
+ *   FFTW3 documentation :
+ *      http://www.fftw.org/fftw3.pdf
+ *
+ *   T. Stilson, J. Smith
+ *    - Alias-Free Digital Synthesis of Classic Analog Waveforms (ICMC, 1996)
+ *
+ *
+ *  This object is a band-limited wavetable oscillator : [templatewavetable~ 220] plays one cycle of a waveform at
+ *  the frequency of its signal inlet (or of the last float, 220 Hz here), without aliasing. It plays a sine until
+ *  set <buffer~ name> [channel] gives it a cycle. phase <0 - 1> restarts the cycle.
+ *
+ *  The cycle is transformed once, at any length, and resampled in the spectrum to TEMPLATEWAVETABLE_SIZE samples.
+ *  Level j of the mipmap keeps the harmonics up to (TEMPLATEWAVETABLE_SIZE / 2) >> j, one inverse transform each :
+ *  a level has half the harmonics of the previous one, i.e. it can play an octave higher. The highest harmonic
+ *  of a note at f Hz has to stay under sr / 2, the perform routine crossfades the two highest levels that fit,
+ *  so a sweep moves smoothly from one to the next.
+ *
+ *  The two levels are interleaved in memory, one vd_load reads the same point of both : linear interpolation
+ *  in the table runs on both levels at once in the lanes of a t_vd, then the lanes are crossfaded.
+ *
+ *  set copies the buffer~ and starts a worker thread which builds the mipmap in a free slot and publishes it,
+ *  the audio thread swaps tables at the start of a vector and never waits (same scheme as the kernels of
+ *  templatefftw~, see Table Swap).
+ *
+ */
+
+//____________________________________________________________________
+//                         External Libraries
+//____________________________________________________________________
+/*
+
+ Headears and Platform specific elements
+
+ */
+#ifdef MAC_VERSION
+    // do something specific to the Mac
+#endif
+#ifdef WIN_VERSION
+    // do something specific to Windows
+#endif
+
+#include "ext.h"            // should always be first, then ext_obex.h + other files.
+#include "ext_obex.h"		// required for "new" style objects
+#include "z_dsp.h"			// required for MSP objects
+#include "ext_buffer.h"     // the cycle comes from a buffer~
+#include "ext_systhread.h"  // the mipmap is built on a worker thread
+
+#include <math.h>
+#ifndef M_PI
+#define M_PI 3.14159265358979323846     // not defined by every compiler (Visual Studio)
+#endif
+
+#include "../template-fftw~/fftw3.h"    // the FFTW build of templatefftw~
+
+#include "../../common/simd.h"
+#include "../../common/lockfree.h"
+#include "../../common/tablecache.h"
+#include "../../common/denormal.h"
+
+#define TEMPLATEWAVETABLE_SIZE      2048    ///<    Samples of a level, a power of 2
+#define TEMPLATEWAVETABLE_LEVELS    11      ///<    Levels of the mipmap, 1023 harmonics down to 1 (log2(SIZE / 2) + 1)
+#define TEMPLATEWAVETABLE_MAXFRAMES 1048576 ///<    Longest cycle read from a buffer~
+#define TEMPLATEWAVETABLE_SLOTS     3       ///<    Table slots : live, ready and being built
+#define TEMPLATEWAVETABLE_PAIR      (2 * (TEMPLATEWAVETABLE_SIZE + 1))  ///<    Doubles of two interleaved levels, with the guard point
+
+// kinds of the plans shared through the table cache
+enum {
+    TABLE_PLAN_R2C = 1, ///<    Real to complex forward plan, of the cycle length
+    TABLE_PLAN_C2R      ///<    Complex to real backward plan of TEMPLATEWAVETABLE_SIZE
+};
+
+// life of a table slot, each state has a single owner thread which hands the slot to the next one
+enum {
+    WAVETABLE_FREE = 0,     ///<    Empty, main thread
+    WAVETABLE_BUILDING,     ///<    Being built, worker thread
+    WAVETABLE_READY,        ///<    Published in x_pending, audio thread picks it up at the next vector
+    WAVETABLE_LIVE,         ///<    Played by the audio thread
+    WAVETABLE_RETIRED       ///<    Replaced, freed on the main thread by templatewavetable_reclaim
+};
+
+// what set hands to the worker
+typedef struct _templatewavetable_job
+{
+    struct _templatewavetable *j_x;
+    long        j_slot;
+    double      *j_wave;        ///<    One cycle, copied from the buffer~
+    long        j_n;
+
+} t_templatewavetable_job;
+
+
+
+
+
+//____________________________________________________________________
+//                        'Class' Definition
+//____________________________________________________________________
+/*
+
+ 'Class' decleration and a struct for the object is declared and typedef'd.
+
+ */
+
+typedef struct _templatewavetable	///<	A struct to hold data for our object
+{
+    t_pxobject  x_obj;          ///<	The object itself (t_pxobject in MSP instead of t_object)
+    double      x_freq;         ///<    Frequency without a signal (argument, float)
+    double      x_sr;
+    fftw_plan   x_c2r;          ///<    Backward plan of a level, shared with the other instances
+
+    // audio thread
+    double      x_phase;        ///<    0 to 1
+    t_int32_atomic x_newphase;  ///<    Phase * 2^30 + 1 set by the phase message, 0 if none
+
+    // Table swap, see templatewavetable_set
+    double      *x_tset[TEMPLATEWAVETABLE_SLOTS];   ///<    Mipmaps, TEMPLATEWAVETABLE_LEVELS pairs of levels
+    t_int32_atomic x_tstate[TEMPLATEWAVETABLE_SLOTS];   ///<    WAVETABLE_FREE ... WAVETABLE_RETIRED
+    t_int32_atomic x_pending;   ///<    Slot + 1 of the newest READY table, 0 if none
+    long        x_live;         ///<    Slot played by the audio thread, -1 before the first table
+    t_systhread x_thread;       ///<    Worker building a table, joined once it returned (or by free)
+    t_int32_atomic x_busy;      ///<    The worker is building, cleared by it when it returns
+    t_templatewavetable_job *x_job; ///<    Newest set waiting for the worker, main thread
+    void        *x_clock;       ///<    Set from the audio thread and the worker when a slot retires or the worker returns
+    void        *x_qelem;       ///<    Frees the retired slots and starts the waiting set on the main thread
+
+} t_templatewavetable;
+
+// global pointer to our class definition that is setup in main()
+static t_class *templatewavetable_class = NULL;
+
+// plans shared by the instances
+static t_tablecache *templatewavetable_cache = NULL;
+
+
+
+
+
+//____________________________________________________________________
+//                        Function Prototypes
+//____________________________________________________________________
+
+//// standard set
+void *templatewavetable_new( t_symbol *s, long argc, t_atom *argv);
+void templatewavetable_free( t_templatewavetable *x);
+void templatewavetable_assist(t_templatewavetable *x, void *b, long m, long a, char *s);
+void *templatewavetable_tablecreate(long kind, long size, long variant);
+void templatewavetable_plandestroy(void *table);
+
+//// value specific
+void templatewavetable_float(t_templatewavetable *x, double f);
+void templatewavetable_int(  t_templatewavetable *x, long n);
+void templatewavetable_phase(t_templatewavetable *x, double f);
+
+//// performance set
+void templatewavetable_dsp64(t_templatewavetable *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
+void templatewavetable_perform64(t_templatewavetable *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+
+//// mipmap
+double *templatewavetable_build(t_templatewavetable *x, const double *wave, long n);
+
+//// table swap
+void templatewavetable_set(t_templatewavetable *x, t_symbol *s, long argc, t_atom *argv);
+void *templatewavetable_worker(t_templatewavetable_job *job);
+long templatewavetable_start(t_templatewavetable *x);
+void templatewavetable_idle(t_templatewavetable *x);
+void templatewavetable_jobfree(t_templatewavetable_job *job);
+long templatewavetable_slot(t_templatewavetable *x);
+void templatewavetable_publish(t_templatewavetable *x, long slot, double *table);
+void templatewavetable_retire(t_templatewavetable *x, long slot);
+void templatewavetable_tick(t_templatewavetable *x);
+void templatewavetable_reclaim(t_templatewavetable *x);
+
+
+
+
+
+//____________________________________________________________________
+//                          Initialisation Routine
+//____________________________________________________________________
+
+void ext_main(void *r)
+{
+    t_class *c;
+
+    c = class_new("templatewavetable~", (method)templatewavetable_new, (method)templatewavetable_free, (long)sizeof(t_templatewavetable), 0L, A_GIMME, 0);
+
+    class_addmethod(c, (method)templatewavetable_int,       "int",      A_LONG, 0);
+    class_addmethod(c, (method)templatewavetable_float,     "float",    A_FLOAT,0);
+    class_addmethod(c, (method)templatewavetable_phase,     "phase",    A_FLOAT,0);
+    class_addmethod(c, (method)templatewavetable_set,       "set",      A_GIMME, 0);
+    class_addmethod(c, (method)templatewavetable_dsp64,		"dsp64",	A_CANT, 0);
+    class_addmethod(c, (method)templatewavetable_assist,    "assist",	A_CANT, 0);
+
+    class_dspinit(c);
+    class_register(CLASS_BOX, c);
+    templatewavetable_class = c;
+
+    // lives as long as the class, plans are freed with their last user
+    templatewavetable_cache = tablecache_new();
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Instance Routines
+//____________________________________________________________________
+
+void *templatewavetable_new(t_symbol *s, long argc, t_atom *argv)
+{
+    t_templatewavetable *x = (t_templatewavetable *) object_alloc((t_class *) templatewavetable_class);
+    double  *sine;
+    long    i;
+
+    // the frequency inlet, the outlet
+    dsp_setup((t_pxobject *)x, 1);
+    outlet_new((t_pxobject *)x, "signal");
+
+    atom_arg_getdouble(&x->x_freq, 0, argc, argv);
+    x->x_sr = sys_getsr();
+    x->x_live = -1;
+    x->x_clock = clock_new(x, (method)templatewavetable_tick);
+    x->x_qelem = qelem_new(x, (method)templatewavetable_idle);
+
+    // a sine until the first set, built here : the instance plays as soon as it exists
+    x->x_c2r = (fftw_plan) tablecache_acquire(templatewavetable_cache, TABLE_PLAN_C2R, TEMPLATEWAVETABLE_SIZE, 0,
+                                              templatewavetable_tablecreate, templatewavetable_plandestroy);
+    sine = (double *) sysmem_newptr(sizeof(double) * TEMPLATEWAVETABLE_SIZE);
+    if (sine) {
+        for (i = 0; i < TEMPLATEWAVETABLE_SIZE; i++)
+            sine[i] = sin(2. * M_PI * i / TEMPLATEWAVETABLE_SIZE);
+        x->x_tset[0] = x->x_c2r ? templatewavetable_build(x, sine, TEMPLATEWAVETABLE_SIZE) : NULL;
+        sysmem_freeptr(sine);
+    }
+    if (!x->x_tset[0]) {
+        object_error((t_object *)x, "out of memory");
+        object_free(x);     // calls templatewavetable_free
+        return NULL;
+    }
+    templatewavetable_publish(x, 0, x->x_tset[0]);
+
+    return (x);
+}
+
+void templatewavetable_free(t_templatewavetable *x)
+{
+    long i;
+
+    dsp_free((t_pxobject *)x);
+
+    // out of the DSP chain and the worker done, every slot is ours
+    if (x->x_thread)
+        systhread_join(x->x_thread, NULL);
+    templatewavetable_jobfree(x->x_job);
+    if (x->x_clock)
+        object_free(x->x_clock);
+    if (x->x_qelem)
+        qelem_free(x->x_qelem);
+    for (i = 0; i < TEMPLATEWAVETABLE_SLOTS; i++)
+        if (x->x_tset[i])
+            sysmem_freeptr(x->x_tset[i]);
+
+    tablecache_release(templatewavetable_cache, x->x_c2r);
+}
+
+void *templatewavetable_tablecreate(long kind, long size, long variant)
+{
+    double      *in  = (double *) fftw_malloc(sizeof(double) * size);
+    fftw_complex *out = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * (size / 2 + 1));
+    fftw_plan   p = NULL;
+
+    // FFTW_ESTIMATE doesn't touch the arrays, the plans are executed on other fftw_malloc'd ones
+    if (in && out)
+        p = kind == TABLE_PLAN_R2C ? fftw_plan_dft_r2c_1d((int)size, in, out, FFTW_ESTIMATE)
+                                   : fftw_plan_dft_c2r_1d((int)size, out, in, FFTW_ESTIMATE);
+    fftw_free(in);
+    fftw_free(out);
+
+    return p;
+}
+
+void templatewavetable_plandestroy(void *table)
+{
+    fftw_destroy_plan((fftw_plan)table);
+}
+
+void templatewavetable_assist(t_templatewavetable *x, void *b, long m, long a, char *s)
+{
+    if (m == ASSIST_INLET)
+        sprintf(s, "(Signal/Float) Frequency; set <buffer~> loads a cycle, phase restarts it");
+    else if (m == ASSIST_OUTLET)
+        sprintf(s, "(Signal) Band-limited oscillator");
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Message Handlers
+//____________________________________________________________________
+
+void templatewavetable_int(t_templatewavetable *x, long n)
+{
+    templatewavetable_float(x, n);
+}
+
+// the frequency while the inlet has no signal
+void templatewavetable_float(t_templatewavetable *x, double f)
+{
+    x->x_freq = f;
+}
+
+// the audio thread jumps to it at its next vector
+void templatewavetable_phase(t_templatewavetable *x, double f)
+{
+    f -= floor(f);
+    lockfree_store(&x->x_newphase, (int32_t)(f * 1073741824.) + 1);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Perfomance Routines
+//____________________________________________________________________
+
+void templatewavetable_dsp64(t_templatewavetable *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
+{
+    x->x_sr = samplerate;
+
+    // without a signal the float frequency is used
+    object_method(dsp64, gensym("dsp_add64"), x, templatewavetable_perform64, 0, (void *)(t_ptr_int)count[0]);
+}
+
+/*
+
+ Level j has K_j = (SIZE / 2) >> j harmonics and plays without aliasing while f K_j < sr / 2. With
+ m = log2(2 f K_0 / sr) + 1, clipped to 0 ... LEVELS - 1, pair j = floor(m) holds levels j and j + 1 : both fit,
+ and the crossfade t = m - j reaches level j + 1 alone when the next pair starts. The level and the weights only
+ change with the frequency, the perform routine computes them again when it does.
+
+ */
+static void templatewavetable_process64(t_templatewavetable *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+    const double    *in = ins[0];
+    double          *out = outs[0];
+    const double    *table, *pair = NULL;
+    double          w[VD_SIZE] = { 1., 0. };
+    double          f, last = NAN, inc = 0., m, pos, frac;
+    double          phase = x->x_phase;
+    long            connected = (long)(t_ptr_int)userparam;
+    long            pending, newphase, i, j, k;
+    t_vd            a, b, weights = vd_load(w);
+
+    // a new table at the start of the vector, the previous one goes back to the main thread
+    pending = lockfree_exchange(&x->x_pending, 0);
+    if (pending) {
+        if (x->x_live >= 0)
+            templatewavetable_retire(x, x->x_live);
+        x->x_live = pending - 1;
+        lockfree_store(&x->x_tstate[x->x_live], WAVETABLE_LIVE);
+    }
+    newphase = lockfree_exchange(&x->x_newphase, 0);
+    if (newphase)
+        phase = (newphase - 1) / 1073741824.;
+
+    if (x->x_live < 0) {
+        memset(out, 0, sizeof(double) * sampleframes);
+        return;
+    }
+    table = x->x_tset[x->x_live];
+
+    for (i = 0; i < sampleframes; i++) {
+        f = connected ? in[i] : x->x_freq;
+        if (f != last) {
+            last = f;
+            inc = f / x->x_sr;
+            m = fabs(f) > 0. ? log2(2. * fabs(f) * (TEMPLATEWAVETABLE_SIZE / 2) / x->x_sr) + 1. : 0.;
+            m = m > 0. ? (m < TEMPLATEWAVETABLE_LEVELS - 1 ? m : TEMPLATEWAVETABLE_LEVELS - 1) : 0.;   // NaN : 0
+            j = (long)m;
+            pair = table + j * TEMPLATEWAVETABLE_PAIR;
+            w[0] = 1. - (m - j);
+            w[1] = m - j;
+            weights = vd_load(w);
+        }
+
+        // the same point of both levels in the lanes, interpolated, then crossfaded
+        pos = phase * TEMPLATEWAVETABLE_SIZE;
+        k = (long)pos;
+        frac = pos - k;
+        a = vd_load(pair + 2 * k);
+        b = vd_load(pair + 2 * k + 2);
+        out[i] = vd_hsum(vd_mul(vd_madd(vd_sub(b, a), vd_set1(frac), a), weights));
+
+        phase += inc;
+        if (phase >= 1. || phase < 0.)
+            phase -= floor(phase);
+        if (!(phase >= 0. && phase < 1.))       // NaN or infinite frequency, and a - floor(a) rounding to 1
+            phase = 0.;
+    }
+
+    x->x_phase = phase;
+}
+
+// a NaN frequency only costs the vector it came in
+DENORMAL_PERFORM(templatewavetable_perform64, templatewavetable_process64, t_templatewavetable, 0, 1)
+
+
+
+
+
+//____________________________________________________________________
+//                              Mipmap
+//____________________________________________________________________
+/*
+
+ The cycle of n samples is transformed once (r2c of size n, any n). Its harmonics below min(n / 2, SIZE / 2)
+ are the spectrum of the same cycle at SIZE samples, scaled by 1 / n : the c2r of size SIZE turns them into the
+ cycle resampled, exactly band-limited. The Nyquist bin is left out, its phase is ambiguous.
+
+ Level j keeps the harmonics 1 ... (SIZE / 2) >> j (and DC). Pair j interleaves level j and level j + 1,
+ SIZE + 1 points each (the guard point is the first one), the last pair has the last level twice.
+ Runs on the worker, or on the main thread for the sine of new. Returns the pairs, or NULL without memory.
+
+ */
+double *templatewavetable_build(t_templatewavetable *x, const double *wave, long n)
+{
+    fftw_plan       r2c = (fftw_plan) tablecache_acquire(templatewavetable_cache, TABLE_PLAN_R2C, n, 0,
+                                                         templatewavetable_tablecreate, templatewavetable_plandestroy);
+    long            nbins = n / 2 + 1;
+    long            top = (n - 1) / 2 < TEMPLATEWAVETABLE_SIZE / 2 - 1 ? (n - 1) / 2 : TEMPLATEWAVETABLE_SIZE / 2 - 1;
+    double          *pairs = (double *) sysmem_newptr(sizeof(double) * TEMPLATEWAVETABLE_PAIR * TEMPLATEWAVETABLE_LEVELS);
+    double          *level = (double *) fftw_malloc(sizeof(double) * (n > TEMPLATEWAVETABLE_SIZE ? n : TEMPLATEWAVETABLE_SIZE));
+    fftw_complex    *spec = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * nbins);
+    fftw_complex    *mip = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * (TEMPLATEWAVETABLE_SIZE / 2 + 1));
+    double          *p;
+    long            j, k, i, harmonics;
+
+    if (!r2c || !pairs || !level || !spec || !mip) {
+        if (pairs)
+            sysmem_freeptr(pairs);
+        pairs = NULL;
+        goto done;
+    }
+
+    memcpy(level, wave, sizeof(double) * n);
+    fftw_execute_dft_r2c(r2c, level, spec);
+
+    for (j = 0; j < TEMPLATEWAVETABLE_LEVELS; j++) {
+        harmonics = (TEMPLATEWAVETABLE_SIZE / 2) >> j;
+        harmonics = harmonics < top ? harmonics : top;
+
+        // the backward transform overwrites its input, the spectrum is copied for each level
+        memset(mip, 0, sizeof(fftw_complex) * (TEMPLATEWAVETABLE_SIZE / 2 + 1));
+        for (k = 0; k <= harmonics; k++) {
+            mip[k][0] = spec[k][0] / n;
+            mip[k][1] = spec[k][1] / n;
+        }
+        fftw_execute_dft_c2r(x->x_c2r, mip, level);
+
+        // lane 0 of pair j, lane 1 of pair j - 1
+        p = pairs + j * TEMPLATEWAVETABLE_PAIR;
+        for (i = 0; i <= TEMPLATEWAVETABLE_SIZE; i++) {
+            p[2 * i] = level[i & (TEMPLATEWAVETABLE_SIZE - 1)];
+            if (j)
+                p[2 * i + 1 - TEMPLATEWAVETABLE_PAIR] = p[2 * i];
+        }
+    }
+    for (i = 0; i <= TEMPLATEWAVETABLE_SIZE; i++)
+        p[2 * i + 1] = p[2 * i];
+
+done:
+    tablecache_release(templatewavetable_cache, r2c);
+    if (level)
+        fftw_free(level);
+    if (spec)
+        fftw_free(spec);
+    if (mip)
+        fftw_free(mip);
+    return pairs;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Table Swap
+//____________________________________________________________________
+
+/*
+
+ The kernel swap of templatefftw~, with mipmaps :
+    - main thread   : set copies the buffer~ into a job, which waits in x_job while the worker is busy (a newer set
+                      replaces it). templatewavetable_start gives it a WAVETABLE_FREE slot and starts templatewavetable_worker
+    - worker        : builds the mipmap into the slot, marks it READY and publishes slot + 1 in x_pending
+                      (a READY table that was never picked up is retired, the newest wins)
+    - audio thread  : takes x_pending at the start of a vector and retires the table it played
+    - main thread   : retired slots are freed by templatewavetable_reclaim, from a qelem set by the clock the audio
+                      thread and the worker set (neither may free, nor set a qelem from the perform routine).
+                      The worker sets it when it returns too, the qelem then starts the job waiting in x_job
+
+ The phase goes on across the swap, the new cycle starts where the old one was.
+
+ */
+void templatewavetable_set(t_templatewavetable *x, t_symbol *s, long argc, t_atom *argv)
+{
+    t_templatewavetable_job *job;
+    t_buffer_ref            *ref;
+    t_buffer_obj            *b;
+    t_symbol                *name;
+    float                   *samples;
+    long                    frames, chans, chan, i;
+
+    if (!argc || atom_gettype(argv) != A_SYM) {
+        object_error((t_object *)x, "set <buffer~> [channel]");
+        return;
+    }
+
+    job = (t_templatewavetable_job *) sysmem_newptrclear(sizeof(t_templatewavetable_job));
+    if (!job)
+        return;
+    job->j_x = x;
+    job->j_slot = -1;
+
+    // the samples are copied here, the buffer~ may change while the worker runs
+    name = atom_getsym(argv);
+    ref = buffer_ref_new((t_object *)x, name);
+    b = buffer_ref_getobject(ref);
+    samples = b ? buffer_locksamples(b) : NULL;
+    if (!samples) {
+        object_error((t_object *)x, "set: no buffer~ named %s", name->s_name);
+        object_free(ref);
+        sysmem_freeptr(job);
+        return;
+    }
+
+    frames = buffer_getframecount(b);
+    chans  = buffer_getchannelcount(b);
+    chan   = argc > 1 ? (long)atom_getlong(argv + 1) - 1 : 0;
+    chan   = chan < 0 ? 0 : (chan < chans ? chan : chans - 1);
+    if (frames > TEMPLATEWAVETABLE_MAXFRAMES) {
+        object_warn((t_object *)x, "set: %s truncated to %d samples", name->s_name, TEMPLATEWAVETABLE_MAXFRAMES);
+        frames = TEMPLATEWAVETABLE_MAXFRAMES;
+    }
+
+    job->j_wave = frames > 0 ? (double *) sysmem_newptr(sizeof(double) * frames) : NULL;
+    if (job->j_wave) {
+        for (i = 0; i < frames; i++)
+            job->j_wave[i] = samples[i * chans + chan];
+        job->j_n = frames;
+    }
+
+    buffer_unlocksamples(b);
+    object_free(ref);
+
+    if (!job->j_wave) {
+        if (frames > 0)
+            object_error((t_object *)x, "set: out of memory");
+        else
+            object_error((t_object *)x, "set: %s is empty", name->s_name);
+        sysmem_freeptr(job);
+        return;
+    }
+
+    // one worker at a time : while it builds, the newest set waits and the one it replaces is dropped
+    templatewavetable_jobfree(x->x_job);
+    x->x_job = job;
+    templatewavetable_reclaim(x);
+    if (templatewavetable_start(x)) {
+        object_error((t_object *)x, "set: no free table slot, try again");
+        templatewavetable_jobfree(x->x_job);
+        x->x_job = NULL;
+    }
+}
+
+// main thread, starts the worker on x_job unless it is busy. Returns 1 if no slot is free
+long templatewavetable_start(t_templatewavetable *x)
+{
+    t_templatewavetable_job *job = x->x_job;
+    long                    slot;
+
+    if (!job || lockfree_load(&x->x_busy))
+        return 0;
+
+    // it cleared x_busy on its way out, the join doesn't wait
+    if (x->x_thread) {
+        systhread_join(x->x_thread, NULL);
+        x->x_thread = NULL;
+    }
+
+    slot = templatewavetable_slot(x);
+    if (slot < 0)
+        return 1;
+
+    x->x_job = NULL;
+    job->j_slot = slot;
+    lockfree_store(&x->x_tstate[slot], WAVETABLE_BUILDING);
+    lockfree_store(&x->x_busy, 1);
+    if (systhread_create((method)templatewavetable_worker, job, 0, 0, 0, &x->x_thread)) {
+        object_error((t_object *)x, "set: can't start the table thread");
+        x->x_thread = NULL;
+        lockfree_store(&x->x_busy, 0);
+        lockfree_store(&x->x_tstate[slot], WAVETABLE_FREE);
+        templatewavetable_jobfree(job);
+    }
+    return 0;
+}
+
+// main thread (qelem), after a slot retired or the worker returned
+void templatewavetable_idle(t_templatewavetable *x)
+{
+    templatewavetable_reclaim(x);
+    templatewavetable_start(x);
+}
+
+void templatewavetable_jobfree(t_templatewavetable_job *job)
+{
+    if (!job)
+        return;
+    if (job->j_wave)
+        sysmem_freeptr(job->j_wave);
+    sysmem_freeptr(job);
+}
+
+// worker thread, builds the mipmap of job->j_wave and publishes it
+void *templatewavetable_worker(t_templatewavetable_job *job)
+{
+    t_templatewavetable *x = job->j_x;
+    double              *table = templatewavetable_build(x, job->j_wave, job->j_n);
+
+    if (table)
+        templatewavetable_publish(x, job->j_slot, table);
+    else {
+        object_error((t_object *)x, "set: out of memory");
+        lockfree_store(&x->x_tstate[job->j_slot], WAVETABLE_FREE);
+    }
+
+    templatewavetable_jobfree(job);
+
+    // the main thread starts the next set, if one came in meanwhile
+    lockfree_store(&x->x_busy, 0);
+    clock_delay(x->x_clock, 0);
+
+    systhread_exit(0);
+    return NULL;
+}
+
+// main thread, a WAVETABLE_FREE slot or -1. Live + READY is the most we hold when the worker is idle, a slot is free
+long templatewavetable_slot(t_templatewavetable *x)
+{
+    long slot;
+
+    for (slot = 0; slot < TEMPLATEWAVETABLE_SLOTS; slot++)
+        if (lockfree_load(&x->x_tstate[slot]) == WAVETABLE_FREE)
+            return slot;
+
+    return -1;
+}
+
+// worker or main thread, hands a complete table to the audio thread for its next vector
+void templatewavetable_publish(t_templatewavetable *x, long slot, double *table)
+{
+    int32_t old;
+
+    // the exchange is a full barrier, the audio thread sees the whole table once it sees the slot
+    x->x_tset[slot] = table;
+    lockfree_store(&x->x_tstate[slot], WAVETABLE_READY);
+    old = lockfree_exchange(&x->x_pending, (int32_t)slot + 1);
+    if (old)
+        templatewavetable_retire(x, old - 1);   // never picked up, the newest wins
+}
+
+// audio or worker thread, hands a slot over to the main thread
+void templatewavetable_retire(t_templatewavetable *x, long slot)
+{
+    lockfree_store(&x->x_tstate[slot], WAVETABLE_RETIRED);
+    clock_delay(x->x_clock, 0);
+}
+
+// scheduler thread, the free happens in the main thread
+void templatewavetable_tick(t_templatewavetable *x)
+{
+    qelem_set(x->x_qelem);
+}
+
+// main thread, frees the retired tables
+void templatewavetable_reclaim(t_templatewavetable *x)
+{
+    long slot;
+
+    for (slot = 0; slot < TEMPLATEWAVETABLE_SLOTS; slot++) {
+        if (lockfree_load(&x->x_tstate[slot]) != WAVETABLE_RETIRED)
+            continue;
+        sysmem_freeptr(x->x_tset[slot]);
+        x->x_tset[slot] = NULL;
+        lockfree_store(&x->x_tstate[slot], WAVETABLE_FREE);
+    }
+}
@@ -0,0 +1,599 @@
+/**
+ *
+ *  @file	templatexcorr~.c
+ *
+ *
+ *  Sources :
+ *
+ *   Cylcing 74'
+ *    - Max 7.1 API :
+ *          https://cycling74.com/sdk/MaxSDK-6.0.4/html/index.html
+ *
+ *    - Max/MSP 7.1 SDK examples :
+ *          https://cycling74.com/downloads/sdk/#.Vzn0OpPbugw
+ *
+ *   FFTW3 documentation :
+ *      http://www.fftw.org/fftw3.pdf
+ *
+ *   C. Knapp, G. Carter
+ *    - The Generalized Correlation Method for Estimation of Time Delay (IEEE Trans. ASSP, 1976)
+ *
+ *
+ *  This object has two signal inlets and no signal outlet : it estimates the delay of the right input
+ *  (e.g. a room mic) against the left one (e.g. the direct feed) with GCC-PHAT. Each frame of size samples
+ *  is zero padded to 2 * size, the cross-spectrum conj(L) R is averaged over the frames, divided by its
+ *  magnitude (the PHAT weight, which whitens it so the correlation is a sharp peak) and transformed back.
+ *  The highest point within maxlag samples, refined by a parabola, is the lag.
+ *
+ *  The left outlet outputs the lag in samples (positive when the right input is late), the right one the
+ *  height of the peak, 1. for a pure delay. Both go out after every frame, and on bang.
+ *
+ *  The perform routine only copies the inputs into a ring of blocks. A worker thread collects the frames,
+ *  transforms, averages and searches the peak, so the audio thread never runs an FFT however long the frames.
+ *
+ */
+
+//____________________________________________________________________
+//                         External Libraries
+//____________________________________________________________________
+/*
+
+ Headears and Platform specific elements
+
+ */
+#ifdef MAC_VERSION
+    // do something specific to the Mac
+#endif
+#ifdef WIN_VERSION
+    // do something specific to Windows
+#endif
+
+#include "ext.h"            // should always be first, then ext_obex.h + other files.
+#include "ext_obex.h"		// required for "new" style objects
+#include "z_dsp.h"			// required for MSP objects
+#include "ext_systhread.h"  // the correlation runs on a worker thread
+
+#include <math.h>
+#ifndef M_PI
+#define M_PI 3.14159265358979323846     // not defined by every compiler (Visual Studio)
+#endif
+
+#include "../template-fftw~/fftw3.h"    // the FFTW build of templatefftw~
+
+#include "../../common/lockfree.h"
+#include "../../common/arena.h"
+#include "../../common/tablecache.h"
+#include "../../common/denormal.h"
+
+#define TEMPLATEXCORR_SIZE      8192    ///<    Default frame size, a power of 2
+#define TEMPLATEXCORR_MINSIZE   1024    ///<    Smallest frame size
+#define TEMPLATEXCORR_MAXSIZE   65536   ///<    Largest frame size, about 1.4 s at 48 kHz
+#define TEMPLATEXCORR_BLOCK     64      ///<    Samples per channel in a ring item, divides every frame size
+#define TEMPLATEXCORR_RINGSIZE  512     ///<    Ring items, i.e. 32768 samples of slack for the worker
+#define TEMPLATEXCORR_POLL      5       ///<    Worker sleep between two looks at the ring, in ms
+#define TEMPLATEXCORR_SILENCE   1e-10   ///<    Mean power below which a frame isn't averaged
+
+// kinds of the plans shared through the table cache
+enum {
+    TABLE_PLAN_R2C = 1, ///<    Real to complex forward plan of size 2 * frame size
+    TABLE_PLAN_C2R      ///<    Complex to real backward plan of the same size
+};
+
+// what the perform routine hands to the worker
+typedef struct _templatexcorr_block
+{
+    double      b_left[TEMPLATEXCORR_BLOCK];    ///<    Left input
+    double      b_right[TEMPLATEXCORR_BLOCK];   ///<    Right input
+} t_templatexcorr_block;
+
+
+//____________________________________________________________________
+//                        'Class' Definition
+//____________________________________________________________________
+/*
+
+ 'Class' decleration and a struct for the object is declared and typedef'd.
+
+ */
+
+typedef struct _templatexcorr	///<	A struct to hold data for our object
+{
+    t_pxobject  x_obj;          ///<	The object itself (t_pxobject in MSP instead of t_object)
+    void        *x_lagout;      ///<    Lag outlet, in samples
+    void        *x_peakout;     ///<    Peak height outlet
+
+    // settings
+    long        x_size;         ///<    Frame size (size attribute), applied in dsp64
+    long        x_average;      ///<    Frames of the running average (average attribute)
+    long        x_maxlag;       ///<    Longest lag searched, in samples (maxlag attribute)
+
+    // audio thread side
+    t_spsc      x_ring;         ///<    Blocks from the perform routine to the worker
+    t_templatexcorr_block x_stage;  ///<    Block being filled
+    long        x_stagepos;     ///<    Samples in x_stage
+    t_int32_atomic x_dropped;   ///<    Blocks dropped on a full ring, posted by bang
+
+    // worker side, everything is carved from x_block in dsp64 while the worker is stopped
+    long        x_n;            ///<    Frame size of the buffers (x_size when they were carved)
+    fftw_plan   x_r2c;          ///<    2 N forward plan, shared with the other instances
+    fftw_plan   x_c2r;          ///<    2 N backward plan, shared with the other instances
+    double      *x_left;        ///<    Left frame, N samples
+    double      *x_right;       ///<    Right frame, N samples
+    long        x_framepos;     ///<    Samples in the frames
+    double      *x_pad;         ///<    Zero padded frame, then the correlation, 2 N samples
+    fftw_complex *x_lspec;      ///<    Left spectrum, N + 1 bins
+    fftw_complex *x_rspec;      ///<    Right spectrum, N + 1 bins
+    fftw_complex *x_cross;      ///<    Averaged cross-spectrum, N + 1 bins
+    long        x_frames;       ///<    Frames averaged since the last reset
+    char        *x_block;       ///<    Arena block holding the worker buffers
+    long        x_blocksize;    ///<    Size of x_block in bytes
+
+    // worker thread
+    t_systhread x_thread;       ///<    Worker, running between dsp64 and the next dsp64 or free
+    t_int32_atomic x_quit;      ///<    Asks the worker to return
+    t_int32_atomic x_reset;     ///<    Asks the worker to restart the average
+    t_snapshot  x_result;       ///<    Lag and peak height of the last frame, written by the worker, read by the clock only
+    void        *x_clock;       ///<    Set by the worker and by bang, outputs the result from the scheduler
+    t_int32_atomic x_again;     ///<    Set by bang, the clock outputs x_last even without a new frame
+    double      x_last[2];      ///<    Last lag and peak height output, scheduler side
+
+} t_templatexcorr;
+
+// global pointer to our class definition that is setup in main()
+static t_class *templatexcorr_class = NULL;
+
+// arena holding the worker buffers of all the instances
+static t_arena *templatexcorr_arena = NULL;
+
+// plans shared by the instances of the same frame size
+static t_tablecache *templatexcorr_cache = NULL;
+
+
+
+
+
+//____________________________________________________________________
+//                        Function Prototypes
+//____________________________________________________________________
+
+//// standard set
+void *templatexcorr_new( t_symbol *s, long argc, t_atom *argv);
+void templatexcorr_free( t_templatexcorr *x);
+void templatexcorr_assist(t_templatexcorr *x, void *b, long m, long a, char *s);
+long templatexcorr_alloc(t_templatexcorr *x);
+void *templatexcorr_tablecreate(long kind, long size, long variant);
+void templatexcorr_plandestroy(void *table);
+t_max_err templatexcorr_size_set(t_templatexcorr *x, void *attr, long argc, t_atom *argv);
+
+//// value specific
+void templatexcorr_bang( t_templatexcorr *x);
+void templatexcorr_reset(t_templatexcorr *x);
+
+//// performance set
+void templatexcorr_dsp64(t_templatexcorr *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
+void templatexcorr_perform64(t_templatexcorr *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+
+//// worker
+long templatexcorr_start(t_templatexcorr *x);
+void templatexcorr_stop(t_templatexcorr *x);
+void *templatexcorr_worker(t_templatexcorr *x);
+void templatexcorr_frame(t_templatexcorr *x);
+void templatexcorr_tick(t_templatexcorr *x);
+
+
+
+
+
+//____________________________________________________________________
+//                          Initialisation Routine
+//____________________________________________________________________
+
+void ext_main(void *r)
+{
+    t_class *c;
+
+    c = class_new("templatexcorr~", (method)templatexcorr_new, (method)templatexcorr_free, (long)sizeof(t_templatexcorr), 0L, A_GIMME, 0);
+
+    class_addmethod(c, (method)templatexcorr_bang,      "bang",             0);
+    class_addmethod(c, (method)templatexcorr_reset,     "reset",            0);
+    class_addmethod(c, (method)templatexcorr_dsp64,		"dsp64",	A_CANT, 0);
+    class_addmethod(c, (method)templatexcorr_assist,    "assist",	A_CANT, 0);
+
+    CLASS_ATTR_LONG(c, "size", 0, t_templatexcorr, x_size);
+    CLASS_ATTR_ACCESSORS(c, "size", NULL, templatexcorr_size_set);
+    CLASS_ATTR_LABEL(c, "size", 0, "Frame Size (applied when DSP restarts)");
+
+    CLASS_ATTR_LONG(c, "average", 0, t_templatexcorr, x_average);
+    CLASS_ATTR_FILTER_MIN(c, "average", 1);
+    CLASS_ATTR_LABEL(c, "average", 0, "Frames Averaged");
+
+    CLASS_ATTR_LONG(c, "maxlag", 0, t_templatexcorr, x_maxlag);
+    CLASS_ATTR_FILTER_MIN(c, "maxlag", 1);
+    CLASS_ATTR_LABEL(c, "maxlag", 0, "Longest Lag (samples)");
+
+    class_dspinit(c);
+    class_register(CLASS_BOX, c);
+    templatexcorr_class = c;
+
+    // live as long as the class, chunks and plans are freed with their last user
+    templatexcorr_arena = arena_new();
+    templatexcorr_cache = tablecache_new();
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Instance Routines
+//____________________________________________________________________
+
+void *templatexcorr_new(t_symbol *s, long argc, t_atom *argv)
+{
+    t_templatexcorr *x = (t_templatexcorr *) object_alloc((t_class *) templatexcorr_class);
+
+    // two signal inlets, the outlets are created from right to left
+    dsp_setup((t_pxobject *)x, 2);
+    x->x_peakout = floatout((t_object *)x);
+    x->x_lagout  = floatout((t_object *)x);
+
+    x->x_size    = TEMPLATEXCORR_SIZE;
+    x->x_average = 8;
+    x->x_maxlag  = 4800;
+    x->x_clock   = clock_new(x, (method)templatexcorr_tick);
+
+    attr_args_process(x, (short)argc, argv);
+
+    if (spsc_new(&x->x_ring, TEMPLATEXCORR_RINGSIZE, sizeof(t_templatexcorr_block))
+        || snapshot_new(&x->x_result, 2 * sizeof(double))) {
+        object_error((t_object *)x, "out of memory");
+        object_free(x);     // calls templatexcorr_free
+        return NULL;
+    }
+
+    return (x);
+}
+
+void templatexcorr_free(t_templatexcorr *x)
+{
+    dsp_free((t_pxobject *)x);
+
+    // out of the DSP chain, then the worker : nobody uses the buffers anymore
+    templatexcorr_stop(x);
+    if (x->x_clock)
+        object_free(x->x_clock);
+
+    arena_free(templatexcorr_arena, x->x_block);
+    tablecache_release(templatexcorr_cache, x->x_r2c);
+    tablecache_release(templatexcorr_cache, x->x_c2r);
+
+    spsc_free(&x->x_ring);
+    snapshot_free(&x->x_result);
+}
+
+// (re)carves the worker buffers and gets the plans of the frame size, the worker must be stopped. Returns 0 on success
+long templatexcorr_alloc(t_templatexcorr *x)
+{
+    char    *cursor;
+    long    n = x->x_size;
+    long    size = 0;
+
+    if (n != x->x_n) {
+        tablecache_release(templatexcorr_cache, x->x_r2c);
+        tablecache_release(templatexcorr_cache, x->x_c2r);
+        x->x_r2c = (fftw_plan) tablecache_acquire(templatexcorr_cache, TABLE_PLAN_R2C, 2 * n, 0,
+                                                  templatexcorr_tablecreate, templatexcorr_plandestroy);
+        x->x_c2r = (fftw_plan) tablecache_acquire(templatexcorr_cache, TABLE_PLAN_C2R, 2 * n, 0,
+                                                  templatexcorr_tablecreate, templatexcorr_plandestroy);
+        x->x_n = (x->x_r2c && x->x_c2r) ? n : 0;
+        if (!x->x_n)
+            return 1;
+    }
+
+    arena_carve(NULL, &size, sizeof(double) * 2 * n);               // x_left, x_right
+    arena_carve(NULL, &size, sizeof(double) * 2 * n);               // x_pad
+    arena_carve(NULL, &size, sizeof(fftw_complex) * (n + 1));       // x_lspec
+    arena_carve(NULL, &size, sizeof(fftw_complex) * (n + 1));       // x_rspec
+    arena_carve(NULL, &size, sizeof(fftw_complex) * (n + 1));       // x_cross
+
+    // a new block also restarts the average
+    if (!x->x_block || x->x_blocksize != size) {
+        arena_free(templatexcorr_arena, x->x_block);
+        x->x_block = (char *) arena_alloc(templatexcorr_arena, size);
+        x->x_blocksize = x->x_block ? size : 0;
+        if (!x->x_block)
+            return 1;
+        x->x_frames = 0;
+    }
+
+    cursor = x->x_block;
+    x->x_left   = (double *)       arena_carve(&cursor, NULL, sizeof(double) * 2 * n);
+    x->x_right  = x->x_left + n;
+    x->x_pad    = (double *)       arena_carve(&cursor, NULL, sizeof(double) * 2 * n);
+    x->x_lspec  = (fftw_complex *) arena_carve(&cursor, NULL, sizeof(fftw_complex) * (n + 1));
+    x->x_rspec  = (fftw_complex *) arena_carve(&cursor, NULL, sizeof(fftw_complex) * (n + 1));
+    x->x_cross  = (fftw_complex *) arena_carve(&cursor, NULL, sizeof(fftw_complex) * (n + 1));
+    x->x_framepos = 0;
+
+    return 0;
+}
+
+// builds the plans shared through the cache (under the cache mutex, the FFTW planner isn't thread safe)
+void *templatexcorr_tablecreate(long kind, long size, long variant)
+{
+    double      *in  = (double *) fftw_malloc(sizeof(double) * size);
+    fftw_complex *out = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * (size / 2 + 1));
+    fftw_plan   p = NULL;
+
+    // FFTW_ESTIMATE doesn't touch the arrays, the instances execute the plan on their own (arena aligned) ones
+    if (in && out)
+        p = kind == TABLE_PLAN_R2C ? fftw_plan_dft_r2c_1d((int)size, in, out, FFTW_ESTIMATE)
+                                   : fftw_plan_dft_c2r_1d((int)size, out, in, FFTW_ESTIMATE);
+    fftw_free(in);
+    fftw_free(out);
+
+    return p;
+}
+
+void templatexcorr_plandestroy(void *table)
+{
+    fftw_destroy_plan((fftw_plan)table);
+}
+
+// the frame size is a power of 2 between TEMPLATEXCORR_MINSIZE and TEMPLATEXCORR_MAXSIZE
+t_max_err templatexcorr_size_set(t_templatexcorr *x, void *attr, long argc, t_atom *argv)
+{
+    long want = argc ? (long)atom_getlong(argv) : TEMPLATEXCORR_SIZE;
+    long n = TEMPLATEXCORR_MINSIZE;
+
+    while (n < want && n < TEMPLATEXCORR_MAXSIZE)
+        n <<= 1;
+    x->x_size = n;
+
+    return MAX_ERR_NONE;
+}
+
+void templatexcorr_assist(t_templatexcorr *x, void *b, long m, long a, char *s)
+{
+    if (m == ASSIST_INLET) {
+        switch (a){
+            case 0: sprintf(s, "(Signal) Reference; bang outputs the last estimate, reset restarts the average"); break;
+            case 1: sprintf(s, "(Signal) Delayed input"); break;
+        }
+    }
+    else if (m == ASSIST_OUTLET) {
+        switch (a){
+            case 0: sprintf(s, "(Float) Lag in samples"); break;
+            case 1: sprintf(s, "(Float) Peak height, 0. to 1."); break;
+        }
+    }
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Message Handlers
+//____________________________________________________________________
+
+// outputs the last estimate again, and the blocks the worker couldn't keep up with.
+// The clock is the only reader of the snapshot : bang asks it for the output
+void templatexcorr_bang(t_templatexcorr *x)
+{
+    int32_t dropped = lockfree_exchange(&x->x_dropped, 0);
+
+    if (dropped)
+        object_warn((t_object *)x, "%d blocks dropped, the worker is late", (int)dropped);
+
+    lockfree_store(&x->x_again, 1);
+    clock_delay(x->x_clock, 0);
+}
+
+// forgets the frames averaged so far, e.g. after moving a mic
+void templatexcorr_reset(t_templatexcorr *x)
+{
+    lockfree_store(&x->x_reset, 1);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Perfomance Routines
+//____________________________________________________________________
+
+// the worker is restarted around the new buffers : it never runs while they are carved
+void templatexcorr_dsp64(t_templatexcorr *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
+{
+    templatexcorr_stop(x);
+
+    // the blocks left in the ring belong to the previous chain
+    while (spsc_peek(&x->x_ring))
+        spsc_pop(&x->x_ring);
+    x->x_stagepos = 0;
+
+    if (templatexcorr_alloc(x) || templatexcorr_start(x)) {
+        object_error((t_object *)x, "out of memory, not added to the DSP chain");
+        return;
+    }
+
+    object_method(dsp64, gensym("dsp_add64"), x, templatexcorr_perform64, 0, NULL);
+}
+
+// copies the inputs in blocks for the worker, nothing else runs on the audio thread
+void templatexcorr_perform64(t_templatexcorr *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+    long i, n;
+
+    for (i = 0; i < sampleframes; i += n) {
+        n = TEMPLATEXCORR_BLOCK - x->x_stagepos;
+        if (n > sampleframes - i)
+            n = sampleframes - i;
+
+        memcpy(x->x_stage.b_left + x->x_stagepos, ins[0] + i, n * sizeof(double));
+        memcpy(x->x_stage.b_right + x->x_stagepos, ins[1] + i, n * sizeof(double));
+        x->x_stagepos += n;
+
+        if (x->x_stagepos == TEMPLATEXCORR_BLOCK) {
+            x->x_stagepos = 0;
+            if (spsc_push(&x->x_ring, &x->x_stage))
+                ATOMIC_INCREMENT(&x->x_dropped);
+        }
+    }
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Worker
+//____________________________________________________________________
+
+/*
+
+ The worker owns the frames, the spectra and the average between templatexcorr_start and templatexcorr_stop,
+ both called from the main thread (dsp64 and free). It polls the ring every TEMPLATEXCORR_POLL ms,
+ a frame is complete every size samples. The average is a plain mean over the first frames, then a one pole
+ with a time constant of average frames. Frames where an input is silent are skipped, PHAT would
+ otherwise whiten noise. The result goes to the scheduler through a snapshot and a clock, the clock is its only reader.
+
+ */
+
+long templatexcorr_start(t_templatexcorr *x)
+{
+    lockfree_store(&x->x_quit, 0);
+    if (systhread_create((method)templatexcorr_worker, x, 0, 0, 0, &x->x_thread)) {
+        x->x_thread = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+void templatexcorr_stop(t_templatexcorr *x)
+{
+    if (!x->x_thread)
+        return;
+
+    lockfree_store(&x->x_quit, 1);
+    systhread_join(x->x_thread, NULL);
+    x->x_thread = NULL;
+}
+
+void *templatexcorr_worker(t_templatexcorr *x)
+{
+    t_templatexcorr_block   *b;
+
+    // the FPU mode is per thread, no denormals in the average either
+    denormal_enter();
+
+    while (!lockfree_load(&x->x_quit)) {
+        while ((b = (t_templatexcorr_block *) spsc_peek(&x->x_ring))) {
+            memcpy(x->x_left + x->x_framepos, b->b_left, sizeof(b->b_left));
+            memcpy(x->x_right + x->x_framepos, b->b_right, sizeof(b->b_right));
+            spsc_pop(&x->x_ring);
+
+            x->x_framepos += TEMPLATEXCORR_BLOCK;
+            if (x->x_framepos == x->x_n) {
+                x->x_framepos = 0;
+                templatexcorr_frame(x);
+            }
+        }
+        systhread_sleep(TEMPLATEXCORR_POLL);
+    }
+
+    systhread_exit(0);
+    return NULL;
+}
+
+// worker, one complete frame : transforms, average, PHAT, backward transform and peak
+void templatexcorr_frame(t_templatexcorr *x)
+{
+    long    n = x->x_n;
+    long    maxlag = x->x_maxlag < n - 1 ? x->x_maxlag : n - 1;
+    double  *c = x->x_pad;
+    double  el = 0., er = 0.;
+    double  a, re, im, mag, y0, y1, y2, den, delta, peak;
+    double  *out;
+    long    i, best, lag;
+
+    if (lockfree_exchange(&x->x_reset, 0))
+        x->x_frames = 0;
+
+    for (i = 0; i < n; i++) {
+        el += x->x_left[i] * x->x_left[i];
+        er += x->x_right[i] * x->x_right[i];
+    }
+    if (el < TEMPLATEXCORR_SILENCE * n || er < TEMPLATEXCORR_SILENCE * n)
+        return;
+
+    // both frames zero padded to 2 N, the correlation doesn't wrap for lags under N
+    memset(x->x_pad + n, 0, sizeof(double) * n);
+    memcpy(x->x_pad, x->x_left, sizeof(double) * n);
+    fftw_execute_dft_r2c(x->x_r2c, x->x_pad, x->x_lspec);
+    memcpy(x->x_pad, x->x_right, sizeof(double) * n);
+    fftw_execute_dft_r2c(x->x_r2c, x->x_pad, x->x_rspec);
+
+    // mean of the first frames, then a one pole : cross += a (conj(L) R - cross)
+    a = x->x_frames < x->x_average ? 1. / (x->x_frames + 1) : 1. / x->x_average;
+    x->x_frames++;
+    for (i = 0; i <= n; i++) {
+        re = x->x_lspec[i][0] * x->x_rspec[i][0] + x->x_lspec[i][1] * x->x_rspec[i][1];
+        im = x->x_lspec[i][0] * x->x_rspec[i][1] - x->x_lspec[i][1] * x->x_rspec[i][0];
+        x->x_cross[i][0] += a * (re - x->x_cross[i][0]);
+        x->x_cross[i][1] += a * (im - x->x_cross[i][1]);
+    }
+
+    // PHAT : unit magnitude, the average itself is kept (x_lspec receives the weighted copy)
+    for (i = 0; i <= n; i++) {
+        mag = sqrt(x->x_cross[i][0] * x->x_cross[i][0] + x->x_cross[i][1] * x->x_cross[i][1]);
+        mag = mag > 0. ? 1. / mag : 0.;
+        x->x_lspec[i][0] = x->x_cross[i][0] * mag;
+        x->x_lspec[i][1] = x->x_cross[i][1] * mag;
+    }
+    fftw_execute_dft_c2r(x->x_c2r, x->x_lspec, c);
+
+    // highest point within +/- maxlag, negative lags are at the end of the 2 N correlation
+    best = 0;
+    for (lag = -maxlag; lag <= maxlag; lag++) {
+        i = lag < 0 ? lag + 2 * n : lag;
+        if (c[i] > c[best])
+            best = i;
+    }
+
+    // parabola through the neighbours (circular), for the fraction of a sample
+    y0 = c[(best + 2 * n - 1) % (2 * n)];
+    y1 = c[best];
+    y2 = c[(best + 1) % (2 * n)];
+    den = y0 - 2. * y1 + y2;
+    delta = den != 0. ? 0.5 * (y0 - y2) / den : 0.;
+    delta = delta < -0.5 ? -0.5 : (delta > 0.5 ? 0.5 : delta);
+    peak = y1 - 0.25 * (y0 - y2) * delta;
+
+    // a pure delay whitens to 2 N unit bins, i.e. a peak of 2 N
+    out = (double *) snapshot_back(&x->x_result);
+    out[0] = (best < n ? best : best - 2 * n) + delta;
+    out[1] = peak / (2. * n);
+    snapshot_publish(&x->x_result);
+    clock_delay(x->x_clock, 0);
+}
+
+// scheduler, outputs the newest estimate, or the last one again after a bang
+void templatexcorr_tick(t_templatexcorr *x)
+{
+    long    fresh;
+    long    again = lockfree_exchange(&x->x_again, 0);
+    double  *v = (double *) snapshot_read(&x->x_result, &fresh);
+
+    if (fresh) {
+        x->x_last[0] = v[0];
+        x->x_last[1] = v[1];
+    }
+    else if (!again)
+        return;
+
+    outlet_float(x->x_peakout, x->x_last[1]);
+    outlet_float(x->x_lagout, x->x_last[0]);
+}
@@ -0,0 +1,940 @@
+/**
+ *
+ *  @file	templateexpr~.c
+ *
+ *
+ *  Sources :
+ *
+ *  Documentation :
+ *      Cylcing 74'
+ *          - Max 7.1 API :
+ *              https://cycling74.com/sdk/MaxSDK-6.0.4/html/index.html
+ *
+ *          - Max/MSP 7.1 SDK examples :
+ *              https://cycling74.com/downloads/sdk/#.Vzn0OpPbugw
+ *
+ *      Niklaus Wirth
+ *          - Compiler Construction (recursive descent parsing) :
+ *              http://www.ethoberon.ethz.ch/WirthPubl/CBEAll.pdf
+ *
+ *  Code :
+ *
+ *      template~ (this repository)
+ *          - same structure, inlets/outlets and perform routine conventions
+ *
+ *
+ *
+ *  This object evaluates an expression over its signal inlets, e.g. [templateexpr~ (in1*in2)+in3*0.5]
+ *  It has as many inlets as the highest inN in the expression, and one signal outlet.
+ *
+ *  A chain of template~-like objects costs one perform call and one full signal vector per operator.
+ *  Here the expression is compiled (in dsp64) into a flat list of instructions working on chunks of
+ *  TEMPLATEEXPR_CHUNK samples, so every intermediate result stays in a small scratch area in the L1 cache.
+ *
+ *  Syntax :
+ *      numbers, in1 ... in8, + - * / ^ (power), unary -, parentheses
+ *      abs(a) sqrt(a) exp(a) sin(a) cos(a) tanh(a) min(a,b) max(a,b) pow(a,b) clip(a,lo,hi)
+ *  An inlet without a signal uses the last float received in it.
+ *
+ *  The check message compares the compiled program with the same expression evaluated
+ *  one operator at a time on full buffers, i.e. like a chain of single operator objects.
+ *
+ */
+
+//____________________________________________________________________
+//                         External Libraries
+//____________________________________________________________________
+/*
+
+ Headears and Platform specific elements
+
+ */
+#ifdef MAC_VERSION
+    // do something specific to the Mac
+#endif
+#ifdef WIN_VERSION
+    // do something specific to Windows
+#endif
+
+#include "ext.h"            // should always be first, then ext_obex.h + other files.
+#include "ext_obex.h"		// required for "new" style objects
+#include "z_dsp.h"			// required for MSP objects
+
+#include <math.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#include "../../common/simd.h"
+#include "../../common/denormal.h"
+
+#define TEMPLATEEXPR_MAXIN      8       ///<    Max inlets (in1 ... in8)
+#define TEMPLATEEXPR_MAXNODES   128     ///<    Max nodes of the parsed expression
+#define TEMPLATEEXPR_MAXINSTR   128     ///<    Max instructions of a program
+#define TEMPLATEEXPR_MAXSLOTS   32      ///<    Max scratch slots (temporaries, constants, scalars)
+#define TEMPLATEEXPR_CHUNK      64      ///<    Samples per slot, 32 slots * 64 doubles = 16 KB, fits in L1
+#define TEMPLATEEXPR_MAXTEXT    1024    ///<    Max length of the expression text
+#define TEMPLATEEXPR_CHECKSIZE  4096    ///<    Samples used by the check message
+
+// operators, shared by the parse tree and the instructions
+enum {
+    EXPR_COPY = 0,      ///<    instructions only, d = a
+    EXPR_ADD, EXPR_SUB, EXPR_MUL, EXPR_DIV, EXPR_POW, EXPR_MIN, EXPR_MAX,
+    EXPR_NEG, EXPR_ABS, EXPR_SQRT, EXPR_EXP, EXPR_SIN, EXPR_COS, EXPR_TANH,
+    EXPR_CLIP,
+    EXPR_MADD           ///<    instructions only, d = a * b + c, fused from an add of a mul
+};
+
+// parse tree nodes
+enum {
+    NODE_CONST = 0,
+    NODE_INPUT,
+    NODE_OP
+};
+
+typedef struct _exprnode    ///<    A node of the parsed expression
+{
+    short       type;       ///<    NODE_CONST, NODE_INPUT or NODE_OP
+    short       op;         ///<    Operator of a NODE_OP
+    short       input;      ///<    Inlet of a NODE_INPUT (0 based)
+    short       nchild;
+    short       child[3];   ///<    Operands of a NODE_OP (node indexes)
+    double      value;      ///<    Value of a NODE_CONST
+
+} t_exprnode;
+
+typedef struct _exprinstr   ///<    One instruction : d = op(a, b, c), operands are indexes in the pointer table
+{
+    short       op;
+    short       d, a, b, c;
+
+} t_exprinstr;
+
+typedef struct _exprprog    ///<    A compiled expression
+{
+    t_exprinstr instr[TEMPLATEEXPR_MAXINSTR];
+    long        ninstr;
+    double      *ptr[TEMPLATEEXPR_MAXIN + 1 + TEMPLATEEXPR_MAXSLOTS];  ///<    Inputs, output, then the scratch slots
+    long        nslots;                                     ///<    Scratch slots in use
+    double      *scratch;                                   ///<    nslots * TEMPLATEEXPR_CHUNK doubles
+    short       scalar[TEMPLATEEXPR_MAXIN];                 ///<    Slot (pointer index) filled with the scalar of an inlet, 0 if none
+    long        nin;
+
+} t_exprprog;
+
+
+
+
+
+//____________________________________________________________________
+//                        'Class' Definition
+//____________________________________________________________________
+/*
+
+ 'Class' decleration and a struct for the object is declared and typedef'd.
+
+ */
+
+typedef struct _templateexpr	///<	A struct to hold data for our object
+{
+    t_pxobject  x_obj;          ///<	The object itself (t_pxobject in MSP instead of t_object)
+    char        x_text[TEMPLATEEXPR_MAXTEXT];   ///<    The expression as typed
+    t_exprnode  x_nodes[TEMPLATEEXPR_MAXNODES]; ///<    Parsed expression
+    long        x_nnodes;
+    long        x_root;         ///<    Root node, -1 if the expression didn't parse
+    long        x_nin;          ///<    Number of inlets
+    double      x_scalar[TEMPLATEEXPR_MAXIN];   ///<    Last float received in each inlet
+    t_exprprog  *x_prog;        ///<    Program run by the perform routine, compiled in dsp64
+
+} t_templateexpr;
+
+// global pointer to our class definition that is setup in main()
+static t_class *templateexpr_class = NULL;
+
+// parser state
+typedef struct _exprparser
+{
+    t_templateexpr  *x;
+    const char      *p;         ///<    Next character
+    long            error;
+
+} t_exprparser;
+
+
+
+
+
+//____________________________________________________________________
+//                        Function Prototypes
+//____________________________________________________________________
+
+//// standard set
+void *templateexpr_new( t_symbol *s, long argc, t_atom *argv);
+void templateexpr_free( t_templateexpr *x);
+void templateexpr_assist(t_templateexpr *x, void *b, long m, long a, char *s);
+
+//// value specific
+void templateexpr_float(t_templateexpr *x, double f);
+void templateexpr_int(  t_templateexpr *x, long n);
+void templateexpr_check(t_templateexpr *x);
+
+//// performance set
+void templateexpr_dsp64(t_templateexpr *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
+void templateexpr_perform64(t_templateexpr *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+
+//// parser
+long templateexpr_parse(t_templateexpr *x, const char *text);
+long templateexpr_expr(t_exprparser *ps);
+long templateexpr_term(t_exprparser *ps);
+long templateexpr_unary(t_exprparser *ps);
+long templateexpr_primary(t_exprparser *ps);
+long templateexpr_node(t_exprparser *ps, short type, short op, long a, long b, long c);
+
+//// compiler
+t_exprprog *templateexpr_compile(t_templateexpr *x, short *connected);
+void templateexpr_progfree(t_exprprog *prog);
+long templateexpr_emit(t_templateexpr *x, t_exprprog *prog, long node, short *connected, uint32_t *temps);
+void templateexpr_run(t_exprprog *prog, double *scalars, double **ins, double *out, long sampleframes);
+double templateexpr_eval(short op, double a, double b, double c);
+void templateexpr_reference(t_templateexpr *x, long node, double **ins, double *out, long n);
+
+
+
+
+
+//____________________________________________________________________
+//                          Initialisation Routine
+//____________________________________________________________________
+
+/*
+
+The initialization routine, which must be called main, is called when Max loads your object for the first time. In the initialization routine, you define one or more classes. Defining a class consists of the following:
+
+        1) telling Max about the size of your object's structure and how to create and destroy an instance
+        2) defining methods that implement the object's behavior
+        3) in some cases, defining attributes that describe the object's data
+        4) registering the class in a name space
+
+*/
+
+void ext_main(void *r)
+{
+    // we free the compiled program, so templateexpr_free calls dsp_free itself
+    t_class *c = class_new("templateexpr~", (method)templateexpr_new, (method)templateexpr_free, (long)sizeof(t_templateexpr), 0L, A_GIMME, 0);
+
+    class_addmethod(c, (method)templateexpr_int,        "int",      A_LONG, 0);
+    class_addmethod(c, (method)templateexpr_float,		"float",	A_FLOAT,0);
+    class_addmethod(c, (method)templateexpr_check,      "check",            0);
+    class_addmethod(c, (method)templateexpr_dsp64,		"dsp64",	A_CANT, 0);
+    class_addmethod(c, (method)templateexpr_assist,     "assist",	A_CANT, 0);
+
+    //  Adds a set of methods to your object's class that are called by MSP to build the DSP call chain.
+    class_dspinit(c);
+
+    //  adds this class to the CLASS_BOX name space, meaning that it will be searched when a user tries to type it into a box.
+    class_register(CLASS_BOX, c);
+
+    //assign the class we've created to a global variable so we can use it when creating new instances.
+    templateexpr_class = c;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Instance Routines
+//____________________________________________________________________
+
+
+void *templateexpr_new(t_symbol *s, long argc, t_atom *argv)
+{
+    //Setup the custom struct for our object
+    t_templateexpr *x = (t_templateexpr *) object_alloc((t_class *) templateexpr_class);
+    long    i, n, len = 0;
+
+    // Max splits the expression in atoms (and at the commas), we glue them back together
+    x->x_text[0] = 0;
+    for (i = 0; i < argc; i++) {
+        switch (atom_gettype(argv + i)) {
+            case A_LONG:    n = snprintf(x->x_text + len, TEMPLATEEXPR_MAXTEXT - len, "%ld ", (long)atom_getlong(argv + i)); break;
+            case A_FLOAT:   n = snprintf(x->x_text + len, TEMPLATEEXPR_MAXTEXT - len, "%.17g ", atom_getfloat(argv + i)); break;
+            case A_SYM:     n = snprintf(x->x_text + len, TEMPLATEEXPR_MAXTEXT - len, "%s ", atom_getsym(argv + i)->s_name); break;
+            case A_COMMA:   n = snprintf(x->x_text + len, TEMPLATEEXPR_MAXTEXT - len, ", "); break;
+            default:        n = 0; break;
+        }
+        if (len + n >= TEMPLATEEXPR_MAXTEXT)
+            break;
+        len += n;
+    }
+
+    x->x_nin = 1;
+    x->x_root = -1;
+    if (i < argc)
+        object_error((t_object *)x, "expression longer than %d characters, outputs 0.", TEMPLATEEXPR_MAXTEXT - 1);
+    else if (templateexpr_parse(x, x->x_text))
+        object_error((t_object *)x, "can't parse \"%s\", outputs 0.", x->x_text);
+
+    // one signal inlet per inN of the expression
+    dsp_setup((t_pxobject *)x, x->x_nin);
+    outlet_new((t_pxobject *)x, "signal");
+
+    // the output is written chunk by chunk while inputs of later chunks are still to be read
+    x->x_obj.z_misc |= Z_NO_INPLACE;
+
+    return (x);
+}
+
+void templateexpr_free(t_templateexpr *x)
+{
+    dsp_free((t_pxobject *)x);
+    templateexpr_progfree(x->x_prog);
+}
+
+//Documentation shown when hovering over an inlet/outlet
+void templateexpr_assist(t_templateexpr *x, void *b, long m, long a, char *s)
+{
+    if (m == ASSIST_INLET)
+        sprintf(s, "(Signal/Float) in%ld", a + 1);
+    else if (m == ASSIST_OUTLET)
+        sprintf(s, "(Signal) %s", x->x_text);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Message Handlers
+//____________________________________________________________________
+
+void templateexpr_int(t_templateexpr *x, long n)
+{
+    templateexpr_float(x, n);
+}
+
+// the value of an inlet without a signal, read at the start of each vector
+void templateexpr_float(t_templateexpr *x, double f)
+{
+    long in = proxy_getinlet((t_object *)x);
+
+    if (in >= 0 && in < TEMPLATEEXPR_MAXIN)
+        x->x_scalar[in] = f;
+}
+
+/*
+
+ Runs random signals through the compiled program (all inlets as signals) and through the reference,
+ which evaluates the expression one operator at a time, each operator writing a full buffer.
+ Both sides do the same double operations, the error should be 0 (or a few ulps for the transcendental functions).
+
+ */
+void templateexpr_check(t_templateexpr *x)
+{
+    short       connected[TEMPLATEEXPR_MAXIN];
+    double      *ins[TEMPLATEEXPR_MAXIN];
+    double      *out, *ref;
+    double      err, maxerr = 0., maxrel = 0.;
+    t_exprprog  *prog;
+    long        i, k;
+
+    if (x->x_root < 0) {
+        object_error((t_object *)x, "check: no expression");
+        return;
+    }
+
+    for (k = 0; k < TEMPLATEEXPR_MAXIN; k++)
+        connected[k] = 1;
+    prog = templateexpr_compile(x, connected);
+    if (!prog) {
+        object_error((t_object *)x, "check: can't compile");
+        return;
+    }
+
+    for (k = 0; k < x->x_nin; k++) {
+        ins[k] = (double *) sysmem_newptr(TEMPLATEEXPR_CHECKSIZE * sizeof(double));
+        for (i = 0; i < TEMPLATEEXPR_CHECKSIZE; i++)
+            ins[k][i] = 2. * rand() / RAND_MAX - 1.;
+    }
+    out = (double *) sysmem_newptr(TEMPLATEEXPR_CHECKSIZE * sizeof(double));
+    ref = (double *) sysmem_newptr(TEMPLATEEXPR_CHECKSIZE * sizeof(double));
+
+    templateexpr_run(prog, x->x_scalar, ins, out, TEMPLATEEXPR_CHECKSIZE);
+    templateexpr_reference(x, x->x_root, ins, ref, TEMPLATEEXPR_CHECKSIZE);
+    denormal_scrub(out, TEMPLATEEXPR_CHECKSIZE);
+    denormal_scrub(ref, TEMPLATEEXPR_CHECKSIZE);
+
+    for (i = 0; i < TEMPLATEEXPR_CHECKSIZE; i++) {
+        err = fabs(out[i] - ref[i]);
+        if (err > maxerr)
+            maxerr = err;
+        if (fabs(ref[i]) > 1e-12 && err / fabs(ref[i]) > maxrel)
+            maxrel = err / fabs(ref[i]);
+    }
+
+    object_post((t_object *)x, "check: %ld instructions, %ld slots, max error %g (relative %g) over %d samples",
+                prog->ninstr, prog->nslots, maxerr, maxrel, TEMPLATEEXPR_CHECKSIZE);
+
+    for (k = 0; k < x->x_nin; k++)
+        sysmem_freeptr(ins[k]);
+    sysmem_freeptr(out);
+    sysmem_freeptr(ref);
+    templateexpr_progfree(prog);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Perfomance Routines
+//____________________________________________________________________
+
+// compiles the expression for the inlets that are actually connected, then registers the perform routine
+// without a program (the expression didn't parse or is too long) the perform routine outputs 0
+void templateexpr_dsp64(t_templateexpr *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
+{
+    t_exprprog  *prog = NULL;
+
+    if (x->x_root >= 0) {
+        prog = templateexpr_compile(x, count);
+        if (!prog)
+            object_error((t_object *)x, "expression too long, outputs 0");
+    }
+
+    // the chain is being rebuilt, the previous program isn't running anymore
+    templateexpr_progfree(x->x_prog);
+    x->x_prog = prog;
+
+    object_method(dsp64, gensym("dsp_add64"), x, templateexpr_perform64, 0, NULL);
+}
+
+static void templateexpr_process64(t_templateexpr *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+    templateexpr_run(x->x_prog, x->x_scalar, ins, outs[0], sampleframes);
+}
+
+// denormals are flushed by the FPU while the program runs, NaN (sqrt(-1)...) are scrubbed after it
+DENORMAL_PERFORM(templateexpr_perform64, templateexpr_process64, t_templateexpr, 0, 1)
+
+
+
+
+
+//____________________________________________________________________
+//                          Parser
+//____________________________________________________________________
+
+/*
+
+ Recursive descent, one routine per precedence level :
+    expr    := term (('+' | '-') term)*
+    term    := unary (('*' | '/') unary)*
+    unary   := '-' unary | primary ('^' unary)?
+    primary := number | inN | function '(' expr (',' expr)* ')' | '(' expr ')'
+ Each routine returns the index of the node it built, -1 on error.
+
+ */
+
+static void templateexpr_skip(t_exprparser *ps)
+{
+    while (*ps->p && isspace((unsigned char)*ps->p))
+        ps->p++;
+}
+
+// returns 0 on success, sets x_root, x_nnodes and x_nin
+long templateexpr_parse(t_templateexpr *x, const char *text)
+{
+    t_exprparser ps;
+
+    ps.x = x;
+    ps.p = text;
+    ps.error = 0;
+    x->x_nnodes = 0;
+
+    x->x_root = templateexpr_expr(&ps);
+    templateexpr_skip(&ps);
+
+    if (ps.error || *ps.p || x->x_root < 0) {
+        x->x_root = -1;
+        return 1;
+    }
+    return 0;
+}
+
+long templateexpr_node(t_exprparser *ps, short type, short op, long a, long b, long c)
+{
+    t_templateexpr  *x = ps->x;
+    t_exprnode      *n;
+
+    if (x->x_nnodes >= TEMPLATEEXPR_MAXNODES || (type == NODE_OP && (a < 0 || (b < -1) || (c < -1)))) {
+        ps->error = 1;
+        return -1;
+    }
+
+    n = x->x_nodes + x->x_nnodes;
+    n->type = type;
+    n->op = op;
+    n->child[0] = (short)a;
+    n->child[1] = (short)b;
+    n->child[2] = (short)c;
+    n->nchild = (type != NODE_OP) ? 0 : (c >= 0) ? 3 : (b >= 0) ? 2 : 1;
+
+    return x->x_nnodes++;
+}
+
+long templateexpr_expr(t_exprparser *ps)
+{
+    long    left = templateexpr_term(ps);
+    char    c;
+
+    for (;;) {
+        templateexpr_skip(ps);
+        c = *ps->p;
+        if (c != '+' && c != '-')
+            return left;
+        ps->p++;
+        left = templateexpr_node(ps, NODE_OP, c == '+' ? EXPR_ADD : EXPR_SUB, left, templateexpr_term(ps), -1);
+    }
+}
+
+long templateexpr_term(t_exprparser *ps)
+{
+    long    left = templateexpr_unary(ps);
+    char    c;
+
+    for (;;) {
+        templateexpr_skip(ps);
+        c = *ps->p;
+        if (c != '*' && c != '/')
+            return left;
+        ps->p++;
+        left = templateexpr_node(ps, NODE_OP, c == '*' ? EXPR_MUL : EXPR_DIV, left, templateexpr_unary(ps), -1);
+    }
+}
+
+long templateexpr_unary(t_exprparser *ps)
+{
+    long    base;
+
+    templateexpr_skip(ps);
+    if (*ps->p == '-') {
+        ps->p++;
+        return templateexpr_node(ps, NODE_OP, EXPR_NEG, templateexpr_unary(ps), -1, -1);
+    }
+
+    base = templateexpr_primary(ps);
+    templateexpr_skip(ps);
+    if (*ps->p == '^') {
+        ps->p++;
+        return templateexpr_node(ps, NODE_OP, EXPR_POW, base, templateexpr_unary(ps), -1);
+    }
+    return base;
+}
+
+long templateexpr_primary(t_exprparser *ps)
+{
+    static const struct { const char *name; short op; short nargs; } functions[] = {
+        { "abs", EXPR_ABS, 1 }, { "sqrt", EXPR_SQRT, 1 }, { "exp", EXPR_EXP, 1 },
+        { "sin", EXPR_SIN, 1 }, { "cos", EXPR_COS, 1 }, { "tanh", EXPR_TANH, 1 },
+        { "min", EXPR_MIN, 2 }, { "max", EXPR_MAX, 2 }, { "pow", EXPR_POW, 2 },
+        { "clip", EXPR_CLIP, 3 }
+    };
+    t_templateexpr  *x = ps->x;
+    char            name[16];
+    char            *end;
+    double          v;
+    long            args[3] = { -1, -1, -1 };
+    long            i, n, node;
+
+    templateexpr_skip(ps);
+
+    // parenthesis
+    if (*ps->p == '(') {
+        ps->p++;
+        node = templateexpr_expr(ps);
+        templateexpr_skip(ps);
+        if (*ps->p != ')') {
+            ps->error = 1;
+            return -1;
+        }
+        ps->p++;
+        return node;
+    }
+
+    // number
+    if (isdigit((unsigned char)*ps->p) || *ps->p == '.') {
+        v = strtod(ps->p, &end);
+        ps->p = end;
+        node = templateexpr_node(ps, NODE_CONST, 0, -1, -1, -1);
+        if (node >= 0)
+            x->x_nodes[node].value = v;
+        return node;
+    }
+
+    // identifier : inN or a function
+    for (n = 0; isalnum((unsigned char)*ps->p) && n < (long)sizeof(name) - 1; n++)
+        name[n] = *ps->p++;
+    name[n] = 0;
+
+    if (name[0] == 'i' && name[1] == 'n' && name[2] >= '1' && name[2] <= '0' + TEMPLATEEXPR_MAXIN && !name[3]) {
+        node = templateexpr_node(ps, NODE_INPUT, 0, -1, -1, -1);
+        if (node >= 0)
+            x->x_nodes[node].input = name[2] - '1';
+        if (name[2] - '0' > x->x_nin)
+            x->x_nin = name[2] - '0';
+        return node;
+    }
+
+    for (i = 0; i < (long)(sizeof(functions) / sizeof(functions[0])); i++) {
+        if (strcmp(name, functions[i].name))
+            continue;
+
+        templateexpr_skip(ps);
+        if (*ps->p++ != '(')
+            break;
+        for (n = 0; n < functions[i].nargs; n++) {
+            if (n > 0) {
+                templateexpr_skip(ps);
+                if (*ps->p++ != ',')
+                    break;
+            }
+            args[n] = templateexpr_expr(ps);
+        }
+        templateexpr_skip(ps);
+        if (n != functions[i].nargs || *ps->p++ != ')')
+            break;
+
+        return templateexpr_node(ps, NODE_OP, functions[i].op, args[0], args[1], args[2]);
+    }
+
+    ps->error = 1;
+    return -1;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Compiler
+//____________________________________________________________________
+
+/*
+
+ The pointer table of a program holds, in this order :
+    - the inputs, set to the current chunk of each signal inlet
+    - the output, set to the current chunk of the outlet
+    - the scratch slots, TEMPLATEEXPR_CHUNK doubles each : constants, inlet scalars and temporaries
+ Every operand is an index in this table, so an instruction is the same loop whatever its operands are.
+
+ Constant sub-expressions are computed here, an add of a mul becomes a fused multiply-add,
+ and a temporary is freed as soon as it has been read, so the scratch stays as small as the expression depth.
+
+ */
+
+#define EXPR_OUT(prog)      ((prog)->nin)
+#define EXPR_SLOT0(prog)    ((prog)->nin + 1)
+
+// returns a new scratch slot index, or -1
+static long templateexpr_slot(t_exprprog *prog)
+{
+    if (prog->nslots >= TEMPLATEEXPR_MAXSLOTS)
+        return -1;
+    return EXPR_SLOT0(prog) + prog->nslots++;
+}
+
+// a temporary from the free list (bitmask of freed temporaries), or a new slot
+static long templateexpr_temp(t_exprprog *prog, uint32_t *temps)
+{
+    long i;
+
+    // unsigned and 32 bits : bit 31 is a slot too, long is 32 bits on Windows
+    for (i = 0; i < TEMPLATEEXPR_MAXSLOTS; i++) {
+        if (*temps & ((uint32_t)1 << i)) {
+            *temps &= ~((uint32_t)1 << i);
+            return EXPR_SLOT0(prog) + i;
+        }
+    }
+    return templateexpr_slot(prog);
+}
+
+// temporaries are marked in the high bit of the returned operand so they can be freed once read
+#define EXPR_TEMPFLAG   0x4000
+#define EXPR_INDEX(o)   ((o) & ~EXPR_TEMPFLAG)
+
+static void templateexpr_release(t_exprprog *prog, long operand, uint32_t *temps)
+{
+    if (operand >= 0 && (operand & EXPR_TEMPFLAG))
+        *temps |= (uint32_t)1 << (EXPR_INDEX(operand) - EXPR_SLOT0(prog));
+}
+
+// folds a node whose operands are all constants, returns 1 if it did
+static long templateexpr_fold(t_templateexpr *x, long node)
+{
+    t_exprnode  *n = x->x_nodes + node;
+    double      v[3] = { 0., 0., 0. };
+    long        i;
+
+    if (n->type != NODE_OP)
+        return n->type == NODE_CONST;
+
+    for (i = 0; i < n->nchild; i++) {
+        if (!templateexpr_fold(x, n->child[i]))
+            return 0;
+        v[i] = x->x_nodes[n->child[i]].value;
+    }
+
+    n->value = templateexpr_eval(n->op, v[0], v[1], v[2]);
+    n->type = NODE_CONST;
+    return 1;
+}
+
+static long templateexpr_instr(t_exprprog *prog, short op, long d, long a, long b, long c)
+{
+    t_exprinstr *in;
+
+    if (prog->ninstr >= TEMPLATEEXPR_MAXINSTR)
+        return -1;
+
+    in = prog->instr + prog->ninstr++;
+    in->op = op;
+    in->d = (short)EXPR_INDEX(d);
+    in->a = (short)(a >= 0 ? EXPR_INDEX(a) : 0);
+    in->b = (short)(b >= 0 ? EXPR_INDEX(b) : 0);
+    in->c = (short)(c >= 0 ? EXPR_INDEX(c) : 0);
+    return 0;
+}
+
+// emits the instructions computing node, returns its operand (EXPR_TEMPFLAG set for a temporary), -1 on error
+long templateexpr_emit(t_templateexpr *x, t_exprprog *prog, long node, short *connected, uint32_t *temps)
+{
+    t_exprnode  *n = x->x_nodes + node;
+    t_exprnode  *m;
+    long        o[3] = { -1, -1, -1 };
+    short       op = n->op;
+    long        d, i, k;
+
+    switch (n->type) {
+        case NODE_CONST:
+            d = templateexpr_slot(prog);
+            if (d < 0)
+                return -1;
+            for (k = 0; k < TEMPLATEEXPR_CHUNK; k++)
+                prog->ptr[d][k] = n->value;
+            return d;
+
+        case NODE_INPUT:
+            if (connected[n->input])
+                return n->input;
+            // no signal : a slot filled with the inlet's scalar at the start of each vector
+            if (!prog->scalar[n->input])
+                prog->scalar[n->input] = (short)templateexpr_slot(prog);
+            return prog->scalar[n->input] > 0 ? prog->scalar[n->input] : -1;
+
+        default: break;
+    }
+
+    // a + b*c or a*b + c : one fused instruction instead of two
+    if (op == EXPR_ADD) {
+        for (i = 0; i < 2; i++) {
+            m = x->x_nodes + n->child[i];
+            if (m->type == NODE_OP && m->op == EXPR_MUL) {
+                o[0] = templateexpr_emit(x, prog, m->child[0], connected, temps);
+                o[1] = templateexpr_emit(x, prog, m->child[1], connected, temps);
+                o[2] = templateexpr_emit(x, prog, n->child[1 - i], connected, temps);
+                op = EXPR_MADD;
+                break;
+            }
+        }
+    }
+
+    if (op != EXPR_MADD)
+        for (i = 0; i < n->nchild; i++)
+            o[i] = templateexpr_emit(x, prog, n->child[i], connected, temps);
+
+    for (i = 0; i < 3; i++)
+        if (o[i] == -1 && (op == EXPR_MADD || i < n->nchild))
+            return -1;
+
+    // operands are read before the result is written (element by element), so the result may reuse one of them
+    for (i = 0; i < 3; i++)
+        templateexpr_release(prog, o[i], temps);
+
+    d = templateexpr_temp(prog, temps);
+    if (d < 0 || templateexpr_instr(prog, op, d, o[0], o[1], o[2]))
+        return -1;
+
+    return d | EXPR_TEMPFLAG;
+}
+
+// compiles the parsed expression, connected[k] tells if inlet k has a signal
+t_exprprog *templateexpr_compile(t_templateexpr *x, short *connected)
+{
+    t_exprprog  *prog;
+    uint32_t    temps = 0;
+    long        r, i;
+
+    prog = (t_exprprog *) sysmem_newptrclear(sizeof(t_exprprog));
+    if (!prog)
+        return NULL;
+
+    prog->nin = x->x_nin;
+    prog->scratch = (double *) sysmem_newptrclear(TEMPLATEEXPR_MAXSLOTS * TEMPLATEEXPR_CHUNK * sizeof(double));
+    if (!prog->scratch) {
+        templateexpr_progfree(prog);
+        return NULL;
+    }
+    for (i = 0; i < TEMPLATEEXPR_MAXSLOTS; i++)
+        prog->ptr[EXPR_SLOT0(prog) + i] = prog->scratch + i * TEMPLATEEXPR_CHUNK;
+
+    templateexpr_fold(x, x->x_root);
+
+    r = templateexpr_emit(x, prog, x->x_root, connected, &temps);
+    if (r < 0) {
+        templateexpr_progfree(prog);
+        return NULL;
+    }
+
+    // the last instruction writes straight to the outlet when it computed the result, otherwise copy it
+    if ((r & EXPR_TEMPFLAG) && prog->ninstr && prog->instr[prog->ninstr - 1].d == EXPR_INDEX(r))
+        prog->instr[prog->ninstr - 1].d = (short)EXPR_OUT(prog);
+    else if (templateexpr_instr(prog, EXPR_COPY, EXPR_OUT(prog), r, -1, -1)) {
+        templateexpr_progfree(prog);
+        return NULL;
+    }
+
+    return prog;
+}
+
+void templateexpr_progfree(t_exprprog *prog)
+{
+    if (!prog)
+        return;
+    if (prog->scratch)
+        sysmem_freeptr(prog->scratch);
+    sysmem_freeptr(prog);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Evaluation
+//____________________________________________________________________
+
+// scalar version of every operator, used for constant folding, the reference and the loop tails
+double templateexpr_eval(short op, double a, double b, double c)
+{
+    switch (op) {
+        case EXPR_COPY: return a;
+        case EXPR_ADD:  return a + b;
+        case EXPR_SUB:  return a - b;
+        case EXPR_MUL:  return a * b;
+        case EXPR_DIV:  return a / b;
+        case EXPR_POW:  return pow(a, b);
+        case EXPR_MIN:  return a < b ? a : b;
+        case EXPR_MAX:  return a > b ? a : b;
+        case EXPR_NEG:  return -a;
+        case EXPR_ABS:  return fabs(a);
+        case EXPR_SQRT: return sqrt(a);
+        case EXPR_EXP:  return exp(a);
+        case EXPR_SIN:  return sin(a);
+        case EXPR_COS:  return cos(a);
+        case EXPR_TANH: return tanh(a);
+        case EXPR_CLIP: return a < b ? b : a > c ? c : a;
+        case EXPR_MADD: return a * b + c;
+        default:        return 0.;
+    }
+}
+
+// vector body for the operators that have one, the tail (and the others) use templateexpr_eval
+#define EXPR_VLOOP(EXPR)                                                    \
+    for (i = 0; i + VD_SIZE <= n; i += VD_SIZE) {                           \
+        va = vd_load(a + i); vb = vd_load(b + i); vc = vd_load(c + i);     \
+        vd_store(d + i, EXPR);                                              \
+    }
+
+// runs the program over a signal vector, one chunk at a time : all the instructions on a chunk, then the next chunk
+void templateexpr_run(t_exprprog *prog, double *scalars, double **ins, double *out, long sampleframes)
+{
+    t_exprinstr *in, *end;
+    double      *d, *a, *b, *c;
+    t_vd        va, vb, vc;
+    long        off, n, i, k;
+
+    if (!prog) {
+        memset(out, 0, sampleframes * sizeof(double));
+        return;
+    }
+
+    // inlets without a signal
+    for (k = 0; k < prog->nin; k++)
+        if (prog->scalar[k])
+            for (i = 0; i < TEMPLATEEXPR_CHUNK; i++)
+                prog->ptr[prog->scalar[k]][i] = scalars[k];
+
+    end = prog->instr + prog->ninstr;
+
+    for (off = 0; off < sampleframes; off += TEMPLATEEXPR_CHUNK) {
+        n = sampleframes - off < TEMPLATEEXPR_CHUNK ? sampleframes - off : TEMPLATEEXPR_CHUNK;
+
+        for (k = 0; k < prog->nin; k++)
+            prog->ptr[k] = ins[k] + off;
+        prog->ptr[EXPR_OUT(prog)] = out + off;
+
+        for (in = prog->instr; in < end; in++) {
+            d = prog->ptr[in->d];
+            a = prog->ptr[in->a];
+            b = prog->ptr[in->b];
+            c = prog->ptr[in->c];
+            i = 0;
+
+            switch (in->op) {
+                case EXPR_COPY: EXPR_VLOOP(va); break;
+                case EXPR_ADD:  EXPR_VLOOP(vd_add(va, vb)); break;
+                case EXPR_SUB:  EXPR_VLOOP(vd_sub(va, vb)); break;
+                case EXPR_MUL:  EXPR_VLOOP(vd_mul(va, vb)); break;
+                case EXPR_DIV:  EXPR_VLOOP(vd_div(va, vb)); break;
+                case EXPR_MIN:  EXPR_VLOOP(vd_min(va, vb)); break;
+                case EXPR_MAX:  EXPR_VLOOP(vd_max(va, vb)); break;
+                case EXPR_NEG:  EXPR_VLOOP(vd_neg(va)); break;
+                case EXPR_ABS:  EXPR_VLOOP(vd_abs(va)); break;
+                case EXPR_SQRT: EXPR_VLOOP(vd_sqrt(va)); break;
+                case EXPR_CLIP: EXPR_VLOOP(vd_min(vd_max(va, vb), vc)); break;
+                case EXPR_MADD: EXPR_VLOOP(vd_madd(va, vb, vc)); break;
+                default: break;
+            }
+            for (; i < n; i++)
+                d[i] = templateexpr_eval(in->op, a[i], b[i], c[i]);
+        }
+    }
+}
+
+// the expression evaluated like a chain of single operator objects : one full buffer per node
+void templateexpr_reference(t_templateexpr *x, long node, double **ins, double *out, long n)
+{
+    t_exprnode  *nd = x->x_nodes + node;
+    double      *arg[3] = { NULL, NULL, NULL };
+    long        i, k;
+
+    switch (nd->type) {
+        case NODE_CONST:
+            for (i = 0; i < n; i++)
+                out[i] = nd->value;
+            return;
+        case NODE_INPUT:
+            memcpy(out, ins[nd->input], n * sizeof(double));
+            return;
+        default: break;
+    }
+
+    for (k = 0; k < nd->nchild; k++) {
+        arg[k] = (double *) sysmem_newptr(n * sizeof(double));
+        templateexpr_reference(x, nd->child[k], ins, arg[k], n);
+    }
+    for (i = 0; i < n; i++)
+        out[i] = templateexpr_eval(nd->op, arg[0][i], nd->nchild > 1 ? arg[1][i] : 0., nd->nchild > 2 ? arg[2][i] : 0.);
+    for (k = 0; k < nd->nchild; k++)
+        sysmem_freeptr(arg[k]);
+}
@@ -0,0 +1,920 @@
+/**
+ *
+ *  @file	templatefilter~.c
+ *
+ *
+ *  Sources :
+ *
+ *  Documentation :
+ *      Cylcing 74'
+ *          - Max 7.1 API :
+ *              https://cycling74.com/sdk/MaxSDK-6.0.4/html/index.html
+ *
+ *          - Max/MSP 7.1 SDK examples :
+ *              https://cycling74.com/downloads/sdk/#.Vzn0OpPbugw
+ *
+ *      Robert Bristow-Johnson
+ *          - Cookbook formulae for audio EQ biquad filter coefficients :
+ *              https://www.w3.org/TR/audio-eq-cookbook/
+ *
+ *      Andrew Simper (Cytomic)
+ *          - Linear Trapezoidal Integrated State Variable Filter With Low Noise Optimisation :
+ *              https://cytomic.com/files/dsp/SvfLinearTrapOptimised2.pdf
+ *
+ *  Code :
+ *
+ *      template~ (this repository)
+ *          - same structure, inlets/outlets and perform routine conventions
+ *
+ *
+ *
+ *  This object is a bank of up to 64 second order sections, e.g. a 31 band EQ, over 1 to 16 channels :
+ *  [templatefilter~ 2 @topology parallel] has two signal inlets and two signal outlets.
+ *
+ *  Each section is set by a message, the frequency in Hz, Q and the gain in dB of the peak and shelves :
+ *      section <index> <type> <freq> [q] [gain]    type is off lowpass highpass bandpass notch allpass peak lowshelf highshelf
+ *      coeffs <index> b0 b1 b2 a1 a2               raw biquad coefficients, in the order of biquad~ (feed-forward first)
+ *      level <index> <gain>                        linear gain of the section in the parallel sum (1 by default)
+ *      clear                                       zeroes the filter states
+ *
+ *  @topology serial (default) runs the sections in a chain, parallel sums their outputs. @form is biquad (transposed
+ *  direct form II) or svf (trapezoidal state variable filter, smoother under fast coefficient changes). Both give
+ *  the same response, the bilinear transform of the same analog prototype.
+ *
+ *  The coefficients are stored transposed (one row per coefficient, one column per section), so VD_SIZE
+ *  independent filters load in one t_vd and run in its lanes :
+ *      parallel    the lanes are sections, which all read the same input sample
+ *      serial      a section needs the output of the previous one, the lanes are channels
+ *  The messages compute the coefficients on the main thread and publish them as one block through a
+ *  lock-free snapshot, the audio thread picks the newest block at the start of a vector and never waits.
+ *
+ *  The check message compares the SIMD bank with a plain scalar loop over the sections.
+ *
+ */
+
+//____________________________________________________________________
+//                         External Libraries
+//____________________________________________________________________
+/*
+
+ Headears and Platform specific elements
+
+ */
+#ifdef MAC_VERSION
+    // do something specific to the Mac
+#endif
+#ifdef WIN_VERSION
+    // do something specific to Windows
+#endif
+
+#include "ext.h"            // should always be first, then ext_obex.h + other files.
+#include "ext_obex.h"		// required for "new" style objects
+#include "z_dsp.h"			// required for MSP objects
+
+#include <math.h>
+#ifndef M_PI
+#define M_PI 3.14159265358979323846     // not defined by every compiler (Visual Studio)
+#endif
+
+#include "../../common/simd.h"
+#include "../../common/lockfree.h"
+#include "../../common/denormal.h"
+#include "../../common/accuracy.h"
+
+#define TEMPLATEFILTER_MAXSECTIONS  64      ///<    Sections of a bank, a multiple of VD_SIZE
+#define TEMPLATEFILTER_MAXCHANNELS  16      ///<    Signal inlets and outlets
+#define TEMPLATEFILTER_COEFS        6       ///<    Coefficients of a section, b0 b1 b2 a1 a2 or a1 a2 a3 m0 m1 m2
+#define TEMPLATEFILTER_MINQ         0.025
+#define TEMPLATEFILTER_MAXFREQ      0.49    ///<    Highest frequency, times the sample rate
+
+// section types, in the order of TEMPLATEFILTER_TYPES
+enum {
+    FILTER_OFF = 0,     ///<    Passes its input in a chain, adds nothing to a parallel sum
+    FILTER_LOWPASS,
+    FILTER_HIGHPASS,
+    FILTER_BANDPASS,    ///<    0 dB at the center frequency
+    FILTER_NOTCH,
+    FILTER_ALLPASS,
+    FILTER_PEAK,
+    FILTER_LOWSHELF,
+    FILTER_HIGHSHELF,
+    FILTER_RAW,         ///<    coeffs message, biquad form only
+    FILTER_TYPES
+};
+#define TEMPLATEFILTER_TYPES    "off lowpass highpass bandpass notch allpass peak lowshelf highshelf"
+
+enum {
+    TOPOLOGY_SERIAL = 0,
+    TOPOLOGY_PARALLEL
+};
+
+enum {
+    FORM_BIQUAD = 0,
+    FORM_SVF
+};
+
+typedef struct _filtersection   ///<    A section as set by the messages
+{
+    long        type;
+    double      freq;           ///<    Hz
+    double      q;
+    double      gain;           ///<    dB, peak and shelves
+    double      raw[5];         ///<    b0 b1 b2 a1 a2 of FILTER_RAW
+    double      level;          ///<    Linear gain in the parallel sum
+
+} t_filtersection;
+
+typedef struct _filterbank      ///<    What the audio thread runs, published as one block
+{
+    double      c[TEMPLATEFILTER_COEFS][TEMPLATEFILTER_MAXSECTIONS];   ///<    Row r is coefficient r of every section
+    double      level[TEMPLATEFILTER_MAXSECTIONS];                  ///<    0 for the sections out of the parallel sum
+    long        nsections;      ///<    Up to the last section that isn't off
+    long        topology;
+    long        form;
+    long        stamp;          ///<    Changes when the states have to be zeroed (topology, form, clear)
+
+} t_filterbank;
+
+
+
+
+
+//____________________________________________________________________
+//                        'Class' Definition
+//____________________________________________________________________
+/*
+
+ 'Class' decleration and a struct for the object is declared and typedef'd.
+
+ */
+
+typedef struct _templatefilter	///<	A struct to hold data for our object
+{
+    t_pxobject      x_obj;          ///<	The object itself (t_pxobject in MSP instead of t_object)
+    long            x_channels;     ///<    Signal inlets and outlets (argument)
+    long            x_topology;     ///<    TOPOLOGY_SERIAL or TOPOLOGY_PARALLEL (topology attribute)
+    long            x_form;         ///<    FORM_BIQUAD or FORM_SVF (form attribute)
+    double          x_sr;
+    t_filtersection x_sections[TEMPLATEFILTER_MAXSECTIONS];
+    long            x_stamp;        ///<    Stamp of the next block that zeroes the states
+
+    // main thread -> audio thread
+    t_snapshot      x_bank;         ///<    t_filterbank, written by the messages, read at the start of each vector
+
+    // audio thread
+    long            x_running;      ///<    Stamp of the block in use
+    double          *x_work;        ///<    VD_SIZE * maxvectorsize doubles : interleaved channels, or the parallel sum per lane
+    double          x_state[2 * TEMPLATEFILTER_MAXCHANNELS * TEMPLATEFILTER_MAXSECTIONS]; ///<    Two states per section and channel
+
+} t_templatefilter;
+
+// global pointer to our class definition that is setup in main()
+static t_class *templatefilter_class = NULL;
+
+
+
+
+
+//____________________________________________________________________
+//                        Function Prototypes
+//____________________________________________________________________
+
+//// standard set
+void *templatefilter_new( t_symbol *s, long argc, t_atom *argv);
+void templatefilter_free( t_templatefilter *x);
+void templatefilter_assist(t_templatefilter *x, void *b, long m, long a, char *s);
+
+//// value specific
+void templatefilter_section(t_templatefilter *x, t_symbol *s, long argc, t_atom *argv);
+void templatefilter_coeffs( t_templatefilter *x, t_symbol *s, long argc, t_atom *argv);
+void templatefilter_level(  t_templatefilter *x, t_symbol *s, long argc, t_atom *argv);
+void templatefilter_clear(  t_templatefilter *x);
+void templatefilter_check(  t_templatefilter *x);
+t_max_err templatefilter_topology_set(t_templatefilter *x, void *attr, long argc, t_atom *argv);
+t_max_err templatefilter_form_set(    t_templatefilter *x, void *attr, long argc, t_atom *argv);
+
+//// coefficients
+void templatefilter_design(long form, const t_filtersection *sec, double sr, double *k);
+void templatefilter_fill(t_templatefilter *x, t_filterbank *bank, long topology, long form);
+void templatefilter_publish(t_templatefilter *x, long reset);
+
+//// performance set
+void templatefilter_dsp64(t_templatefilter *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
+void templatefilter_perform64(t_templatefilter *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+void templatefilter_serial(  const t_filterbank *bank, double *state, double **ins, double **outs, long channels, double *work, long sampleframes);
+void templatefilter_parallel(const t_filterbank *bank, double *state, double **ins, double **outs, long channels, double *work, long sampleframes);
+
+
+
+
+
+//____________________________________________________________________
+//                          Initialisation Routine
+//____________________________________________________________________
+
+/*
+
+The initialization routine, which must be called main, is called when Max loads your object for the first time. In the initialization routine, you define one or more classes. Defining a class consists of the following:
+
+        1) telling Max about the size of your object's structure and how to create and destroy an instance
+        2) defining methods that implement the object's behavior
+        3) in some cases, defining attributes that describe the object's data
+        4) registering the class in a name space
+
+*/
+
+void ext_main(void *r)
+{
+    // we free the snapshot and the work buffer, so templatefilter_free calls dsp_free itself
+    t_class *c = class_new("templatefilter~", (method)templatefilter_new, (method)templatefilter_free, (long)sizeof(t_templatefilter), 0L, A_GIMME, 0);
+
+    class_addmethod(c, (method)templatefilter_section,  "section",  A_GIMME, 0);
+    class_addmethod(c, (method)templatefilter_coeffs,   "coeffs",   A_GIMME, 0);
+    class_addmethod(c, (method)templatefilter_level,    "level",    A_GIMME, 0);
+    class_addmethod(c, (method)templatefilter_clear,    "clear",            0);
+    class_addmethod(c, (method)templatefilter_check,    "check",            0);
+    class_addmethod(c, (method)templatefilter_dsp64,	"dsp64",	A_CANT, 0);
+    class_addmethod(c, (method)templatefilter_assist,   "assist",	A_CANT, 0);
+
+    // both republish the bank and zero the states, the layout of the states depends on them
+    CLASS_ATTR_LONG(c, "topology", 0, t_templatefilter, x_topology);
+    CLASS_ATTR_ENUMINDEX(c, "topology", 0, "serial parallel");
+    CLASS_ATTR_ACCESSORS(c, "topology", NULL, templatefilter_topology_set);
+    CLASS_ATTR_LABEL(c, "topology", 0, "Sections in a Chain or Summed");
+    CLASS_ATTR_LONG(c, "form", 0, t_templatefilter, x_form);
+    CLASS_ATTR_ENUMINDEX(c, "form", 0, "biquad svf");
+    CLASS_ATTR_ACCESSORS(c, "form", NULL, templatefilter_form_set);
+    CLASS_ATTR_LABEL(c, "form", 0, "Filter Structure");
+
+    //  Adds a set of methods to your object's class that are called by MSP to build the DSP call chain.
+    class_dspinit(c);
+
+    //  adds this class to the CLASS_BOX name space, meaning that it will be searched when a user tries to type it into a box.
+    class_register(CLASS_BOX, c);
+
+    //assign the class we've created to a global variable so we can use it when creating new instances.
+    templatefilter_class = c;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Instance Routines
+//____________________________________________________________________
+
+
+void *templatefilter_new(t_symbol *s, long argc, t_atom *argv)
+{
+    //Setup the custom struct for our object
+    t_templatefilter *x = (t_templatefilter *) object_alloc((t_class *) templatefilter_class);
+    t_atom_long channels = 1;
+    long        i;
+
+    // the channels are the first argument, before the attributes
+    atom_arg_getlong(&channels, 0, argc, argv);
+    x->x_channels = channels < 1 ? 1 : channels > TEMPLATEFILTER_MAXCHANNELS ? TEMPLATEFILTER_MAXCHANNELS : (long)channels;
+
+    //Setup one signal inlet and outlet per channel
+    dsp_setup((t_pxobject *)x, x->x_channels);
+    for (i = 0; i < x->x_channels; i++)
+        outlet_new((t_pxobject *)x, "signal");
+
+    // the channels are interleaved before any output is written, an output must not be another channel's input
+    x->x_obj.z_misc |= Z_NO_INPLACE;
+
+    for (i = 0; i < TEMPLATEFILTER_MAXSECTIONS; i++) {
+        x->x_sections[i].type  = FILTER_OFF;
+        x->x_sections[i].q     = M_SQRT1_2;
+        x->x_sections[i].level = 1.;
+    }
+    x->x_sr = sys_getsr();
+    x->x_stamp = 1;
+
+    if (snapshot_new(&x->x_bank, sizeof(t_filterbank))) {
+        object_error((t_object *)x, "out of memory");
+        object_free(x);     // calls templatefilter_free
+        return NULL;
+    }
+
+    attr_args_process(x, (short)argc, argv);
+    templatefilter_publish(x, 1);
+
+    return (x);
+}
+
+void templatefilter_free(t_templatefilter *x)
+{
+    dsp_free((t_pxobject *)x);
+    snapshot_free(&x->x_bank);
+    if (x->x_work)
+        sysmem_freeptr(x->x_work);
+}
+
+//Documentation shown when hovering over an inlet/outlet
+void templatefilter_assist(t_templatefilter *x, void *b, long m, long a, char *s)
+{
+    if (m == ASSIST_INLET)
+        sprintf(s, a ? "(Signal) Channel %ld" : "(Signal) Channel %ld, section, coeffs, level, clear", a + 1);
+    else if (m == ASSIST_OUTLET)
+        sprintf(s, "(Signal) Channel %ld filtered", a + 1);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Message Handlers
+//____________________________________________________________________
+
+// section <index> <type> <freq> [q] [gain]
+void templatefilter_section(t_templatefilter *x, t_symbol *s, long argc, t_atom *argv)
+{
+    static const char   *names[FILTER_RAW] = { "off", "lowpass", "highpass", "bandpass", "notch", "allpass", "peak", "lowshelf", "highshelf" };
+    t_filtersection     *sec;
+    t_symbol            *type;
+    long                index, i;
+
+    if (argc < 2 || atom_gettype(argv + 1) != A_SYM) {
+        object_error((t_object *)x, "section <index> <type> <freq> [q] [gain]");
+        return;
+    }
+    index = (long)atom_getlong(argv);
+    if (index < 0 || index >= TEMPLATEFILTER_MAXSECTIONS) {
+        object_error((t_object *)x, "section: index %ld out of 0 - %d", index, TEMPLATEFILTER_MAXSECTIONS - 1);
+        return;
+    }
+    type = atom_getsym(argv + 1);
+    for (i = 0; i < FILTER_RAW; i++)
+        if (!strcmp(type->s_name, names[i]))
+            break;
+    if (i == FILTER_RAW) {
+        object_error((t_object *)x, "section: no type %s (%s)", type->s_name, TEMPLATEFILTER_TYPES);
+        return;
+    }
+    if (i != FILTER_OFF && argc < 3) {
+        object_error((t_object *)x, "section: %s needs a frequency", type->s_name);
+        return;
+    }
+
+    sec = x->x_sections + index;
+    sec->type = i;
+    if (argc > 2)
+        sec->freq = atom_getfloat(argv + 2);
+    sec->q    = argc > 3 ? atom_getfloat(argv + 3) : M_SQRT1_2;
+    sec->gain = argc > 4 ? atom_getfloat(argv + 4) : 0.;
+
+    templatefilter_publish(x, 0);
+}
+
+// coeffs <index> b0 b1 b2 a1 a2, y = b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2
+void templatefilter_coeffs(t_templatefilter *x, t_symbol *s, long argc, t_atom *argv)
+{
+    t_filtersection     *sec;
+    long                index, i;
+
+    if (argc != 6) {
+        object_error((t_object *)x, "coeffs <index> b0 b1 b2 a1 a2");
+        return;
+    }
+    index = (long)atom_getlong(argv);
+    if (index < 0 || index >= TEMPLATEFILTER_MAXSECTIONS) {
+        object_error((t_object *)x, "coeffs: index %ld out of 0 - %d", index, TEMPLATEFILTER_MAXSECTIONS - 1);
+        return;
+    }
+    if (x->x_form != FORM_BIQUAD)
+        object_warn((t_object *)x, "coeffs: section %ld passes its input until the form is biquad", index);
+
+    sec = x->x_sections + index;
+    sec->type = FILTER_RAW;
+    for (i = 0; i < 5; i++)
+        sec->raw[i] = atom_getfloat(argv + 1 + i);
+
+    templatefilter_publish(x, 0);
+}
+
+// level <index> <gain>
+void templatefilter_level(t_templatefilter *x, t_symbol *s, long argc, t_atom *argv)
+{
+    long index;
+
+    if (argc != 2) {
+        object_error((t_object *)x, "level <index> <gain>");
+        return;
+    }
+    index = (long)atom_getlong(argv);
+    if (index < 0 || index >= TEMPLATEFILTER_MAXSECTIONS) {
+        object_error((t_object *)x, "level: index %ld out of 0 - %d", index, TEMPLATEFILTER_MAXSECTIONS - 1);
+        return;
+    }
+    x->x_sections[index].level = atom_getfloat(argv + 1);
+    templatefilter_publish(x, 0);
+}
+
+void templatefilter_clear(t_templatefilter *x)
+{
+    templatefilter_publish(x, 1);
+}
+
+t_max_err templatefilter_topology_set(t_templatefilter *x, void *attr, long argc, t_atom *argv)
+{
+    if (argc && argv) {
+        x->x_topology = atom_getlong(argv) ? TOPOLOGY_PARALLEL : TOPOLOGY_SERIAL;
+        templatefilter_publish(x, 1);
+    }
+    return MAX_ERR_NONE;
+}
+
+t_max_err templatefilter_form_set(t_templatefilter *x, void *attr, long argc, t_atom *argv)
+{
+    if (argc && argv) {
+        x->x_form = atom_getlong(argv) ? FORM_SVF : FORM_BIQUAD;
+        templatefilter_publish(x, 1);
+    }
+    return MAX_ERR_NONE;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Coefficients
+//____________________________________________________________________
+/*
+
+ biquad     b0 b1 b2 a1 a2, transposed direct form II :
+                y = b0 x + s1,  s1 = b1 x - a1 y + s2,  s2 = b2 x - a2 y
+ svf        a1 a2 a3 m0 m1 m2, the states are the integrator memories ic1eq ic2eq :
+                v3 = x - ic2eq,  v1 = a1 ic1eq + a2 v3,  v2 = ic2eq + a2 ic1eq + a3 v3
+                ic1eq = 2 v1 - ic1eq,  ic2eq = 2 v2 - ic2eq,  y = m0 x + m1 v1 + m2 v2
+
+ Both forms use the bilinear transform prewarped at the frequency (RBJ's sin(w0) / cos(w0), Simper's tan(w0 / 2)),
+ a section has the same response in both. An off section is y = x (b0 = 1, m0 = 1).
+
+ */
+
+// the 6 coefficients of a section in one form
+void templatefilter_design(long form, const t_filtersection *sec, double sr, double *k)
+{
+    double  f = sec->freq / sr;
+    double  q = sec->q < TEMPLATEFILTER_MINQ ? TEMPLATEFILTER_MINQ : sec->q;
+    double  A = pow(10., sec->gain / 40.);
+    double  w, cw, alpha, sA, a0, g, r;
+    double  b[3] = { 1., 0., 0. }, a[2] = { 0., 0. };
+    long    i;
+
+    f = f < 1e-6 ? 1e-6 : f > TEMPLATEFILTER_MAXFREQ ? TEMPLATEFILTER_MAXFREQ : f;
+    for (i = 0; i < TEMPLATEFILTER_COEFS; i++)
+        k[i] = 0.;
+
+    if (form == FORM_SVF) {
+        k[3] = 1.;                          // m0, off and raw pass the input
+        if (sec->type == FILTER_OFF || sec->type == FILTER_RAW)
+            return;
+
+        g = tan(M_PI * f);
+        r = 1. / q;
+        switch (sec->type) {
+            case FILTER_LOWPASS:    k[3] = 0.; k[5] = 1.; break;
+            case FILTER_HIGHPASS:   k[4] = -r; k[5] = -1.; break;
+            case FILTER_BANDPASS:   k[3] = 0.; k[4] = r; break;
+            case FILTER_NOTCH:      k[4] = -r; break;
+            case FILTER_ALLPASS:    k[4] = -2. * r; break;
+            case FILTER_PEAK:       r = 1. / (q * A); k[4] = r * (A * A - 1.); break;
+            case FILTER_LOWSHELF:   g /= sqrt(A); k[4] = r * (A - 1.); k[5] = A * A - 1.; break;
+            default:                g *= sqrt(A); k[3] = A * A; k[4] = r * (1. - A) * A; k[5] = 1. - A * A; break;
+        }
+        k[0] = 1. / (1. + g * (g + r));
+        k[1] = g * k[0];
+        k[2] = g * k[1];
+        return;
+    }
+
+    if (sec->type == FILTER_RAW) {
+        for (i = 0; i < 5; i++)
+            k[i] = sec->raw[i];
+        return;
+    }
+    if (sec->type == FILTER_OFF) {
+        k[0] = 1.;
+        return;
+    }
+
+    w = 2. * M_PI * f;
+    cw = cos(w);
+    alpha = sin(w) / (2. * q);
+    sA = 2. * sqrt(A) * alpha;
+    a0 = 1. + alpha;
+    a[0] = -2. * cw;
+    a[1] = 1. - alpha;
+    switch (sec->type) {
+        case FILTER_LOWPASS:
+            b[0] = b[2] = (1. - cw) / 2.; b[1] = 1. - cw;
+            break;
+        case FILTER_HIGHPASS:
+            b[0] = b[2] = (1. + cw) / 2.; b[1] = -(1. + cw);
+            break;
+        case FILTER_BANDPASS:
+            b[0] = alpha; b[1] = 0.; b[2] = -alpha;
+            break;
+        case FILTER_NOTCH:
+            b[0] = b[2] = 1.; b[1] = -2. * cw;
+            break;
+        case FILTER_ALLPASS:
+            b[0] = 1. - alpha; b[1] = -2. * cw; b[2] = 1. + alpha;
+            break;
+        case FILTER_PEAK:
+            b[0] = 1. + alpha * A; b[1] = -2. * cw; b[2] = 1. - alpha * A;
+            a0 = 1. + alpha / A; a[1] = 1. - alpha / A;
+            break;
+        case FILTER_LOWSHELF:
+            b[0] = A * ((A + 1.) - (A - 1.) * cw + sA);
+            b[1] = 2. * A * ((A - 1.) - (A + 1.) * cw);
+            b[2] = A * ((A + 1.) - (A - 1.) * cw - sA);
+            a0   = (A + 1.) + (A - 1.) * cw + sA;
+            a[0] = -2. * ((A - 1.) + (A + 1.) * cw);
+            a[1] = (A + 1.) + (A - 1.) * cw - sA;
+            break;
+        default:
+            b[0] = A * ((A + 1.) + (A - 1.) * cw + sA);
+            b[1] = -2. * A * ((A - 1.) + (A + 1.) * cw);
+            b[2] = A * ((A + 1.) + (A - 1.) * cw - sA);
+            a0   = (A + 1.) - (A - 1.) * cw + sA;
+            a[0] = 2. * ((A - 1.) - (A + 1.) * cw);
+            a[1] = (A + 1.) - (A - 1.) * cw - sA;
+            break;
+    }
+    k[0] = b[0] / a0;
+    k[1] = b[1] / a0;
+    k[2] = b[2] / a0;
+    k[3] = a[0] / a0;
+    k[4] = a[1] / a0;
+}
+
+// the bank of the sections in one topology and form. The columns past nsections are 0, coefficients and level :
+// the padding lane of the last parallel group outputs nothing
+void templatefilter_fill(t_templatefilter *x, t_filterbank *bank, long topology, long form)
+{
+    double  k[TEMPLATEFILTER_COEFS];
+    long    i, r;
+
+    memset(bank, 0, sizeof(t_filterbank));
+    bank->topology = topology;
+    bank->form = form;
+    for (i = 0; i < TEMPLATEFILTER_MAXSECTIONS; i++)
+        if (x->x_sections[i].type != FILTER_OFF)
+            bank->nsections = i + 1;
+
+    for (i = 0; i < bank->nsections; i++) {
+        templatefilter_design(form, x->x_sections + i, x->x_sr, k);
+        for (r = 0; r < TEMPLATEFILTER_COEFS; r++)
+            bank->c[r][i] = k[r];
+        bank->level[i] = x->x_sections[i].type == FILTER_OFF ? 0. : x->x_sections[i].level;
+    }
+}
+
+// main thread : writes the bank in the back buffer of the snapshot, the audio thread takes it at its next vector.
+// reset zeroes the states, as the first vector of a new topology or form reads them in another layout
+void templatefilter_publish(t_templatefilter *x, long reset)
+{
+    t_filterbank *bank = (t_filterbank *) snapshot_back(&x->x_bank);
+
+    if (!bank)
+        return;
+    if (reset)
+        x->x_stamp++;
+    templatefilter_fill(x, bank, x->x_topology, x->x_form);
+    bank->stamp = x->x_stamp;
+    snapshot_publish(&x->x_bank);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Perfomance Routines
+//____________________________________________________________________
+
+// the coefficients depend on the sample rate, the work buffer on the vector size
+void templatefilter_dsp64(t_templatefilter *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
+{
+    // the chain is being rebuilt, the perform routine isn't running
+    if (x->x_work)
+        sysmem_freeptr(x->x_work);
+    x->x_work = (double *) sysmem_newptrclear(VD_SIZE * maxvectorsize * sizeof(double));
+    if (!x->x_work) {
+        object_error((t_object *)x, "out of memory, not added to the DSP chain");
+        return;
+    }
+
+    if (samplerate != x->x_sr) {
+        x->x_sr = samplerate;
+        templatefilter_publish(x, 0);
+    }
+
+    object_method(dsp64, gensym("dsp_add64"), x, templatefilter_perform64, 0, NULL);
+}
+
+static void templatefilter_process64(t_templatefilter *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+    const t_filterbank *bank = (const t_filterbank *) snapshot_read(&x->x_bank, NULL);
+
+    if (bank->stamp != x->x_running) {
+        memset(x->x_state, 0, sizeof(x->x_state));
+        x->x_running = bank->stamp;
+    }
+
+    if (bank->topology == TOPOLOGY_PARALLEL)
+        templatefilter_parallel(bank, x->x_state, ins, outs, x->x_channels, x->x_work, sampleframes);
+    else
+        templatefilter_serial(bank, x->x_state, ins, outs, x->x_channels, x->x_work, sampleframes);
+}
+
+// the recursion flushes its states to 0 as they decay, NaN are scrubbed from the outputs (and the states, see below)
+DENORMAL_PERFORM(templatefilter_perform64, templatefilter_process64, t_templatefilter, 0, numouts)
+
+
+
+
+
+//____________________________________________________________________
+//                              Kernels
+//____________________________________________________________________
+/*
+
+ One sample through VD_SIZE sections at once, k are the 6 coefficients and s the 2 states of the lanes.
+ Written with the plain vd_ operations (mul, then add) in the order of the formulas above, the scalar
+ reference of the check does the same operations.
+
+ At the end of a vector the states go through vd_fixdenormnan : a lane fed a NaN or an infinity would
+ output NaN forever, it is zeroed instead and recovers at the next vector.
+
+ */
+
+static inline t_vd templatefilter_biquad(const t_vd *k, t_vd *s, t_vd x)
+{
+    t_vd y = vd_add(vd_mul(k[0], x), s[0]);
+
+    s[0] = vd_add(vd_sub(vd_mul(k[1], x), vd_mul(k[3], y)), s[1]);
+    s[1] = vd_sub(vd_mul(k[2], x), vd_mul(k[4], y));
+    return y;
+}
+
+static inline t_vd templatefilter_svf(const t_vd *k, t_vd *s, t_vd x)
+{
+    t_vd v3 = vd_sub(x, s[1]);
+    t_vd v1 = vd_add(vd_mul(k[0], s[0]), vd_mul(k[1], v3));
+    t_vd v2 = vd_add(vd_add(s[1], vd_mul(k[1], s[0])), vd_mul(k[2], v3));
+
+    s[0] = vd_sub(vd_add(v1, v1), s[0]);
+    s[1] = vd_sub(vd_add(v2, v2), s[1]);
+    return vd_add(vd_add(vd_mul(k[3], x), vd_mul(k[4], v1)), vd_mul(k[5], v2));
+}
+
+/*
+
+ Serial : the lanes are VD_SIZE channels. Their inputs are interleaved in work, each section runs over the whole
+ vector in place (the states stay in registers), then the outputs are deinterleaved. Running the chain a section
+ at a time gives the same samples as a sample at a time, the sections are causal.
+ The states are stored [section][state][channel], an odd channel count fills the last lane with zeros.
+
+ */
+void templatefilter_serial(const t_filterbank *bank, double *state, double **ins, double **outs, long channels, double *work, long sampleframes)
+{
+    t_vd    k[TEMPLATEFILTER_COEFS], s[2];
+    double  *st;
+    long    c, l, j, r, i;
+
+    for (c = 0; c < channels; c += VD_SIZE) {
+        for (i = 0; i < sampleframes; i++)
+            for (l = 0; l < VD_SIZE; l++)
+                work[i * VD_SIZE + l] = c + l < channels ? ins[c + l][i] : 0.;
+
+        for (j = 0; j < bank->nsections; j++) {
+            for (r = 0; r < TEMPLATEFILTER_COEFS; r++)
+                k[r] = vd_set1(bank->c[r][j]);
+            st = state + 2 * j * TEMPLATEFILTER_MAXCHANNELS + c;
+            s[0] = vd_load(st);
+            s[1] = vd_load(st + TEMPLATEFILTER_MAXCHANNELS);
+
+            if (bank->form == FORM_SVF)
+                for (i = 0; i < sampleframes; i++)
+                    vd_store(work + i * VD_SIZE, templatefilter_svf(k, s, vd_load(work + i * VD_SIZE)));
+            else
+                for (i = 0; i < sampleframes; i++)
+                    vd_store(work + i * VD_SIZE, templatefilter_biquad(k, s, vd_load(work + i * VD_SIZE)));
+
+            vd_store(st, vd_fixdenormnan(s[0]));
+            vd_store(st + TEMPLATEFILTER_MAXCHANNELS, vd_fixdenormnan(s[1]));
+        }
+
+        for (l = 0; l < VD_SIZE && c + l < channels; l++)
+            for (i = 0; i < sampleframes; i++)
+                outs[c + l][i] = work[i * VD_SIZE + l];
+    }
+}
+
+/*
+
+ Parallel : the lanes are VD_SIZE sections reading the same input sample. Each group of sections runs over the
+ whole vector and adds level * y to a sum per lane (work), the lanes are added at the end.
+ The states are stored [channel][state][section].
+
+ */
+void templatefilter_parallel(const t_filterbank *bank, double *state, double **ins, double **outs, long channels, double *work, long sampleframes)
+{
+    t_vd    k[TEMPLATEFILTER_COEFS], s[2], level;
+    double  *st;
+    const double *in;
+    long    c, j, r, i;
+
+    for (c = 0; c < channels; c++) {
+        in = ins[c];
+        memset(work, 0, VD_SIZE * sampleframes * sizeof(double));
+
+        for (j = 0; j < bank->nsections; j += VD_SIZE) {
+            for (r = 0; r < TEMPLATEFILTER_COEFS; r++)
+                k[r] = vd_load(bank->c[r] + j);
+            level = vd_load(bank->level + j);
+            st = state + 2 * c * TEMPLATEFILTER_MAXSECTIONS + j;
+            s[0] = vd_load(st);
+            s[1] = vd_load(st + TEMPLATEFILTER_MAXSECTIONS);
+
+            if (bank->form == FORM_SVF)
+                for (i = 0; i < sampleframes; i++)
+                    vd_store(work + i * VD_SIZE, vd_madd(level, templatefilter_svf(k, s, vd_set1(in[i])), vd_load(work + i * VD_SIZE)));
+            else
+                for (i = 0; i < sampleframes; i++)
+                    vd_store(work + i * VD_SIZE, vd_madd(level, templatefilter_biquad(k, s, vd_set1(in[i])), vd_load(work + i * VD_SIZE)));
+
+            vd_store(st, vd_fixdenormnan(s[0]));
+            vd_store(st + TEMPLATEFILTER_MAXSECTIONS, vd_fixdenormnan(s[1]));
+        }
+
+        for (i = 0; i < sampleframes; i++)
+            outs[c][i] = vd_hsum(vd_load(work + i * VD_SIZE));
+    }
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Accuracy Check
+//____________________________________________________________________
+/*
+
+ Runs the sections of the instance (or a test bank of every type when they are all off) in the 4 kernels,
+ serial and parallel, biquad and svf, against a scalar loop : one channel, one section, one sample at a time.
+ The signals of accuracy.h go through every channel, a vector of TEMPLATEFILTER_CHECKBLOCK samples at a
+ time with the state fix at the end of each, which the reference does too. The inputs of the reference are
+ flushed to zero like the kernel's under the perform wrapper.
+
+ Both sides do the same double operations, only the order of the parallel sum differs (a sum per lane, then
+ the lanes) : the error is a few ulps of the output. The error is relative above 1, absolute below.
+
+ */
+#define TEMPLATEFILTER_CHECKSIZE    4095
+#define TEMPLATEFILTER_CHECKBLOCK   64
+#define TEMPLATEFILTER_CHECKREL     1e-12
+#define TEMPLATEFILTER_CHECKDB      -240.
+
+// one channel of the bank over one vector, state is [section][2]
+static void templatefilter_reference(const t_filterbank *bank, double *state, const double *in, double *out, long n)
+{
+    const double (*c)[TEMPLATEFILTER_MAXSECTIONS] = bank->c;
+    double  x, y, v1, v2, v3, sum, *s;
+    long    i, j;
+
+    for (i = 0; i < n; i++) {
+        x = accuracy_daz(in[i], 0);
+        sum = 0.;
+        for (j = 0; j < bank->nsections; j++) {
+            s = state + 2 * j;
+            if (bank->form == FORM_SVF) {
+                v3 = x - s[1];
+                v1 = c[0][j] * s[0] + c[1][j] * v3;
+                v2 = s[1] + c[1][j] * s[0] + c[2][j] * v3;
+                s[0] = (v1 + v1) - s[0];
+                s[1] = (v2 + v2) - s[1];
+                y = c[3][j] * x + c[4][j] * v1 + c[5][j] * v2;
+            }
+            else {
+                y = c[0][j] * x + s[0];
+                s[0] = c[1][j] * x - c[3][j] * y + s[1];
+                s[1] = c[2][j] * x - c[4][j] * y;
+            }
+            if (bank->topology == TOPOLOGY_PARALLEL)
+                sum += bank->level[j] * y;
+            else
+                x = y;
+        }
+        out[i] = bank->topology == TOPOLOGY_PARALLEL ? sum : x;
+    }
+
+    for (j = 0; j < 2 * bank->nsections; j++)
+        FIX_DENORM_NAN_DOUBLE(state[j]);
+}
+
+void templatefilter_check(t_templatefilter *x)
+{
+    static const char   *names[4] = { "serial biquad", "serial svf", "parallel biquad", "parallel svf" };
+    t_templatefilter    *y = (t_templatefilter *) sysmem_newptrclear(sizeof(t_templatefilter));
+    t_filterbank        *bank = (t_filterbank *) sysmem_newptr(sizeof(t_filterbank));
+    t_accuracy          acc;
+    t_denormal_state    dstate;
+    double              *ins[TEMPLATEFILTER_MAXCHANNELS], *outs[TEMPLATEFILTER_MAXCHANNELS], *ins_b[TEMPLATEFILTER_MAXCHANNELS], *outs_b[TEMPLATEFILTER_MAXCHANNELS];
+    double              *buf, *ref, *work, *rstate;
+    uint32_t            seed;
+    long                nch = x->x_channels, kernel, kind, ch, i, n, failed, fails = 0;
+
+    // the inputs and outputs of the channels, the reference, the work buffer and the reference states
+    buf = (double *) sysmem_newptr((TEMPLATEFILTER_CHECKSIZE * (2 * nch + 1) + VD_SIZE * TEMPLATEFILTER_CHECKBLOCK
+                                    + 2 * TEMPLATEFILTER_MAXSECTIONS) * sizeof(double));
+    if (!y || !bank || !buf) {
+        object_error((t_object *)x, "check: out of memory");
+        if (y)
+            sysmem_freeptr(y);
+        if (bank)
+            sysmem_freeptr(bank);
+        if (buf)
+            sysmem_freeptr(buf);
+        return;
+    }
+    for (ch = 0; ch < nch; ch++) {
+        ins[ch]  = buf + ch * TEMPLATEFILTER_CHECKSIZE;
+        outs[ch] = buf + (nch + ch) * TEMPLATEFILTER_CHECKSIZE;
+    }
+    ref = buf + 2 * nch * TEMPLATEFILTER_CHECKSIZE;
+    work = ref + TEMPLATEFILTER_CHECKSIZE;
+    rstate = work + VD_SIZE * TEMPLATEFILTER_CHECKBLOCK;
+
+    // the sections of this instance, or one of each type on a blank one
+    memcpy(y->x_sections, x->x_sections, sizeof(x->x_sections));
+    y->x_sr = x->x_sr;
+    for (i = 0; i < TEMPLATEFILTER_MAXSECTIONS && y->x_sections[i].type == FILTER_OFF; i++)
+        ;
+    if (i == TEMPLATEFILTER_MAXSECTIONS) {
+        for (i = 0; i < FILTER_RAW; i++) {
+            y->x_sections[i].type  = i;
+            y->x_sections[i].freq  = 100. * (i + 1) * (i + 1);
+            y->x_sections[i].q     = 0.5 + i;
+            y->x_sections[i].gain  = 6. - 2. * i;
+            y->x_sections[i].level = 1. / (i + 1);
+        }
+    }
+
+    for (kernel = 0; kernel < 4; kernel++) {
+        templatefilter_fill(y, bank, kernel / 2 ? TOPOLOGY_PARALLEL : TOPOLOGY_SERIAL, kernel % 2 ? FORM_SVF : FORM_BIQUAD);
+        accuracy_reset(&acc, 1., 0);
+        seed = 0x9E3779B9;      // the same signals for every kernel
+
+        for (kind = 0; kind < ACCURACY_KINDS; kind++) {
+            for (ch = 0; ch < nch; ch++)
+                accuracy_signal(ins[ch], TEMPLATEFILTER_CHECKSIZE, kind, 1., &seed);
+
+            // under flush-to-zero as in the perform routine
+            memset(y->x_state, 0, sizeof(y->x_state));
+            dstate = denormal_enter();
+            for (i = 0; i < TEMPLATEFILTER_CHECKSIZE; i += n) {
+                n = TEMPLATEFILTER_CHECKSIZE - i < TEMPLATEFILTER_CHECKBLOCK ? TEMPLATEFILTER_CHECKSIZE - i : TEMPLATEFILTER_CHECKBLOCK;
+                for (ch = 0; ch < nch; ch++) {
+                    ins_b[ch]  = ins[ch] + i;
+                    outs_b[ch] = outs[ch] + i;
+                }
+                if (bank->topology == TOPOLOGY_PARALLEL)
+                    templatefilter_parallel(bank, y->x_state, ins_b, outs_b, nch, work, n);
+                else
+                    templatefilter_serial(bank, y->x_state, ins_b, outs_b, nch, work, n);
+            }
+            denormal_leave(dstate);
+
+            for (ch = 0; ch < nch; ch++) {
+                memset(rstate, 0, 2 * TEMPLATEFILTER_MAXSECTIONS * sizeof(double));
+                for (i = 0; i < TEMPLATEFILTER_CHECKSIZE; i += TEMPLATEFILTER_CHECKBLOCK)
+                    templatefilter_reference(bank, rstate, ins[ch] + i, ref + i,
+                                             TEMPLATEFILTER_CHECKSIZE - i < TEMPLATEFILTER_CHECKBLOCK ? TEMPLATEFILTER_CHECKSIZE - i : TEMPLATEFILTER_CHECKBLOCK);
+                accuracy_add(&acc, ref, outs[ch], TEMPLATEFILTER_CHECKSIZE);
+            }
+        }
+
+        failed = accuracy_fails(&acc, TEMPLATEFILTER_CHECKREL, TEMPLATEFILTER_CHECKDB);
+        fails += failed;
+        object_post((t_object *)x, "check %-16s %ld sections %8g ulp, error %-12g %7.1f dB%s%s", names[kernel], bank->nsections,
+                    acc.maxulp, acc.maxrel, acc.db, acc.special ? ", NaN/inf mismatch" : "", failed ? " (above bound)" : "");
+    }
+
+    if (fails)
+        object_error((t_object *)x, "check: %ld kernel(s) above bounds", fails);
+    else
+        object_post((t_object *)x, "check : 4 kernels within bounds");
+
+    sysmem_freeptr(y);
+    sysmem_freeptr(bank);
+    sysmem_freeptr(buf);
+}
@@ -0,0 +1,558 @@
+/**
+ *
+ *  @file	templatemeter~.c
+ *
+ *
+ *  Sources :
+ *
+ *  Documentation :
+ *      Cylcing 74'
+ *          - Max 7.1 API :
+ *              https://cycling74.com/sdk/MaxSDK-6.0.4/html/index.html
+ *
+ *          - Max/MSP 7.1 SDK examples :
+ *              https://cycling74.com/downloads/sdk/#.Vzn0OpPbugw
+ *
+ *      ITU-R
+ *          - BS.1770-4, Algorithms to measure audio programme loudness and true-peak audio level :
+ *              https://www.itu.int/rec/R-REC-BS.1770
+ *
+ *      EBU
+ *          - Tech 3341, Loudness Metering : 'EBU Mode' metering to supplement EBU R 128 :
+ *              https://tech.ebu.ch/publications/tech3341
+ *
+ *  Code :
+ *
+ *      template~ (this repository)
+ *          - same structure, inlets/outlets and perform routine conventions
+ *
+ *      libebur128 (Jan Kokemüller)
+ *          - K-weighting filters at any sample rate, from the analog prototype of the 48 kHz coefficients
+ *              https://github.com/jiixyj/libebur128
+ *
+ *
+ *
+ *  This object meters 1 to 64 channels : [templatemeter~ 8] has 8 signal inlets and one list outlet.
+ *  Every interval ms (interval attribute, 50 by default) it outputs one list :
+ *      peak 1 ... peak N   highest |sample| of each channel over the interval
+ *      rms 1 ... rms N     RMS of each channel over the interval
+ *      momentary           loudness over the last 400 ms, LUFS
+ *      short-term          loudness over the last 3 s, LUFS
+ *      integrated          gated loudness since the DSP started or the last reset, LUFS
+ *  Peaks and RMS are in dBFS, or linear with @db 0. Levels below -120 dB (silence) are output as -120.
+ *
+ *  The loudness is K-weighted and summed over the channels with the weights of the weights message (1 by default,
+ *  BS.1770 gives 1.41 to the surround channels and 0 to the LFE). The integrated loudness uses the gates of BS.1770,
+ *  -70 LUFS and 10 LU below the ungated loudness. reset restarts it.
+ *
+ *  One instance replaces a peakamp~ per channel and its scheduler traffic : the perform routine goes once over the
+ *  samples for all the meters, with VD_SIZE channels in the lanes of a t_vd. It publishes the values through a
+ *  lock-free snapshot once per interval and sets a clock, the list goes out from the scheduler.
+ *
+ */
+
+//____________________________________________________________________
+//                         External Libraries
+//____________________________________________________________________
+/*
+
+ Headears and Platform specific elements
+
+ */
+#ifdef MAC_VERSION
+    // do something specific to the Mac
+#endif
+#ifdef WIN_VERSION
+    // do something specific to Windows
+#endif
+
+#include "ext.h"            // should always be first, then ext_obex.h + other files.
+#include "ext_obex.h"		// required for "new" style objects
+#include "z_dsp.h"			// required for MSP objects
+
+#include <math.h>
+#ifndef M_PI
+#define M_PI 3.14159265358979323846     // not defined by every compiler (Visual Studio)
+#endif
+
+#include "../../common/simd.h"
+#include "../../common/lockfree.h"
+#include "../../common/denormal.h"
+
+#define TEMPLATEMETER_MAXCHANNELS   64      ///<    Signal inlets, a multiple of VD_SIZE
+#define TEMPLATEMETER_FLOOR         -120.   ///<    Lowest level output, dB or LUFS
+#define TEMPLATEMETER_STEP          0.1     ///<    Loudness blocks, seconds : the momentary and short-term windows move by 100 ms
+#define TEMPLATEMETER_MOMENTARY     4       ///<    Blocks of the momentary loudness, 400 ms
+#define TEMPLATEMETER_SHORTTERM     30      ///<    Blocks of the short-term loudness, 3 s
+#define TEMPLATEMETER_BINS          1000    ///<    Histogram of the momentary loudness for the integrated loudness, 0.1 LU bins
+#define TEMPLATEMETER_HISTMIN       -70.    ///<    Lowest bin, the absolute gate of BS.1770
+#define TEMPLATEMETER_OFFSET        -0.691  ///<    Loudness of a mean square of 1 after the K-weighting
+
+typedef struct _templatemeter_hist      ///<    One bin of the histogram
+{
+    double      z;          ///<    Sum of the mean squares of the momentary blocks in the bin
+    long        n;          ///<    Blocks in the bin
+
+} t_templatemeter_hist;
+
+
+
+
+
+//____________________________________________________________________
+//                        'Class' Definition
+//____________________________________________________________________
+/*
+
+ 'Class' decleration and a struct for the object is declared and typedef'd.
+
+ */
+
+typedef struct _templatemeter	///<	A struct to hold data for our object
+{
+    t_pxobject  x_obj;          ///<	The object itself (t_pxobject in MSP instead of t_object)
+    void        *x_out;         ///<    List outlet
+    long        x_channels;     ///<    Signal inlets (argument)
+
+    // settings
+    double      x_interval;     ///<    Output interval in ms (interval attribute)
+    long        x_db;           ///<    Peaks and RMS in dBFS, else linear (db attribute)
+    double      x_weight[TEMPLATEMETER_MAXCHANNELS];    ///<    Loudness weight of each channel (weights message)
+
+    // audio thread, reset in dsp64
+    double      x_sr;
+    double      x_k[2][5];      ///<    K-weighting, high shelf then high pass, b0 b1 b2 a1 a2
+    double      x_kstate[4][TEMPLATEMETER_MAXCHANNELS]; ///<    Two states of each stage, per channel
+    double      x_peak[TEMPLATEMETER_MAXCHANNELS];      ///<    Over the interval
+    double      x_sq[TEMPLATEMETER_MAXCHANNELS];        ///<    Sum of squares over the interval
+    double      x_ksq[TEMPLATEMETER_MAXCHANNELS];       ///<    Sum of K-weighted squares over the block
+    long        x_elapsed;      ///<    Samples of the interval so far
+    long        x_bcount;       ///<    Samples of the block so far
+    long        x_step;         ///<    Samples of a block
+    double      x_ringz[TEMPLATEMETER_SHORTTERM];       ///<    Weighted sums of squares of the last blocks
+    long        x_ringn[TEMPLATEMETER_SHORTTERM];       ///<    and their samples
+    long        x_ringpos;      ///<    Next block of the ring
+    long        x_blocks;       ///<    Blocks since the start, the ring isn't full before TEMPLATEMETER_SHORTTERM
+    t_templatemeter_hist x_hist[TEMPLATEMETER_BINS];    ///<    Momentary blocks above the absolute gate
+    t_int32_atomic x_reset;     ///<    Set by reset, the audio thread clears the histogram
+
+    // audio thread -> main thread
+    t_snapshot  x_values;       ///<    The list in linear units (peaks, RMS) and LUFS, 2 N + 3 doubles
+    void        *x_clock;       ///<    Set by the audio thread, outputs the list from the scheduler
+
+} t_templatemeter;
+
+// global pointer to our class definition that is setup in main()
+static t_class *templatemeter_class = NULL;
+
+
+
+
+
+//____________________________________________________________________
+//                        Function Prototypes
+//____________________________________________________________________
+
+//// standard set
+void *templatemeter_new( t_symbol *s, long argc, t_atom *argv);
+void templatemeter_free( t_templatemeter *x);
+void templatemeter_assist(t_templatemeter *x, void *b, long m, long a, char *s);
+
+//// value specific
+void templatemeter_weights(t_templatemeter *x, t_symbol *s, long argc, t_atom *argv);
+void templatemeter_reset(  t_templatemeter *x);
+void templatemeter_tick(   t_templatemeter *x);
+
+//// performance set
+void templatemeter_dsp64(t_templatemeter *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
+void templatemeter_perform64(t_templatemeter *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+
+//// loudness
+void templatemeter_kdesign(t_templatemeter *x, double sr);
+void templatemeter_block(t_templatemeter *x);
+double templatemeter_integrated(t_templatemeter *x);
+void templatemeter_publish(t_templatemeter *x);
+
+
+
+
+
+//____________________________________________________________________
+//                          Initialisation Routine
+//____________________________________________________________________
+
+/*
+
+The initialization routine, which must be called main, is called when Max loads your object for the first time. In the initialization routine, you define one or more classes. Defining a class consists of the following:
+
+        1) telling Max about the size of your object's structure and how to create and destroy an instance
+        2) defining methods that implement the object's behavior
+        3) in some cases, defining attributes that describe the object's data
+        4) registering the class in a name space
+
+*/
+
+void ext_main(void *r)
+{
+    // we free the snapshot and the clock, so templatemeter_free calls dsp_free itself
+    t_class *c = class_new("templatemeter~", (method)templatemeter_new, (method)templatemeter_free, (long)sizeof(t_templatemeter), 0L, A_GIMME, 0);
+
+    class_addmethod(c, (method)templatemeter_weights,   "weights",  A_GIMME, 0);
+    class_addmethod(c, (method)templatemeter_reset,     "reset",            0);
+    class_addmethod(c, (method)templatemeter_dsp64,		"dsp64",	A_CANT, 0);
+    class_addmethod(c, (method)templatemeter_assist,    "assist",	A_CANT, 0);
+
+    // read by the audio thread at the end of each vector
+    CLASS_ATTR_DOUBLE(c, "interval", 0, t_templatemeter, x_interval);
+    CLASS_ATTR_FILTER_MIN(c, "interval", 5);
+    CLASS_ATTR_LABEL(c, "interval", 0, "Output Interval (ms)");
+    CLASS_ATTR_LONG(c, "db", 0, t_templatemeter, x_db);
+    CLASS_ATTR_STYLE_LABEL(c, "db", 0, "onoff", "Peak and RMS in dBFS");
+
+    //  Adds a set of methods to your object's class that are called by MSP to build the DSP call chain.
+    class_dspinit(c);
+
+    //  adds this class to the CLASS_BOX name space, meaning that it will be searched when a user tries to type it into a box.
+    class_register(CLASS_BOX, c);
+
+    //assign the class we've created to a global variable so we can use it when creating new instances.
+    templatemeter_class = c;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Instance Routines
+//____________________________________________________________________
+
+
+void *templatemeter_new(t_symbol *s, long argc, t_atom *argv)
+{
+    //Setup the custom struct for our object
+    t_templatemeter *x = (t_templatemeter *) object_alloc((t_class *) templatemeter_class);
+    t_atom_long channels = 1;
+    long        i;
+
+    // the channels are the first argument, before the attributes
+    atom_arg_getlong(&channels, 0, argc, argv);
+    x->x_channels = channels < 1 ? 1 : channels > TEMPLATEMETER_MAXCHANNELS ? TEMPLATEMETER_MAXCHANNELS : (long)channels;
+
+    //Setup one signal inlet per channel and the list outlet
+    dsp_setup((t_pxobject *)x, x->x_channels);
+    x->x_out = listout((t_object *)x);
+
+    x->x_interval = 50.;
+    x->x_db = 1;
+    for (i = 0; i < TEMPLATEMETER_MAXCHANNELS; i++)
+        x->x_weight[i] = 1.;
+    x->x_clock = clock_new(x, (method)templatemeter_tick);
+
+    attr_args_process(x, (short)argc, argv);
+
+    if (snapshot_new(&x->x_values, (2 * x->x_channels + 3) * sizeof(double))) {
+        object_error((t_object *)x, "out of memory");
+        object_free(x);     // calls templatemeter_free
+        return NULL;
+    }
+
+    return (x);
+}
+
+void templatemeter_free(t_templatemeter *x)
+{
+    dsp_free((t_pxobject *)x);
+    if (x->x_clock)
+        object_free(x->x_clock);
+    snapshot_free(&x->x_values);
+}
+
+//Documentation shown when hovering over an inlet/outlet
+void templatemeter_assist(t_templatemeter *x, void *b, long m, long a, char *s)
+{
+    if (m == ASSIST_INLET)
+        sprintf(s, a ? "(Signal) Channel %ld" : "(Signal) Channel %ld, weights, reset", a + 1);
+    else if (m == ASSIST_OUTLET)
+        sprintf(s, "(List) Peaks, RMS, momentary, short-term and integrated loudness");
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Message Handlers
+//____________________________________________________________________
+
+// weights <w1> <w2> ..., the loudness weight of each channel from the first one, e.g. 1 1 1 0 1.41 1.41 in 5.1
+void templatemeter_weights(t_templatemeter *x, t_symbol *s, long argc, t_atom *argv)
+{
+    long i;
+
+    for (i = 0; i < argc && i < x->x_channels; i++)
+        x->x_weight[i] = atom_getfloat(argv + i);
+}
+
+// restarts the integrated loudness
+void templatemeter_reset(t_templatemeter *x)
+{
+    lockfree_store(&x->x_reset, 1);
+}
+
+// scheduler, outputs the newest values
+void templatemeter_tick(t_templatemeter *x)
+{
+    t_atom  av[2 * TEMPLATEMETER_MAXCHANNELS + 3];
+    double  v;
+    long    fresh, i, n = 2 * x->x_channels;
+    double  *values = (double *) snapshot_read(&x->x_values, &fresh);
+
+    if (!fresh)
+        return;
+
+    for (i = 0; i < n; i++) {
+        v = values[i];
+        if (x->x_db)
+            v = v > 0. && 20. * log10(v) > TEMPLATEMETER_FLOOR ? 20. * log10(v) : TEMPLATEMETER_FLOOR;
+        atom_setfloat(av + i, v);
+    }
+    for (; i < n + 3; i++)
+        atom_setfloat(av + i, values[i] < TEMPLATEMETER_FLOOR ? TEMPLATEMETER_FLOOR : values[i]);
+
+    outlet_list(x->x_out, NULL, (short)(n + 3), av);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Perfomance Routines
+//____________________________________________________________________
+
+// the meters start over with the chain, the K-weighting depends on the sample rate
+void templatemeter_dsp64(t_templatemeter *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
+{
+    // the perform routine isn't running
+    memset(x->x_kstate, 0, sizeof(x->x_kstate));
+    memset(x->x_peak, 0, sizeof(x->x_peak));
+    memset(x->x_sq, 0, sizeof(x->x_sq));
+    memset(x->x_ksq, 0, sizeof(x->x_ksq));
+    memset(x->x_hist, 0, sizeof(x->x_hist));
+    x->x_elapsed = x->x_bcount = x->x_ringpos = x->x_blocks = 0;
+    lockfree_store(&x->x_reset, 0);
+
+    x->x_sr = samplerate;
+    x->x_step = (long)(TEMPLATEMETER_STEP * samplerate + 0.5);
+    templatemeter_kdesign(x, samplerate);
+
+    object_method(dsp64, gensym("dsp_add64"), x, templatemeter_perform64, 0, NULL);
+}
+
+/*
+
+ One pass over the vector, VD_SIZE channels at a time in the lanes : the peak (max of |x|), the sum of squares
+ and the K-weighting (two biquads in transposed direct form II) with the sum of its squares. The sums are
+ made over the vector in registers, then added to the interval and the block : a vector with a NaN or an
+ infinity adds nothing (vd_fixdenormnan), and the filter states are fixed the same way. vd_max returns its
+ second operand when the first one is NaN, a NaN sample leaves the peak alone.
+
+ With an odd channel count the last lane reads the last channel again, its results land past x_channels.
+
+ */
+static void templatemeter_process64(t_templatemeter *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+    t_vd        k[2][5], s[4], in, y, peak, sq, ksq;
+    double      lane[VD_SIZE];
+    const double *p[VD_SIZE];
+    long        c, l, i, r;
+
+    if (lockfree_exchange(&x->x_reset, 0))
+        memset(x->x_hist, 0, sizeof(x->x_hist));
+
+    for (r = 0; r < 5; r++) {
+        k[0][r] = vd_set1(x->x_k[0][r]);
+        k[1][r] = vd_set1(x->x_k[1][r]);
+    }
+
+    for (c = 0; c < x->x_channels; c += VD_SIZE) {
+        for (l = 0; l < VD_SIZE; l++)
+            p[l] = ins[c + l < x->x_channels ? c + l : x->x_channels - 1];
+        for (r = 0; r < 4; r++)
+            s[r] = vd_load(x->x_kstate[r] + c);
+        peak = vd_load(x->x_peak + c);
+        sq = ksq = vd_set1(0.);
+
+        for (i = 0; i < sampleframes; i++) {
+            for (l = 0; l < VD_SIZE; l++)
+                lane[l] = p[l][i];
+            in = vd_load(lane);
+            peak = vd_max(vd_abs(in), peak);
+            sq = vd_madd(in, in, sq);
+
+            y = vd_add(vd_mul(k[0][0], in), s[0]);
+            s[0] = vd_add(vd_sub(vd_mul(k[0][1], in), vd_mul(k[0][3], y)), s[1]);
+            s[1] = vd_sub(vd_mul(k[0][2], in), vd_mul(k[0][4], y));
+            in = y;
+            y = vd_add(vd_mul(k[1][0], in), s[2]);
+            s[2] = vd_add(vd_sub(vd_mul(k[1][1], in), vd_mul(k[1][3], y)), s[3]);
+            s[3] = vd_sub(vd_mul(k[1][2], in), vd_mul(k[1][4], y));
+            ksq = vd_madd(y, y, ksq);
+        }
+
+        for (r = 0; r < 4; r++)
+            vd_store(x->x_kstate[r] + c, vd_fixdenormnan(s[r]));
+        vd_store(x->x_peak + c, peak);
+        vd_store(x->x_sq + c, vd_add(vd_load(x->x_sq + c), vd_fixdenormnan(sq)));
+        vd_store(x->x_ksq + c, vd_add(vd_load(x->x_ksq + c), vd_fixdenormnan(ksq)));
+    }
+
+    x->x_bcount += sampleframes;
+    if (x->x_bcount >= x->x_step)
+        templatemeter_block(x);
+
+    x->x_elapsed += sampleframes;
+    if (x->x_elapsed >= x->x_interval * 0.001 * x->x_sr)
+        templatemeter_publish(x);
+}
+
+// no signal outlet, the wrapper only flushes the decaying filter states to zero
+DENORMAL_PERFORM(templatemeter_perform64, templatemeter_process64, t_templatemeter, 0, 0)
+
+
+
+
+
+//____________________________________________________________________
+//                              Loudness
+//____________________________________________________________________
+/*
+
+ BS.1770 gives the K-weighting coefficients at 48 kHz. As in libebur128 they are computed at any sample rate
+ from the analog filters they come from : a high shelf of +4 dB above 1.7 kHz (the head), then a high pass
+ at 38 Hz (the RLB curve). Both through the bilinear transform, prewarped at their frequency.
+
+ The weighted sums of squares of the channels are gathered in blocks of 100 ms (to the vector) in a ring
+ of 3 s. The momentary and short-term loudness are the mean square of the last 4 and 30 blocks. Every
+ momentary loudness above -70 LUFS goes in a histogram of 0.1 LU bins, which keeps the sum of the mean
+ squares of each bin : the integrated loudness only needs it to apply the relative gate.
+
+ */
+
+void templatemeter_kdesign(t_templatemeter *x, double sr)
+{
+    double  f0 = 1681.974450955533, g = 3.999843853973347, q = 0.7071752369554196;
+    double  k = tan(M_PI * f0 / sr);
+    double  vh = pow(10., g / 20.);
+    double  vb = pow(vh, 0.4996667741545416);
+    double  a0 = 1. + k / q + k * k;
+
+    x->x_k[0][0] = (vh + vb * k / q + k * k) / a0;
+    x->x_k[0][1] = 2. * (k * k - vh) / a0;
+    x->x_k[0][2] = (vh - vb * k / q + k * k) / a0;
+    x->x_k[0][3] = 2. * (k * k - 1.) / a0;
+    x->x_k[0][4] = (1. - k / q + k * k) / a0;
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / sr);
+    a0 = 1. + k / q + k * k;
+
+    x->x_k[1][0] = 1.;
+    x->x_k[1][1] = -2.;
+    x->x_k[1][2] = 1.;
+    x->x_k[1][3] = 2. * (k * k - 1.) / a0;
+    x->x_k[1][4] = (1. - k / q + k * k) / a0;
+}
+
+// audio thread : closes a block, and a momentary window for the histogram once 4 blocks are in
+void templatemeter_block(t_templatemeter *x)
+{
+    double  z = 0., l;
+    long    n = 0, i, j, bin;
+
+    for (i = 0; i < x->x_channels; i++) {
+        z += x->x_weight[i] * x->x_ksq[i];
+        x->x_ksq[i] = 0.;
+    }
+    x->x_ringz[x->x_ringpos] = z;
+    x->x_ringn[x->x_ringpos] = x->x_bcount;
+    x->x_ringpos = (x->x_ringpos + 1) % TEMPLATEMETER_SHORTTERM;
+    x->x_blocks++;
+    x->x_bcount = 0;
+
+    if (x->x_blocks < TEMPLATEMETER_MOMENTARY)
+        return;
+
+    for (i = 0, z = 0.; i < TEMPLATEMETER_MOMENTARY; i++) {
+        j = (x->x_ringpos - 1 - i + TEMPLATEMETER_SHORTTERM) % TEMPLATEMETER_SHORTTERM;
+        z += x->x_ringz[j];
+        n += x->x_ringn[j];
+    }
+    z /= n;
+    l = z > 0. ? TEMPLATEMETER_OFFSET + 10. * log10(z) : -HUGE_VAL;
+    if (l < TEMPLATEMETER_HISTMIN)
+        return;
+
+    bin = (long)((l - TEMPLATEMETER_HISTMIN) * 10.);
+    bin = bin < TEMPLATEMETER_BINS ? bin : TEMPLATEMETER_BINS - 1;
+    x->x_hist[bin].z += z;
+    x->x_hist[bin].n++;
+}
+
+// gated loudness of the histogram : the blocks 10 LU or less below the loudness of all of them
+double templatemeter_integrated(t_templatemeter *x)
+{
+    double  z = 0., gate;
+    long    n = 0, b, first;
+
+    for (b = 0; b < TEMPLATEMETER_BINS; b++) {
+        z += x->x_hist[b].z;
+        n += x->x_hist[b].n;
+    }
+    if (!n)
+        return -HUGE_VAL;
+
+    // the bins ending above the gate
+    gate = TEMPLATEMETER_OFFSET + 10. * log10(z / n) - 10.;
+    first = (long)floor((gate - TEMPLATEMETER_HISTMIN) * 10.);
+    first = first < 0 ? 0 : first;
+
+    for (b = first, z = 0., n = 0; b < TEMPLATEMETER_BINS; b++) {
+        z += x->x_hist[b].z;
+        n += x->x_hist[b].n;
+    }
+    return n ? TEMPLATEMETER_OFFSET + 10. * log10(z / n) : -HUGE_VAL;
+}
+
+// audio thread : the values of the interval to the snapshot, then the clock outputs them
+void templatemeter_publish(t_templatemeter *x)
+{
+    double  *v = (double *) snapshot_back(&x->x_values);
+    double  z[2] = { 0., 0. };
+    long    n[2] = { 0, 0 };
+    long    nch = x->x_channels, i, j, w;
+
+    for (i = 0; i < nch; i++) {
+        v[i] = x->x_peak[i];
+        v[nch + i] = sqrt(x->x_sq[i] / x->x_elapsed);
+    }
+    memset(x->x_peak, 0, sizeof(x->x_peak));
+    memset(x->x_sq, 0, sizeof(x->x_sq));
+
+    // the blocks in the ring, newest first, until the ring starts over
+    for (w = 0; w < 2; w++) {
+        for (i = 0; i < (w ? TEMPLATEMETER_SHORTTERM : TEMPLATEMETER_MOMENTARY) && i < x->x_blocks; i++) {
+            j = (x->x_ringpos - 1 - i + TEMPLATEMETER_SHORTTERM) % TEMPLATEMETER_SHORTTERM;
+            z[w] += x->x_ringz[j];
+            n[w] += x->x_ringn[j];
+        }
+        v[2 * nch + w] = n[w] && z[w] > 0. ? TEMPLATEMETER_OFFSET + 10. * log10(z[w] / n[w]) : -HUGE_VAL;
+    }
+    v[2 * nch + 2] = templatemeter_integrated(x);
+
+    snapshot_publish(&x->x_values);
+    clock_delay(x->x_clock, 0);
+    x->x_elapsed = 0;
+}
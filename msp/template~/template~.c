@@ -41,6 +41,30 @@
  *  The left outlet multiplies the inlets.
  *  The right outlet adds the inlets.
  *
+ *  The operation of each outlet can be changed with the op1/op2 attributes (see Operators below),
+ *  e.g. [template~ @op1 min @op2 max]. When the right inlet has no signal connected, the last float
+ *  received in it is used instead (signal/scalar variant).
+ *
+ *  With @oversample 2, 4 or 8 the inputs are upsampled, the operators run at the higher rate and
+ *  the outputs are downsampled back (see Oversampling below). Nonlinear operators (L*R, pow, clip)
+ *  create harmonics above Nyquist, which alias back into the audio band without it.
+ *  The latency of the filters is given by the read-only latency attribute, in samples.
+ *
+ *  With @float32 1 the operators and the oversampling filters work on floats, the signals are
+ *  converted once on the way in and once on the way out. Half the memory traffic for ~7 digits
+ *  instead of ~16. The check message runs every operator, double, scalar and float32, against a plain
+ *  loop of its expression on noise, DC, denormals and NaN, and reports the error of each one.
+ *
+ *  With @bridge 1 and no signal in the right inlet, the floats it receives are stamped with the scheduler
+ *  time and queued for the audio thread, which applies each one on its own sample instead of at the start
+ *  of the next vector (see Control Bridge below). A steady 1-2 kHz stream keeps its timing, for a
+ *  constant delay of bridgedelay ms.
+ *
+ *  With @voices N (1 to 64) one instance is a bank of N voices, instead of N copies in a poly~. Each voice
+ *  holds its own right operand and k : note <id> <R> [k] starts a voice (stealing one if they are all taken),
+ *  off <id> releases it, alloff releases them all. Each outlet outputs the sum of L op R over the voices,
+ *  each one faded in and out over ramp ms (see Voice Bank below). The right inlet signal isn't used.
+ *
  */
 
 //____________________________________________________________________
@@ -64,6 +88,39 @@
 #include "ext_obex.h"		// required for "new" style objects
 #include "z_dsp.h"			// required for MSP objects
 
+#include <math.h>
+
+#include "../../common/simd.h"
+#include "../../common/denormal.h"
+#include "../../common/arena.h"     // arena_carve
+#include "../../common/lockfree.h"  // control bridge ring
+#include "../../common/accuracy.h"  // check
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define TEMPLATE_OSSTAGES   3       ///<    Max 2x stages, 8x oversampling
+#define TEMPLATE_RINGSIZE   1024    ///<    Floats queued by the control bridge, ~0.5 s of a 2 kHz stream
+#define TEMPLATE_HBMAXQ     12      ///<    Max half-band order, the filter of a stage has 4q-1 taps
+#define TEMPLATE_MAXVOICES  64      ///<    Voices of a bank, one bit each in the active mask
+#define TEMPLATE_VRINGSIZE  256     ///<    Voice commands queued between two vectors
+#define TEMPLATE_VSILENCE   1e-5    ///<    Gain below which a released voice stops
+
+typedef struct _template_hb     ///<    State of one 2x half-band stage
+{
+    const double    *g;     ///<    Non zero side taps (2q, symmetric), shared by all instances
+    long            q;
+    double          *e;     ///<    Up : history then input, down : history then even samples
+    double          *o;     ///<    Down : history then odd samples
+    
+    // float32 mode, e32/o32 are the same buffers as e/o, only one precision is in use at a time
+    const float     *g32;
+    float           *e32;
+    float           *o32;
+
+} t_template_hb;
+
 
 
 
@@ -81,11 +138,73 @@
 typedef struct _template	///<	A struct to hold data for our object
 {
     t_pxobject x_obj;       ///<	The object itself (t_pxobject in MSP instead of t_object)
-    t_float x_val;          ///<	Value to use for the processing
+    t_float x_val;          ///<	Value to use for the processing, right operand when no signal is connected
     void *x_output;         ///<    Output definition
+    long x_op[2];           ///<    Operator of each outlet (op1/op2 attributes)
+    double x_k;             ///<    Third operand of the fused operators (k attribute)
+    
+    long x_oversample;                  ///<    Oversampling factor, 1, 2, 4 or 8 (oversample attribute)
+    double x_latency;                   ///<    Latency of the oversampling filters in samples (latency attribute, read-only)
+    long x_osstages;                    ///<    2x stages in use
+    long x_ossig;                       ///<    Right inlet has a signal, it needs upsampling too
+    t_template_hb x_hbup[2][TEMPLATE_OSSTAGES];     ///<    Upsampling stages of each inlet
+    t_template_hb x_hbdown[2][TEMPLATE_OSSTAGES];   ///<    Downsampling stages of each outlet
+    double *x_osin[2];                  ///<    Upsampled inlets
+    double *x_osout[2];                 ///<    Outlets at the higher rate
+    float *x_osin32[2];                 ///<    Same as x_osin/x_osout in float32 mode
+    float *x_osout32[2];
+    long x_float32;                     ///<    Process in float (float32 attribute)
+    void *x_osperform[2];               ///<    Operator of each outlet called by the oversampling/float32/bridge routines, NULL if not connected
+    char *x_osblock;                    ///<    Holds all the buffers above, allocated in dsp64
+    
+    long x_bridge;                      ///<    Queues the right inlet floats for sample accurate timing (bridge attribute)
+    double x_bridgedelay;               ///<    Delay between the scheduler and the audio in ms (bridgedelay attribute)
+    long x_bridging;                    ///<    Bridge in use : bridge on and no signal in the right inlet
+    t_int32_atomic x_bridgeon;          ///<    A routine draining x_ring is in the running DSP chain, template_float only queues then
+    t_spsc x_ring;                      ///<    Stamped floats, pushed by template_float, drained by template_bridge
+    double *x_bridgesig;                ///<    Right operand rebuilt from the ring, one vector
+    double x_bridgeval;                 ///<    Last value applied by the audio thread
+    double x_msr;                       ///<    Samples per millisecond
+    double x_now;                       ///<    Samples processed since dsp64, i.e. position of the current vector
+    double x_anchor;                    ///<    Sample position of scheduler time 0
+    long x_anchored;                    ///<    x_anchor is set
+    
+    // voice bank, one array per parameter (structure of arrays) so a t_vd holds the same parameter of VD_SIZE voices
+    long x_voices;                      ///<    Voices given to the notes, 0 for the plain operators (voices attribute)
+    double x_vramp;                     ///<    Fade in / fade out time constant in ms (ramp attribute)
+    double x_vcoef;                     ///<    One pole coefficient of the fades
+    t_spsc x_vring;                     ///<    Voice commands, pushed by the messages, applied at the start of a vector
+    void *x_vperform[2];                ///<    Voice kernel of each outlet, NULL if not connected
+    uint64_t x_vactive;                 ///<    One bit per sounding voice, the lanes of silent voices are skipped
+    double x_vr[TEMPLATE_MAXVOICES];    ///<    Right operand of each voice
+    double x_vk[TEMPLATE_MAXVOICES];    ///<    k of each voice
+    double x_vgain[TEMPLATE_MAXVOICES]; ///<    Gain, goes to x_vtarget
+    double x_vtarget[TEMPLATE_MAXVOICES];   ///<    1. while the note is held, 0. once released
+    double x_vgend[TEMPLATE_MAXVOICES]; ///<    Gains at the end of the vector, written by the kernels
+    long x_vid[TEMPLATE_MAXVOICES];     ///<    Note held by each voice, -1 once released (message side)
+    long x_vstamp[TEMPLATE_MAXVOICES];  ///<    When each voice was last started or released, the oldest is stolen
+    long x_vclock;                      ///<    Counts the notes and releases, stamps x_vstamp
 
 } t_template;
 
+// a float in the control bridge
+typedef struct _template_event
+{
+    double e_time;                      ///<    Scheduler time in ms
+    double e_val;                       ///<    Value
+
+} t_template_event;
+
+// a voice command, from the messages to the audio thread
+typedef struct _template_vcmd
+{
+    long c_voice;                       ///<    Voice index
+    long c_on;                          ///<    1 starts the voice with c_r and c_k, 0 releases it
+    double c_r;                         ///<    Right operand
+    double c_k;                         ///<    k
+
+} t_template_vcmd;
+
 // global pointer to our class definition that is setup in main()
 static t_class *template_class = NULL;
 
@@ -106,6 +225,7 @@ void template_assist(t_template *x, void *b, long m, long a, char *s);
 void template_float(t_template *x, double f);
 void template_int(  t_template *x, long n);
 void template_bang( t_template *x);
+void template_check(t_template *x);
 
 //// additional inlet behavious
 void template_in0( t_template *x, long n);      //1st inlet
@@ -113,7 +233,58 @@ void template_in1( t_template *x, long n);      //2nd inlet
 
 //// performance set
 void template_dsp64(t_template *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
-void template_perform64(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+void template_dspstate(t_template *x, long n);
+typedef void (*t_template_perform)(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+void template_perform64_os(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+void template_perform64_os32(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+
+// float kernels, outlet o of outs, called by template_perform64_os32 between the conversions
+typedef void (*t_template_perform32)(t_template *x, float **ins, float **outs, long sampleframes, long o);
+
+// voice kernels, add the voices of the bank to out
+typedef void (*t_template_vkernel)(t_template *x, const double *in, double *out, long sampleframes);
+
+//// control bridge
+double *template_bridge(t_template *x, long sampleframes);
+void template_perform64_bridge(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+
+//// voice bank
+void template_note(t_template *x, t_symbol *s, long argc, t_atom *argv);
+void template_off(t_template *x, long id);
+void template_alloff(t_template *x);
+long template_valloc(t_template *x, long id);
+void template_vpush(t_template *x, long v, long on, double r, double k);
+t_max_err template_ramp_set(t_template *x, void *attr, long argc, t_atom *argv);
+void template_vreset(t_template *x);
+void template_perform64_voices(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+
+//// oversampling
+t_max_err template_oversample_set(t_template *x, void *attr, long argc, t_atom *argv);
+void template_hbdesign(void);
+long template_osalloc(t_template *x, long maxvectorsize);
+
+//// operators, the perform routines are generated in the Operators section
+// enum and attribute names must be in the same order as template_ops
+enum {
+    OP_MUL = 0, OP_ADD, OP_SUB, OP_DIV, OP_MIN, OP_MAX, OP_POW, OP_CLIP, OP_MADD, OP_ADDMUL,
+    OP_COUNT
+};
+#define TEMPLATE_OPNAMES "mul add sub div min max pow clip madd addmul"
+
+typedef struct _template_op
+{
+    const char          *desc;      ///<    Shown by assist
+    t_template_perform  sig;        ///<    Right inlet is a signal
+    t_template_perform  scalar;     ///<    Right inlet is a float
+    t_template_perform  ksig;       ///<    Same without the denormal wrapper, for the oversampled routines
+    t_template_perform  kscalar;
+    t_template_perform32 sig32;     ///<    Same in float32 mode
+    t_template_perform32 scalar32;
+    t_template_vkernel  voices;     ///<    Voice bank
+
+} t_template_op;
+
+static const t_template_op template_ops[OP_COUNT];
 
 
 
@@ -141,13 +312,19 @@ void ext_main(void *r)
     // your custom free function.
     
     // creates a class with the new instance routine (see below), a free function (in this case there isn't one, so we pass NULL), the size of the structure, a no-longer used argument, and then a description of the arguments you type when creating an instance (in this case, there are no arguments, so we pass 0).
-    t_class *c = class_new("template~", (method)template_new, (method)dsp_free, (long)sizeof(t_template), 0L, A_GIMME, 0);
+    // the oversampling buffers are ours to free, template_free calls dsp_free itself
+    t_class *c = class_new("template~", (method)template_new, (method)template_free, (long)sizeof(t_template), 0L, A_GIMME, 0);
     
     //binds a C function to a text symbol. The three methods defined here are int, float and bang.
     class_addmethod(c, (method)template_bang,       "bang",             0);
     class_addmethod(c, (method)template_int,        "int",      A_LONG, 0);
     class_addmethod(c, (method)template_float,		"float",	A_FLOAT,0);
+    class_addmethod(c, (method)template_check,      "check",            0);
+    class_addmethod(c, (method)template_note,       "note",     A_GIMME, 0);
+    class_addmethod(c, (method)template_off,        "off",      A_LONG, 0);
+    class_addmethod(c, (method)template_alloff,     "alloff",           0);
     class_addmethod(c, (method)template_dsp64,		"dsp64",	A_CANT, 0);
+    class_addmethod(c, (method)template_dspstate,   "dspstate", A_CANT, 0);
     class_addmethod(c, (method)template_assist,     "assist",	A_CANT, 0);
     
     // The A_LONG, 0 args specify the type of arguments expeced by the C function
@@ -159,6 +336,42 @@ void ext_main(void *r)
     class_addmethod(c, (method)template_in0,        "int",      A_LONG, 0);
     class_addmethod(c, (method)template_in1,        "in1",      A_LONG, 0);
     
+    // one attribute per outlet, the enum order is the order of the template_ops table
+    CLASS_ATTR_LONG(c, "op1", 0, t_template, x_op[0]);
+    CLASS_ATTR_ENUMINDEX(c, "op1", 0, TEMPLATE_OPNAMES);
+    CLASS_ATTR_FILTER_CLIP(c, "op1", 0, OP_COUNT - 1);
+    CLASS_ATTR_LABEL(c, "op1", 0, "Left Outlet Operator");
+    CLASS_ATTR_LONG(c, "op2", 0, t_template, x_op[1]);
+    CLASS_ATTR_ENUMINDEX(c, "op2", 0, TEMPLATE_OPNAMES);
+    CLASS_ATTR_FILTER_CLIP(c, "op2", 0, OP_COUNT - 1);
+    CLASS_ATTR_LABEL(c, "op2", 0, "Right Outlet Operator");
+    CLASS_ATTR_DOUBLE(c, "k", 0, t_template, x_k);
+    CLASS_ATTR_LABEL(c, "k", 0, "Fused Operators Constant");
+    
+    // applied when the DSP chain is (re)built
+    CLASS_ATTR_LONG(c, "oversample", 0, t_template, x_oversample);
+    CLASS_ATTR_ENUM(c, "oversample", 0, "1 2 4 8");
+    CLASS_ATTR_ACCESSORS(c, "oversample", NULL, template_oversample_set);
+    CLASS_ATTR_LABEL(c, "oversample", 0, "Oversampling Factor");
+    CLASS_ATTR_DOUBLE(c, "latency", ATTR_SET_OPAQUE_USER, t_template, x_latency);
+    CLASS_ATTR_LABEL(c, "latency", 0, "Latency (samples)");
+    CLASS_ATTR_LONG(c, "float32", 0, t_template, x_float32);
+    CLASS_ATTR_STYLE_LABEL(c, "float32", 0, "onoff", "Float Processing");
+    CLASS_ATTR_LONG(c, "bridge", 0, t_template, x_bridge);
+    CLASS_ATTR_STYLE_LABEL(c, "bridge", 0, "onoff", "Sample Accurate Right Inlet Floats");
+    CLASS_ATTR_DOUBLE(c, "bridgedelay", 0, t_template, x_bridgedelay);
+    CLASS_ATTR_FILTER_MIN(c, "bridgedelay", 0.);
+    CLASS_ATTR_LABEL(c, "bridgedelay", 0, "Bridge Delay (ms)");
+    CLASS_ATTR_LONG(c, "voices", 0, t_template, x_voices);
+    CLASS_ATTR_FILTER_CLIP(c, "voices", 0, TEMPLATE_MAXVOICES);
+    CLASS_ATTR_LABEL(c, "voices", 0, "Voice Bank Size (0 turns the bank off when DSP restarts)");
+    CLASS_ATTR_DOUBLE(c, "ramp", 0, t_template, x_vramp);
+    CLASS_ATTR_ACCESSORS(c, "ramp", NULL, template_ramp_set);
+    CLASS_ATTR_LABEL(c, "ramp", 0, "Voice Fade Time (ms)");
+    
+    // the half-band filters are the same for every instance
+    template_hbdesign();
+    
     // if the filename on disk is different from the object name in Max, ex. w/ times
 //  class_setname("*~","times~");
     
@@ -194,16 +407,45 @@ void *template_new(t_symbol *s, long argc, t_atom *argv)
     outlet_new((t_pxobject *)x, "signal");
     outlet_new((t_pxobject *)x, "signal");
     
+    // the outlets are computed by two perform routines, an output can't overwrite an input the other one still needs
+    x->x_obj.z_misc |= Z_NO_INPLACE;
+    
     // splatted in _dsp method if optimizations are on
     x->x_val = (t_float)argc;
     
+    // L*R and L+R by default
+    x->x_op[0] = OP_MUL;
+    x->x_op[1] = OP_ADD;
+    x->x_k     = 0.;
+    x->x_oversample = 1;
+    x->x_bridgedelay = 5.;
+    x->x_msr = sys_getsr() * 0.001;
+    template_ramp_set(x, NULL, 0, NULL);    // 5 ms
+    template_vreset(x);
+    
+    attr_args_process(x, (short)argc, argv);
+    
+    if (spsc_new(&x->x_ring, TEMPLATE_RINGSIZE, sizeof(t_template_event))
+        || spsc_new(&x->x_vring, TEMPLATE_VRINGSIZE, sizeof(t_template_vcmd))) {
+        object_error((t_object *)x, "out of memory");
+        object_free(x);     // calls template_free
+        return NULL;
+    }
+    
     return (x);
 }
 
-// NOT CALLED!, we use dsp_free for a generic free function
 void template_free(t_template *x)
 {
-    ;
+    dsp_free((t_pxobject *)x);
+    
+    if (x->x_osblock)
+        sysmem_freeptr(x->x_osblock);
+    if (x->x_bridgesig)
+        sysmem_freeptr(x->x_bridgesig);
+    
+    spsc_free(&x->x_ring);
+    spsc_free(&x->x_vring);
 }
 
 //Documentation shown when hovering over an inlet/outlet
@@ -220,8 +462,8 @@ void template_assist(t_template *x, void *b, long m, long a, char *s)
     else if (m == ASSIST_OUTLET) {
         // outlet
         switch (a){
-            case 0: sprintf(s, "(Signal) Left Output  : L*R"); break;
-            case 1: sprintf(s, "(Signal) Right Output : L+R"); break;
+            case 0: sprintf(s, "(Signal) Left Output  : %s", template_ops[x->x_op[0]].desc); break;
+            case 1: sprintf(s, "(Signal) Right Output : %s", template_ops[x->x_op[1]].desc); break;
         }
     }
 }
@@ -265,9 +507,27 @@ void template_int(t_template *x, long n)
 }
 
 //This simply copies the value of the argument to the internal storage within the instance.
+//Only the right inlet holds a scalar, it replaces R when no signal is connected
+//In bridge mode the value is also queued with its time, the audio thread applies it on the matching sample
+//Only while the bridge runs : nothing drains the ring otherwise, x_val is what the next DSP start uses
 void template_float(t_template *x, double f)
 {
+    t_template_event e;
+    
+    if (proxy_getinlet((t_object *)x) != 1)
+        return;
+    
     x-> x_val = (t_float)f;
+    
+    if (lockfree_load(&x->x_bridgeon)) {
+        clock_getftime(&e.e_time);
+        e.e_val = f;
+        
+        // floats come from the main thread, and from the scheduler too in overdrive : the critical region keeps one producer at a time
+        critical_enter(0);
+        spsc_push(&x->x_ring, &e);  // a full ring means the audio is late, x_val still has the value
+        critical_exit(0);
+    }
 }
 
 void template_bang(t_template *x)
@@ -287,8 +547,15 @@ void template_bang(t_template *x)
 // Calls the appropriate functions to do the processing
 void template_dsp64(t_template *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
 {
+    t_template_perform perform;
+    t_atom a;
+    long o;
+    
     post("my sample rate is: %f", samplerate);
     
+    // set again below if a routine draining the bridge ring is added
+    lockfree_store(&x->x_bridgeon, 0);
+    
     /* 
         instead of calling dsp_add(), we send the "dsp_add64" message to the object representing the dsp chain
      the arguments passed are:
@@ -298,44 +565,996 @@ void template_dsp64(t_template *x, t_object *dsp64, short *count, double sampler
             4: a pointer to your 64-bit perform method
             5: flags to alter how the signal chain handles your object -- just pass 0
             6: a generic pointer that you can use to pass any additional data to your perform method
+     
+        each outlet gets its own perform routine, chosen from its operator and from the right inlet
+        being a signal (count[1]) or a scalar. The outlet index goes in the generic pointer.
+        count holds the inlets then the outlets, an outlet connected to nothing isn't computed.
+     
+        when oversampling or in float32 mode, a single perform routine converts/resamples and calls the operators itself.
+        the control bridge turns the right inlet floats into a signal, the operators then take their signal/signal form.
+        the voice bank calls the voice kernels of the operators.
      */
     
-    object_method(dsp64, gensym("dsp_add64"), x, template_perform64, 0, NULL);
+    // the voice bank replaces the other modes, a single perform routine computes both outlets
+    if (x->x_voices) {
+        x->x_msr = samplerate * 0.001;
+        atom_setfloat(&a, x->x_vramp);
+        template_ramp_set(x, NULL, 1, &a);
+        for (o = 0; o < 2; o++)
+            x->x_vperform[o] = count[2 + o] ? template_ops[x->x_op[o]].voices : NULL;
+        x->x_latency = 0.;
+        object_method(dsp64, gensym("dsp_add64"), x, template_perform64_voices, 0, NULL);
+        return;
+    }
+    
+    x->x_bridging = x->x_bridge && !count[1];
+    if (x->x_bridging) {
+        if (x->x_bridgesig)
+            sysmem_freeptr(x->x_bridgesig);
+        x->x_bridgesig = (double *) sysmem_newptr(maxvectorsize * sizeof(double));
+        if (!x->x_bridgesig) {
+            object_error((t_object *)x, "can't allocate the bridge buffer");
+            return;
+        }
+        x->x_bridgeval = x->x_val;
+        x->x_msr = samplerate * 0.001;
+        x->x_now = 0.;
+        x->x_anchored = 0;
+    }
+    
+    if (x->x_oversample > 1 || x->x_float32 || x->x_bridging) {
+        x->x_ossig = count[1] || x->x_bridging;
+        for (o = 0; o < 2; o++) {
+            if (!count[2 + o])
+                x->x_osperform[o] = NULL;
+            else if (x->x_float32)
+                x->x_osperform[o] = x->x_ossig ? template_ops[x->x_op[o]].sig32 : template_ops[x->x_op[o]].scalar32;
+            else
+                x->x_osperform[o] = x->x_ossig ? template_ops[x->x_op[o]].ksig : template_ops[x->x_op[o]].kscalar;
+        }
+        
+        if (x->x_oversample == 1 && !x->x_float32) {
+            x->x_latency = 0.;
+            lockfree_store(&x->x_bridgeon, 1);
+            object_method(dsp64, gensym("dsp_add64"), x, template_perform64_bridge, 0, NULL);
+            return;
+        }
+        
+        if (template_osalloc(x, maxvectorsize)) {
+            object_error((t_object *)x, "can't allocate the oversampling buffers");
+            return;
+        }
+        lockfree_store(&x->x_bridgeon, (int32_t)x->x_bridging);
+        object_method(dsp64, gensym("dsp_add64"), x, x->x_float32 ? template_perform64_os32 : template_perform64_os, 0, NULL);
+        return;
+    }
+    x->x_latency = 0.;
+    
+    for (o = 0; o < 2; o++) {
+        if (!count[2 + o])
+            continue;
+        perform = count[1] ? template_ops[x->x_op[o]].sig : template_ops[x->x_op[o]].scalar;
+        object_method(dsp64, gensym("dsp_add64"), x, perform, 0, (void *)(t_ptr_int)o);
+    }
 }
 
-// this is the 64-bit perform method audio vectors
-// Perform processing on signal & float connected to inlets
-void template_perform64(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+// sent when the DSP starts (1) and stops (0), the bridge ring is only fed while a perform routine drains it
+void template_dspstate(t_template *x, long n)
 {
-    t_double *inL = ins[0];     // we get audio for each inlet of the object from the **ins argument
-    t_double *inR = ins[1];
-    t_double *outL = outs[0];    // we get audio for each outlet of the object from the **outs argument
-    t_double *outR = outs[1];
+    if (!n)
+        lockfree_store(&x->x_bridgeon, 0);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Operators
+//____________________________________________________________________
+
+/*
+ 
+ Every operator gets its perform routines from the same loop, generated by the TEMPLATE_OP macros.
+ An operator is given twice : as a vector expression (t_vd, 2 doubles, see simd.h) and as a scalar expression.
+ The vector one does the bulk of the vector, the scalar one the remaining samples.
+ The kernels are plain arithmetic, the registered perform routines wrap them with the per block
+ denormal/NaN policy of denormal.h (division by 0 gives inf, which becomes 0. as well).
+ 
+ For each operator we get :
+    template_perform64_<op>         : L op R, both signals
+    template_perform64_<op>_scalar  : L op x_val, when the right inlet has no signal
+    template_perform32_<op>         : same two on floats (t_vf, 4 floats), for the float32 mode
+    template_perform32_<op>_scalar
+    template_kernel64_<op>          : the double ones without the denormal wrapper, for the oversampled routines
+    template_kernel64_<op>_scalar
+    template_voices64_<op>          : sum over the voice bank, the lanes of a t_vd are voices (see Voice Bank)
+ The fused operators also read x_k, the k attribute.
+ 
+ To add an operator : one line in the enum, one TEMPLATE_OP line, one line in template_ops.
+ 
+ */
+
+// scalar expressions, a = L, b = R, c = k
+#define SOP_MUL(a, b, c)    ((a) * (b))
+#define SOP_ADD(a, b, c)    ((a) + (b))
+#define SOP_SUB(a, b, c)    ((a) - (b))
+#define SOP_DIV(a, b, c)    ((a) / (b))
+#define SOP_MIN(a, b, c)    ((a) < (b) ? (a) : (b))
+#define SOP_MAX(a, b, c)    ((a) > (b) ? (a) : (b))
+#define SOP_POW(a, b, c)    pow(fabs(a) < DBL_MIN ? 0. : (a), fabs(b) < DBL_MIN ? 0. : (b))    // see VOP_POW
+#define SOP_CLIP(a, b, c)   fmax(fmin((a), fabs(b)), -fabs(b))          // clips L in [-|R|, |R|]
+#define SOP_MADD(a, b, c)   ((a) * (b) + (c))
+#define SOP_ADDMUL(a, b, c) (((a) + (b)) * (c))
+
+// vector expressions, same operands as t_vd
+#define VOP_MUL(a, b, c)    vd_mul((a), (b))
+#define VOP_ADD(a, b, c)    vd_add((a), (b))
+#define VOP_SUB(a, b, c)    vd_sub((a), (b))
+#define VOP_DIV(a, b, c)    vd_div((a), (b))
+#define VOP_MIN(a, b, c)    vd_min((a), (b))
+#define VOP_MAX(a, b, c)    vd_max((a), (b))
+#define VOP_POW(a, b, c)    vd_map2(pow, vd_daz(a), vd_daz(b))          // pow ignores DAZ : pow(denormal, -0.5) was ~1e160, not inf
+#define VOP_CLIP(a, b, c)   vd_max(vd_min((a), vd_abs(b)), vd_neg(vd_abs(b)))
+#define VOP_MADD(a, b, c)   vd_madd((a), (b), (c))
+#define VOP_ADDMUL(a, b, c) vd_mul(vd_add((a), (b)), (c))
+
+// float vector expressions, t_vf operands
+#define VFOP_MUL(a, b, c)    vf_mul((a), (b))
+#define VFOP_ADD(a, b, c)    vf_add((a), (b))
+#define VFOP_SUB(a, b, c)    vf_sub((a), (b))
+#define VFOP_DIV(a, b, c)    vf_div((a), (b))
+#define VFOP_MIN(a, b, c)    vf_min((a), (b))
+#define VFOP_MAX(a, b, c)    vf_max((a), (b))
+#define VFOP_POW(a, b, c)    vf_map2(powf, (a), (b))
+#define VFOP_CLIP(a, b, c)   vf_max(vf_min((a), vf_abs(b)), vf_neg(vf_abs(b)))
+#define VFOP_MADD(a, b, c)   vf_madd((a), (b), (c))
+#define VFOP_ADDMUL(a, b, c) vf_mul(vf_add((a), (b)), (c))
+
+// the template_perform64 loop : 2 vectors per iteration, then the remaining samples one by one
+#define TEMPLATE_OP_LOOP(VOP, SOP, LOADR, SCALARR)                                  \
+    t_double *inL = ins[0];                                                         \
+    t_double *inR = ins[1];                                                         \
+    t_double *out = outs[(t_ptr_int)userparam];                                     \
+    t_vd     k  = vd_set1(x->x_k);                                                  \
+    t_vd     vr = vd_set1(x->x_val);                                                \
+    double   kk = x->x_k;                                                           \
+    long     i  = 0;                                                                \
+    (void)inR; (void)vr; (void)k; (void)kk;                                         \
+                                                                                    \
+    for (; i + 2 * VD_SIZE <= sampleframes; i += 2 * VD_SIZE) {                     \
+        vd_store(out + i,           VOP(vd_load(inL + i), LOADR(i), k));            \
+        vd_store(out + i + VD_SIZE, VOP(vd_load(inL + i + VD_SIZE), LOADR(i + VD_SIZE), k)); \
+    }                                                                               \
+    for (; i < sampleframes; i++)                                                   \
+        out[i] = SOP(inL[i], SCALARR(i), kk);
+
+// the float loop, 4 floats per vector
+#define TEMPLATE_OP_LOOP32(VFOP, SOP, LOADR, SCALARR)                               \
+    float   *inL = ins[0];                                                          \
+    float   *inR = ins[1];                                                          \
+    float   *out = outs[o];                                                         \
+    t_vf    k  = vf_set1((float)x->x_k);                                            \
+    t_vf    vr = vf_set1((float)x->x_val);                                          \
+    float   kk = (float)x->x_k;                                                     \
+    long    i  = 0;                                                                 \
+    (void)inR; (void)vr; (void)k; (void)kk;                                         \
+                                                                                    \
+    for (; i + VF_SIZE <= sampleframes; i += VF_SIZE)                               \
+        vf_store(out + i, VFOP(vf_load(inL + i), LOADR(i), k));                     \
+    for (; i < sampleframes; i++)                                                   \
+        out[i] = (float)SOP(inL[i], SCALARR(i), kk);
+
+// the voice loop : the voices go by VD_SIZE, each lane of a t_vd is a voice with its own R, k and gain
+// the pairs without an active voice are skipped, two samples per iteration share one horizontal add
+#define TEMPLATE_VOICE_LOOP(VOP)                                                    \
+    uint64_t lanes = ((uint64_t)1 << VD_SIZE) - 1;                                  \
+    t_vd     c = vd_set1(x->x_vcoef);                                               \
+    t_vd     r, k, g, t, a, b;                                                      \
+    long     v, i;                                                                  \
+    (void)k;                                                                        \
+                                                                                    \
+    for (v = 0; v < TEMPLATE_MAXVOICES; v += VD_SIZE) {                             \
+        if (!((x->x_vactive >> v) & lanes))                                         \
+            continue;                                                               \
+        r = vd_load(x->x_vr + v);                                                   \
+        k = vd_load(x->x_vk + v);                                                   \
+        g = vd_load(x->x_vgain + v);                                                \
+        t = vd_load(x->x_vtarget + v);                                              \
+        for (i = 0; i + 2 <= sampleframes; i += 2) {                                \
+            a = vd_mul(VOP(vd_set1(in[i]), r, k), g);                               \
+            g = vd_madd(vd_sub(t, g), c, g);                                        \
+            b = vd_mul(VOP(vd_set1(in[i + 1]), r, k), g);                           \
+            g = vd_madd(vd_sub(t, g), c, g);                                        \
+            vd_store(out + i, vd_add(vd_load(out + i), vd_hadd2(a, b)));            \
+        }                                                                           \
+        if (i < sampleframes) {                                                     \
+            out[i] += vd_hsum(vd_mul(VOP(vd_set1(in[i]), r, k), g));                \
+            g = vd_madd(vd_sub(t, g), c, g);                                        \
+        }                                                                           \
+        vd_store(x->x_vgend + v, g);                                                \
+    }
+
+#define TEMPLATE_LOADR32_SIG(i)     vf_load(inR + (i))
+#define TEMPLATE_LOADR32_SCALAR(i)  vr
+
+#define TEMPLATE_LOADR_SIG(i)       vd_load(inR + (i))
+#define TEMPLATE_SCALARR_SIG(i)     inR[i]
+#define TEMPLATE_LOADR_SCALAR(i)    vr
+#define TEMPLATE_SCALARR_SCALAR(i)  ((double)x->x_val)
+
+// generates the signal/signal and signal/scalar perform routines of an operator, double and float
+#define TEMPLATE_OP(name, VOP, VFOP, SOP)                                           \
+void template_kernel64_##name(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam) \
+{                                                                                   \
+    TEMPLATE_OP_LOOP(VOP, SOP, TEMPLATE_LOADR_SIG, TEMPLATE_SCALARR_SIG)            \
+}                                                                                   \
+void template_kernel64_##name##_scalar(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam) \
+{                                                                                   \
+    TEMPLATE_OP_LOOP(VOP, SOP, TEMPLATE_LOADR_SCALAR, TEMPLATE_SCALARR_SCALAR)      \
+}                                                                                   \
+DENORMAL_PERFORM(template_perform64_##name, template_kernel64_##name, t_template, (t_ptr_int)userparam, 1) \
+DENORMAL_PERFORM(template_perform64_##name##_scalar, template_kernel64_##name##_scalar, t_template, (t_ptr_int)userparam, 1) \
+                                                                                    \
+void template_perform32_##name(t_template *x, float **ins, float **outs, long sampleframes, long o) \
+{                                                                                   \
+    TEMPLATE_OP_LOOP32(VFOP, SOP, TEMPLATE_LOADR32_SIG, TEMPLATE_SCALARR_SIG)       \
+}                                                                                   \
+void template_perform32_##name##_scalar(t_template *x, float **ins, float **outs, long sampleframes, long o) \
+{                                                                                   \
+    TEMPLATE_OP_LOOP32(VFOP, SOP, TEMPLATE_LOADR32_SCALAR, TEMPLATE_SCALARR_SCALAR) \
+}                                                                                   \
+void template_voices64_##name(t_template *x, const double *in, double *out, long sampleframes) \
+{                                                                                   \
+    TEMPLATE_VOICE_LOOP(VOP)                                                        \
+}
+
+TEMPLATE_OP(mul,    VOP_MUL,    VFOP_MUL,    SOP_MUL)
+TEMPLATE_OP(add,    VOP_ADD,    VFOP_ADD,    SOP_ADD)
+TEMPLATE_OP(sub,    VOP_SUB,    VFOP_SUB,    SOP_SUB)
+TEMPLATE_OP(div,    VOP_DIV,    VFOP_DIV,    SOP_DIV)
+TEMPLATE_OP(min,    VOP_MIN,    VFOP_MIN,    SOP_MIN)
+TEMPLATE_OP(max,    VOP_MAX,    VFOP_MAX,    SOP_MAX)
+TEMPLATE_OP(pow,    VOP_POW,    VFOP_POW,    SOP_POW)
+TEMPLATE_OP(clip,   VOP_CLIP,   VFOP_CLIP,   SOP_CLIP)
+TEMPLATE_OP(madd,   VOP_MADD,   VFOP_MADD,   SOP_MADD)
+TEMPLATE_OP(addmul, VOP_ADDMUL, VFOP_ADDMUL, SOP_ADDMUL)
+
+// operators table, indexed by the op1/op2 attributes
+#define TEMPLATE_OPENTRY(name, desc) { desc, template_perform64_##name, template_perform64_##name##_scalar, \
+                                              template_kernel64_##name,  template_kernel64_##name##_scalar,  \
+                                              template_perform32_##name, template_perform32_##name##_scalar, \
+                                              template_voices64_##name }
+
+static const t_template_op template_ops[OP_COUNT] = {
+    TEMPLATE_OPENTRY(mul,    "L*R"),
+    TEMPLATE_OPENTRY(add,    "L+R"),
+    TEMPLATE_OPENTRY(sub,    "L-R"),
+    TEMPLATE_OPENTRY(div,    "L/R"),
+    TEMPLATE_OPENTRY(min,    "min(L,R)"),
+    TEMPLATE_OPENTRY(max,    "max(L,R)"),
+    TEMPLATE_OPENTRY(pow,    "pow(L,R)"),
+    TEMPLATE_OPENTRY(clip,   "clip(L,-|R|,|R|)"),
+    TEMPLATE_OPENTRY(madd,   "L*R+k"),
+    TEMPLATE_OPENTRY(addmul, "(L+R)*k"),
+};
 
-    t_double ftmpL;
-    t_double ftmpR;
 
-    // this perform method simply copies the input to the output, offsetting the value
-    while (sampleframes--) {
-        //  mult two signals
-        ftmpL = *inL * *inR;
-        FIX_DENORM_NAN_DOUBLE(ftmpL);
-        *outL++ = ftmpL;
+
+
+
+//____________________________________________________________________
+//                          Control Bridge
+//____________________________________________________________________
+
+/*
+ 
+ The scheduler and the audio thread run on different clocks : a float handled by the scheduler lands
+ at the start of whichever vector comes next, so a regular stream comes out with a vector of jitter.
+ 
+ template_float stamps each float with the scheduler time (clock_getftime) and pushes it in an SPSC ring,
+ as long as a routine draining it runs (x_bridgeon, set by dsp64, cleared by dspstate). The floats come from
+ the main thread and, in overdrive, from the scheduler : the pushes are in a critical region, one producer at a time.
+ Once per vector the audio thread drains the events due in this vector and rebuilds the right operand
+ sample by sample, each value starting on the sample matching its time.
+ 
+ Scheduler time t maps to sample t * msr + x_anchor. The anchor is set by the first event so that it
+ lands bridgedelay ms after the current vector : the delay absorbs the scheduler jitter, the spacing of
+ the events is kept. The two clocks drift apart, an event more than bridgedelay late or early re-anchors.
+ 
+ */
+
+// audio thread, returns the right operand of this vector
+double *template_bridge(t_template *x, long sampleframes)
+{
+    t_template_event    *e;
+    double              *sig = x->x_bridgesig;
+    double              val = x->x_bridgeval;
+    double              delay = x->x_bridgedelay * x->x_msr;
+    double              pos;
+    long                i = 0;
+    long                at;
+    
+    // events queued before this start (the last run, or between dsp64 and now) are stale, x_val has the last one
+    if (x->x_now == 0.) {
+        while (spsc_peek(&x->x_ring))
+            spsc_pop(&x->x_ring);
+        val = x->x_val;
+    }
+    
+    while ((e = (t_template_event *) spsc_peek(&x->x_ring))) {
+        pos = e->e_time * x->x_msr + x->x_anchor - x->x_now;
         
-        //  add two signals
-        ftmpR = *inL++ + *inR++;
-        FIX_DENORM_NAN_DOUBLE(ftmpR);
-        *outR++ = ftmpR;
+        if (!x->x_anchored || pos < -delay || pos > sampleframes + 2. * delay) {
+            x->x_anchor = x->x_now + delay - e->e_time * x->x_msr;
+            x->x_anchored = 1;
+            pos = delay;
+        }
+        
+        // due in a later vector, it stays in the ring
+        if (pos >= sampleframes)
+            break;
+        
+        // a late event (pos < 0) still comes in order, on the first sample not yet written
+        at = pos > i ? (long)pos : i;
+        for (; i < at; i++)
+            sig[i] = val;
+        val = e->e_val;
+        spsc_pop(&x->x_ring);
+    }
+    
+    for (; i < sampleframes; i++)
+        sig[i] = val;
+    
+    x->x_bridgeval = val;
+    x->x_now += sampleframes;
+    
+    return sig;
+}
 
+// both outlets at the normal rate with the bridged right operand
+static void template_process64_bridge(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+    t_template_perform perform;
+    double *bins[2];
+    long o;
+    
+    bins[0] = ins[0];
+    bins[1] = template_bridge(x, sampleframes);
+    
+    for (o = 0; o < 2; o++) {
+        perform = (t_template_perform)x->x_osperform[o];
+        if (perform)
+            perform(x, dsp64, bins, numins, outs, numouts, sampleframes, flags, (void *)(t_ptr_int)o);
     }
 }
 
+DENORMAL_PERFORM(template_perform64_bridge, template_process64_bridge, t_template, 0, 2)
+
 
 
 
 
 //____________________________________________________________________
-//                          Additional Routines
+//                          Voice Bank
+//____________________________________________________________________
+
+/*
+ 
+ A bank of voices in one instance : each voice is L op R with its own R and k, times its gain.
+ The parameters are stored by arrays (x_vr, x_vk, x_vgain...) rather than by voice, so the voice kernels
+ load VD_SIZE voices in a t_vd and run them in its lanes, the input sample being the same for all of them.
+ x_vactive has a bit per sounding voice : a pair of lanes without any is skipped, a bank of 64 voices
+ playing 3 notes costs 2 pairs.
+ 
+ The messages allocate the voices (x_vid, x_vstamp are only touched by them) and push commands in an SPSC
+ ring, the audio thread applies them at the start of the next vector and owns everything else. They run in
+ a critical region : the main thread and the scheduler (overdrive) both send them, the ring has one producer.
+ Ids are 0 or more, -1 in x_vid marks a released voice. A note takes the voice of the bank already playing
+ its id, else the voice released the longest ago, else steals the oldest note.
+ The gains follow their target (1. held, 0. released) with a one pole of ramp ms, so starts, releases and
+ steals don't click. A released voice leaves x_vactive once its gain is below TEMPLATE_VSILENCE.
+ 
+ */
+
+// note <id> <R> [k] : starts or restarts the voice of id
+void template_note(t_template *x, t_symbol *s, long argc, t_atom *argv)
+{
+    long id, v;
+    
+    if (argc < 2) {
+        object_error((t_object *)x, "note <id> <R> [k]");
+        return;
+    }
+    if (!x->x_voices) {
+        object_warn((t_object *)x, "note : the voice bank is off (voices attribute)");
+        return;
+    }
+    
+    id = (long)atom_getlong(argv);
+    if (id < 0) {
+        object_error((t_object *)x, "note : the id must be 0 or more");
+        return;
+    }
+    
+    critical_enter(0);
+    v = template_valloc(x, id);
+    x->x_vid[v] = id;
+    x->x_vstamp[v] = x->x_vclock++;
+    template_vpush(x, v, 1, atom_getfloat(argv + 1), argc > 2 ? atom_getfloat(argv + 2) : x->x_k);
+    critical_exit(0);
+}
+
+// off <id> : releases the voice of id, if it still has it
+void template_off(t_template *x, long id)
+{
+    long v;
+    
+    // -1 would match every released voice
+    if (id < 0) {
+        object_error((t_object *)x, "off : the id must be 0 or more");
+        return;
+    }
+    
+    // all the voices, a note may be held above a lowered voices attribute
+    critical_enter(0);
+    for (v = 0; v < TEMPLATE_MAXVOICES; v++) {
+        if (x->x_vid[v] == id) {
+            x->x_vid[v] = -1;
+            x->x_vstamp[v] = x->x_vclock++;
+            template_vpush(x, v, 0, 0., 0.);
+        }
+    }
+    critical_exit(0);
+}
+
+void template_alloff(t_template *x)
+{
+    long v;
+    
+    critical_enter(0);
+    for (v = 0; v < TEMPLATE_MAXVOICES; v++) {
+        if (x->x_vid[v] >= 0) {
+            x->x_vid[v] = -1;
+            x->x_vstamp[v] = x->x_vclock++;
+            template_vpush(x, v, 0, 0., 0.);
+        }
+    }
+    critical_exit(0);
+}
+
+// voice for a new note of id, among the first x_voices
+long template_valloc(t_template *x, long id)
+{
+    long v, best = 0;
+    
+    // only in the bank, a voice above a lowered voices attribute isn't given new notes
+    for (v = 0; v < x->x_voices; v++)
+        if (x->x_vid[v] == id)
+            return v;
+    
+    // released before held, then the oldest
+    for (v = 1; v < x->x_voices; v++) {
+        if ((x->x_vid[v] >= 0) != (x->x_vid[best] >= 0)) {
+            if (x->x_vid[v] < 0)
+                best = v;
+        }
+        else if (x->x_vstamp[v] < x->x_vstamp[best])
+            best = v;
+    }
+    
+    return best;
+}
+
+void template_vpush(t_template *x, long v, long on, double r, double k)
+{
+    t_template_vcmd c;
+    
+    c.c_voice = v;
+    c.c_on = on;
+    c.c_r = r;
+    c.c_k = k;
+    
+    // a full ring means the audio isn't draining it (DSP off)
+    if (spsc_push(&x->x_vring, &c))
+        object_warn((t_object *)x, "voice commands dropped, is the DSP on ?");
+}
+
+// ramp : time constant of the fades in ms, the coefficient depends on the sample rate (dsp64 calls us again)
+t_max_err template_ramp_set(t_template *x, void *attr, long argc, t_atom *argv)
+{
+    double ms = argc ? atom_getfloat(argv) : 5.;
+    
+    x->x_vramp = ms > 0. ? ms : 0.;
+    x->x_vcoef = x->x_vramp * x->x_msr > 1. ? 1. - exp(-1. / (x->x_vramp * x->x_msr)) : 1.;
+    
+    return MAX_ERR_NONE;
+}
+
+// every voice silent and free, called by new
+void template_vreset(t_template *x)
+{
+    long v;
+    
+    x->x_vactive = 0;
+    for (v = 0; v < TEMPLATE_MAXVOICES; v++) {
+        x->x_vr[v] = 1.;
+        x->x_vk[v] = 0.;
+        x->x_vgain[v] = 0.;
+        x->x_vtarget[v] = 0.;
+        x->x_vid[v] = -1;
+        x->x_vstamp[v] = 0;
+    }
+}
+
+// audio thread : commands, then each connected outlet sums the voices
+static void template_process64_voices(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+    t_template_vcmd     *c;
+    t_template_vkernel  kernel;
+    uint64_t            bit;
+    long                o, v, ran = 0;
+    
+    while ((c = (t_template_vcmd *) spsc_peek(&x->x_vring))) {
+        bit = (uint64_t)1 << c->c_voice;
+        if (c->c_on) {
+            x->x_vr[c->c_voice] = c->c_r;
+            x->x_vk[c->c_voice] = c->c_k;
+            x->x_vtarget[c->c_voice] = 1.;
+            x->x_vactive |= bit;
+        }
+        else
+            x->x_vtarget[c->c_voice] = 0.;
+        spsc_pop(&x->x_vring);
+    }
+    
+    for (o = 0; o < 2; o++) {
+        kernel = (t_template_vkernel)x->x_vperform[o];
+        if (!kernel)
+            continue;
+        memset(outs[o], 0, sampleframes * sizeof(double));
+        kernel(x, ins[0], outs[o], sampleframes);
+        ran = 1;
+    }
+    if (!ran)
+        return;
+    
+    // every kernel ended on the same gains, the released voices that faded out leave the mask
+    for (v = 0; v < TEMPLATE_MAXVOICES; v++) {
+        bit = (uint64_t)1 << v;
+        if (!(x->x_vactive & bit))
+            continue;
+        x->x_vgain[v] = x->x_vgend[v];
+        if (x->x_vtarget[v] == 0. && x->x_vgain[v] < TEMPLATE_VSILENCE) {
+            x->x_vgain[v] = 0.;
+            x->x_vactive &= ~bit;
+        }
+    }
+}
+
+DENORMAL_PERFORM(template_perform64_voices, template_process64_voices, t_template, 0, 2)
+
+
+
+
+
 //____________________________________________________________________
+//                          Oversampling
+//____________________________________________________________________
+
+/*
+ 
+ Oversampling by 2^stages is a cascade of 2x stages, each one a half-band FIR filter (4q-1 taps).
+ In a half-band filter every other tap is 0, except the center one which is 1/2, so each stage is
+ computed in polyphase form :
+    up   : y[2p] = 2 * sum g[j] x[p-j]              y[2p+1] = x[p-q+1]
+    down : y[p]  = sum g[j] v[2p-2j] + v[2p-2q+1] / 2
+ with g the 2q non zero side taps. Only the branch with the side taps costs anything, half the taps of
+ the filter, and it is a plain dot product (done with t_vd). Each stage keeps the end of its input
+ in front of the next one, so the dot product never has to wrap.
+ 
+ The stage at the original rate has the narrowest transition band, the higher ones have more room
+ (the band above the original Nyquist is already empty) and get shorter filters.
+ 
+ Latency : 2q-1 samples at the output rate of each up stage and at the input rate of each down stage.
+ 
+ */
+
+static const long template_hbq[TEMPLATE_OSSTAGES] = { 12, 6, 4 };   // even, 2q is a multiple of 2 * VD_SIZE and of VF_SIZE
+static double template_hbcoef[TEMPLATE_OSSTAGES][2 * TEMPLATE_HBMAXQ];
+static float  template_hbcoef32[TEMPLATE_OSSTAGES][2 * TEMPLATE_HBMAXQ];
+
+// oversample : 1, 2, 4 or 8, anything else is rounded down to one of them
+t_max_err template_oversample_set(t_template *x, void *attr, long argc, t_atom *argv)
+{
+    long f = argc ? atom_getlong(argv) : 1;
+    
+    x->x_oversample = f >= 8 ? 8 : f >= 4 ? 4 : f >= 2 ? 2 : 1;
+    return MAX_ERR_NONE;
+}
+
+// Blackman windowed sinc half-band filters, normalized for a unity gain at DC
+void template_hbdesign(void)
+{
+    double  *g, t, w, sum;
+    long    s, j, q, k, len;
+    
+    for (s = 0; s < TEMPLATE_OSSTAGES; s++) {
+        q   = template_hbq[s];
+        g   = template_hbcoef[s];
+        len = 4 * q - 1;
+        sum = 0.;
+        
+        // side tap j is tap k = 2j of the filter, the center is k = 2q-1
+        for (j = 0; j < 2 * q; j++) {
+            k = 2 * j;
+            t = (k - (2 * q - 1)) * 0.5;
+            w = 0.42 - 0.5 * cos(2. * M_PI * k / (len - 1)) + 0.08 * cos(4. * M_PI * k / (len - 1));
+            g[j] = 0.5 * sin(M_PI * t) / (M_PI * t) * w;
+            sum += g[j];
+        }
+        
+        // the side taps add up to 1/2, the center tap is the other 1/2
+        for (j = 0; j < 2 * q; j++) {
+            g[j] *= 0.5 / sum;
+            template_hbcoef32[s][j] = (float)g[j];
+        }
+    }
+}
+
+// allocates the stages and the buffers of the higher rate for vectors up to maxvectorsize, returns 0 on success
+// in float32 mode without oversampling there are no stages, only the float buffers
+long template_osalloc(t_template *x, long maxvectorsize)
+{
+    char    *cursor = NULL;
+    long    size = x->x_float32 ? sizeof(float) : sizeof(double);
+    long    total, pass, s, c, q, n;
+    
+    x->x_osstages = x->x_oversample >= 8 ? 3 : x->x_oversample >= 4 ? 2 : x->x_oversample >= 2 ? 1 : 0;
+    x->x_latency  = 0.;
+    for (s = 0; s < x->x_osstages; s++)
+        x->x_latency += (2. * template_hbq[s] - 1.) / (1L << s);
+    
+    if (x->x_osblock)
+        sysmem_freeptr(x->x_osblock);
+    x->x_osblock = NULL;
+    
+    // first pass adds up the size of the block, second pass carves it (the block is zeroed, so are the histories)
+    for (pass = 0; pass < 2; pass++) {
+        total = 0;
+        for (c = 0; c < 2; c++) {
+            for (s = 0; s < x->x_osstages; s++) {
+                q = template_hbq[s];
+                n = maxvectorsize << s;     // input of up stage s, output of down stage s
+                
+                x->x_hbup[c][s].g   = template_hbcoef[s];
+                x->x_hbup[c][s].g32 = template_hbcoef32[s];
+                x->x_hbup[c][s].q   = q;
+                x->x_hbup[c][s].e   = (double *) arena_carve(pass ? &cursor : NULL, &total, (2 * q + n) * size);
+                x->x_hbup[c][s].o   = NULL;
+                
+                x->x_hbdown[c][s].g   = template_hbcoef[s];
+                x->x_hbdown[c][s].g32 = template_hbcoef32[s];
+                x->x_hbdown[c][s].q   = q;
+                x->x_hbdown[c][s].e   = (double *) arena_carve(pass ? &cursor : NULL, &total, (2 * q + n) * size);
+                x->x_hbdown[c][s].o   = (double *) arena_carve(pass ? &cursor : NULL, &total, (q + n) * size);
+                
+                x->x_hbup[c][s].e32   = (float *) x->x_hbup[c][s].e;
+                x->x_hbup[c][s].o32   = NULL;
+                x->x_hbdown[c][s].e32 = (float *) x->x_hbdown[c][s].e;
+                x->x_hbdown[c][s].o32 = (float *) x->x_hbdown[c][s].o;
+            }
+            x->x_osin[c]  = (double *) arena_carve(pass ? &cursor : NULL, &total, (maxvectorsize << x->x_osstages) * size);
+            x->x_osout[c] = (double *) arena_carve(pass ? &cursor : NULL, &total, (maxvectorsize << x->x_osstages) * size);
+            x->x_osin32[c]  = (float *) x->x_osin[c];
+            x->x_osout32[c] = (float *) x->x_osout[c];
+        }
+        
+        if (!pass) {
+            x->x_osblock = (char *) sysmem_newptrclear(total);
+            if (!x->x_osblock)
+                return 1;
+            cursor = x->x_osblock;
+        }
+    }
+    
+    return 0;
+}
+
+// sum of g[i] * x[i], taps is a multiple of 2 * VD_SIZE
+static inline double template_hbdot(const double *g, const double *x, long taps)
+{
+    t_vd    acc0 = vd_set1(0.);
+    t_vd    acc1 = vd_set1(0.);
+    long    i;
+    
+    for (i = 0; i < taps; i += 2 * VD_SIZE) {
+        acc0 = vd_madd(vd_load(g + i),           vd_load(x + i),           acc0);
+        acc1 = vd_madd(vd_load(g + i + VD_SIZE), vd_load(x + i + VD_SIZE), acc1);
+    }
+    
+    return vd_hsum(vd_add(acc0, acc1));
+}
+
+// same on floats, taps is a multiple of VF_SIZE
+static inline float template_hbdot32(const float *g, const float *x, long taps)
+{
+    t_vf    acc = vf_set1(0.f);
+    long    i;
+    
+    for (i = 0; i < taps; i += VF_SIZE)
+        acc = vf_madd(vf_load(g + i), vf_load(x + i), acc);
+    
+    return vf_hsum(acc);
+}
+
+// the signals enter and leave the stages in double, as a plain copy or through simd_tofloat/simd_todouble
+static void template_import(const double *in, double *out, long n)
+{
+    memcpy(out, in, n * sizeof(double));
+}
+
+static void template_export(const double *in, double *out, long n)
+{
+    memcpy(out, in, n * sizeof(double));
+}
+
+#define template_import32   simd_tofloat
+#define template_export32   simd_todouble
+
+/*
+ 
+ The stages are generated for both precisions, T is the sample type, SFX the suffix of the routines,
+ of the t_template_hb members and of the import/export routines (nothing for double, 32 for float).
+ 
+ */
+#define TEMPLATE_HB(T, SFX)                                                         \
+                                                                                    \
+/* n samples already in hb->e + 2q give 2n samples in out */                        \
+static void template_hbup##SFX(t_template_hb *hb, T *out, long n)                   \
+{                                                                                   \
+    long    q = hb->q;                                                              \
+    T       *in = hb->e##SFX + 2 * q;                                               \
+    long    p;                                                                      \
+                                                                                    \
+    for (p = 0; p < n; p++) {                                                       \
+        out[2 * p]     = 2 * template_hbdot##SFX(hb->g##SFX, in + p - 2 * q + 1, 2 * q); \
+        out[2 * p + 1] = in[p - q + 1];                                             \
+    }                                                                               \
+                                                                                    \
+    memmove(hb->e##SFX, hb->e##SFX + n, 2 * q * sizeof(T));                         \
+}                                                                                   \
+                                                                                    \
+/* 2n samples of v give n samples in y, y can be v */                               \
+static void template_hbdown##SFX(t_template_hb *hb, const T *v, T *y, long n)       \
+{                                                                                   \
+    long    q = hb->q;                                                              \
+    T       *e = hb->e##SFX + 2 * q;                                                \
+    T       *o = hb->o##SFX + q;                                                    \
+    long    p;                                                                      \
+                                                                                    \
+    for (p = 0; p < n; p++) {                                                       \
+        e[p] = v[2 * p];                                                            \
+        o[p] = v[2 * p + 1];                                                        \
+    }                                                                               \
+                                                                                    \
+    for (p = 0; p < n; p++)                                                         \
+        y[p] = template_hbdot##SFX(hb->g##SFX, e + p - 2 * q + 1, 2 * q) + (T)0.5 * o[p - q]; \
+                                                                                    \
+    memmove(hb->e##SFX, hb->e##SFX + n, 2 * q * sizeof(T));                         \
+    memmove(hb->o##SFX, hb->o##SFX + n, q * sizeof(T));                             \
+}                                                                                   \
+                                                                                    \
+/* n samples of in give n << stages samples in out, each stage writes in the input of the next one */ \
+static void template_upsample##SFX(t_template_hb *hb, long stages, const double *in, T *out, long n) \
+{                                                                                   \
+    long s;                                                                         \
+                                                                                    \
+    if (!stages) {                                                                  \
+        template_import##SFX(in, out, n);                                           \
+        return;                                                                     \
+    }                                                                               \
+    template_import##SFX(in, hb[0].e##SFX + 2 * hb[0].q, n);                        \
+                                                                                    \
+    for (s = 0; s < stages; s++, n *= 2)                                            \
+        template_hbup##SFX(hb + s, s == stages - 1 ? out : hb[s + 1].e##SFX + 2 * hb[s + 1].q, n); \
+}                                                                                   \
+                                                                                    \
+/* n << stages samples of in (decimated in place) give n samples in out */          \
+static void template_downsample##SFX(t_template_hb *hb, long stages, T *in, double *out, long n) \
+{                                                                                   \
+    long s;                                                                         \
+                                                                                    \
+    for (s = stages - 1; s >= 0; s--)                                               \
+        template_hbdown##SFX(hb + s, in, in, n << s);                               \
+                                                                                    \
+    template_export##SFX(in, out, n);                                               \
+}
+
+TEMPLATE_HB(double, )
+TEMPLATE_HB(float, 32)
+
+// the operators of both outlets at the higher rate
+static void template_process64_os(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+    t_template_perform perform;
+    long o;
+    
+    template_upsample(x->x_hbup[0], x->x_osstages, ins[0], x->x_osin[0], sampleframes);
+    if (x->x_ossig)
+        template_upsample(x->x_hbup[1], x->x_osstages, x->x_bridging ? template_bridge(x, sampleframes) : ins[1], x->x_osin[1], sampleframes);
+    
+    for (o = 0; o < 2; o++) {
+        perform = (t_template_perform)x->x_osperform[o];
+        if (!perform)
+            continue;
+        perform(x, dsp64, x->x_osin, numins, x->x_osout, numouts, sampleframes << x->x_osstages, flags, (void *)(t_ptr_int)o);
+        template_downsample(x->x_hbdown[o], x->x_osstages, x->x_osout[o], outs[o], sampleframes);
+    }
+}
 
+// same in float, with or without oversampling, the only conversions are in import and export
+static void template_process64_os32(t_template *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
+{
+    t_template_perform32 perform;
+    long o;
+    
+    template_upsample32(x->x_hbup[0], x->x_osstages, ins[0], x->x_osin32[0], sampleframes);
+    if (x->x_ossig)
+        template_upsample32(x->x_hbup[1], x->x_osstages, x->x_bridging ? template_bridge(x, sampleframes) : ins[1], x->x_osin32[1], sampleframes);
+    
+    for (o = 0; o < 2; o++) {
+        perform = (t_template_perform32)x->x_osperform[o];
+        if (!perform)
+            continue;
+        perform(x, x->x_osin32, x->x_osout32, sampleframes << x->x_osstages, o);
+        template_downsample32(x->x_hbdown[o], x->x_osstages, x->x_osout32[o], outs[o], sampleframes);
+    }
+}
+
+// the filter tails decay towards denormals : flushed to zero by the wrapper
+DENORMAL_PERFORM(template_perform64_os,   template_process64_os,   t_template, 0, 2)
+DENORMAL_PERFORM(template_perform64_os32, template_process64_os32, t_template, 0, 2)
+
+/*
+ 
+ Accuracy of the fast paths : every operator on the signals of accuracy.h (noise, DC, sine, denormals, NaN and
+ infinities) against a plain loop of its scalar expression, the SOP macro. Three kernels per operator :
+    double      template_perform64_<op>, the t_vd loop under flush-to-zero, R signal
+    scalar      template_perform64_<op>_scalar, R from the right inlet float
+    float32     template_perform32_<op> between simd_tofloat and simd_todouble, as in the float32 mode
+ The reference reads its inputs the way the kernel does : denormals are 0, and for float32 the inputs are rounded
+ to floats first, the bound measures the kernel and not the 24 bits of the mode. A NaN input leaves the output
+ undefined (see accuracy.h), it only has to be scrubbed.
+ The error is relative for outputs above 1, absolute below. Each line gives the max ULP, the max error and the
+ error to signal ratio of the worst signal, a kernel outside the bounds is reported as an error.
+ 
+ The length isn't a multiple of the vectors, the scalar tails run too. The kernels read x_val and x_k from a blank
+ instance, the audio thread keeps using this one.
+ 
+ */
+#define TEMPLATE_CHECKSIZE  4095
+#define TEMPLATE_CHECKK     0.75                ///<    k of the fused operators
+#define TEMPLATE_CHECKREL64 (4 * DBL_EPSILON)   ///<    0 unless the compiler fuses a * b + c in one of the two
+#define TEMPLATE_CHECKDB64  -250.
+#define TEMPLATE_CHECKREL32 (16 * FLT_EPSILON)  ///<    Each operation rounds once in float : a few FLT_EPSILON
+#define TEMPLATE_CHECKDB32  -120.
+
+enum {
+    CHECK_DOUBLE = 0,
+    CHECK_SCALAR,
+    CHECK_FLOAT32,
+    CHECK_KERNELS
+};
+
+// the reference : one operator, one sample, in double
+static double template_reference(long op, double a, double b, double c)
+{
+    switch (op) {
+        case OP_MUL:    return SOP_MUL(a, b, c);
+        case OP_ADD:    return SOP_ADD(a, b, c);
+        case OP_SUB:    return SOP_SUB(a, b, c);
+        case OP_DIV:    return SOP_DIV(a, b, c);
+        case OP_MIN:    return SOP_MIN(a, b, c);
+        case OP_MAX:    return SOP_MAX(a, b, c);
+        case OP_POW:    return SOP_POW(a, b, c);
+        case OP_CLIP:   return SOP_CLIP(a, b, c);
+        case OP_MADD:   return SOP_MADD(a, b, c);
+        default:        return SOP_ADDMUL(a, b, c);
+    }
+}
+
+void template_check(t_template *x)
+{
+    static const char   *names[CHECK_KERNELS] = { "double", "scalar", "float32" };
+    t_template          *y = (t_template *) sysmem_newptrclear(sizeof(t_template));
+    t_accuracy          acc;
+    t_denormal_state    state;
+    double              *ind[2], *outd[2], *ref;
+    float               *inf[2], *outf[2];
+    double              a, b, c;
+    uint32_t            seed;
+    long                op, kernel, kind, i, ch, single, failed, fails = 0;
+    
+    // one block : the reference, 2 inputs and 2 outputs in double, then in float
+    ref = (double *) sysmem_newptr(TEMPLATE_CHECKSIZE * (5 * sizeof(double) + 4 * sizeof(float)));
+    if (!y || !ref) {
+        object_error((t_object *)x, "check: out of memory");
+        if (y)
+            sysmem_freeptr(y);
+        if (ref)
+            sysmem_freeptr(ref);
+        return;
+    }
+    for (ch = 0; ch < 2; ch++) {
+        ind[ch]  = ref + (1 + ch) * TEMPLATE_CHECKSIZE;
+        outd[ch] = ref + (3 + ch) * TEMPLATE_CHECKSIZE;
+        inf[ch]  = (float *)(ref + 5 * TEMPLATE_CHECKSIZE) + ch * TEMPLATE_CHECKSIZE;
+        outf[ch] = (float *)(ref + 5 * TEMPLATE_CHECKSIZE) + (2 + ch) * TEMPLATE_CHECKSIZE;
+    }
+    y->x_k = TEMPLATE_CHECKK;
+    
+    for (op = 0; op < OP_COUNT; op++) {
+        for (kernel = 0; kernel < CHECK_KERNELS; kernel++) {
+            single = kernel == CHECK_FLOAT32;
+            accuracy_reset(&acc, 1., single);
+            seed = 0x9E3779B9;      // the same signals for every kernel
+            
+            for (kind = 0; kind < ACCURACY_KINDS; kind++) {
+                accuracy_signal(ind[0], TEMPLATE_CHECKSIZE, kind, 1., &seed);
+                accuracy_signal(ind[1], TEMPLATE_CHECKSIZE, kind, 1., &seed);
+                
+                switch (kernel) {
+                    case CHECK_DOUBLE:
+                        template_ops[op].sig(y, NULL, ind, 2, outd, 2, TEMPLATE_CHECKSIZE, 0, (void *)0);
+                        break;
+                    case CHECK_SCALAR:
+                        y->x_val = (t_float)ind[1][TEMPLATE_CHECKSIZE / 2];
+                        for (i = 0; i < TEMPLATE_CHECKSIZE; i++)
+                            ind[1][i] = y->x_val;
+                        template_ops[op].scalar(y, NULL, ind, 2, outd, 2, TEMPLATE_CHECKSIZE, 0, (void *)0);
+                        break;
+                    default:
+                        // under flush-to-zero as in template_perform64_os32, the conversions included
+                        state = denormal_enter();
+                        simd_tofloat(ind[0], inf[0], TEMPLATE_CHECKSIZE);
+                        simd_tofloat(ind[1], inf[1], TEMPLATE_CHECKSIZE);
+                        template_ops[op].sig32(y, inf, outf, TEMPLATE_CHECKSIZE, 0);
+                        simd_todouble(outf[0], outd[0], TEMPLATE_CHECKSIZE);
+                        denormal_leave(state);
+                        break;
+                }
+                
+                c = single ? (float)y->x_k : y->x_k;
+                for (i = 0; i < TEMPLATE_CHECKSIZE; i++) {
+                    a = single ? (float)ind[0][i] : ind[0][i];
+                    b = single ? (float)ind[1][i] : ind[1][i];
+                    ref[i] = isnan(a) || isnan(b) ? NAN : template_reference(op, accuracy_daz(a, single), accuracy_daz(b, single), c);
+                }
+                accuracy_add(&acc, ref, outd[0], TEMPLATE_CHECKSIZE);
+            }
+            
+            failed = accuracy_fails(&acc, single ? TEMPLATE_CHECKREL32 : TEMPLATE_CHECKREL64, single ? TEMPLATE_CHECKDB32 : TEMPLATE_CHECKDB64);
+            fails += failed;
+            object_post((t_object *)x, "check %-18s %-7s %8g ulp, error %-12g %7.1f dB%s%s", template_ops[op].desc, names[kernel],
+                        acc.maxulp, acc.maxrel, acc.db, acc.special ? ", NaN/inf mismatch" : "", failed ? " (above bound)" : "");
+        }
+    }
+    
+    if (fails)
+        object_error((t_object *)x, "check: %ld kernel(s) above bounds", fails);
+    else
+        object_post((t_object *)x, "check : %ld kernels within bounds", (long)(OP_COUNT * CHECK_KERNELS));
+    
+    sysmem_freeptr(y);
+    sysmem_freeptr(ref);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Additional Routines
+//____________________________________________________________________
 
@@ -0,0 +1,1607 @@
+/**
+ *
+ *  @file	host.c
+ *
+ *
+ *  Sources :
+ *
+ *   Cylcing 74'
+ *    - Max 7.1 API :
+ *          https://cycling74.com/sdk/MaxSDK-6.0.4/html/index.html
+ *
+ *
+ *  Offline renderer : the stand-in for Max (see host.h).
+ *
+ *  Every routine of include/ is implemented here, as far as the templates need it :
+ *
+ *      classes         methods and attributes are kept in tables, messages are dispatched by selector
+ *      attributes      @name arguments and attribute messages, with the enum, clip and setter of the class
+ *      outlets         signal outlets are counted, control outlets write to the event file (see render.c)
+ *      clocks, qelems  run by the instance's logical clock, after the vector that makes them due
+ *      threads         pthreads, offline_settle waits for the ones an instance started
+ *      buffer~         sound files loaded by offline_loadbuffer
+ *      files           stdio, names relative to the working directory
+ *      Jitter          no matrix is ever found
+ *
+ */
+
+#include <stdarg.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "ext.h"
+#include "ext_obex.h"
+#include "z_dsp.h"
+#include "ext_atomic.h"
+#include "ext_systhread.h"
+#include "ext_buffer.h"
+#include "ext_path.h"
+#include "jit.common.h"
+
+#include "host.h"
+#include "wav.h"
+
+#define OFFLINE_MAXMETHODS  64      ///<    Messages of a class
+#define OFFLINE_MAXATTRS    64      ///<    Attributes of a class
+#define OFFLINE_MAXARGS     4       ///<    Typed arguments of a method, A_GIMME has no limit
+#define OFFLINE_MAXATOMS    256     ///<    Atoms of a message or an attribute value
+#define OFFLINE_MAXPERFORMS 16      ///<    Perform routines added by one dsp64
+#define OFFLINE_SYMBOLS     1024    ///<    Buckets of the symbol table
+
+
+
+
+
+//____________________________________________________________________
+//                          Host Structures
+//____________________________________________________________________
+
+typedef struct _offline_method
+{
+    t_symbol    *m_sym;
+    method      m_fn;
+    short       m_types[OFFLINE_MAXARGS];   ///<    A_GIMME in m_types[0], or up to 4 typed arguments
+    long        m_ntypes;
+} t_offline_method;
+
+typedef struct _offline_attr
+{
+    t_symbol    *a_sym;
+    t_symbol    *a_type;        ///<    long, float64 or symbol
+    long        a_flags;
+    t_ptr_int   a_offset;
+    method      a_set;
+    char        a_enum[256];    ///<    Space separated names, enumindex maps a name to its index
+    long        a_enumindex;
+    double      a_min;
+    double      a_max;
+    long        a_clip;         ///<    1 min, 2 max
+} t_offline_attr;
+
+struct _class
+{
+    const char          *c_name;
+    method              c_new;
+    method              c_free;
+    long                c_size;
+    long                c_dsp;
+    t_offline_method    c_methods[OFFLINE_MAXMETHODS];
+    long                c_nmethods;
+    t_offline_attr      c_attrs[OFFLINE_MAXATTRS];
+    long                c_nattrs;
+    struct _class       *c_next;
+};
+
+typedef void (*t_offline_perform)(t_object *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts,
+                                  long sampleframes, long flags, void *userparam);
+
+typedef struct _offline_clock       ///<    A clock or a qelem
+{
+    t_object                ob;
+    t_offline               *o;
+    void                    *owner;
+    method                  fn;
+    double                  when;       ///<    Logical time it is due, ms
+    long                    pending;
+    long                    armed;      ///<    o->armed when it was set, one run doesn't fire what it sets
+    struct _offline_clock   *next;
+} t_offline_clock;
+
+typedef struct _offline_outlet     ///<    Freed with the instance
+{
+    t_object                ob;
+    t_offline               *o;
+    long                    order;      ///<    Creation order, Max creates the outlets right to left
+    struct _offline_outlet  *next;
+} t_offline_outlet;
+
+typedef struct _offline_thread
+{
+    pthread_t   t;
+    method      fn;
+    void        *arg;
+    t_offline   *o;
+} t_offline_thread;
+
+typedef struct _buffer_obj          ///<    A sound file standing for a buffer~
+{
+    t_object            ob;
+    t_symbol            *name;
+    float               *samples;       ///<    Interleaved
+    long                frames;
+    long                channels;
+    double              sr;
+    struct _buffer_obj  *next;
+} t_offline_buffer;
+
+struct _buffer_ref
+{
+    t_object    ob;
+    t_symbol    *name;
+};
+
+struct _offline
+{
+    t_class             *c;
+    t_object            *x;
+    const char          *label;     ///<    Prefix of the posts, the input file
+    double              sr;
+    long                vs;
+
+    pthread_mutex_t     lock;       ///<    Time, clocks and threads, they are touched by the audio and worker threads
+    pthread_cond_t      idle;       ///<    Signaled when a thread ends
+    long long           samples;    ///<    Logical time
+    double              now;        ///<    Logical time, ms
+    t_offline_clock     *clocks;
+    long                armed;      ///<    Clocks set since the instance exists
+    long                threads;    ///<    Threads started and not ended
+    t_int32_atomic      errors;     ///<    object_error and error posts, from any thread
+
+    long                inlet;      ///<    Inlet of the message being sent, for proxy_getinlet
+    long                nsigin;
+    long                nsigout;
+    long                noutlets;   ///<    Signal and control
+    t_offline_outlet    *outlets;
+    FILE                *events;
+
+    t_offline_perform   perform[OFFLINE_MAXPERFORMS];
+    void                *userparam[OFFLINE_MAXPERFORMS];
+    long                nperform;
+    long                connected;
+    double              *zeros;     ///<    Input of the inlets without a signal
+    double              **ins;
+};
+
+static pthread_mutex_t  offline_mainlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t  offline_symlock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t  offline_critical;                   ///<    critical_enter, recursive like Max's
+static __thread t_offline *offline_current = NULL;     ///<    Instance being run by this thread
+
+static t_class          *offline_classes = NULL;
+static t_offline_buffer *offline_buffers = NULL;
+
+static t_class          offline_clockclass;
+static t_class          offline_outletclass;
+static t_class          offline_bufrefclass;
+static t_class          offline_dspclass;
+static t_object         offline_dspchain = { &offline_dspclass };
+
+t_symbol *_jit_sym_lock, *_jit_sym_getinfo, *_jit_sym_getdata, *_jit_sym_float32, *_jit_sym_float64, *_jit_sym_char, *_jit_sym_long;
+
+void offline_clockfree(t_offline_clock *c);
+void offline_run(t_offline *o);
+void offline_vpost(t_object *x, const char *kind, const char *fmt, va_list args);
+
+
+
+
+
+//____________________________________________________________________
+//                              Setup
+//____________________________________________________________________
+
+void offline_init(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&offline_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    offline_clockclass.c_name   = "clock";
+    offline_clockclass.c_free   = (method)offline_clockfree;
+    offline_outletclass.c_name  = "outlet";
+    offline_bufrefclass.c_name  = "buffer_ref";
+    offline_dspclass.c_name     = "dspchain";
+
+    _jit_sym_lock    = gensym("lock");
+    _jit_sym_getinfo = gensym("getinfo");
+    _jit_sym_getdata = gensym("getdata");
+    _jit_sym_float32 = gensym("float32");
+    _jit_sym_float64 = gensym("float64");
+    _jit_sym_char    = gensym("char");
+    _jit_sym_long    = gensym("long");
+}
+
+// loads a sound file as the buffer~ name, returns non zero if it can't be read
+long offline_loadbuffer(const char *name, const char *path)
+{
+    t_offline_buffer    *b;
+    t_wav               w;
+    double              **chans = NULL;
+    long                i, c, n, done = 0;
+
+    if (wav_open(&w, path))
+        return 1;
+
+    b = (t_offline_buffer *) calloc(1, sizeof(t_offline_buffer));
+    chans = (double **) calloc((size_t)w.channels, sizeof(double *));
+    if (!b || !chans)
+        goto fail;
+    b->samples = (float *) malloc(sizeof(float) * (w.frames * w.channels + 1));
+    for (c = 0; c < w.channels; c++)
+        if (!(chans[c] = (double *) malloc(sizeof(double) * 4096)))
+            goto fail;
+    if (!b->samples)
+        goto fail;
+
+    while ((n = wav_read(&w, chans, 4096)) > 0) {
+        for (i = 0; i < n; i++)
+            for (c = 0; c < w.channels; c++)
+                b->samples[(done + i) * w.channels + c] = (float) chans[c][i];
+        done += n;
+    }
+
+    b->ob.o_class = &offline_bufrefclass;
+    b->name = gensym(name);
+    b->frames = done;
+    b->channels = w.channels;
+    b->sr = w.sr;
+    b->next = offline_buffers;
+    offline_buffers = b;
+
+    for (c = 0; c < w.channels; c++)
+        free(chans[c]);
+    free(chans);
+    wav_close(&w);
+    return 0;
+
+fail:
+    if (chans)
+        for (c = 0; c < w.channels; c++)
+            free(chans[c]);
+    free(chans);
+    if (b)
+        free(b->samples);
+    free(b);
+    wav_close(&w);
+    return 1;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Symbols and Text
+//____________________________________________________________________
+
+typedef struct _offline_symbol
+{
+    t_symbol                s;
+    struct _offline_symbol  *next;
+} t_offline_symbol;
+
+t_symbol *gensym(C74_CONST char *s)
+{
+    static t_offline_symbol *table[OFFLINE_SYMBOLS];
+    t_offline_symbol        *sym;
+    unsigned long           h = 5381;
+    const char              *p;
+
+    for (p = s; *p; p++)
+        h = h * 33 + (unsigned char)*p;
+    h %= OFFLINE_SYMBOLS;
+
+    pthread_mutex_lock(&offline_symlock);
+    for (sym = table[h]; sym; sym = sym->next)
+        if (!strcmp(sym->s.s_name, s))
+            break;
+    if (!sym && (sym = (t_offline_symbol *) calloc(1, sizeof(t_offline_symbol)))) {
+        sym->s.s_name = strdup(s);
+        sym->next = table[h];
+        table[h] = sym;
+    }
+    pthread_mutex_unlock(&offline_symlock);
+
+    return sym ? &sym->s : NULL;
+}
+
+// splits text in atoms the way a message box would, numbers are longs or floats, the rest symbols
+long offline_parse(const char *text, t_atom *av, long maxatoms)
+{
+    char        word[MAX_PATH_CHARS];
+    char        *end;
+    long        ac = 0, n;
+    double      f;
+    t_atom_long l;
+
+    while (*text && ac < maxatoms) {
+        while (*text == ' ' || *text == '\t')
+            text++;
+        if (!*text)
+            break;
+        // as in a box, the commas and semicolons are atoms of their own
+        if (*text == ',' || *text == ';') {
+            av[ac++].a_type = *text++ == ',' ? A_COMMA : A_SEMI;
+            continue;
+        }
+        for (n = 0; text[n] && text[n] != ' ' && text[n] != '\t' && text[n] != ',' && text[n] != ';'; n++)
+            ;
+        if (n >= MAX_PATH_CHARS)
+            n = MAX_PATH_CHARS - 1;
+        memcpy(word, text, (size_t)n);
+        word[n] = 0;
+        text += n;
+
+        l = strtol(word, &end, 10);
+        if (!*end) {
+            atom_setlong(av + ac++, l);
+            continue;
+        }
+        f = strtod(word, &end);
+        if (!*end)
+            atom_setfloat(av + ac++, f);
+        else
+            atom_setsym(av + ac++, gensym(word));
+    }
+    return ac;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Posts
+//____________________________________________________________________
+
+// one write per line, the lines of the threads don't mix
+void offline_vpost(t_object *x, const char *kind, const char *fmt, va_list args)
+{
+    char        line[2048];
+    t_offline   *o = offline_current;
+    int         n;
+
+    n = snprintf(line, sizeof(line), "%s%s%s%s%s", o ? o->label : "", o && *o->label ? ": " : "",
+                 x ? x->o_class->c_name : "", x ? ": " : "", kind);
+    if (n < 0 || n >= (int)sizeof(line))
+        n = 0;
+    vsnprintf(line + n, sizeof(line) - n, fmt, args);
+    fprintf(stderr, "%s\n", line);
+}
+
+void post(C74_CONST char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    offline_vpost(NULL, "", fmt, args);
+    va_end(args);
+}
+
+void error(C74_CONST char *fmt, ...)
+{
+    va_list args;
+
+    if (offline_current)
+        ATOMIC_INCREMENT(&offline_current->errors);
+    va_start(args, fmt);
+    offline_vpost(NULL, "error: ", fmt, args);
+    va_end(args);
+}
+
+void object_post(t_object *x, C74_CONST char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    offline_vpost(x, "", fmt, args);
+    va_end(args);
+}
+
+void object_error(t_object *x, C74_CONST char *fmt, ...)
+{
+    va_list args;
+
+    if (offline_current)
+        ATOMIC_INCREMENT(&offline_current->errors);
+    va_start(args, fmt);
+    offline_vpost(x, "error: ", fmt, args);
+    va_end(args);
+}
+
+void object_warn(t_object *x, C74_CONST char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    offline_vpost(x, "warning: ", fmt, args);
+    va_end(args);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Classes and Objects
+//____________________________________________________________________
+
+t_class *class_new(C74_CONST char *name, C74_CONST method mnew, C74_CONST method mfree, long size, C74_CONST method mmenu, short type, ...)
+{
+    t_class *c = (t_class *) calloc(1, sizeof(t_class));
+
+    if (!c)
+        return NULL;
+    c->c_name = strdup(name);
+    c->c_new  = mnew;
+    c->c_free = mfree;
+    c->c_size = size;
+    return c;
+}
+
+// a message added twice keeps the last method, as in Max
+t_max_err class_addmethod(t_class *c, C74_CONST method m, C74_CONST char *name, ...)
+{
+    t_offline_method    *me = NULL;
+    t_symbol            *s = gensym(name);
+    va_list             args;
+    long                i, type;
+
+    for (i = 0; i < c->c_nmethods; i++)
+        if (c->c_methods[i].m_sym == s)
+            me = c->c_methods + i;
+    if (!me) {
+        if (c->c_nmethods == OFFLINE_MAXMETHODS)
+            return MAX_ERR_GENERIC;
+        me = c->c_methods + c->c_nmethods++;
+    }
+
+    me->m_sym = s;
+    me->m_fn = m;
+    me->m_ntypes = 0;
+    va_start(args, name);
+    while ((type = va_arg(args, int)) != A_NOTHING && me->m_ntypes < OFFLINE_MAXARGS)
+        me->m_types[me->m_ntypes++] = (short)type;
+    va_end(args);
+
+    return MAX_ERR_NONE;
+}
+
+t_max_err class_register(t_symbol *name_space, t_class *c)
+{
+    c->c_next = offline_classes;
+    offline_classes = c;
+    return MAX_ERR_NONE;
+}
+
+void class_dspinit(t_class *c)
+{
+    c->c_dsp = 1;
+}
+
+t_class *offline_findclass(const char *name)
+{
+    t_class *c;
+
+    for (c = offline_classes; c; c = c->c_next)
+        if (!strcmp(c->c_name, name))
+            return c;
+    return NULL;
+}
+
+static t_offline_method *offline_findmethod(t_class *c, t_symbol *s)
+{
+    long i;
+
+    for (i = 0; i < c->c_nmethods; i++)
+        if (c->c_methods[i].m_sym == s)
+            return c->c_methods + i;
+    return NULL;
+}
+
+void *object_alloc(t_class *c)
+{
+    t_object *x = (t_object *) calloc(1, (size_t)c->c_size);
+
+    if (x)
+        x->o_class = c;
+    return x;
+}
+
+// the free method of the class, then the memory, as in Max
+t_max_err object_free(void *x)
+{
+    t_class *c;
+
+    if (!x)
+        return MAX_ERR_INVALID_PTR;
+    c = ((t_object *)x)->o_class;
+    if (c->c_free)
+        ((void (*)(void *)) c->c_free)(x);
+    free(x);
+    return MAX_ERR_NONE;
+}
+
+// A_CANT messages (dsp_add64 to the DSP chain, dsp64, assist...), up to 6 pointer sized arguments
+void *object_method(void *x, t_symbol *s, ...)
+{
+    t_offline_method    *me;
+    t_offline           *o = offline_current;
+    va_list             args;
+    void                *a[6];
+    long                i;
+
+    va_start(args, s);
+    for (i = 0; i < 6; i++)
+        a[i] = va_arg(args, void *);
+    va_end(args);
+
+    if (((t_object *)x)->o_class == &offline_dspclass) {
+        if (o && s == gensym("dsp_add64") && o->nperform < OFFLINE_MAXPERFORMS) {
+            o->perform[o->nperform] = (t_offline_perform) a[1];
+            o->userparam[o->nperform++] = a[3];
+        }
+        return NULL;
+    }
+
+    me = offline_findmethod(((t_object *)x)->o_class, s);
+    if (!me)
+        return NULL;
+    return ((void *(*)(void *, void *, void *, void *, void *, void *, void *)) me->m_fn)(x, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+// typed arguments are converted, the missing ones are 0 or the empty symbol
+static t_max_err offline_call(t_object *x, t_offline_method *me, t_symbol *s, long argc, t_atom *argv)
+{
+    t_ptr_int   a[OFFLINE_MAXARGS] = { 0 };
+    double      f = 0.;
+    long        i, floats = 0;
+
+    if (me->m_ntypes && me->m_types[0] == A_GIMME) {
+        ((void (*)(t_object *, t_symbol *, long, t_atom *)) me->m_fn)(x, s, argc, argv);
+        return MAX_ERR_NONE;
+    }
+
+    for (i = 0; i < me->m_ntypes; i++) {
+        switch (me->m_types[i]) {
+            case A_LONG:
+            case A_DEFLONG:
+                a[i] = i < argc ? (t_ptr_int) atom_getlong(argv + i) : 0;
+                break;
+            case A_FLOAT:
+            case A_DEFFLOAT:
+                f = i < argc ? atom_getfloat(argv + i) : 0.;
+                floats++;
+                break;
+            case A_SYM:
+            case A_DEFSYM:
+                if (i < argc && atom_gettype(argv + i) != A_SYM)
+                    return MAX_ERR_GENERIC;
+                a[i] = (t_ptr_int)(i < argc ? atom_getsym(argv + i) : gensym(""));
+                break;
+            default:
+                return MAX_ERR_GENERIC;     // A_CANT, not a message
+        }
+    }
+
+    // the methods of the templates take either integers and symbols, or a single float
+    if (floats) {
+        if (me->m_ntypes != 1)
+            return MAX_ERR_GENERIC;
+        ((void (*)(t_object *, double)) me->m_fn)(x, f);
+        return MAX_ERR_NONE;
+    }
+    switch (me->m_ntypes) {
+        case 0: ((void (*)(t_object *)) me->m_fn)(x); break;
+        case 1: ((void (*)(t_object *, t_ptr_int)) me->m_fn)(x, a[0]); break;
+        case 2: ((void (*)(t_object *, t_ptr_int, t_ptr_int)) me->m_fn)(x, a[0], a[1]); break;
+        case 3: ((void (*)(t_object *, t_ptr_int, t_ptr_int, t_ptr_int)) me->m_fn)(x, a[0], a[1], a[2]); break;
+        default: ((void (*)(t_object *, t_ptr_int, t_ptr_int, t_ptr_int, t_ptr_int)) me->m_fn)(x, a[0], a[1], a[2], a[3]); break;
+    }
+    return MAX_ERR_NONE;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Attributes
+//____________________________________________________________________
+
+static t_offline_attr *offline_findattr(t_class *c, t_symbol *s)
+{
+    long i;
+
+    for (i = 0; i < c->c_nattrs; i++)
+        if (c->c_attrs[i].a_sym == s)
+            return c->c_attrs + i;
+    return NULL;
+}
+
+t_max_err offline_attr_new(t_class *c, C74_CONST char *name, t_symbol *type, long flags, t_ptr_int offset)
+{
+    t_offline_attr *a = offline_findattr(c, gensym(name));
+
+    if (!a) {
+        if (c->c_nattrs == OFFLINE_MAXATTRS)
+            return MAX_ERR_GENERIC;
+        a = c->c_attrs + c->c_nattrs++;
+    }
+    memset(a, 0, sizeof(t_offline_attr));
+    a->a_sym = gensym(name);
+    a->a_type = type;
+    a->a_flags = flags;
+    a->a_offset = offset;
+    return MAX_ERR_NONE;
+}
+
+t_max_err offline_attr_enum(t_class *c, C74_CONST char *name, C74_CONST char *list, long index)
+{
+    t_offline_attr *a = offline_findattr(c, gensym(name));
+
+    if (!a)
+        return MAX_ERR_GENERIC;
+    strncpy_zero(a->a_enum, list, sizeof(a->a_enum));
+    a->a_enumindex = index;
+    return MAX_ERR_NONE;
+}
+
+t_max_err offline_attr_clip(t_class *c, C74_CONST char *name, double min, double max, long which)
+{
+    t_offline_attr *a = offline_findattr(c, gensym(name));
+
+    if (!a)
+        return MAX_ERR_GENERIC;
+    if (which & 1)
+        a->a_min = min;
+    if (which & 2)
+        a->a_max = max;
+    a->a_clip |= which;
+    return MAX_ERR_NONE;
+}
+
+t_max_err offline_attr_accessors(t_class *c, C74_CONST char *name, method get, method set)
+{
+    t_offline_attr *a = offline_findattr(c, gensym(name));
+
+    if (!a)
+        return MAX_ERR_GENERIC;
+    a->a_set = set;
+    return MAX_ERR_NONE;
+}
+
+// enum names become their index, numbers are clipped, then the setter or a plain store
+static t_max_err offline_attr_set(t_object *x, t_offline_attr *a, long argc, t_atom *argv)
+{
+    t_atom      av[OFFLINE_MAXATOMS];
+    char        list[256], *name, *next;
+    long        i, index;
+    double      f;
+
+    if (a->a_flags & (ATTR_SET_OPAQUE | ATTR_SET_OPAQUE_USER)) {
+        object_error(x, "%s is read only", a->a_sym->s_name);
+        return MAX_ERR_GENERIC;
+    }
+    if (argc > OFFLINE_MAXATOMS)
+        argc = OFFLINE_MAXATOMS;
+
+    for (i = 0; i < argc; i++) {
+        av[i] = argv[i];
+        if (a->a_enumindex && atom_gettype(av + i) == A_SYM) {
+            strncpy_zero(list, a->a_enum, sizeof(list));
+            for (index = 0, name = strtok_r(list, " ", &next); name; index++, name = strtok_r(NULL, " ", &next))
+                if (!strcmp(name, atom_getsym(av + i)->s_name))
+                    break;
+            if (!name) {
+                object_error(x, "%s: unknown value %s", a->a_sym->s_name, atom_getsym(av + i)->s_name);
+                return MAX_ERR_GENERIC;
+            }
+            atom_setlong(av + i, index);
+        }
+        if (a->a_clip && atom_gettype(av + i) != A_SYM) {
+            f = atom_getfloat(av + i);
+            if ((a->a_clip & 1) && f < a->a_min)
+                f = a->a_min;
+            if ((a->a_clip & 2) && f > a->a_max)
+                f = a->a_max;
+            if (atom_gettype(av + i) == A_LONG)
+                atom_setlong(av + i, (t_atom_long) f);
+            else
+                atom_setfloat(av + i, f);
+        }
+    }
+
+    if (a->a_set)
+        return ((t_max_err (*)(t_object *, void *, long, t_atom *)) a->a_set)(x, a, argc, av);
+
+    if (!argc)
+        return MAX_ERR_GENERIC;
+    if (a->a_type == gensym("long"))
+        *(long *)((char *)x + a->a_offset) = (long) atom_getlong(av);
+    else if (a->a_type == gensym("float64"))
+        *(double *)((char *)x + a->a_offset) = atom_getfloat(av);
+    else if (atom_gettype(av) == A_SYM)
+        *(t_symbol **)((char *)x + a->a_offset) = atom_getsym(av);
+    else
+        return MAX_ERR_GENERIC;
+    return MAX_ERR_NONE;
+}
+
+void attr_args_process(void *x, short ac, t_atom *av)
+{
+    t_offline_attr  *a;
+    t_symbol        *s;
+    long            i, n;
+
+    for (i = 0; i < ac; i += n) {
+        n = 1;
+        if (atom_gettype(av + i) != A_SYM || atom_getsym(av + i)->s_name[0] != '@')
+            continue;
+        s = atom_getsym(av + i);
+        while (i + n < ac && !(atom_gettype(av + i + n) == A_SYM && atom_getsym(av + i + n)->s_name[0] == '@'))
+            n++;
+        a = offline_findattr(((t_object *)x)->o_class, gensym(s->s_name + 1));
+        if (a)
+            offline_attr_set((t_object *)x, a, n - 1, av + i + 1);
+        else
+            object_error((t_object *)x, "no attribute %s", s->s_name + 1);
+    }
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Atoms
+//____________________________________________________________________
+
+t_atom_long atom_getlong(C74_CONST t_atom *a)
+{
+    return a->a_type == A_LONG ? a->a_w.w_long : a->a_type == A_FLOAT ? (t_atom_long) a->a_w.w_float : 0;
+}
+
+t_atom_float atom_getfloat(C74_CONST t_atom *a)
+{
+    return a->a_type == A_FLOAT ? a->a_w.w_float : a->a_type == A_LONG ? (t_atom_float) a->a_w.w_long : 0.;
+}
+
+t_symbol *atom_getsym(C74_CONST t_atom *a)
+{
+    return a->a_type == A_SYM ? a->a_w.w_sym : gensym("");
+}
+
+long atom_gettype(C74_CONST t_atom *a)
+{
+    return a->a_type;
+}
+
+t_max_err atom_setlong(t_atom *a, t_atom_long b)
+{
+    a->a_type = A_LONG;
+    a->a_w.w_long = b;
+    return MAX_ERR_NONE;
+}
+
+t_max_err atom_setfloat(t_atom *a, double b)
+{
+    a->a_type = A_FLOAT;
+    a->a_w.w_float = b;
+    return MAX_ERR_NONE;
+}
+
+t_max_err atom_setsym(t_atom *a, t_symbol *b)
+{
+    a->a_type = A_SYM;
+    a->a_w.w_sym = b;
+    return MAX_ERR_NONE;
+}
+
+t_max_err atom_arg_getlong(t_atom_long *c, long idx, long ac, C74_CONST t_atom *av)
+{
+    if (idx >= ac || (av[idx].a_type != A_LONG && av[idx].a_type != A_FLOAT))
+        return MAX_ERR_GENERIC;
+    *c = atom_getlong(av + idx);
+    return MAX_ERR_NONE;
+}
+
+t_max_err atom_arg_getdouble(double *c, long idx, long ac, C74_CONST t_atom *av)
+{
+    if (idx >= ac || (av[idx].a_type != A_LONG && av[idx].a_type != A_FLOAT))
+        return MAX_ERR_GENERIC;
+    *c = atom_getfloat(av + idx);
+    return MAX_ERR_NONE;
+}
+
+t_max_err atom_arg_getsym(t_symbol **c, long idx, long ac, C74_CONST t_atom *av)
+{
+    if (idx >= ac || av[idx].a_type != A_SYM)
+        return MAX_ERR_GENERIC;
+    *c = atom_getsym(av + idx);
+    return MAX_ERR_NONE;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Memory
+//____________________________________________________________________
+
+void *sysmem_newptr(long size)
+{
+    return malloc((size_t)size);
+}
+
+void *sysmem_newptrclear(long size)
+{
+    return calloc(1, (size_t)size);
+}
+
+void *sysmem_resizeptr(void *ptr, long newsize)
+{
+    return realloc(ptr, (size_t)newsize);
+}
+
+void sysmem_freeptr(void *ptr)
+{
+    free(ptr);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Outlets
+//____________________________________________________________________
+
+void *outlet_new(void *x, C74_CONST char *s)
+{
+    t_offline           *o = offline_current;
+    t_offline_outlet    *out;
+
+    if (!o || !(out = (t_offline_outlet *) calloc(1, sizeof(t_offline_outlet))))
+        return NULL;
+    out->ob.o_class = &offline_outletclass;
+    out->o = o;
+    out->order = o->noutlets++;
+    out->next = o->outlets;
+    o->outlets = out;
+    if (s && !strcmp(s, "signal"))
+        o->nsigout++;
+    return out;
+}
+
+void *floatout(void *x)     { return outlet_new(x, NULL); }
+void *intout(void *x)       { return outlet_new(x, NULL); }
+void *listout(void *x)      { return outlet_new(x, NULL); }
+void *bangout(void *x)      { return outlet_new(x, NULL); }
+
+// one line per message : time (ms), outlet (from the left), message
+static void offline_outlet(void *p, t_symbol *s, long ac, t_atom *av)
+{
+    t_offline_outlet    *out = (t_offline_outlet *)p;
+    t_offline           *o;
+    long                i;
+
+    if (!out || !(o = out->o)->events)
+        return;
+
+    fprintf(o->events, "%.3f\t%ld\t%s", o->now, o->noutlets - 1 - out->order, s->s_name);
+    for (i = 0; i < ac; i++) {
+        switch (atom_gettype(av + i)) {
+            case A_LONG:    fprintf(o->events, " %ld", (long) atom_getlong(av + i)); break;
+            case A_FLOAT:   fprintf(o->events, " %.9g", atom_getfloat(av + i)); break;
+            default:        fprintf(o->events, " %s", atom_getsym(av + i)->s_name); break;
+        }
+    }
+    fputc('\n', o->events);
+}
+
+void *outlet_bang(void *o)
+{
+    offline_outlet(o, gensym("bang"), 0, NULL);
+    return NULL;
+}
+
+void *outlet_int(void *o, t_atom_long n)
+{
+    t_atom a;
+
+    atom_setlong(&a, n);
+    offline_outlet(o, gensym("int"), 1, &a);
+    return NULL;
+}
+
+void *outlet_float(void *o, double f)
+{
+    t_atom a;
+
+    atom_setfloat(&a, f);
+    offline_outlet(o, gensym("float"), 1, &a);
+    return NULL;
+}
+
+void *outlet_list(void *o, t_symbol *s, short ac, t_atom *av)
+{
+    offline_outlet(o, gensym("list"), ac, av);
+    return NULL;
+}
+
+void *outlet_anything(void *o, t_symbol *s, short ac, t_atom *av)
+{
+    offline_outlet(o, s, ac, av);
+    return NULL;
+}
+
+long proxy_getinlet(t_object *master)
+{
+    return offline_current ? offline_current->inlet : 0;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                          Clocks and Qelems
+//____________________________________________________________________
+/*
+
+ A clock is due at its logical time, a qelem right away. Both run after the vector during which
+ they were set (see offline_run), under the main lock, like the scheduler and the main thread of Max.
+
+ */
+
+void *clock_new(void *obj, method fn)
+{
+    t_offline       *o = offline_current;
+    t_offline_clock *c;
+
+    if (!o || !(c = (t_offline_clock *) calloc(1, sizeof(t_offline_clock))))
+        return NULL;
+    c->ob.o_class = &offline_clockclass;
+    c->o = o;
+    c->owner = obj;
+    c->fn = fn;
+    pthread_mutex_lock(&o->lock);
+    c->next = o->clocks;
+    o->clocks = c;
+    pthread_mutex_unlock(&o->lock);
+    return c;
+}
+
+void offline_clockfree(t_offline_clock *c)
+{
+    t_offline_clock **p;
+
+    pthread_mutex_lock(&c->o->lock);
+    for (p = &c->o->clocks; *p; p = &(*p)->next) {
+        if (*p == c) {
+            *p = c->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&c->o->lock);
+}
+
+void clock_fdelay(void *x, double t)
+{
+    t_offline_clock *c = (t_offline_clock *)x;
+
+    if (!c)
+        return;
+    pthread_mutex_lock(&c->o->lock);
+    c->when = c->o->now + (t > 0. ? t : 0.);
+    c->pending = 1;
+    c->armed = ++c->o->armed;
+    pthread_mutex_unlock(&c->o->lock);
+}
+
+void clock_delay(void *x, long n)
+{
+    clock_fdelay(x, (double)n);
+}
+
+void clock_unset(void *x)
+{
+    t_offline_clock *c = (t_offline_clock *)x;
+
+    if (!c)
+        return;
+    pthread_mutex_lock(&c->o->lock);
+    c->pending = 0;
+    pthread_mutex_unlock(&c->o->lock);
+}
+
+void clock_getftime(double *time)
+{
+    t_offline *o = offline_current;
+
+    if (!o) {
+        *time = 0.;
+        return;
+    }
+    pthread_mutex_lock(&o->lock);
+    *time = o->now;
+    pthread_mutex_unlock(&o->lock);
+}
+
+void *qelem_new(void *obj, method fn)
+{
+    return clock_new(obj, fn);
+}
+
+void qelem_set(void *q)
+{
+    clock_fdelay(q, 0.);
+}
+
+void qelem_unset(void *q)
+{
+    clock_unset(q);
+}
+
+void qelem_free(void *q)
+{
+    object_free(q);
+}
+
+void critical_enter(t_critical x)
+{
+    pthread_mutex_lock(&offline_critical);
+}
+
+void critical_exit(t_critical x)
+{
+    pthread_mutex_unlock(&offline_critical);
+}
+
+// fires the due clocks, earliest first, the ones they set run after the next vector
+void offline_run(t_offline *o)
+{
+    t_offline_clock *c, *due;
+    long            armed;
+
+    pthread_mutex_lock(&o->lock);
+    armed = o->armed;
+    for (;;) {
+        due = NULL;
+        for (c = o->clocks; c; c = c->next)
+            if (c->pending && c->when <= o->now && c->armed <= armed && (!due || c->when < due->when))
+                due = c;
+        if (!due)
+            break;
+        due->pending = 0;
+        pthread_mutex_unlock(&o->lock);
+
+        pthread_mutex_lock(&offline_mainlock);
+        ((void (*)(void *)) due->fn)(due->owner);
+        pthread_mutex_unlock(&offline_mainlock);
+
+        pthread_mutex_lock(&o->lock);
+    }
+    pthread_mutex_unlock(&o->lock);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Threads
+//____________________________________________________________________
+
+static void offline_threadend(void *p)
+{
+    t_offline *o = (t_offline *)p;
+
+    pthread_mutex_lock(&o->lock);
+    o->threads--;
+    pthread_cond_broadcast(&o->idle);
+    pthread_mutex_unlock(&o->lock);
+}
+
+// runs in the new thread, which belongs to the instance that started it
+static void *offline_thread(void *p)
+{
+    t_offline_thread *t = (t_offline_thread *)p;
+
+    offline_current = t->o;
+    pthread_cleanup_push(offline_threadend, t->o);
+    ((void *(*)(void *)) t->fn)(t->arg);
+    pthread_cleanup_pop(1);
+    return NULL;
+}
+
+long systhread_create(method entryproc, void *arg, long stacksize, long priority, long flags, t_systhread *thread)
+{
+    t_offline_thread    *t = (t_offline_thread *) calloc(1, sizeof(t_offline_thread));
+    t_offline           *o = offline_current;
+
+    if (!t || !o) {
+        free(t);
+        return 1;
+    }
+    t->fn = entryproc;
+    t->arg = arg;
+    t->o = o;
+
+    pthread_mutex_lock(&o->lock);
+    o->threads++;
+    pthread_mutex_unlock(&o->lock);
+
+    if (pthread_create(&t->t, NULL, offline_thread, t)) {
+        offline_threadend(o);
+        free(t);
+        return 1;
+    }
+    *thread = t;
+    return 0;
+}
+
+long systhread_join(t_systhread thread, unsigned int *retval)
+{
+    t_offline_thread    *t = (t_offline_thread *)thread;
+    void                *r;
+    long                err;
+
+    err = pthread_join(t->t, &r);
+    if (retval)
+        *retval = (unsigned int)(t_ptr_uint) r;
+    free(t);
+    return err;
+}
+
+void systhread_exit(long status)
+{
+    pthread_exit((void *)(t_ptr_int) status);
+}
+
+void systhread_sleep(long millis)
+{
+    usleep((useconds_t)(millis * 1000));
+}
+
+long systhread_mutex_new(t_systhread_mutex *pmutex, long flags)
+{
+    pthread_mutex_t *m = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
+
+    if (!m || pthread_mutex_init(m, NULL)) {
+        free(m);
+        return 1;
+    }
+    *pmutex = m;
+    return 0;
+}
+
+long systhread_mutex_free(t_systhread_mutex pmutex)
+{
+    pthread_mutex_destroy((pthread_mutex_t *)pmutex);
+    free(pmutex);
+    return 0;
+}
+
+long systhread_mutex_lock(t_systhread_mutex pmutex)
+{
+    return pthread_mutex_lock((pthread_mutex_t *)pmutex);
+}
+
+long systhread_mutex_unlock(t_systhread_mutex pmutex)
+{
+    return pthread_mutex_unlock((pthread_mutex_t *)pmutex);
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              buffer~
+//____________________________________________________________________
+
+t_buffer_ref *buffer_ref_new(t_object *self, t_symbol *name)
+{
+    t_buffer_ref *ref = (t_buffer_ref *) calloc(1, sizeof(t_buffer_ref));
+
+    if (ref) {
+        ref->ob.o_class = &offline_bufrefclass;
+        ref->name = name;
+    }
+    return ref;
+}
+
+void buffer_ref_set(t_buffer_ref *x, t_symbol *name)
+{
+    x->name = name;
+}
+
+t_buffer_obj *buffer_ref_getobject(t_buffer_ref *x)
+{
+    t_offline_buffer *b;
+
+    for (b = offline_buffers; x && b; b = b->next)
+        if (b->name == x->name)
+            return (t_buffer_obj *)b;
+    return NULL;
+}
+
+float *buffer_locksamples(t_buffer_obj *b)
+{
+    return ((t_offline_buffer *)b)->samples;
+}
+
+void buffer_unlocksamples(t_buffer_obj *b)
+{
+}
+
+t_atom_long buffer_getchannelcount(t_buffer_obj *b)
+{
+    return ((t_offline_buffer *)b)->channels;
+}
+
+t_atom_long buffer_getframecount(t_buffer_obj *b)
+{
+    return ((t_offline_buffer *)b)->frames;
+}
+
+t_atom_float buffer_getsamplerate(t_buffer_obj *b)
+{
+    return ((t_offline_buffer *)b)->sr;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Files
+//____________________________________________________________________
+
+short path_getdefault(void)
+{
+    return 0;
+}
+
+short path_createsysfile(C74_CONST char *name, short path, t_fourcc type, t_filehandle *ref)
+{
+    return (*ref = fopen(name, "wb")) == NULL;
+}
+
+short path_opensysfile(C74_CONST char *name, short path, t_filehandle *ref, short perm)
+{
+    return (*ref = fopen(name, perm == READ_PERM ? "rb" : "r+b")) == NULL;
+}
+
+short locatefile_extended(char *name, short *outvol, t_fourcc *outtype, C74_CONST t_fourcc *filetypelist, short numtypes)
+{
+    *outvol = 0;
+    *outtype = 0;
+    return access(name, R_OK) != 0;
+}
+
+char *strncpy_zero(char *dst, C74_CONST char *src, long size)
+{
+    size_t n;
+
+    if (size > 0) {
+        n = strnlen(src, (size_t)size - 1);
+        memcpy(dst, src, n);
+        dst[n] = 0;
+    }
+    return dst;
+}
+
+t_max_err sysfile_read(t_filehandle f, t_ptr_size *count, void *bufr)
+{
+    *count = (t_ptr_size) fread(bufr, 1, (size_t)*count, (FILE *)f);
+    return ferror((FILE *)f) ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+t_max_err sysfile_write(t_filehandle f, t_ptr_size *count, C74_CONST void *bufr)
+{
+    *count = (t_ptr_size) fwrite(bufr, 1, (size_t)*count, (FILE *)f);
+    return ferror((FILE *)f) ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+t_max_err sysfile_setpos(t_filehandle f, long mode, t_ptr_int offset)
+{
+    int whence = mode == SYSFILE_FROMSTART ? SEEK_SET : mode == SYSFILE_FROMLEOF ? SEEK_END : SEEK_CUR;
+
+    return fseek((FILE *)f, offset, whence) ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+t_max_err sysfile_getpos(t_filehandle f, t_ptr_size *filepos)
+{
+    long pos = ftell((FILE *)f);
+
+    *filepos = pos < 0 ? 0 : (t_ptr_size)pos;
+    return pos < 0 ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+t_max_err sysfile_geteof(t_filehandle f, t_ptr_size *logeof)
+{
+    long pos = ftell((FILE *)f);
+    long eof;
+
+    if (pos < 0 || fseek((FILE *)f, 0, SEEK_END))
+        return MAX_ERR_GENERIC;
+    eof = ftell((FILE *)f);
+    fseek((FILE *)f, pos, SEEK_SET);
+    *logeof = eof < 0 ? 0 : (t_ptr_size)eof;
+    return eof < 0 ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+t_max_err sysfile_close(t_filehandle f)
+{
+    return fclose((FILE *)f) ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Jitter
+//____________________________________________________________________
+
+void *jit_object_findregistered(t_symbol *s)
+{
+    return NULL;
+}
+
+void *jit_object_method(void *x, t_symbol *s, ...)
+{
+    return NULL;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                                MSP
+//____________________________________________________________________
+
+void dsp_setup(t_pxobject *x, long nsignals)
+{
+    x->z_in = nsignals;
+    if (offline_current)
+        offline_current->nsigin = nsignals;
+}
+
+void dsp_free(t_pxobject *x)
+{
+}
+
+double sys_getsr(void)
+{
+    return offline_current ? offline_current->sr : 44100.;
+}
+
+int sys_getblksize(void)
+{
+    return offline_current ? (int) offline_current->vs : 64;
+}
+
+int sys_getmaxblksize(void)
+{
+    return sys_getblksize();
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Instances
+//____________________________________________________________________
+
+t_offline *offline_new(t_class *c, const char *label, double sr, long vs, long argc, t_atom *argv)
+{
+    t_offline *o = (t_offline *) calloc(1, sizeof(t_offline));
+
+    if (!o)
+        return NULL;
+    pthread_mutex_init(&o->lock, NULL);
+    pthread_cond_init(&o->idle, NULL);
+    o->c = c;
+    o->label = label;
+    o->sr = sr;
+    o->vs = vs;
+
+    offline_current = o;
+    pthread_mutex_lock(&offline_mainlock);
+    o->x = (t_object *)((void *(*)(t_symbol *, long, t_atom *)) c->c_new)(gensym(c->c_name), argc, argv);
+    pthread_mutex_unlock(&offline_mainlock);
+
+    if (!o->x) {
+        offline_free(o);
+        return NULL;
+    }
+    return o;
+}
+
+// the first atom is the selector, or the message is int, float or list
+t_max_err offline_send(t_offline *o, long inlet, long argc, t_atom *argv)
+{
+    t_offline_method    *me;
+    t_offline_attr      *a;
+    t_symbol            *s;
+    t_max_err           err = MAX_ERR_NONE;
+
+    if (argc < 1)
+        return MAX_ERR_NONE;
+    if (atom_gettype(argv) == A_SYM) {
+        s = atom_getsym(argv);
+        argc--;
+        argv++;
+    }
+    else
+        s = argc > 1 ? gensym("list") : atom_gettype(argv) == A_LONG ? gensym("int") : gensym("float");
+
+    offline_current = o;
+    pthread_mutex_lock(&offline_mainlock);
+    o->inlet = inlet;
+
+    if ((me = offline_findmethod(o->c, s)) && (err = offline_call(o->x, me, s, argc, argv)))
+        object_error(o->x, "bad arguments for message %s", s->s_name);
+    else if (!me && (a = offline_findattr(o->c, s)))
+        err = offline_attr_set(o->x, a, argc, argv);
+    else if (!me) {
+        object_error(o->x, "doesn't understand %s", s->s_name);
+        err = MAX_ERR_GENERIC;
+    }
+
+    o->inlet = 0;
+    pthread_mutex_unlock(&offline_mainlock);
+    return err;
+}
+
+// waits for the threads started by the messages (an impulse response being transformed...), then runs their clocks,
+// until no thread is left and no clock is due : a clock may start the next thread (the set waiting for the worker)
+void offline_settle(t_offline *o)
+{
+    t_offline_clock *c;
+    long            due;
+
+    offline_current = o;
+    for (;;) {
+        pthread_mutex_lock(&o->lock);
+        while (o->threads)
+            pthread_cond_wait(&o->idle, &o->lock);
+        for (due = 0, c = o->clocks; c; c = c->next)
+            due |= c->pending && c->when <= o->now;
+        pthread_mutex_unlock(&o->lock);
+        if (!due)
+            break;
+        offline_run(o);
+    }
+}
+
+t_max_err offline_dsp(t_offline *o, long connected)
+{
+    t_offline_method    *me = offline_findmethod(o->c, gensym("dsp64"));
+    short               count[64];
+    long                i;
+
+    if (!o->c->c_dsp || !me || o->nsigin + o->nsigout > 64) {
+        object_error(o->x, "not an MSP object");
+        return MAX_ERR_GENERIC;
+    }
+    for (i = 0; i < o->nsigin + o->nsigout; i++)
+        count[i] = i >= o->nsigin || i < connected;
+
+    free(o->zeros);
+    free(o->ins);
+    o->zeros = (double *) calloc((size_t)o->vs, sizeof(double));
+    o->ins = (double **) calloc((size_t)o->nsigin + 1, sizeof(double *));
+    if (!o->zeros || !o->ins)
+        return MAX_ERR_OUT_OF_MEM;
+    o->connected = connected;
+    o->nperform = 0;
+
+    offline_current = o;
+    pthread_mutex_lock(&offline_mainlock);
+    ((void (*)(t_object *, t_object *, short *, double, long, long)) me->m_fn)(o->x, &offline_dspchain, count, o->sr, o->vs, 0);
+    pthread_mutex_unlock(&offline_mainlock);
+
+    if (!o->nperform) {
+        object_error(o->x, "dsp64 added no perform routine");
+        return MAX_ERR_GENERIC;
+    }
+
+    // the DSP is on from here
+    if ((me = offline_findmethod(o->c, gensym("dspstate")))) {
+        pthread_mutex_lock(&offline_mainlock);
+        ((void (*)(t_object *, long)) me->m_fn)(o->x, 1);
+        pthread_mutex_unlock(&offline_mainlock);
+    }
+    return MAX_ERR_NONE;
+}
+
+// ins has the connected inlets, outs one vector per signal outlet
+void offline_perform(t_offline *o, double **ins, double **outs)
+{
+    long i;
+
+    offline_current = o;
+    for (i = 0; i < o->nsigin; i++)
+        o->ins[i] = i < o->connected ? ins[i] : o->zeros;
+    memset(o->zeros, 0, sizeof(double) * o->vs);
+
+    for (i = 0; i < o->nperform; i++)
+        o->perform[i](o->x, &offline_dspchain, o->ins, o->nsigin, outs, o->nsigout, o->vs, 0, o->userparam[i]);
+
+    pthread_mutex_lock(&o->lock);
+    o->samples += o->vs;
+    o->now = o->samples * 1000. / o->sr;
+    pthread_mutex_unlock(&o->lock);
+
+    offline_run(o);
+}
+
+void offline_events(t_offline *o, FILE *f)
+{
+    o->events = f;
+}
+
+long offline_numinlets(t_offline *o)
+{
+    return o->nsigin;
+}
+
+long offline_numoutlets(t_offline *o)
+{
+    return o->nsigout;
+}
+
+// errors posted by the instance so far, a buffer~ not found, a check out of bounds...
+long offline_errors(t_offline *o)
+{
+    return __sync_fetch_and_add(&o->errors, 0);     // its threads may still be posting
+}
+
+void offline_free(t_offline *o)
+{
+    t_offline_outlet    *out;
+    t_offline_clock     *c;
+
+    offline_current = o;
+    if (o->x) {
+        pthread_mutex_lock(&offline_mainlock);
+        object_free(o->x);
+        pthread_mutex_unlock(&offline_mainlock);
+    }
+
+    while ((out = o->outlets)) {
+        o->outlets = out->next;
+        free(out);
+    }
+    while ((c = o->clocks)) {       // not freed by the object
+        o->clocks = c->next;
+        free(c);
+    }
+    free(o->zeros);
+    free(o->ins);
+    pthread_cond_destroy(&o->idle);
+    pthread_mutex_destroy(&o->lock);
+    free(o);
+    offline_current = NULL;
+}
@@ -0,0 +1,55 @@
+/**
+ *
+ *  @file	host.h
+ *
+ *
+ *  Offline renderer : the stand-in for Max that runs one instance of an external outside of a patcher.
+ *
+ *  host.c implements the Max API of include/ (see ext.h) and these routines, used by render.c.
+ *  A t_offline is one instance with its own logical clock, sample rate and vector size :
+ *
+ *      offline_new         creates the instance, like typing [name @attr value] in a box
+ *      offline_send        sends it a message, like a message box connected to one of its inlets
+ *      offline_settle      waits for the threads it started and runs its due clocks
+ *      offline_dsp         calls dsp64, the first n signal inlets are connected
+ *      offline_perform     runs the perform routines on one vector, then the clocks now due
+ *      offline_errors      counts the errors it posted
+ *      offline_free        frees the instance
+ *
+ *  Time only moves with offline_perform, a vector of audio advances the clocks by exactly its duration,
+ *  as fast as the machine goes. new, free, the messages, dsp64 and the clocks run under one lock shared by
+ *  every instance, the way they would all run on the main thread in Max : only the perform routines run
+ *  in parallel. The instances of different threads share nothing else.
+ *
+ */
+
+#ifndef _OFFLINE_HOST_H_
+#define _OFFLINE_HOST_H_
+
+#include <stdio.h>
+
+#include "ext.h"
+
+typedef struct _offline t_offline;
+
+//// setup, from the main thread before any instance exists
+void        offline_init(void);
+long        offline_loadbuffer(const char *name, const char *path);
+
+//// text
+long        offline_parse(const char *text, t_atom *av, long maxatoms);
+
+//// instances
+t_class     *offline_findclass(const char *name);
+t_offline   *offline_new(t_class *c, const char *label, double sr, long vs, long argc, t_atom *argv);
+t_max_err   offline_send(t_offline *o, long inlet, long argc, t_atom *argv);
+void        offline_settle(t_offline *o);
+t_max_err   offline_dsp(t_offline *o, long connected);
+void        offline_perform(t_offline *o, double **ins, double **outs);
+void        offline_events(t_offline *o, FILE *f);
+long        offline_numinlets(t_offline *o);
+long        offline_numoutlets(t_offline *o);
+long        offline_errors(t_offline *o);
+void        offline_free(t_offline *o);
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ *
+ *  @file	ext.h
+ *
+ *
+ *  Sources :
+ *
+ *   Cylcing 74'
+ *    - Max 7.1 API :
+ *          https://cycling74.com/sdk/MaxSDK-6.0.4/html/index.html
+ *
+ *
+ *  Offline renderer : the part of the Max SDK headers the externals use, declared the way the SDK does,
+ *  so the externals build where Max doesn't run (a batch server). host.c implements every routine.
+ *
+ *  Only what the templates call is here. An external using more of the API needs it added here
+ *  and in host.c first, the compiler says what's missing.
+ *
+ */
+
+#ifndef _OFFLINE_EXT_H_
+#define _OFFLINE_EXT_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define C74_CONST   const
+#define C74_EXPORT
+
+typedef void *(*method)(void *, ...);
+
+typedef long            t_atom_long;
+typedef double          t_atom_float;
+typedef long            t_max_err;
+typedef long            t_ptr_int;
+typedef long            t_ptr_size;
+typedef unsigned long   t_ptr_uint;
+typedef int             t_bool;
+typedef float           t_float;
+typedef double          t_double;
+
+typedef struct _symbol
+{
+    const char  *s_name;
+    void        *s_thing;
+} t_symbol;
+
+typedef struct _class t_class;
+
+typedef struct _object      ///<    Header of every object, the host's ones (clocks, outlets...) included
+{
+    t_class     *o_class;
+} t_object;
+
+typedef union word
+{
+    t_atom_long w_long;
+    t_atom_float w_float;
+    t_symbol    *w_sym;
+    t_object    *w_obj;
+} word;
+
+typedef struct atom
+{
+    short       a_type;
+    word        a_w;
+} t_atom;
+
+enum { A_NOTHING = 0, A_LONG, A_FLOAT, A_SYM, A_OBJ, A_DEFLONG, A_DEFFLOAT, A_DEFSYM, A_GIMME, A_CANT, A_SEMI, A_COMMA };
+enum { MAX_ERR_NONE = 0, MAX_ERR_GENERIC = -1, MAX_ERR_INVALID_PTR = -2, MAX_ERR_OUT_OF_MEM = -4 };
+
+#define ASSIST_INLET    1
+#define ASSIST_OUTLET   2
+
+#ifndef true
+#define true    1
+#define false   0
+#endif
+
+#define CLASS_BOX   gensym("box")
+
+// the externals are linked in one binary, each one is built with -Dext_main=<name>_main
+C74_EXPORT void ext_main(void *r);
+
+t_symbol    *gensym(C74_CONST char *s);
+
+void        post(C74_CONST char *fmt, ...);
+void        error(C74_CONST char *fmt, ...);
+void        object_post(t_object *x, C74_CONST char *s, ...);
+void        object_error(t_object *x, C74_CONST char *s, ...);
+void        object_warn(t_object *x, C74_CONST char *s, ...);
+
+void        *outlet_new(void *x, C74_CONST char *s);
+void        *floatout(void *x);
+void        *intout(void *x);
+void        *listout(void *x);
+void        *bangout(void *x);
+void        *outlet_bang(void *o);
+void        *outlet_int(void *o, t_atom_long n);
+void        *outlet_float(void *o, double f);
+void        *outlet_list(void *o, t_symbol *s, short ac, t_atom *av);
+void        *outlet_anything(void *o, t_symbol *s, short ac, t_atom *av);
+long        proxy_getinlet(t_object *master);
+
+void        *clock_new(void *obj, method fn);
+void        clock_delay(void *x, long n);
+void        clock_fdelay(void *x, double t);
+void        clock_unset(void *x);
+void        clock_getftime(double *time);
+void        *qelem_new(void *obj, method fn);
+void        qelem_set(void *q);
+void        qelem_unset(void *q);
+void        qelem_free(void *q);
+
+typedef void *t_critical;           ///<    Only the global critical region (0) is implemented
+void        critical_enter(t_critical x);
+void        critical_exit(t_critical x);
+
+void        *sysmem_newptr(long size);
+void        *sysmem_newptrclear(long size);
+void        *sysmem_resizeptr(void *ptr, long newsize);
+void        sysmem_freeptr(void *ptr);
+
+t_atom_long atom_getlong(C74_CONST t_atom *a);
+t_atom_float atom_getfloat(C74_CONST t_atom *a);
+t_symbol    *atom_getsym(C74_CONST t_atom *a);
+long        atom_gettype(C74_CONST t_atom *a);
+t_max_err   atom_setlong(t_atom *a, t_atom_long b);
+t_max_err   atom_setfloat(t_atom *a, double b);
+t_max_err   atom_setsym(t_atom *a, t_symbol *b);
+t_max_err   atom_arg_getlong(t_atom_long *c, long idx, long ac, C74_CONST t_atom *av);
+t_max_err   atom_arg_getdouble(double *c, long idx, long ac, C74_CONST t_atom *av);
+t_max_err   atom_arg_getsym(t_symbol **c, long idx, long ac, C74_CONST t_atom *av);
+
+void        *object_alloc(t_class *c);
+t_max_err   object_free(void *x);
+void        *object_method(void *x, t_symbol *s, ...);
+
+#endif
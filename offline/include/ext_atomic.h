@@ -0,0 +1,24 @@
+/**
+ *
+ *  @file	ext_atomic.h
+ *
+ *
+ *  Offline renderer : atomics (see ext.h), the GCC/Clang builtins are full barriers like the SDK's.
+ *
+ */
+
+#ifndef _OFFLINE_EXT_ATOMIC_H_
+#define _OFFLINE_EXT_ATOMIC_H_
+
+#include <stdint.h>
+
+typedef volatile int32_t t_int32_atomic;
+typedef volatile int64_t t_int64_atomic;
+
+#define ATOMIC_INCREMENT(p)             __sync_add_and_fetch((p), 1)
+#define ATOMIC_INCREMENT_BARRIER(p)     __sync_add_and_fetch((p), 1)
+#define ATOMIC_DECREMENT(p)             __sync_sub_and_fetch((p), 1)
+#define ATOMIC_DECREMENT_BARRIER(p)     __sync_sub_and_fetch((p), 1)
+#define ATOMIC_COMPARE_SWAP32(o, n, p)  __sync_bool_compare_and_swap((p), (o), (n))
+
+#endif
@@ -0,0 +1,27 @@
+/**
+ *
+ *  @file	ext_buffer.h
+ *
+ *
+ *  Offline renderer : buffer~ access (see ext.h). The buffers are sound files loaded by the renderer (-b name=file).
+ *
+ */
+
+#ifndef _OFFLINE_EXT_BUFFER_H_
+#define _OFFLINE_EXT_BUFFER_H_
+
+#include "ext.h"
+
+typedef struct _buffer_ref t_buffer_ref;
+typedef t_object t_buffer_obj;
+
+t_buffer_ref    *buffer_ref_new(t_object *self, t_symbol *name);
+void            buffer_ref_set(t_buffer_ref *x, t_symbol *name);
+t_buffer_obj    *buffer_ref_getobject(t_buffer_ref *x);
+float           *buffer_locksamples(t_buffer_obj *b);
+void            buffer_unlocksamples(t_buffer_obj *b);
+t_atom_long     buffer_getchannelcount(t_buffer_obj *b);
+t_atom_long     buffer_getframecount(t_buffer_obj *b);
+t_atom_float    buffer_getsamplerate(t_buffer_obj *b);
+
+#endif
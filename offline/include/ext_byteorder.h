@@ -0,0 +1,15 @@
+/**
+ *
+ *  @file	ext_byteorder.h
+ *
+ *
+ *  Offline renderer : byte order (see ext.h). Nothing the templates use, the include has to resolve.
+ *
+ */
+
+#ifndef _OFFLINE_EXT_BYTEORDER_H_
+#define _OFFLINE_EXT_BYTEORDER_H_
+
+#include "ext.h"
+
+#endif
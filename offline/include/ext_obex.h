@@ -0,0 +1,54 @@
+/**
+ *
+ *  @file	ext_obex.h
+ *
+ *
+ *  Offline renderer : classes, methods and attributes (see ext.h).
+ *
+ *  The CLASS_ATTR macros register what the host needs to set an attribute from @name arguments
+ *  or a message : where it lives, its type, its enum, its clip range and its setter.
+ *  The ones only used by the inspector (labels, styles, categories) expand to nothing.
+ *
+ */
+
+#ifndef _OFFLINE_EXT_OBEX_H_
+#define _OFFLINE_EXT_OBEX_H_
+
+#include "ext.h"
+
+#define ATTR_FLAGS_NONE         0x0000
+#define ATTR_GET_OPAQUE         0x0001
+#define ATTR_SET_OPAQUE         0x0002
+#define ATTR_GET_OPAQUE_USER    0x0100
+#define ATTR_SET_OPAQUE_USER    0x0200
+
+#define calcoffset(x, y)        ((t_ptr_int)(&(((x *)0L)->y)))
+
+t_class     *class_new(C74_CONST char *name, C74_CONST method mnew, C74_CONST method mfree, long size, C74_CONST method mmenu, short type, ...);
+t_max_err   class_addmethod(t_class *c, C74_CONST method m, C74_CONST char *name, ...);
+t_max_err   class_register(t_symbol *name_space, t_class *c);
+
+void        attr_args_process(void *x, short ac, t_atom *av);
+
+//// host side of the attribute macros
+t_max_err   offline_attr_new(t_class *c, C74_CONST char *name, t_symbol *type, long flags, t_ptr_int offset);
+t_max_err   offline_attr_enum(t_class *c, C74_CONST char *name, C74_CONST char *list, long index);
+t_max_err   offline_attr_clip(t_class *c, C74_CONST char *name, double min, double max, long which);
+t_max_err   offline_attr_accessors(t_class *c, C74_CONST char *name, method get, method set);
+
+#define CLASS_ATTR_LONG(c, name, flags, type, member)       offline_attr_new(c, name, gensym("long"), flags, calcoffset(type, member))
+#define CLASS_ATTR_DOUBLE(c, name, flags, type, member)     offline_attr_new(c, name, gensym("float64"), flags, calcoffset(type, member))
+#define CLASS_ATTR_SYM(c, name, flags, type, member)        offline_attr_new(c, name, gensym("symbol"), flags, calcoffset(type, member))
+#define CLASS_ATTR_ENUM(c, name, flags, list)               offline_attr_enum(c, name, list, 0)
+#define CLASS_ATTR_ENUMINDEX(c, name, flags, list)          offline_attr_enum(c, name, list, 1)
+#define CLASS_ATTR_FILTER_MIN(c, name, min)                 offline_attr_clip(c, name, min, 0, 1)
+#define CLASS_ATTR_FILTER_MAX(c, name, max)                 offline_attr_clip(c, name, 0, max, 2)
+#define CLASS_ATTR_FILTER_CLIP(c, name, min, max)           offline_attr_clip(c, name, min, max, 3)
+#define CLASS_ATTR_ACCESSORS(c, name, get, set)             offline_attr_accessors(c, name, (method)(get), (method)(set))
+#define CLASS_ATTR_LABEL(c, name, flags, label)             ((void)0)
+#define CLASS_ATTR_STYLE_LABEL(c, name, flags, style, label) ((void)0)
+#define CLASS_ATTR_SAVE(c, name, flags)                     ((void)0)
+#define CLASS_ATTR_BASIC(c, name, flags)                    ((void)0)
+#define CLASS_ATTR_CATEGORY(c, name, flags, str)            ((void)0)
+
+#endif
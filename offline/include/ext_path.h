@@ -0,0 +1,45 @@
+/**
+ *
+ *  @file	ext_path.h
+ *
+ *
+ *  Offline renderer : files (see ext.h). There is no search path, names are relative to the working directory.
+ *
+ */
+
+#ifndef _OFFLINE_EXT_PATH_H_
+#define _OFFLINE_EXT_PATH_H_
+
+#include "ext.h"
+
+typedef void *t_filehandle;
+typedef unsigned long t_fourcc;
+
+#define MAX_PATH_CHARS      2048
+#define MAX_FILENAME_CHARS  512
+
+#define READ_PERM   1
+#define WRITE_PERM  2
+#define RW_PERM     3
+
+#define SYSFILE_ATMARK      0
+#define SYSFILE_FROMSTART   1
+#define SYSFILE_FROMLEOF    2
+#define SYSFILE_FROMMARK    3
+
+#define FOUR_CHAR_CODE(a, b, c, d)  (((t_fourcc)(a) << 24) | ((t_fourcc)(b) << 16) | ((t_fourcc)(c) << 8) | (t_fourcc)(d))
+
+short       path_getdefault(void);
+short       path_createsysfile(C74_CONST char *name, short path, t_fourcc type, t_filehandle *ref);
+short       path_opensysfile(C74_CONST char *name, short path, t_filehandle *ref, short perm);
+short       locatefile_extended(char *name, short *outvol, t_fourcc *outtype, C74_CONST t_fourcc *filetypelist, short numtypes);
+char        *strncpy_zero(char *dst, C74_CONST char *src, long size);
+
+t_max_err   sysfile_read(t_filehandle f, t_ptr_size *count, void *bufr);
+t_max_err   sysfile_write(t_filehandle f, t_ptr_size *count, C74_CONST void *bufr);
+t_max_err   sysfile_setpos(t_filehandle f, long mode, t_ptr_int offset);
+t_max_err   sysfile_getpos(t_filehandle f, t_ptr_size *filepos);
+t_max_err   sysfile_geteof(t_filehandle f, t_ptr_size *logeof);
+t_max_err   sysfile_close(t_filehandle f);
+
+#endif
@@ -0,0 +1,27 @@
+/**
+ *
+ *  @file	ext_systhread.h
+ *
+ *
+ *  Offline renderer : threads and mutexes (see ext.h), over pthreads.
+ *
+ */
+
+#ifndef _OFFLINE_EXT_SYSTHREAD_H_
+#define _OFFLINE_EXT_SYSTHREAD_H_
+
+#include "ext.h"
+
+typedef void *t_systhread;
+typedef void *t_systhread_mutex;
+
+long        systhread_create(method entryproc, void *arg, long stacksize, long priority, long flags, t_systhread *thread);
+long        systhread_join(t_systhread thread, unsigned int *retval);
+void        systhread_exit(long status);
+void        systhread_sleep(long millis);
+long        systhread_mutex_new(t_systhread_mutex *pmutex, long flags);
+long        systhread_mutex_free(t_systhread_mutex pmutex);
+long        systhread_mutex_lock(t_systhread_mutex pmutex);
+long        systhread_mutex_unlock(t_systhread_mutex pmutex);
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ *
+ *  @file	jit.common.h
+ *
+ *
+ *  Offline renderer : Jitter (see ext.h). There are no matrices offline, jit_object_findregistered finds nothing.
+ *
+ */
+
+#ifndef _OFFLINE_JIT_COMMON_H_
+#define _OFFLINE_JIT_COMMON_H_
+
+#include "ext.h"
+
+#define JIT_MATRIX_MAX_DIMCOUNT     32
+#define JIT_MATRIX_MAX_PLANECOUNT   32
+#define JIT_ERR_NONE                0
+
+typedef long t_jit_err;
+
+typedef struct _jit_matrix_info
+{
+    long        size;
+    t_symbol    *type;
+    long        flags;
+    long        dimcount;
+    long        dim[JIT_MATRIX_MAX_DIMCOUNT];
+    long        dimstride[JIT_MATRIX_MAX_DIMCOUNT];
+    long        planecount;
+} t_jit_matrix_info;
+
+extern t_symbol *_jit_sym_lock, *_jit_sym_getinfo, *_jit_sym_getdata, *_jit_sym_float32, *_jit_sym_float64, *_jit_sym_char, *_jit_sym_long;
+
+void        *jit_object_findregistered(t_symbol *s);
+void        *jit_object_method(void *x, t_symbol *s, ...);
+
+#endif
@@ -0,0 +1,38 @@
+/**
+ *
+ *  @file	z_dsp.h
+ *
+ *
+ *  Offline renderer : MSP objects (see ext.h).
+ *
+ */
+
+#ifndef _OFFLINE_Z_DSP_H_
+#define _OFFLINE_Z_DSP_H_
+
+#include "ext.h"
+
+typedef struct _pxobject
+{
+    t_object    z_ob;
+    long        z_in;
+    void        *z_proxy;
+    long        z_disabled;
+    short       z_count;
+    short       z_misc;
+} t_pxobject;
+
+#define Z_NO_INPLACE    1
+#define Z_PUT_LAST      2
+#define Z_PUT_FIRST     4
+
+#define FIX_DENORM_NAN_DOUBLE(v)    ((v) = ((v) - (v) == 0. && ((v) > 2.2250738585072014e-308 || (v) < -2.2250738585072014e-308)) ? (v) : 0.)
+
+void        dsp_setup(t_pxobject *x, long nsignals);
+void        dsp_free(t_pxobject *x);
+void        class_dspinit(t_class *c);
+double      sys_getsr(void);
+int         sys_getblksize(void);
+int         sys_getmaxblksize(void);
+
+#endif
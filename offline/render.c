@@ -0,0 +1,358 @@
+/**
+ *
+ *  @file	render.c
+ *
+ *
+ *  Offline renderer : runs an external over sound files, as fast as the machine goes.
+ *
+ *      render -o templatefftw~ -a "@denoise wiener" -m "learn 32" -d out -j 8 *.wav
+ *
+ *  Each file is streamed a vector at a time through the perform routines of its own instance, created
+ *  with the sample rate of the file (see host.h), and written to a 32 bit float WAV file. Nothing runs in
+ *  real time : the clocks of the instance follow the audio, not the wall clock.
+ *
+ *  The files are shared by a pool of threads (-j), each one takes the next file and renders it with an
+ *  instance it alone uses. A new instance per file keeps the results independent of the order of the files
+ *  and of the thread they land on (the sample rate of new, the state learned from the previous file...).
+ *
+ *  The input channels go to the signal inlets in order, the inlets past the last channel have no signal
+ *  (template~ uses its right inlet float). With -e the messages of the control outlets are written next
+ *  to the output, one line each : time (ms), outlet, message.
+ *
+ *  A file fails when its instance posts an error (a buffer~ not found...), the exit status is 1 if a file failed.
+ *  Without a file, the messages are sent to one instance at 44.1 kHz and nothing is rendered :
+ *
+ *      render -o template~ -m check
+ *
+ *  runs the accuracy check of template~ and exits with 1 if a kernel is out of its bounds.
+ *
+ *  The externals are linked in (each one built with -Dext_main=<name>_ext_main, see README.md),
+ *  RENDER_TEMPLATE, RENDER_TEMPLATEEXPR and RENDER_TEMPLATEFFTW say which ones.
+ *
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "ext.h"
+#include "ext_atomic.h"
+#include "ext_path.h"
+
+#include "host.h"
+#include "wav.h"
+
+#define RENDER_MAXMESSAGES  32      ///<    -m options
+#define RENDER_MAXATOMS     256     ///<    Atoms of -a or of one -m
+
+#ifdef RENDER_TEMPLATE
+void template_ext_main(void *r);
+#endif
+#ifdef RENDER_TEMPLATEEXPR
+void templateexpr_ext_main(void *r);
+#endif
+#ifdef RENDER_TEMPLATEFFTW
+void templatefftw_ext_main(void *r);
+#endif
+
+typedef struct _render_message
+{
+    long        inlet;
+    t_atom      av[RENDER_MAXATOMS];
+    long        ac;
+} t_render_message;
+
+typedef struct _render
+{
+    t_class             *c;
+    const char          *object;
+    const char          *dir;       ///<    Output directory, NULL : next to the input
+    long                vs;
+    double              tail;       ///<    Silence rendered after the file, seconds
+    long                events;
+    t_atom              args[RENDER_MAXATOMS];
+    long                nargs;
+    t_render_message    msgs[RENDER_MAXMESSAGES];
+    long                nmsgs;
+
+    char                **files;
+    long                nfiles;
+    t_int32_atomic      next;       ///<    Next file to take
+    t_int32_atomic      failed;
+} t_render;
+
+void    render_usage(void);
+void    *render_worker(t_render *r);
+long    render_file(t_render *r, const char *in);
+long    render_messages(t_render *r);
+void    render_outpath(t_render *r, const char *in, char *out, long size);
+double  render_seconds(void);
+
+
+
+
+
+//____________________________________________________________________
+//                                Main
+//____________________________________________________________________
+
+int main(int argc, char **argv)
+{
+    t_render    r;
+    pthread_t   *threads;
+    char        *eq;
+    long        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    long        i, opt;
+
+    memset(&r, 0, sizeof(t_render));
+    r.vs = 64;
+
+    offline_init();
+#ifdef RENDER_TEMPLATE
+    template_ext_main(NULL);
+#endif
+#ifdef RENDER_TEMPLATEEXPR
+    templateexpr_ext_main(NULL);
+#endif
+#ifdef RENDER_TEMPLATEFFTW
+    templatefftw_ext_main(NULL);
+#endif
+
+    while ((opt = getopt(argc, argv, "o:a:m:b:d:j:v:t:eh")) != -1) {
+        switch (opt) {
+            case 'o': r.object = optarg; break;
+            case 'a': r.nargs = offline_parse(optarg, r.args, RENDER_MAXATOMS); break;
+            case 'm':
+                if (r.nmsgs == RENDER_MAXMESSAGES) {
+                    fprintf(stderr, "render: too many messages\n");
+                    return 1;
+                }
+                // "1: 0.5" goes to the second inlet
+                if (optarg[0] >= '0' && optarg[0] <= '9' && optarg[1] == ':') {
+                    r.msgs[r.nmsgs].inlet = optarg[0] - '0';
+                    optarg += 2;
+                }
+                r.msgs[r.nmsgs].ac = offline_parse(optarg, r.msgs[r.nmsgs].av, RENDER_MAXATOMS);
+                r.nmsgs++;
+                break;
+            case 'b':
+                if (!(eq = strchr(optarg, '='))) {
+                    render_usage();
+                    return 1;
+                }
+                *eq = 0;
+                if (offline_loadbuffer(optarg, eq + 1)) {
+                    fprintf(stderr, "render: can't read %s\n", eq + 1);
+                    return 1;
+                }
+                break;
+            case 'd': r.dir = optarg; break;
+            case 'j': jobs = atol(optarg); break;
+            case 'v': r.vs = atol(optarg); break;
+            case 't': r.tail = atof(optarg); break;
+            case 'e': r.events = 1; break;
+            default:
+                render_usage();
+                return opt != 'h';
+        }
+    }
+
+    if (!r.object || (optind == argc && !r.nmsgs) || r.vs < 1 || r.tail < 0.) {
+        render_usage();
+        return 1;
+    }
+    if (!(r.c = offline_findclass(r.object))) {
+        fprintf(stderr, "render: no object named %s\n", r.object);
+        return 1;
+    }
+    if (optind == argc)
+        return render_messages(&r) != 0;
+
+    r.files = argv + optind;
+    r.nfiles = argc - optind;
+    if (jobs < 1)
+        jobs = 1;
+    if (jobs > r.nfiles)
+        jobs = r.nfiles;
+
+    // the main thread is one of the workers
+    threads = (pthread_t *) calloc((size_t)jobs, sizeof(pthread_t));
+    if (!threads)
+        return 1;
+    for (i = 1; i < jobs; i++)
+        if (pthread_create(threads + i, NULL, (void *(*)(void *))render_worker, &r))
+            break;
+    render_worker(&r);
+    while (--i > 0)
+        pthread_join(threads[i], NULL);
+    free(threads);
+
+    return r.failed != 0;
+}
+
+void render_usage(void)
+{
+    fprintf(stderr,
+            "usage: render -o object [options] file.wav ...\n"
+            "       render -o object [options] -m \"message\" (no file : sends the messages, renders nothing)\n"
+            "  -o object     external to run\n"
+            "  -a \"@attr v\"  arguments of the object box\n"
+            "  -m \"message\"  sent before the audio starts, \"N: message\" to inlet N, repeatable\n"
+            "  -b name=file  loads file as the buffer~ name, repeatable\n"
+            "  -d dir        output directory (default : next to the input, as name-object.wav)\n"
+            "  -j n          threads (default : one per core)\n"
+            "  -v n          vector size (default : 64)\n"
+            "  -t seconds    silence rendered after each file, for the tails (default : 0)\n"
+            "  -e            writes the control outlets to the output name .txt\n");
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Workers
+//____________________________________________________________________
+
+void *render_worker(t_render *r)
+{
+    long i;
+
+    while ((i = ATOMIC_INCREMENT(&r->next) - 1) < r->nfiles)
+        if (render_file(r, r->files[i]))
+            ATOMIC_INCREMENT(&r->failed);
+    return NULL;
+}
+
+// wall clock, for the speed report
+double render_seconds(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// dir/name.wav, or name-object.wav next to the input
+void render_outpath(t_render *r, const char *in, char *out, long size)
+{
+    const char  *base = strrchr(in, '/');
+    const char  *dot;
+
+    base = base ? base + 1 : in;
+    if (r->dir) {
+        snprintf(out, (size_t)size, "%s/%s", r->dir, base);
+        return;
+    }
+    dot = strrchr(base, '.');
+    snprintf(out, (size_t)size, "%.*s-%s.wav", (int)(dot ? dot - in : (long)strlen(in)), in, r->object);
+}
+
+// renders one file, returns non zero if it failed
+long render_file(t_render *r, const char *in)
+{
+    t_offline   *o = NULL;
+    t_wav       src, dst;
+    FILE        *events = NULL;
+    double      *buf = NULL;
+    double      *ins[64], *outs[64];
+    char        out[MAX_PATH_CHARS], txt[MAX_PATH_CHARS];
+    long        tail, n, m, i, nin, nout, err = 1;
+    double      start = render_seconds();
+
+    memset(&dst, 0, sizeof(t_wav));
+    if (wav_open(&src, in)) {
+        fprintf(stderr, "%s: can't read, not a PCM or float WAV file\n", in);
+        return 1;
+    }
+    render_outpath(r, in, out, sizeof(out));
+    if (!strcmp(in, out)) {
+        fprintf(stderr, "%s: the output would replace the input\n", in);
+        wav_close(&src);
+        return 1;
+    }
+    tail = (long)(r->tail * src.sr + 0.5);
+
+    if (!(o = offline_new(r->c, in, src.sr, r->vs, r->nargs, r->args)))
+        goto done;
+    for (i = 0; i < r->nmsgs; i++)
+        offline_send(o, r->msgs[i].inlet, r->msgs[i].ac, r->msgs[i].av);
+    offline_settle(o);
+
+    nin = src.channels;
+    nout = offline_numoutlets(o);
+    if (nin > 64 || nout > 64) {
+        fprintf(stderr, "%s: more than 64 channels\n", in);
+        goto done;
+    }
+    if (offline_dsp(o, nin < offline_numinlets(o) ? nin : offline_numinlets(o)))
+        goto done;
+
+    if (!(buf = (double *) malloc(sizeof(double) * r->vs * (nin + nout))))
+        goto done;
+    for (i = 0; i < nin; i++)
+        ins[i] = buf + i * r->vs;
+    for (i = 0; i < nout; i++)
+        outs[i] = buf + (nin + i) * r->vs;
+
+    if (wav_create(&dst, out, nout, src.sr)) {
+        fprintf(stderr, "%s: can't write %s\n", in, out);
+        goto done;
+    }
+    if (r->events) {
+        snprintf(txt, sizeof(txt), "%.*s.txt", (int)(strlen(out) - 4), out);
+        if (!(events = fopen(txt, "w"))) {
+            fprintf(stderr, "%s: can't write %s\n", in, txt);
+            goto done;
+        }
+        offline_events(o, events);
+    }
+
+    // the last vector is padded with zeros, then the tail is silence
+    for (;;) {
+        n = m = wav_read(&src, ins, r->vs);
+        if (!n && tail > 0) {
+            n = tail < r->vs ? tail : r->vs;
+            tail -= n;
+        }
+        else if (!n)
+            break;
+        for (i = 0; i < nin; i++)
+            memset(ins[i] + m, 0, sizeof(double) * (r->vs - m));
+        offline_perform(o, ins, outs);
+        if (wav_write(&dst, outs, n)) {
+            fprintf(stderr, "%s: can't write %s\n", in, out);
+            goto done;
+        }
+    }
+    fprintf(stderr, "%s -> %s : %.2f s in %.2f s\n", in, out, dst.frames / src.sr, render_seconds() - start);
+    err = offline_errors(o) != 0;
+
+done:
+    if (o)
+        offline_free(o);
+    if (events)
+        fclose(events);
+    if (dst.f && wav_close(&dst))
+        err = 1;
+    wav_close(&src);
+    free(buf);
+    return err;
+}
+
+// no file : one instance gets the messages, returns non zero if it posted an error
+long render_messages(t_render *r)
+{
+    t_offline   *o;
+    long        i, err;
+
+    if (!(o = offline_new(r->c, "", 44100., r->vs, r->nargs, r->args)))
+        return 1;
+    for (i = 0; i < r->nmsgs; i++)
+        offline_send(o, r->msgs[i].inlet, r->msgs[i].ac, r->msgs[i].av);
+    offline_settle(o);
+
+    err = offline_errors(o);
+    offline_free(o);
+    return err;
+}
@@ -0,0 +1,241 @@
+/**
+ *
+ *  @file	wav.c
+ *
+ *
+ *  Offline renderer : streaming WAV reader and writer (see wav.h).
+ *
+ *  The file is read and written a block at a time, a long file never sits in memory.
+ *  Multi-byte values are assembled byte by byte, the code doesn't depend on the host byte order.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "wav.h"
+
+#define WAV_HEADER  44      ///<    RIFF + fmt (16 bytes) + data headers, as written by wav_create
+
+
+
+
+
+//____________________________________________________________________
+//                          Byte Helpers
+//____________________________________________________________________
+
+static unsigned long wav_le(const unsigned char *p, long n)
+{
+    unsigned long v = 0;
+
+    while (n--)
+        v = (v << 8) | p[n];
+    return v;
+}
+
+static void wav_putle(unsigned char *p, unsigned long v, long n)
+{
+    while (n--) {
+        *p++ = (unsigned char)(v & 0xff);
+        v >>= 8;
+    }
+}
+
+static long wav_reserve(t_wav *w, long bytes)
+{
+    unsigned char *raw;
+
+    if (bytes <= w->rawsize)
+        return 0;
+    raw = (unsigned char *) realloc(w->raw, bytes);
+    if (!raw)
+        return 1;
+    w->raw = raw;
+    w->rawsize = bytes;
+    return 0;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Reading
+//____________________________________________________________________
+
+// opens a file and leaves it at the first sample, returns non zero if it isn't a WAV file we can read
+long wav_open(t_wav *w, const char *path)
+{
+    unsigned char   h[40];
+    unsigned long   size;
+    long            fmt = 0, bits = 0, align = 0;
+
+    memset(w, 0, sizeof(t_wav));
+    w->f = fopen(path, "rb");
+    if (!w->f)
+        return 1;
+
+    if (fread(h, 1, 12, w->f) != 12 || memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4))
+        goto bad;
+
+    // chunks until data, fmt has to come first
+    while (fread(h, 1, 8, w->f) == 8) {
+        size = wav_le(h + 4, 4);
+
+        if (!memcmp(h, "fmt ", 4)) {
+            if (size < 16 || fread(h, 1, size < 40 ? size : 40, w->f) != (size < 40 ? size : 40))
+                goto bad;
+            fmt         = (long) wav_le(h, 2);
+            w->channels = (long) wav_le(h + 2, 2);
+            w->sr       = (double) wav_le(h + 4, 4);
+            align       = (long) wav_le(h + 12, 2);
+            bits        = (long) wav_le(h + 14, 2);
+            if (fmt == 0xFFFE && size >= 40)
+                fmt = (long) wav_le(h + 24, 2);     // subformat GUID, starts with the format code
+            if (size > 40 && fseek(w->f, (long)(size - 40), SEEK_CUR))
+                goto bad;
+        }
+        else if (!memcmp(h, "data", 4)) {
+            if (!fmt)
+                goto bad;
+            w->format = fmt;
+            w->bytes = bits / 8;
+            if (w->channels < 1 || w->sr <= 0. || align != w->channels * w->bytes)
+                goto bad;
+            if (!(fmt == 1 && (bits == 16 || bits == 24 || bits == 32)) && !(fmt == 3 && (bits == 32 || bits == 64)))
+                goto bad;
+            w->frames = (long)(size / align);
+            return 0;
+        }
+        else if (fseek(w->f, (long)(size + (size & 1)), SEEK_CUR))
+            goto bad;
+    }
+
+bad:
+    wav_close(w);
+    return 1;
+}
+
+// reads up to frames frames into chans[0..channels-1], returns the frames read (0 at the end)
+long wav_read(t_wav *w, double **chans, long frames)
+{
+    const unsigned char *p;
+    long                i, c, n;
+    union { uint32_t u; float f; } f32;
+    union { uint64_t u; double d; } f64;
+
+    if (frames > w->frames - w->pos)
+        frames = w->frames - w->pos;
+    if (frames <= 0 || wav_reserve(w, frames * w->channels * w->bytes))
+        return 0;
+
+    n = (long) fread(w->raw, (size_t)(w->channels * w->bytes), (size_t)frames, w->f);
+    p = w->raw;
+    for (i = 0; i < n; i++) {
+        for (c = 0; c < w->channels; c++, p += w->bytes) {
+            switch (w->format * 100 + w->bytes) {
+                case 102: chans[c][i] = (int16_t) wav_le(p, 2) / 32768.; break;
+                case 103: chans[c][i] = (int32_t)(wav_le(p, 3) << 8) / 2147483648.; break;
+                case 104: chans[c][i] = (int32_t) wav_le(p, 4) / 2147483648.; break;
+                case 304: f32.u = (uint32_t) wav_le(p, 4); chans[c][i] = f32.f; break;
+                default : f64.u = ((uint64_t) wav_le(p + 4, 4) << 32) | wav_le(p, 4); chans[c][i] = f64.d; break;
+            }
+        }
+    }
+    w->pos += n;
+    return n;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Writing
+//____________________________________________________________________
+
+// creates a 32 bit float file, the sizes in the header are filled by wav_close
+long wav_create(t_wav *w, const char *path, long channels, double sr)
+{
+    unsigned char h[WAV_HEADER] = { 0 };
+
+    memset(w, 0, sizeof(t_wav));
+    w->f = fopen(path, "wb");
+    if (!w->f)
+        return 1;
+    w->channels = channels;
+    w->sr = sr;
+    w->format = 3;
+    w->bytes = 4;
+    w->writing = 1;
+
+    memcpy(h, "RIFF", 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    wav_putle(h + 16, 16, 4);
+    wav_putle(h + 20, 3, 2);
+    wav_putle(h + 22, (unsigned long) channels, 2);
+    wav_putle(h + 24, (unsigned long) sr, 4);
+    wav_putle(h + 28, (unsigned long)(sr * channels * 4), 4);
+    wav_putle(h + 32, (unsigned long)(channels * 4), 2);
+    wav_putle(h + 34, 32, 2);
+    memcpy(h + 36, "data", 4);
+
+    if (fwrite(h, 1, WAV_HEADER, w->f) != WAV_HEADER) {
+        wav_close(w);
+        return 1;
+    }
+    return 0;
+}
+
+// writes frames frames from chans[0..channels-1], returns non zero on a write error
+long wav_write(t_wav *w, double **chans, long frames)
+{
+    unsigned char   *p;
+    long            i, c;
+    union { uint32_t u; float f; } f32;
+
+    if (wav_reserve(w, frames * w->channels * 4))
+        return 1;
+
+    p = w->raw;
+    for (i = 0; i < frames; i++) {
+        for (c = 0; c < w->channels; c++, p += 4) {
+            f32.f = (float) chans[c][i];
+            wav_putle(p, f32.u, 4);
+        }
+    }
+    if (fwrite(w->raw, (size_t)(w->channels * 4), (size_t)frames, w->f) != (size_t)frames)
+        return 1;
+    w->frames += frames;
+    return 0;
+}
+
+
+
+
+
+//____________________________________________________________________
+//                              Closing
+//____________________________________________________________________
+
+// closes the file, a written one gets its sizes first, returns non zero if they couldn't be written
+long wav_close(t_wav *w)
+{
+    unsigned char   b[4];
+    unsigned long   data = (unsigned long)(w->frames * w->channels * 4);
+    long            err = 0;
+
+    if (w->f && w->writing) {
+        wav_putle(b, data + WAV_HEADER - 8, 4);
+        err |= fseek(w->f, 4, SEEK_SET) || fwrite(b, 1, 4, w->f) != 4;
+        wav_putle(b, data, 4);
+        err |= fseek(w->f, 40, SEEK_SET) || fwrite(b, 1, 4, w->f) != 4;
+    }
+    if (w->f)
+        err |= fclose(w->f) != 0;
+    free(w->raw);
+    memset(w, 0, sizeof(t_wav));
+    return err;
+}
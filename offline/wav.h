@@ -0,0 +1,49 @@
+/**
+ *
+ *  @file	wav.h
+ *
+ *
+ *  Sources :
+ *
+ *   Microsoft
+ *    - Multiple Channel Audio Data and WAVE Files :
+ *          https://learn.microsoft.com/en-us/windows-hardware/drivers/audio/extensible-wave-format-descriptors
+ *
+ *
+ *  Offline renderer : streaming WAV reader and writer.
+ *  Reads 16, 24 and 32 bit PCM and 32/64 bit float files (WAVE_FORMAT_EXTENSIBLE included),
+ *  writes 32 bit float files. The samples go through deinterleaved double arrays, one per channel.
+ *
+ */
+
+#ifndef _OFFLINE_WAV_H_
+#define _OFFLINE_WAV_H_
+
+#include <stdio.h>
+
+typedef struct _wav
+{
+    FILE            *f;
+    long            channels;
+    double          sr;
+    long            frames;     ///<    Reading : frames in the file, writing : frames written
+    long            format;     ///<    1 PCM, 3 float
+    long            bytes;      ///<    Bytes per sample
+    long            pos;        ///<    Frames read
+    long            writing;    ///<    Opened by wav_create, the sizes are written by wav_close
+    unsigned char   *raw;       ///<    Interleaved file data of the last read/write
+    long            rawsize;
+} t_wav;
+
+//// reading
+long    wav_open(t_wav *w, const char *path);
+long    wav_read(t_wav *w, double **chans, long frames);
+
+//// writing
+long    wav_create(t_wav *w, const char *path, long channels, double sr);
+long    wav_write(t_wav *w, double **chans, long frames);
+
+//// both
+long    wav_close(t_wav *w);
+
+#endif